@@ -0,0 +1,381 @@
+#include "Aggregation.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+std::string formatDouble(double value) {
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    return std::string(buf, res.ptr);
+}
+
+void appendInt64(std::string& out, int64_t value) {
+    char bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out.append(bytes, sizeof(bytes));
+}
+
+void appendDouble(std::string& out, double value) {
+    char bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out.append(bytes, sizeof(bytes));
+}
+
+int64_t takeInt64(std::string_view& in) {
+    if (in.size() < sizeof(int64_t)) throw std::invalid_argument("Truncated aggregate state");
+    int64_t value;
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return value;
+}
+
+double takeDouble(std::string_view& in) {
+    if (in.size() < sizeof(double)) throw std::invalid_argument("Truncated aggregate state");
+    double value;
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return value;
+}
+
+bool isExtreme(AggregateKind kind) {
+    return kind == AggregateKind::Min || kind == AggregateKind::Max;
+}
+
+// Whether `candidate` should replace the current MIN / MAX
+template <typename T>
+bool better(AggregateKind kind, const T& candidate, const T& current) {
+    return kind == AggregateKind::Min ? candidate < current : current < candidate;
+}
+
+} // namespace
+
+void AggregateState::merge(AggregateKind kind, const AggregateState& other) {
+    if (other.count == 0) return;
+    if (isExtreme(kind)) {
+        bool take = count == 0;
+        if (!take) {
+            switch (type) {
+                case ColumnType::Int64: take = better(kind, other.intExtreme, intExtreme); break;
+                case ColumnType::Double: take = better(kind, other.doubleExtreme, doubleExtreme); break;
+                case ColumnType::String: take = better(kind, other.textExtreme, textExtreme); break;
+            }
+        }
+        if (take) {
+            type = other.type;
+            intExtreme = other.intExtreme;
+            doubleExtreme = other.doubleExtreme;
+            textExtreme = other.textExtreme;
+        }
+    }
+    if (kind == AggregateKind::Sum || kind == AggregateKind::Avg) {
+        if (count == 0) type = other.type;
+        intSum += other.intSum;
+        doubleSum += other.doubleSum;
+    }
+    if (kind == AggregateKind::CountDistinct && other.distinct) {
+        if (!distinct) distinct = std::make_unique<HyperLogLog>();
+        distinct->merge(*other.distinct);
+    }
+    count += other.count;
+}
+
+void AggregateState::serialize(AggregateKind kind, std::string& out) const {
+    out.push_back(static_cast<char>(type));
+    appendInt64(out, count);
+    switch (kind) {
+        case AggregateKind::None:
+        case AggregateKind::Count:
+            break;
+        case AggregateKind::Sum:
+        case AggregateKind::Avg:
+            if (type == ColumnType::Double) appendDouble(out, doubleSum);
+            else appendInt64(out, intSum);
+            break;
+        case AggregateKind::Min:
+        case AggregateKind::Max:
+            if (count == 0) break;
+            if (type == ColumnType::Int64) appendInt64(out, intExtreme);
+            else if (type == ColumnType::Double) appendDouble(out, doubleExtreme);
+            else out += textExtreme;
+            break;
+        case AggregateKind::CountDistinct:
+            if (distinct) distinct->serialize(out);
+            break;
+    }
+}
+
+void AggregateState::deserialize(AggregateKind kind, std::string_view in) {
+    if (in.empty() || static_cast<uint8_t>(in[0]) > static_cast<uint8_t>(ColumnType::String)) {
+        throw std::invalid_argument("Malformed aggregate state");
+    }
+    type = static_cast<ColumnType>(in[0]);
+    in.remove_prefix(1);
+    count = takeInt64(in);
+    switch (kind) {
+        case AggregateKind::None:
+        case AggregateKind::Count:
+            break;
+        case AggregateKind::Sum:
+        case AggregateKind::Avg:
+            if (type == ColumnType::Double) doubleSum = takeDouble(in);
+            else intSum = takeInt64(in);
+            break;
+        case AggregateKind::Min:
+        case AggregateKind::Max:
+            if (count == 0) break;
+            if (type == ColumnType::Int64) intExtreme = takeInt64(in);
+            else if (type == ColumnType::Double) doubleExtreme = takeDouble(in);
+            else textExtreme = std::string(in);
+            break;
+        case AggregateKind::CountDistinct:
+            if (in.empty()) break;
+            distinct = std::make_unique<HyperLogLog>();
+            if (!distinct->deserialize(in)) throw std::invalid_argument("Malformed HyperLogLog sketch");
+            break;
+    }
+}
+
+std::string AggregateState::finalize(AggregateKind kind) const {
+    switch (kind) {
+        case AggregateKind::None:
+        case AggregateKind::Count:
+            return std::to_string(count);
+        case AggregateKind::CountDistinct:
+            return std::to_string(distinct ? distinct->estimate() : 0);
+        default:
+            break;
+    }
+    if (count == 0) return "NULL";
+    switch (kind) {
+        case AggregateKind::Sum:
+            return type == ColumnType::Double ? formatDouble(doubleSum) : std::to_string(intSum);
+        case AggregateKind::Avg: {
+            double sum = type == ColumnType::Double ? doubleSum : static_cast<double>(intSum);
+            return formatDouble(sum / static_cast<double>(count));
+        }
+        default:
+            if (type == ColumnType::Int64) return std::to_string(intExtreme);
+            if (type == ColumnType::Double) return formatDouble(doubleExtreme);
+            return textExtreme;
+    }
+}
+
+// Per-thread hash table: packed group key -> states of every select item
+struct PartialAggregator::Groups {
+    std::unordered_map<std::string, size_t> index;
+    std::vector<size_t> firstRow;
+    std::vector<std::vector<AggregateState>> states;
+};
+
+PartialAggregator::PartialAggregator(const ColumnTable& table, const Statement& statement,
+                                     const QueryExecutor& executor)
+    : table(table), statement(statement), executor(executor) {
+    auto lookup = [&table](std::string_view name) -> const Column* {
+        int index = table.findColumn(name);
+        if (index < 0) {
+            throw std::invalid_argument("Unknown column " + std::string(name) + " in table " + table.name());
+        }
+        return &table.column(index);
+    };
+    for (uint32_t g = 0; g < statement.groupByCount; ++g) groupColumns.push_back(lookup(statement.groupBy[g]));
+    codeHashes.resize(statement.itemCount);
+    for (uint32_t i = 0; i < statement.itemCount; ++i) {
+        const SelectItem& item = statement.items[i];
+        Target target{item.aggregate, item.column.empty() ? nullptr : lookup(item.column)};
+        bool numeric = item.aggregate == AggregateKind::Sum || item.aggregate == AggregateKind::Avg;
+        if (numeric && target.column->type() == ColumnType::String) {
+            throw std::invalid_argument("Cannot compute " + selectItemName(item) + " over a string column");
+        }
+        if (item.aggregate == AggregateKind::CountDistinct && target.column->type() == ColumnType::String) {
+            for (const auto& value : target.column->dictionary()) codeHashes[i].push_back(hashBytes(value));
+        }
+        targets.push_back(target);
+    }
+}
+
+void PartialAggregator::aggregateChunk(size_t chunkIndex, Groups& groups) const {
+    size_t rows = std::min(kBatchSize, table.rowCount() - chunkIndex * kBatchSize);
+    uint64_t bitmap[kBitmapWords];
+    executor.evaluateChunk(chunkIndex, bitmap);
+    std::string key;
+    for (size_t w = 0; w < (rows + 63) / 64; ++w) {
+        uint64_t word = bitmap[w];
+        while (word) {
+            size_t offset = w * 64 + static_cast<size_t>(__builtin_ctzll(word));
+            word &= word - 1;
+
+            // Group key: int64 values, double bits and dictionary codes, 8 bytes each
+            key.clear();
+            for (const Column* column : groupColumns) {
+                const ColumnChunk& c = column->chunk(chunkIndex);
+                int64_t packed = 0;
+                switch (column->type()) {
+                    case ColumnType::Int64: packed = c.ints[offset]; break;
+                    case ColumnType::Double: std::memcpy(&packed, &c.doubles[offset], sizeof(packed)); break;
+                    case ColumnType::String: packed = c.codes[offset]; break;
+                }
+                appendInt64(key, packed);
+            }
+            auto inserted = groups.index.emplace(key, groups.states.size());
+            if (inserted.second) {
+                groups.firstRow.push_back(chunkIndex * kBatchSize + offset);
+                groups.states.emplace_back(targets.size());
+                for (size_t i = 0; i < targets.size(); ++i) {
+                    if (targets[i].column) groups.states.back()[i].type = targets[i].column->type();
+                }
+            }
+            std::vector<AggregateState>& states = groups.states[inserted.first->second];
+
+            for (size_t i = 0; i < targets.size(); ++i) {
+                const Target& target = targets[i];
+                AggregateState& state = states[i];
+                bool first = state.count++ == 0;
+                if (target.kind == AggregateKind::Count || target.kind == AggregateKind::None) continue;
+                const ColumnChunk& c = target.column->chunk(chunkIndex);
+                switch (target.kind) {
+                    case AggregateKind::Sum:
+                    case AggregateKind::Avg:
+                        if (state.type == ColumnType::Int64) state.intSum += c.ints[offset];
+                        else state.doubleSum += c.doubles[offset];
+                        break;
+                    case AggregateKind::Min:
+                    case AggregateKind::Max:
+                        if (state.type == ColumnType::Int64) {
+                            if (first || better(target.kind, c.ints[offset], state.intExtreme)) {
+                                state.intExtreme = c.ints[offset];
+                            }
+                        } else if (state.type == ColumnType::Double) {
+                            if (first || better(target.kind, c.doubles[offset], state.doubleExtreme)) {
+                                state.doubleExtreme = c.doubles[offset];
+                            }
+                        } else {
+                            const std::string& value = target.column->dictionary()[c.codes[offset]];
+                            if (first || better(target.kind, value, state.textExtreme)) state.textExtreme = value;
+                        }
+                        break;
+                    case AggregateKind::CountDistinct: {
+                        if (!state.distinct) state.distinct = std::make_unique<HyperLogLog>();
+                        uint64_t hash;
+                        if (state.type == ColumnType::Int64) {
+                            hash = hashInt64(c.ints[offset]);
+                        } else if (state.type == ColumnType::Double) {
+                            double value = c.doubles[offset] == 0.0 ? 0.0 : c.doubles[offset];
+                            int64_t bits;
+                            std::memcpy(&bits, &value, sizeof(bits));
+                            hash = hashInt64(bits);
+                        } else {
+                            hash = codeHashes[i][c.codes[offset]];
+                        }
+                        state.distinct->add(hash);
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+}
+
+ResultSet PartialAggregator::run(size_t threads) const {
+    size_t chunks = (table.rowCount() + kBatchSize - 1) / kBatchSize;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<size_t>(1, std::min(threads, chunks));
+
+    // Workers pull chunk indices from a shared counter so skewed chunks balance out
+    std::vector<Groups> local(threads);
+    std::atomic<size_t> next{0};
+    auto work = [&](Groups& groups) {
+        for (size_t c = next++; c < chunks; c = next++) aggregateChunk(c, groups);
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) workers.emplace_back(work, std::ref(local[t]));
+    work(local[0]);
+    for (auto& worker : workers) worker.join();
+
+    Groups& merged = local[0];
+    for (size_t t = 1; t < threads; ++t) {
+        for (const auto& entry : local[t].index) {
+            auto inserted = merged.index.emplace(entry.first, merged.states.size());
+            if (inserted.second) {
+                merged.firstRow.push_back(local[t].firstRow[entry.second]);
+                merged.states.push_back(std::move(local[t].states[entry.second]));
+                continue;
+            }
+            std::vector<AggregateState>& into = merged.states[inserted.first->second];
+            for (size_t i = 0; i < targets.size(); ++i) into[i].merge(targets[i].kind, local[t].states[entry.second][i]);
+        }
+    }
+
+    ResultSet result;
+    for (const Column* column : groupColumns) result.columns.push_back(column->name());
+    for (uint32_t i = 0; i < statement.itemCount; ++i) result.columns.push_back(selectItemName(statement.items[i]));
+    for (size_t g = 0; g < merged.states.size(); ++g) {
+        std::vector<std::string> row(groupColumns.size() + targets.size());
+        for (size_t k = 0; k < groupColumns.size(); ++k) groupColumns[k]->appendText(merged.firstRow[g], row[k]);
+        for (size_t i = 0; i < targets.size(); ++i) {
+            merged.states[g][i].serialize(targets[i].kind, row[groupColumns.size() + i]);
+        }
+        result.rows.push_back(std::move(row));
+    }
+    return result;
+}
+
+AggregateMerger::AggregateMerger(const Statement& statement) : statement(statement) {}
+
+void AggregateMerger::add(const std::vector<std::string>& partialRow) {
+    if (partialRow.size() != statement.groupByCount + statement.itemCount) {
+        throw std::invalid_argument("Partial aggregate row has the wrong shape");
+    }
+    std::vector<std::string> key(partialRow.begin(), partialRow.begin() + statement.groupByCount);
+    auto it = groups.find(key);
+    if (it == groups.end()) it = groups.emplace(std::move(key), std::vector<AggregateState>(statement.itemCount)).first;
+    for (uint32_t i = 0; i < statement.itemCount; ++i) {
+        AggregateKind kind = statement.items[i].aggregate;
+        AggregateState partial;
+        partial.deserialize(kind, partialRow[statement.groupByCount + i]);
+        it->second[i].merge(kind, partial);
+    }
+}
+
+void AggregateMerger::absorb(AggregateMerger& other) {
+    // Splices the map nodes; only groups present in both need their states merged
+    groups.merge(other.groups);
+    for (auto& group : other.groups) {
+        std::vector<AggregateState>& states = groups[group.first];
+        for (uint32_t i = 0; i < statement.itemCount; ++i) states[i].merge(statement.items[i].aggregate, group.second[i]);
+    }
+    other.groups.clear();
+}
+
+ResultSet AggregateMerger::finish() const {
+    ResultSet result;
+    for (uint32_t i = 0; i < statement.itemCount; ++i) result.columns.push_back(selectItemName(statement.items[i]));
+    auto emit = [&](const std::vector<std::string>& key, const std::vector<AggregateState>& states) {
+        std::vector<std::string> row;
+        for (uint32_t i = 0; i < statement.itemCount; ++i) {
+            const SelectItem& item = statement.items[i];
+            if (item.aggregate != AggregateKind::None) {
+                row.push_back(states[i].finalize(item.aggregate));
+                continue;
+            }
+            for (uint32_t g = 0; g < statement.groupByCount; ++g) {
+                if (statement.groupBy[g] == item.column) {
+                    row.push_back(key[g]);
+                    break;
+                }
+            }
+        }
+        result.rows.push_back(std::move(row));
+    };
+    for (const auto& group : groups) emit(group.first, group.second);
+    // An aggregate without GROUP BY yields one row even when nothing matched
+    if (groups.empty() && statement.groupByCount == 0) emit({}, std::vector<AggregateState>(statement.itemCount));
+    return result;
+}
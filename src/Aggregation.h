@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ColumnStore.h"
+#include "HyperLogLog.h"
+#include "QueryExecutor.h"
+#include "QueryParser.h"
+
+// Running state of one aggregate. DataNodes build these per group, ship them
+// serialized, and the coordinator merges and finalizes them.
+struct AggregateState {
+    ColumnType type = ColumnType::Int64; // type of the aggregated column
+    int64_t count = 0;
+    int64_t intSum = 0;
+    double doubleSum = 0.0;
+    // MIN / MAX; only meaningful once count > 0
+    int64_t intExtreme = 0;
+    double doubleExtreme = 0.0;
+    std::string textExtreme;
+    std::unique_ptr<HyperLogLog> distinct;
+
+    void merge(AggregateKind kind, const AggregateState& other);
+    void serialize(AggregateKind kind, std::string& out) const;
+    // Throws std::invalid_argument on malformed input
+    void deserialize(AggregateKind kind, std::string_view in);
+    // Final value in text form; "NULL" for SUM/AVG/MIN/MAX over no rows
+    std::string finalize(AggregateKind kind) const;
+};
+
+// DataNode side of a two-phase aggregation: worker threads pull chunks, filter
+// them with the executor's selection bitmaps and fold matching rows into
+// thread-local hash tables keyed by the packed GROUP BY values. The tables are
+// merged once at the end, so the result holds one row per group: the group
+// values followed by one serialized AggregateState per select item.
+class PartialAggregator {
+public:
+    // Throws std::invalid_argument for unknown columns or SUM/AVG over strings
+    PartialAggregator(const ColumnTable& table, const Statement& statement, const QueryExecutor& executor);
+
+    // `threads` of 0 uses every hardware thread
+    ResultSet run(size_t threads = 0) const;
+
+private:
+    struct Target {
+        AggregateKind kind;
+        const Column* column; // null for COUNT(*)
+    };
+    struct Groups;
+
+    void aggregateChunk(size_t chunkIndex, Groups& groups) const;
+
+    const ColumnTable& table;
+    const Statement& statement;
+    const QueryExecutor& executor;
+    std::vector<const Column*> groupColumns;
+    std::vector<Target> targets;
+    // Hash of every dictionary entry, for COUNT(DISTINCT) over string columns
+    std::vector<std::vector<uint64_t>> codeHashes;
+};
+
+// Coordinator side: merge the partial rows of every DataNode, then produce the
+// final result with one column per select item
+class AggregateMerger {
+public:
+    explicit AggregateMerger(const Statement& statement);
+
+    // Throws std::invalid_argument for a row that does not match the statement
+    void add(const std::vector<std::string>& partialRow);
+    // Move the groups of `other`, a merger of the same statement, into this
+    // one; the coordinator merges disjoint sets of groups in parallel
+    void absorb(AggregateMerger& other);
+    ResultSet finish() const;
+
+private:
+    const Statement& statement;
+    std::map<std::vector<std::string>, std::vector<AggregateState>> groups;
+};
@@ -0,0 +1,588 @@
+#include "AsyncClient.h"
+#include <algorithm>
+#include <cerrno>
+#include <deque>
+#include <queue>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "Coordinators.h"
+#include "KeyValueStore.h"
+#include "PartitionMap.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+using AsyncClock = std::chrono::steady_clock;
+
+CancelToken CancelToken::make() {
+    CancelToken token;
+    token.state = std::make_shared<State>();
+    return token;
+}
+
+void CancelToken::cancel() const {
+    if (!state) return;
+    std::unordered_map<uint64_t, std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(state->mtx);
+        if (state->cancelled) return;
+        state->cancelled = true;
+        callbacks.swap(state->callbacks);
+    }
+    for (auto& callback : callbacks) callback.second();
+}
+
+bool CancelToken::cancelled() const {
+    if (!state) return false;
+    std::lock_guard<std::mutex> lock(state->mtx);
+    return state->cancelled;
+}
+
+uint64_t CancelToken::onCancel(std::function<void()> callback) const {
+    if (!state) return 0;
+    {
+        std::lock_guard<std::mutex> lock(state->mtx);
+        if (!state->cancelled) {
+            uint64_t id = state->nextId++;
+            state->callbacks.emplace(id, std::move(callback));
+            return id;
+        }
+    }
+    callback();
+    return 0;
+}
+
+void CancelToken::forget(uint64_t id) const {
+    if (!state || id == 0) return;
+    std::lock_guard<std::mutex> lock(state->mtx);
+    state->callbacks.erase(id);
+}
+
+// One epoll loop with its own connections, timers and partition map. Every
+// member but post() and stop() is used from the loop's thread only.
+class AsyncReactor {
+public:
+    struct Reply {
+        CallStatus status = CallStatus::Failed;
+        Message message;
+        std::string error;
+    };
+
+    // Awaitable request: sends on the connection to ip:port and resumes with the reply
+    class Send {
+    public:
+        Send(AsyncReactor& reactor, std::string ip, int port, Message request, AsyncClock::time_point deadline,
+             CancelToken cancel, bool keepOpen)
+            : reactor(reactor), ip(std::move(ip)), port(port), request(std::move(request)), deadline(deadline),
+              cancel(std::move(cancel)), keepOpen(keepOpen) {}
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> awaiter) { return reactor.start(*this, awaiter); }
+        Reply await_resume() { return std::move(reply); }
+
+    private:
+        friend class AsyncReactor;
+        AsyncReactor& reactor;
+        std::string ip;
+        int port;
+        Message request;
+        AsyncClock::time_point deadline;
+        CancelToken cancel;
+        bool keepOpen;
+        Reply reply;
+    };
+
+    explicit AsyncReactor(std::vector<std::pair<std::string, int>> coordinators);
+    ~AsyncReactor();
+
+    static AsyncReactor* current() { return running; }
+
+    void loop();
+    void stop();
+    // Run `work` on the loop's thread
+    void post(std::function<void()> work);
+
+    Send send(std::string ip, int port, Message request, AsyncClock::time_point deadline, CancelToken cancel,
+              bool keepOpen = true) {
+        return Send(*this, std::move(ip), port, std::move(request), deadline, std::move(cancel), keepOpen);
+    }
+
+    // Fetch the partition map unless one newer than `staleEpoch` arrived
+    // meanwhile; concurrent callers share one fetch
+    Task<Reply> refresh(uint64_t staleEpoch, AsyncClock::time_point deadline, CancelToken cancel);
+
+    PartitionMap map;
+    bool haveMap = false;
+
+private:
+    struct Connection {
+        std::string address;
+        int fd = -1;
+        bool connecting = true;
+        bool keepOpen = true;
+        bool writable = false; // EPOLLOUT is registered
+        std::string out;
+        size_t outSent = 0;
+        std::string in;
+        std::deque<uint64_t> waiting; // Ops in request order; replies come back in that order
+    };
+    struct Op {
+        std::coroutine_handle<> awaiter;
+        Reply* reply;
+        CancelToken cancel;
+        uint64_t cancelId = 0;
+    };
+    struct RefreshWait {
+        AsyncReactor& reactor;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> awaiter) { reactor.refreshWaiters.push_back(awaiter); }
+        void await_resume() const noexcept {}
+    };
+
+    bool start(Send& send, std::coroutine_handle<> awaiter);
+    Connection* connectionTo(const std::string& ip, int port, bool keepOpen);
+    void complete(uint64_t id, CallStatus status, const std::string& error, Message* message = nullptr);
+    void flush(Connection& connection);
+    void readable(Connection& connection);
+    void closeConnection(Connection& connection, const std::string& error);
+    void watch(Connection& connection, bool writable);
+    void expireTimers();
+    void drain();
+
+    static thread_local AsyncReactor* running;
+
+    std::vector<std::pair<std::string, int>> coordinators;
+    size_t preferredCoordinator = 0;
+    int epollFd;
+    int wakeFd;
+    std::atomic<bool> stopping{false};
+
+    std::mutex postMutex;
+    std::vector<std::function<void()>> posted;
+
+    std::unordered_map<std::string, std::unique_ptr<Connection>> connections; // By ip:port
+    std::unordered_map<int, Connection*> byFd;
+    std::unordered_map<uint64_t, Op> ops;
+    uint64_t nextOp = 1;
+    std::priority_queue<std::pair<AsyncClock::time_point, uint64_t>,
+                        std::vector<std::pair<AsyncClock::time_point, uint64_t>>, std::greater<>>
+        timers; // Deadlines of ops; entries of finished ops are skipped
+    std::deque<std::coroutine_handle<>> ready;
+
+    bool refreshing = false;
+    Reply lastRefresh;
+    std::vector<std::coroutine_handle<>> refreshWaiters;
+};
+
+thread_local AsyncReactor* AsyncReactor::running = nullptr;
+
+AsyncReactor::AsyncReactor(std::vector<std::pair<std::string, int>> coordinators)
+    : coordinators(std::move(coordinators)) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+}
+
+AsyncReactor::~AsyncReactor() {
+    // Cancel callbacks must not reach a reactor that is gone
+    for (auto& op : ops) op.second.cancel.forget(op.second.cancelId);
+    for (auto& connection : connections) close(connection.second->fd);
+    close(wakeFd);
+    close(epollFd);
+}
+
+void AsyncReactor::post(std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        posted.push_back(std::move(work));
+    }
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+void AsyncReactor::stop() {
+    stopping = true;
+    post([] {});
+}
+
+// Run posted work and resume coroutines until neither is left
+void AsyncReactor::drain() {
+    while (true) {
+        std::vector<std::function<void()>> work;
+        {
+            std::lock_guard<std::mutex> lock(postMutex);
+            work.swap(posted);
+        }
+        if (work.empty() && ready.empty()) return;
+        for (auto& item : work) item();
+        while (!ready.empty()) {
+            std::coroutine_handle<> next = ready.front();
+            ready.pop_front();
+            next.resume();
+        }
+    }
+}
+
+void AsyncReactor::loop() {
+    running = this;
+    epoll_event events[256];
+    while (!stopping) {
+        drain();
+        int timeoutMs = -1;
+        if (!timers.empty()) {
+            auto wait = timers.top().first - AsyncClock::now();
+            timeoutMs = static_cast<int>(std::max<long long>(
+                0, std::chrono::ceil<std::chrono::milliseconds>(wait).count()));
+        }
+        int count = epoll_wait(epollFd, events, 256, timeoutMs);
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                uint64_t value;
+                ssize_t got = read(wakeFd, &value, sizeof(value));
+                (void)got;
+                continue;
+            }
+            auto it = byFd.find(fd);
+            if (it == byFd.end()) continue;
+            Connection& connection = *it->second;
+            if (connection.connecting && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                if (error != 0) {
+                    closeConnection(connection, "Cannot reach " + connection.address);
+                    continue;
+                }
+                connection.connecting = false;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                readable(connection);
+                if (!byFd.count(fd)) continue;
+            }
+            if (events[i].events & EPOLLOUT) flush(connection);
+        }
+        expireTimers();
+    }
+    running = nullptr;
+}
+
+AsyncReactor::Connection* AsyncReactor::connectionTo(const std::string& ip, int port, bool keepOpen) {
+    std::string address = ip + ":" + std::to_string(port);
+    if (keepOpen) {
+        auto it = connections.find(address);
+        if (it != connections.end()) return it->second.get();
+    }
+    sockaddr_in peer{};
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &peer.sin_addr) <= 0) return nullptr;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return nullptr;
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&peer), sizeof(peer)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return nullptr;
+    }
+    auto connection = std::make_unique<Connection>();
+    connection->address = address;
+    connection->fd = fd;
+    connection->keepOpen = keepOpen;
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    connection->writable = true;
+    Connection* raw = connection.get();
+    byFd[fd] = raw;
+    // One-shot connections are keyed apart so they never carry a second request
+    connections[keepOpen ? address : address + "#" + std::to_string(fd)] = std::move(connection);
+    return raw;
+}
+
+bool AsyncReactor::start(Send& send, std::coroutine_handle<> awaiter) {
+    if (send.cancel.cancelled()) {
+        send.reply = {CallStatus::Cancelled, {}, "Cancelled"};
+        return false;
+    }
+    if (AsyncClock::now() >= send.deadline) {
+        send.reply = {CallStatus::TimedOut, {}, "Timed out"};
+        return false;
+    }
+    Connection* connection = connectionTo(send.ip, send.port, send.keepOpen);
+    if (!connection) {
+        send.reply = {CallStatus::Failed, {}, "Cannot reach " + send.ip + ":" + std::to_string(send.port)};
+        return false;
+    }
+    uint64_t id = nextOp++;
+    Op& op = ops[id];
+    op.awaiter = awaiter;
+    op.reply = &send.reply;
+    op.cancel = send.cancel;
+    op.cancelId = send.cancel.onCancel([this, id] {
+        post([this, id] { complete(id, CallStatus::Cancelled, "Cancelled"); });
+    });
+    timers.emplace(send.deadline, id);
+
+    std::vector<uint8_t> payload = MessageSerializer::serialize(send.request);
+    uint32_t length = static_cast<uint32_t>(payload.size());
+    const char header[4] = {static_cast<char>(length >> 24), static_cast<char>(length >> 16),
+                            static_cast<char>(length >> 8), static_cast<char>(length)};
+    connection->out.append(header, sizeof(header));
+    connection->out.append(reinterpret_cast<const char*>(payload.data()), payload.size());
+    connection->waiting.push_back(id);
+    if (!connection->connecting) flush(*connection);
+    return true;
+}
+
+void AsyncReactor::complete(uint64_t id, CallStatus status, const std::string& error, Message* message) {
+    auto it = ops.find(id);
+    if (it == ops.end()) return;
+    Op op = std::move(it->second);
+    ops.erase(it);
+    op.cancel.forget(op.cancelId);
+    op.reply->status = status;
+    op.reply->error = error;
+    if (message) op.reply->message = std::move(*message);
+    ready.push_back(op.awaiter);
+}
+
+void AsyncReactor::watch(Connection& connection, bool writable) {
+    if (connection.writable == writable) return;
+    connection.writable = writable;
+    epoll_event event{};
+    event.events = EPOLLIN | (writable ? uint32_t(EPOLLOUT) : 0u);
+    event.data.fd = connection.fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void AsyncReactor::flush(Connection& connection) {
+    if (connection.connecting) return;
+    while (connection.outSent < connection.out.size()) {
+        ssize_t sent = ::send(connection.fd, connection.out.data() + connection.outSent,
+                              connection.out.size() - connection.outSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (sent <= 0) {
+            closeConnection(connection, "Connection to " + connection.address + " lost");
+            return;
+        }
+        connection.outSent += static_cast<size_t>(sent);
+    }
+    if (connection.outSent == connection.out.size()) {
+        connection.out.clear();
+        connection.outSent = 0;
+    }
+    watch(connection, !connection.out.empty());
+}
+
+void AsyncReactor::readable(Connection& connection) {
+    char buffer[64 * 1024];
+    bool closed = false;
+    while (true) {
+        ssize_t got = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (got > 0) {
+            connection.in.append(buffer, static_cast<size_t>(got));
+            continue;
+        }
+        if (got < 0 && errno == EINTR) continue;
+        closed = got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+    size_t offset = 0;
+    while (connection.in.size() - offset >= 4) {
+        const auto* header = reinterpret_cast<const unsigned char*>(connection.in.data() + offset);
+        uint32_t length = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) | (uint32_t(header[2]) << 8) |
+                          uint32_t(header[3]);
+        if (connection.in.size() - offset - 4 < length) break;
+        const char* payload = connection.in.data() + offset + 4;
+        offset += 4 + length;
+        if (connection.waiting.empty()) {
+            closed = true;
+            break;
+        }
+        uint64_t id = connection.waiting.front();
+        connection.waiting.pop_front();
+        // A timed-out or cancelled call's reply still arrives in turn; drop it
+        if (!ops.count(id)) continue;
+        try {
+            Message reply = MessageDeserializer::deserialize(std::vector<uint8_t>(payload, payload + length));
+            complete(id, CallStatus::Ok, "", &reply);
+        } catch (const std::exception& e) {
+            complete(id, CallStatus::Failed, e.what());
+        }
+    }
+    connection.in.erase(0, offset);
+    if (closed) {
+        closeConnection(connection, "Connection to " + connection.address + " closed");
+    } else if (!connection.keepOpen && connection.waiting.empty()) {
+        closeConnection(connection, "");
+    }
+}
+
+void AsyncReactor::closeConnection(Connection& connection, const std::string& error) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+    close(connection.fd);
+    for (uint64_t id : connection.waiting) complete(id, CallStatus::Failed, error);
+    byFd.erase(connection.fd);
+    for (auto it = connections.begin(); it != connections.end(); ++it) {
+        if (it->second.get() == &connection) {
+            connections.erase(it);
+            break;
+        }
+    }
+}
+
+void AsyncReactor::expireTimers() {
+    auto now = AsyncClock::now();
+    while (!timers.empty() && timers.top().first <= now) {
+        uint64_t id = timers.top().second;
+        timers.pop();
+        complete(id, CallStatus::TimedOut, "Timed out");
+    }
+}
+
+Task<AsyncReactor::Reply> AsyncReactor::refresh(uint64_t staleEpoch, AsyncClock::time_point deadline,
+                                                CancelToken cancel) {
+    if (haveMap && map.epoch > staleEpoch) co_return Reply{CallStatus::Ok, {}, ""};
+    if (refreshing) {
+        co_await RefreshWait{*this};
+        co_return lastRefresh;
+    }
+    refreshing = true;
+    Reply result{CallStatus::Failed, {}, "No partition map from the coordinator"};
+    for (size_t i = 0; i < coordinators.size(); ++i) {
+        size_t index = (preferredCoordinator + i) % coordinators.size();
+        Message request;
+        request.type = MessageType::NODE_LIST_REQUEST;
+        // The coordinator answers one request per connection
+        Reply reply = co_await send(coordinators[index].first, coordinators[index].second, std::move(request),
+                                    deadline, cancel, false);
+        if (reply.status == CallStatus::TimedOut || reply.status == CallStatus::Cancelled) {
+            result = std::move(reply);
+            break;
+        }
+        if (reply.status == CallStatus::Ok && reply.message.type == MessageType::NODE_LIST_RESPONSE) {
+            map.epoch = reply.message.node_list.epoch;
+            map.nodes = std::move(reply.message.node_list.nodes);
+            map.assign();
+            haveMap = true;
+            preferredCoordinator = index;
+            result = {CallStatus::Ok, {}, ""};
+            break;
+        }
+    }
+    refreshing = false;
+    lastRefresh = result;
+    for (auto waiter : refreshWaiters) ready.push_back(waiter);
+    refreshWaiters.clear();
+    co_return result;
+}
+
+AsyncClient::AsyncClient(size_t threads) {
+    auto coordinators = coordinatorAddresses();
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+        reactors.push_back(std::make_unique<AsyncReactor>(coordinators));
+    }
+    for (auto& reactor : reactors) loops.emplace_back(&AsyncReactor::loop, reactor.get());
+}
+
+AsyncClient::~AsyncClient() {
+    for (auto& reactor : reactors) reactor->stop();
+    for (auto& loop : loops) loop.join();
+}
+
+static detail::Detached runDetached(Task<void> task) {
+    co_await std::move(task);
+}
+
+void AsyncClient::spawn(Task<void> task) {
+    AsyncReactor& reactor = *reactors[nextReactor++ % reactors.size()];
+    auto held = std::make_shared<Task<void>>(std::move(task));
+    reactor.post([held] { runDetached(std::move(*held)); });
+}
+
+Task<KeyResult> AsyncClient::call(uint8_t op, std::string key, std::string value, CallOptions options) {
+    AsyncReactor* reactor = AsyncReactor::current();
+    KeyResult result;
+    if (!reactor) {
+        result.error = "AsyncClient calls must run on a reactor thread";
+        co_return result;
+    }
+    const auto deadline = AsyncClock::now() + options.timeout;
+    uint64_t usedEpoch = 0;
+    for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+        if (!reactor->haveMap || attempt > 0) {
+            AsyncReactor::Reply refreshed = co_await reactor->refresh(usedEpoch, deadline, options.cancel);
+            if (refreshed.status != CallStatus::Ok) {
+                result.status = refreshed.status;
+                result.error = refreshed.error;
+                co_return result;
+            }
+        }
+        const NodeInfo* owner = reactor->map.ownerOf(key);
+        if (!owner) {
+            result.error = "No DataNodes registered";
+            co_return result;
+        }
+        NodeInfo node = *owner;
+        usedEpoch = reactor->map.epoch;
+        Message request;
+        request.type = MessageType::DATA_REQUEST;
+        request.key_value.key = key;
+        request.key_value.value = value;
+        request.key_value.op = op;
+        request.key_value.epoch = usedEpoch;
+        AsyncReactor::Reply reply = co_await reactor->send(node.ip, node.port, std::move(request), deadline,
+                                                           options.cancel);
+        if (reply.status == CallStatus::TimedOut || reply.status == CallStatus::Cancelled) {
+            result.status = reply.status;
+            result.error = reply.error;
+            co_return result;
+        }
+        // The node restarted or left; the map will say where the key lives now
+        if (reply.status != CallStatus::Ok || reply.message.type != MessageType::DATA_RESPONSE) continue;
+        KeyStatus status = static_cast<KeyStatus>(reply.message.key_value.status);
+        if (status == KeyStatus::WrongEpoch) continue;
+        if (status == KeyStatus::Locked) {
+            result.error = "Key '" + key + "' is held by a transaction that did not resolve";
+            co_return result;
+        }
+        result.status = CallStatus::Ok;
+        result.found = status == KeyStatus::Ok;
+        result.value = std::move(reply.message.key_value.value);
+        result.version = reply.message.key_value.version;
+        co_return result;
+    }
+    result.error = "Request for key '" + key + "' failed after " + std::to_string(kMaxAttempts) +
+                   " partition map refreshes";
+    co_return result;
+}
+
+Task<KeyResult> AsyncClient::get(std::string key, CallOptions options) {
+    return call(static_cast<uint8_t>(KeyOp::Get), std::move(key), "", std::move(options));
+}
+
+Task<KeyResult> AsyncClient::put(std::string key, std::string value, CallOptions options) {
+    return call(static_cast<uint8_t>(KeyOp::Put), std::move(key), std::move(value), std::move(options));
+}
+
+Task<KeyResult> AsyncClient::remove(std::string key, CallOptions options) {
+    return call(static_cast<uint8_t>(KeyOp::Remove), std::move(key), "", std::move(options));
+}
+
+Task<std::vector<KeyResult>> AsyncClient::multiGet(std::vector<std::string> keys, CallOptions options) {
+    std::vector<Task<KeyResult>> calls;
+    calls.reserve(keys.size());
+    for (auto& key : keys) calls.push_back(get(std::move(key), options));
+    co_return co_await whenAll(std::move(calls));
+}
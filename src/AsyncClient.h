@@ -0,0 +1,246 @@
+#pragma once
+// C++20: built only into targets that set CXX_STANDARD 20
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A coroutine producing a T. It starts when awaited and resumes its awaiter
+// when it finishes, so chains of awaits run without extra scheduling.
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+template <typename T>
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+        struct Resume {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept { return continuation; }
+            void await_resume() noexcept {}
+            std::coroutine_handle<> continuation;
+        };
+        return Resume{continuation};
+    }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase<T> {
+    std::optional<T> value;
+    Task<T> get_return_object();
+    void return_value(T result) { value = std::move(result); }
+    T take() {
+        if (this->exception) std::rethrow_exception(this->exception);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase<void> {
+    Task<void> get_return_object();
+    void return_void() {}
+    void take() {
+        if (exception) std::rethrow_exception(exception);
+    }
+};
+
+} // namespace detail
+
+template <typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle) : handle(handle) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle.promise().continuation = awaiter;
+        return handle;
+    }
+    T await_resume() { return handle.promise().take(); }
+
+private:
+    Handle handle;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// A coroutine that starts at once and frees itself when done
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+// Run every task concurrently and collect their results in order
+template <typename T>
+Task<std::vector<T>> whenAll(std::vector<Task<T>> tasks) {
+    struct State {
+        size_t remaining;
+        std::coroutine_handle<> parent;
+        std::vector<T> results;
+    };
+    struct Join {
+        State& state;
+        bool await_ready() const noexcept { return false; }
+        // The last task may already have finished while they were started
+        bool await_suspend(std::coroutine_handle<> parent) noexcept {
+            state.parent = parent;
+            return --state.remaining != 0;
+        }
+        void await_resume() const noexcept {}
+    };
+    State state{tasks.size() + 1, {}, std::vector<T>(tasks.size())};
+    auto run = [](Task<T> task, State& state, size_t index) -> detail::Detached {
+        state.results[index] = co_await std::move(task);
+        if (--state.remaining == 0) state.parent.resume();
+    };
+    for (size_t i = 0; i < tasks.size(); ++i) run(std::move(tasks[i]), state, i);
+    co_await Join{state};
+    co_return std::move(state.results);
+}
+
+// Cancels the calls it was passed to. Copies share one state, so any copy
+// may cancel, from any thread; a default-constructed token never cancels.
+class CancelToken {
+public:
+    static CancelToken make();
+
+    void cancel() const;
+    bool cancelled() const;
+
+    // Run `callback` once on cancel (at once if already cancelled); the id
+    // unregisters it
+    uint64_t onCancel(std::function<void()> callback) const;
+    void forget(uint64_t id) const;
+
+private:
+    struct State {
+        std::mutex mtx;
+        bool cancelled = false;
+        uint64_t nextId = 1;
+        std::unordered_map<uint64_t, std::function<void()>> callbacks;
+    };
+    std::shared_ptr<State> state;
+};
+
+struct CallOptions {
+    // Across retries, including the partition map refreshes they need
+    std::chrono::milliseconds timeout{1000};
+    CancelToken cancel;
+};
+
+enum class CallStatus : uint8_t { Ok, Failed, TimedOut, Cancelled };
+
+struct KeyResult {
+    CallStatus status = CallStatus::Failed;
+    bool found = false; // Get and remove: whether the key existed
+    std::string value;
+    uint64_t version = 0;
+    std::string error;
+
+    bool ok() const { return status == CallStatus::Ok; }
+};
+
+class AsyncReactor;
+
+// Asynchronous counterpart of SmartClient. Each of `threads` reactor threads
+// runs an epoll loop with its own partition map and one connection per
+// DataNode; requests on a connection are pipelined and answered in order, so
+// a handful of threads carries tens of thousands of outstanding calls.
+//
+// Calls are coroutines that must run on a reactor thread: start them with
+// spawn() or run(). A coroutine stays on the reactor that started it.
+class AsyncClient {
+public:
+    static constexpr int kMaxAttempts = 3;
+
+    explicit AsyncClient(size_t threads = 1);
+    ~AsyncClient();
+    AsyncClient(const AsyncClient&) = delete;
+    AsyncClient& operator=(const AsyncClient&) = delete;
+
+    Task<KeyResult> get(std::string key, CallOptions options = {});
+    Task<KeyResult> put(std::string key, std::string value, CallOptions options = {});
+    Task<KeyResult> remove(std::string key, CallOptions options = {});
+    // Results in the order of `keys`; requests for every key are in flight at once
+    Task<std::vector<KeyResult>> multiGet(std::vector<std::string> keys, CallOptions options = {});
+
+    // Start `task` on a reactor thread, round robin; it runs to completion
+    // unless the client is destroyed first
+    void spawn(Task<void> task);
+    // Run `task` on a reactor thread and block the calling (non-reactor)
+    // thread until it is done
+    template <typename T>
+    T run(Task<T> task) {
+        auto done = std::make_shared<std::promise<T>>();
+        std::future<T> result = done->get_future();
+        spawn(deliver(std::move(task), done));
+        return result.get();
+    }
+
+    size_t threads() const { return reactors.size(); }
+
+private:
+    template <typename T>
+    static Task<void> deliver(Task<T> task, std::shared_ptr<std::promise<T>> done) {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            done->set_value();
+        } else {
+            done->set_value(co_await std::move(task));
+        }
+    }
+
+    Task<KeyResult> call(uint8_t op, std::string key, std::string value, CallOptions options);
+
+    std::vector<std::unique_ptr<AsyncReactor>> reactors;
+    std::vector<std::thread> loops;
+    std::atomic<size_t> nextReactor{0};
+};
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "AsyncClient.h"
+
+// Throughput and latency of AsyncClient gets against a running cluster as the
+// number of outstanding calls grows, with a fixed number of reactor threads;
+// then multiGet, timeouts and cancellation.
+// Usage: AsyncClientBench [reactor threads] [seconds per level]
+
+using BenchClock = std::chrono::steady_clock;
+
+static const size_t kKeys = 10000;
+
+static std::string keyName(size_t i) { return "bench-" + std::to_string(i); }
+
+static double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(p * (values.size() - 1))];
+}
+
+// Results of the coroutines of one level; each writes only its own slot
+struct Level {
+    std::vector<std::vector<double>> latencies;
+    std::vector<uint64_t> failures;
+    std::atomic<size_t> running{0};
+    std::promise<void> done;
+};
+
+static Task<void> getLoop(AsyncClient& client, Level& level, size_t index, BenchClock::time_point until) {
+    std::mt19937_64 random(index);
+    while (BenchClock::now() < until) {
+        auto start = BenchClock::now();
+        KeyResult result = co_await client.get(keyName(random() % kKeys));
+        if (!result.ok() || !result.found) ++level.failures[index];
+        level.latencies[index].push_back(std::chrono::duration<double, std::micro>(BenchClock::now() - start).count());
+    }
+    if (--level.running == 0) level.done.set_value();
+}
+
+static Task<size_t> preload(AsyncClient& client, size_t first, size_t count) {
+    std::vector<Task<KeyResult>> puts;
+    for (size_t i = first; i < first + count; ++i) puts.push_back(client.put(keyName(i), "value-" + std::to_string(i)));
+    std::vector<KeyResult> results = co_await whenAll(std::move(puts));
+    co_return static_cast<size_t>(std::count_if(results.begin(), results.end(), [](const KeyResult& r) { return r.ok(); }));
+}
+
+static Task<std::vector<double>> multiGets(AsyncClient& client, size_t rounds, size_t width) {
+    std::vector<double> latencies;
+    for (size_t round = 0; round < rounds; ++round) {
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < width; ++i) keys.push_back(keyName((round * width + i) % kKeys));
+        auto start = BenchClock::now();
+        std::vector<KeyResult> results = co_await client.multiGet(std::move(keys));
+        latencies.push_back(std::chrono::duration<double, std::micro>(BenchClock::now() - start).count());
+    }
+    co_return latencies;
+}
+
+// Calls that cannot finish in time or are cancelled in flight
+static Task<std::vector<KeyResult>> abandoned(AsyncClient& client, size_t count, CallOptions options) {
+    std::vector<Task<KeyResult>> gets;
+    for (size_t i = 0; i < count; ++i) gets.push_back(client.get(keyName(i % kKeys), options));
+    co_return co_await whenAll(std::move(gets));
+}
+
+static size_t countStatus(const std::vector<KeyResult>& results, CallStatus status) {
+    return std::count_if(results.begin(), results.end(), [&](const KeyResult& r) { return r.status == status; });
+}
+
+int main(int argc, char** argv) {
+    size_t threads = argc > 1 ? std::stoul(argv[1]) : 2;
+    double seconds = argc > 2 ? std::stod(argv[2]) : 3.0;
+    AsyncClient client(threads);
+
+    size_t stored = 0;
+    for (size_t first = 0; first < kKeys; first += 1000) stored += client.run(preload(client, first, 1000));
+    std::cout << "Stored " << stored << " keys; " << threads << " reactor threads" << std::endl;
+    if (stored != kKeys) return 1;
+
+    std::cout << std::left << std::setw(13) << "outstanding" << std::setw(12) << "gets/s" << std::setw(11)
+              << "p50_us" << std::setw(11) << "p99_us" << "failures" << std::endl;
+    for (size_t outstanding : {1, 64, 1024, 16384}) {
+        Level level;
+        level.latencies.resize(outstanding);
+        level.failures.assign(outstanding, 0);
+        level.running = outstanding;
+        std::future<void> finished = level.done.get_future();
+        auto start = BenchClock::now();
+        auto until = start + std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(seconds));
+        for (size_t i = 0; i < outstanding; ++i) client.spawn(getLoop(client, level, i, until));
+        finished.wait();
+        double elapsed = std::chrono::duration<double>(BenchClock::now() - start).count();
+        std::vector<double> all;
+        uint64_t failures = 0;
+        for (size_t i = 0; i < outstanding; ++i) {
+            all.insert(all.end(), level.latencies[i].begin(), level.latencies[i].end());
+            failures += level.failures[i];
+        }
+        size_t calls = all.size();
+        std::cout << std::setw(13) << outstanding << std::setw(12) << static_cast<uint64_t>(calls / elapsed)
+                  << std::setw(11) << std::fixed << std::setprecision(0) << percentile(all, 0.5) << std::setw(11)
+                  << percentile(all, 0.99) << failures << std::defaultfloat << std::endl;
+    }
+
+    std::vector<double> multi = client.run(multiGets(client, 200, 100));
+    std::cout << "multiGet of 100 keys: p50 " << std::fixed << std::setprecision(0) << percentile(multi, 0.5)
+              << "us p99 " << percentile(multi, 0.99) << "us" << std::defaultfloat << std::endl;
+
+    CallOptions instant;
+    instant.timeout = std::chrono::milliseconds(0);
+    std::vector<KeyResult> timedOut = client.run(abandoned(client, 1000, instant));
+    std::cout << "Timed out: " << countStatus(timedOut, CallStatus::TimedOut) << " of 1000 with a 0ms timeout"
+              << std::endl;
+
+    CallOptions cancellable;
+    cancellable.cancel = CancelToken::make();
+    cancellable.timeout = std::chrono::seconds(5);
+    std::future<std::vector<KeyResult>> pending =
+        std::async(std::launch::async, [&] { return client.run(abandoned(client, 20000, cancellable)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    cancellable.cancel.cancel();
+    std::vector<KeyResult> cancelled = pending.get();
+    std::cout << "Cancelled: " << countStatus(cancelled, CallStatus::Cancelled) << " of 20000, "
+              << countStatus(cancelled, CallStatus::Ok) << " finished first" << std::endl;
+    return 0;
+}
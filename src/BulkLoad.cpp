@@ -0,0 +1,292 @@
+#include "BulkLoad.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "Communication.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+namespace {
+
+bool sendFramed(int socket, const Message& message) {
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(message);
+    std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    return Communication::sendMessage(socket, std::move(out));
+}
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Cannot stat " + path);
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Cannot map " + path);
+            }
+            madvise(mapped, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const char*>(mapped);
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return std::string_view(bytes, length); }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+};
+
+// Batches waiting for one DataNode's sender. push blocks while the queue is
+// full; once the sender fails, pushes are dropped so parsing can finish.
+class BatchQueue {
+public:
+    void push(std::string batch) {
+        std::unique_lock<std::mutex> lock(mtx);
+        changed.wait(lock, [this]() { return batches.size() < kBulkQueuedBatches || failed; });
+        if (failed) return;
+        batches.push_back(std::move(batch));
+        changed.notify_all();
+    }
+
+    // False once the queue is closed and drained
+    bool pop(std::string& batch) {
+        std::unique_lock<std::mutex> lock(mtx);
+        changed.wait(lock, [this]() { return !batches.empty() || closed; });
+        if (batches.empty()) return false;
+        batch = std::move(batches.front());
+        batches.pop_front();
+        changed.notify_all();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        changed.notify_all();
+    }
+
+    void fail() {
+        std::lock_guard<std::mutex> lock(mtx);
+        failed = true;
+        batches.clear();
+        changed.notify_all();
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable changed;
+    std::deque<std::string> batches;
+    bool closed = false;
+    bool failed = false;
+};
+
+std::string_view trimmed(std::string_view field) {
+    while (!field.empty() && field.front() == ' ') field.remove_prefix(1);
+    while (!field.empty() && (field.back() == ' ' || field.back() == '\r')) field.remove_suffix(1);
+    return field;
+}
+
+} // namespace
+
+BulkLoadReport bulkLoad(const std::string& path, const std::string& table, const std::vector<NodeInfo>& nodes,
+                        char delimiter, size_t threads) {
+    if (nodes.empty()) throw std::runtime_error("No DataNodes to load into");
+    MappedFile file(path);
+    std::string_view data = file.view();
+    size_t headerEnd = data.find('\n');
+    if (data.empty() || headerEnd == 0) throw std::runtime_error("Missing header in " + path);
+    if (headerEnd == std::string_view::npos) headerEnd = data.size();
+
+    Message schema;
+    schema.type = MessageType::BULK_LOAD;
+    schema.bulk.table = table;
+    schema.bulk.delimiter = static_cast<uint8_t>(delimiter);
+    std::vector<std::string_view> fields;
+    splitFields(data.substr(0, headerEnd), delimiter, fields);
+    for (std::string_view name : fields) schema.bulk.columns.emplace_back(name);
+    std::string_view body = data.substr(std::min(headerEnd + 1, data.size()));
+    size_t firstEnd = body.find('\n');
+    std::string_view firstRow = body.substr(0, firstEnd);
+    splitFields(firstRow, delimiter, fields);
+    for (size_t i = 0; i < schema.bulk.columns.size(); ++i) {
+        ColumnType type = i < fields.size() && !trimmed(firstRow).empty() ? ColumnTable::inferType(fields[i])
+                                                                          : ColumnType::String;
+        schema.bulk.types.push_back(static_cast<uint8_t>(type));
+    }
+
+    // One sender per node streams whatever the parsing threads queue for it
+    size_t nodeCount = nodes.size();
+    std::vector<BatchQueue> queues(nodeCount);
+    std::mutex reportMutex;
+    BulkLoadReport report;
+    report.bytes = data.size();
+    std::string error;
+    std::vector<std::thread> senders;
+    for (size_t n = 0; n < nodeCount; ++n) {
+        senders.emplace_back([&, n]() {
+            auto fail = [&](const std::string& why) {
+                queues[n].fail();
+                std::lock_guard<std::mutex> lock(reportMutex);
+                if (error.empty()) error = "Bulk load on node " + nodes[n].uuid + " failed: " + why;
+            };
+            int sock = Communication::startClient(nodes[n].ip, nodes[n].port);
+            if (sock < 0) return fail("cannot connect");
+            Message batch = schema;
+            bool sent = true;
+            while (sent && queues[n].pop(batch.bulk.lines)) sent = sendFramed(sock, batch);
+            batch.bulk.lines.clear();
+            batch.bulk.done = true;
+            if (!sent || !sendFramed(sock, batch)) {
+                Communication::closeSocket(sock);
+                return fail("send failed");
+            }
+            std::string response = Communication::receiveMessage(sock);
+            Communication::closeSocket(sock);
+            if (response.empty()) return fail("connection closed");
+            uint64_t rows = 0;
+            uint64_t rejected = 0;
+            // A garbled reply fails this node's part; the exception must not
+            // escape the thread
+            try {
+                Message reply = MessageDeserializer::deserialize(std::vector<uint8_t>(response.begin(), response.end()));
+                if (!reply.query.error.empty()) return fail(reply.query.error);
+                if (reply.result.rows.size() != 1 || reply.result.rows[0].size() != 2) return fail("unexpected response");
+                rows = std::stoull(reply.result.rows[0][0]);
+                rejected = std::stoull(reply.result.rows[0][1]);
+            } catch (const std::exception&) {
+                return fail("malformed response");
+            }
+            std::lock_guard<std::mutex> lock(reportMutex);
+            report.rows += rows;
+            report.rejected += rejected;
+        });
+    }
+
+    // Split the body at line boundaries into one chunk per thread
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<size_t>(1, std::min(threads, body.size() / kBulkBatchBytes + 1));
+    std::vector<size_t> bounds(threads + 1, body.size());
+    bounds[0] = 0;
+    for (size_t t = 1; t < threads; ++t) {
+        // The line running through the split point stays with the earlier chunk
+        size_t newline = body.find('\n', body.size() / threads * t);
+        bounds[t] = std::max(bounds[t - 1], newline == std::string_view::npos ? body.size() : newline + 1);
+    }
+    std::vector<std::thread> parsers;
+    for (size_t t = 0; t < threads; ++t) {
+        parsers.emplace_back([&, t]() {
+            std::vector<std::string> pending(nodeCount);
+            std::string_view chunk = body.substr(bounds[t], bounds[t + 1] - bounds[t]);
+            while (!chunk.empty()) {
+                size_t end = chunk.find('\n');
+                std::string_view line = chunk.substr(0, end);
+                chunk.remove_prefix(end == std::string_view::npos ? chunk.size() : end + 1);
+                if (trimmed(line).empty()) continue;
+                std::string_view key = trimmed(line.substr(0, line.find(delimiter)));
+                size_t target = nodeCount > 1 ? rowPartition(key, nodeCount) : 0;
+                std::string& out = pending[target];
+                out.append(line);
+                out.push_back('\n');
+                if (out.size() >= kBulkBatchBytes) {
+                    queues[target].push(std::move(out));
+                    out = std::string();
+                    out.reserve(kBulkBatchBytes + 4096);
+                }
+            }
+            for (size_t n = 0; n < nodeCount; ++n) {
+                if (!pending[n].empty()) queues[n].push(std::move(pending[n]));
+            }
+        });
+    }
+    for (auto& parser : parsers) parser.join();
+    for (auto& queue : queues) queue.close();
+    for (auto& sender : senders) sender.join();
+    if (!error.empty()) throw std::runtime_error(error);
+    return report;
+}
+
+void serveBulkLoad(int socket, const Message& first, TableCatalog& catalog) {
+    Message reply;
+    reply.type = MessageType::QUERY_RESPONSE;
+    try {
+        const BulkLoadData& header = first.bulk;
+        if (header.columns.empty() || header.types.size() != header.columns.size()) {
+            throw std::invalid_argument("Bulk load without a schema");
+        }
+        std::vector<std::pair<std::string, ColumnType>> schema;
+        for (size_t i = 0; i < header.columns.size(); ++i) {
+            if (header.types[i] > static_cast<uint8_t>(ColumnType::String)) {
+                throw std::invalid_argument("Bad column type in bulk load");
+            }
+            schema.emplace_back(header.columns[i], static_cast<ColumnType>(header.types[i]));
+        }
+        auto table = std::make_shared<ColumnTable>(header.table, schema);
+        // Indexes of the table being replaced are maintained as rows arrive
+        if (auto previous = catalog.find(header.table)) {
+            for (const auto& column : previous->indexedColumns()) table->createIndex(column);
+        }
+
+        uint64_t loaded = 0;
+        uint64_t rejected = 0;
+        char delimiter = static_cast<char>(header.delimiter);
+        std::vector<std::string_view> fields;
+        Message batch = first;
+        while (true) {
+            std::string_view lines = batch.bulk.lines;
+            while (!lines.empty()) {
+                size_t end = lines.find('\n');
+                std::string_view line = lines.substr(0, end);
+                lines.remove_prefix(end == std::string_view::npos ? lines.size() : end + 1);
+                splitFields(line, delimiter, fields);
+                if (fields.size() == 1 && fields[0].empty()) continue;
+                try {
+                    table->appendRow(fields);
+                    ++loaded;
+                } catch (const std::invalid_argument&) {
+                    ++rejected;
+                }
+            }
+            if (batch.bulk.done) break;
+            std::string data = Communication::receiveMessage(socket);
+            // A stream that ends early is dropped and the old table stays in
+            // place; the loader still gets an error if it is listening
+            if (data.empty()) throw std::runtime_error("Bulk load stream ended early");
+            batch = MessageDeserializer::deserialize(std::vector<uint8_t>(data.begin(), data.end()));
+            if (batch.type != MessageType::BULK_LOAD || batch.bulk.table != header.table) {
+                throw std::invalid_argument("Unexpected message in bulk load stream");
+            }
+        }
+        catalog.put(table);
+        std::cout << "Bulk loaded " << loaded << " rows of " << header.table << std::endl;
+        reply.result.columns = {"loaded_rows", "rejected_rows"};
+        reply.result.rows.push_back({std::to_string(loaded), std::to_string(rejected)});
+    } catch (const std::exception& e) {
+        reply.query.error = e.what();
+    }
+    sendFramed(socket, reply);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ColumnStore.h"
+#include "message.h"
+
+// Target size of the lines in one BULK_LOAD batch
+constexpr size_t kBulkBatchBytes = 1 << 20;
+// Batches queued per DataNode before the parsing threads wait for its sender
+constexpr size_t kBulkQueuedBatches = 8;
+
+struct BulkLoadReport {
+    uint64_t bytes = 0;    // Size of the input file
+    uint64_t rows = 0;     // Rows the DataNodes loaded
+    uint64_t rejected = 0; // Rows the DataNodes could not parse
+};
+
+// Load a delimited file whose first line names the columns into `table`,
+// partitioned across `nodes` by the first field (see rowPartition). The file
+// is memory-mapped and split at line boundaries into one chunk per thread;
+// each thread routes its lines into per-node batches and one sender per node
+// streams them, so parsing, routing and sending overlap and memory stays
+// bounded by the batch queues. Column types are inferred once from the first
+// data row so every node builds the same schema. `threads` 0 uses every core.
+// Throws std::runtime_error when the file cannot be read or a node fails.
+BulkLoadReport bulkLoad(const std::string& path, const std::string& table, const std::vector<NodeInfo>& nodes,
+                        char delimiter = ',', size_t threads = 0);
+
+// DataNode side of BULK_LOAD: build the table from the stream that starts with
+// `first`, carrying over the indexes of the table it replaces, and publish it
+// only once the last batch arrived. Replies with a QUERY_RESPONSE holding the
+// loaded and rejected row counts.
+void serveBulkLoad(int socket, const Message& first, TableCatalog& catalog);
@@ -0,0 +1,56 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "BulkLoad.h"
+#include "Communication.h"
+#include "Coordinators.h"
+#include "message.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+// Usage: BulkLoader file [table] [delimiter] [threads]
+// The table name defaults to the file name without its directory and extension.
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: BulkLoader file [table] [delimiter] [threads]" << std::endl;
+        return 1;
+    }
+    std::string path = argv[1];
+    std::string table = argc > 2 ? argv[2] : path.substr(path.find_last_of('/') + 1);
+    if (argc <= 2) table = table.substr(0, table.find('.'));
+    char delimiter = argc > 3 && argv[3][0] ? argv[3][0] : ',';
+    size_t threads = argc > 4 ? std::stoul(argv[4]) : 0;
+
+    // The DataNodes to load into come from the CoordinatorNode
+    int sock = connectToCoordinator();
+    if (sock < 0) {
+        std::cerr << "Failed to connect to CoordinatorNode." << std::endl;
+        return 1;
+    }
+    Message request;
+    request.type = MessageType::NODE_LIST_REQUEST;
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(request);
+    Communication::sendMessage(sock, std::string(reinterpret_cast<const char*>(serialized.data()), serialized.size()));
+    std::string response = Communication::receiveMessage(sock);
+    Communication::closeSocket(sock);
+    if (response.empty()) {
+        std::cerr << "No response from CoordinatorNode." << std::endl;
+        return 1;
+    }
+    Message nodes = MessageDeserializer::deserialize(std::vector<uint8_t>(response.begin(), response.end()));
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        BulkLoadReport report = bulkLoad(path, table, nodes.node_list.nodes, delimiter, threads);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Loaded " << report.rows << " rows into " << table << " on " << nodes.node_list.nodes.size()
+                  << " node(s) in " << elapsed.count() << " s (" << report.bytes / elapsed.count() / 1e6 << " MB/s)";
+        if (report.rejected) std::cout << ", rejected " << report.rejected << " row(s)";
+        std::cout << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Bulk load failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
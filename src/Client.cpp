@@ -1,48 +1,253 @@
+#include <unistd.h>
+#include <cstdint>
+#include <iomanip>
 #include <iostream>
 #include <string>
 #include <vector>
 #include "Communication.h"
+#include "Coordinators.h"
 #include "message.h"
 #include "message_serializer.h"
 #include "message_deserializer.h"
+#include "SmartClient.h"
+#include "Tracing.h"
 
-int main() {
+// Rows per cursor page, and pages the coordinator may send per request before
+// waiting for the client to ask again
+static const uint32_t kPageRows = 1024;
+static const uint32_t kCredits = 4;
+
+static bool sendRequest(int sock, const Message& msg) {
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(msg);
+    std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    return Communication::sendMessage(sock, out);
+}
+
+static bool receiveResponse(int sock, Message& respMsg) {
+    std::string response = Communication::receiveMessage(sock);
+    if (response.empty()) return false;
+    std::vector<uint8_t> respBuf(response.begin(), response.end());
+    respMsg = MessageDeserializer::deserialize(respBuf);
+    return true;
+}
+
+static void printColumns(const std::vector<std::string>& columns) {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        std::cout << (i ? "\t" : "") << columns[i];
+    }
+    std::cout << std::endl;
+}
+
+static void printRows(const std::vector<std::vector<std::string>>& rows) {
+    for (const auto& row : rows) {
+        for (size_t i = 0; i < row.size(); ++i) {
+            std::cout << (i ? "\t" : "") << row[i];
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Page through a query with a server-side cursor, printing each page as it
+// arrives. Every request grants the coordinator kCredits pages; the next
+// request is only made once those are printed.
+static int runCursor(const std::string& text) {
+    Message request;
+    request.type = MessageType::OPEN_CURSOR;
+    request.query.text = text;
+    request.cursor.credits = kCredits;
+    request.cursor.batch_rows = kPageRows;
+    size_t total = 0;
+    while (true) {
+        int sock = connectToCoordinator();
+        if (sock < 0) {
+            std::cerr << "Failed to connect to CoordinatorNode." << std::endl;
+            return 1;
+        }
+        if (!sendRequest(sock, request)) {
+            std::cerr << "Failed to send message." << std::endl;
+            Communication::closeSocket(sock);
+            return 1;
+        }
+        for (uint32_t page = 0; page < kCredits; ++page) {
+            Message respMsg;
+            if (!receiveResponse(sock, respMsg) || respMsg.type != MessageType::CURSOR_BATCH) {
+                std::cerr << "No response from CoordinatorNode." << std::endl;
+                Communication::closeSocket(sock);
+                return 1;
+            }
+            if (!respMsg.query.error.empty()) {
+                std::cerr << "Query failed: " << respMsg.query.error << std::endl;
+                Communication::closeSocket(sock);
+                return 1;
+            }
+            if (!respMsg.result.columns.empty()) printColumns(respMsg.result.columns);
+            printRows(respMsg.result.rows);
+            total += respMsg.result.rows.size();
+            if (respMsg.result.done) {
+                Communication::closeSocket(sock);
+                std::cout << "(" << total << " rows)" << std::endl;
+                return 0;
+            }
+            request.type = MessageType::FETCH_CURSOR;
+            request.cursor.id = respMsg.cursor.id;
+        }
+        Communication::closeSocket(sock);
+    }
+}
+
+// get / put / remove of one key, sent straight to the DataNode that owns it
+static int runKeyValue(const std::string& command, const std::string& key, const std::string& value) {
+    SmartClient client;
+    std::string error;
+    bool ok;
+    if (command == "put") {
+        uint64_t version = 0;
+        ok = client.put(key, value, version, error);
+        if (ok) std::cout << "Stored '" << key << "' at version " << version << std::endl;
+    } else if (command == "remove") {
+        bool found = false;
+        ok = client.remove(key, found, error);
+        if (ok) std::cout << (found ? "Removed '" : "No key '") << key << "'" << std::endl;
+    } else {
+        std::string stored;
+        uint64_t version = 0;
+        bool found = false;
+        ok = client.get(key, stored, version, found, error);
+        if (ok && found) std::cout << key << " = '" << stored << "' (version " << version << ")" << std::endl;
+        if (ok && !found) std::cout << "No key '" << key << "'" << std::endl;
+    }
+    if (!ok) {
+        std::cerr << "Request failed: " << error << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// One transaction over any keys: KEY=VALUE writes, a bare KEY is read
+static int runTransaction(int argc, char** argv) {
+    SmartClient client;
+    Transaction txn;
+    std::string error;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t equals = arg.find('=');
+        if (equals != std::string::npos) {
+            client.write(txn, arg.substr(0, equals), arg.substr(equals + 1));
+            continue;
+        }
+        std::string value;
+        bool found = false;
+        if (!client.read(txn, arg, value, found, error)) {
+            std::cerr << "Request failed: " << error << std::endl;
+            return 1;
+        }
+        if (found) std::cout << arg << " = '" << value << "'" << std::endl;
+        if (!found) std::cout << "No key '" << arg << "'" << std::endl;
+    }
+    TxnStatus outcome;
+    if (!client.commit(txn, outcome, error)) {
+        std::cerr << "Commit failed: " << error << std::endl;
+        return 1;
+    }
+    std::cout << (outcome == TxnStatus::Committed ? "Committed" : "Aborted: a key changed or was locked") << std::endl;
+    return outcome == TxnStatus::Committed ? 0 : 1;
+}
+
+// Latency percentiles, counters and gauges of one node: the coordinator by
+// default, or any node given as ip:port
+static int runStats(const std::string& address) {
+    int sock = -1;
+    if (address.empty()) {
+        sock = connectToCoordinator();
+    } else {
+        size_t colon = address.rfind(':');
+        if (colon != std::string::npos) {
+            sock = Communication::startClient(address.substr(0, colon), std::stoi(address.substr(colon + 1)));
+        }
+    }
+    if (sock < 0) {
+        std::cerr << "Failed to connect to " << (address.empty() ? "CoordinatorNode" : address) << "." << std::endl;
+        return 1;
+    }
+    Message msg;
+    msg.type = MessageType::STATS_REQUEST;
+    Message respMsg;
+    bool received = sendRequest(sock, msg) && receiveResponse(sock, respMsg);
+    Communication::closeSocket(sock);
+    if (!received || respMsg.type != MessageType::STATS_RESPONSE) {
+        std::cerr << "No stats received." << std::endl;
+        return 1;
+    }
+    const StatsData& stats = respMsg.node_stats;
+    auto micros = [](uint64_t nanos) { return nanos / 1000.0; };
+    std::cout << "Up " << stats.uptime_ms / 1000 << "s; rates over the last " << stats.window_ms / 1000.0 << "s"
+              << std::endl;
+    std::cout << std::left << std::setw(28) << "latency" << std::right << std::setw(10) << "count" << std::setw(9)
+              << "per_s" << std::setw(10) << "p50_us" << std::setw(10) << "p99_us" << std::setw(10) << "p999_us"
+              << std::setw(10) << "max_us" << std::setw(10) << "mean_us" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto& latency : stats.latencies) {
+        std::cout << std::left << std::setw(28) << latency.name << std::right << std::setw(10) << latency.count
+                  << std::setw(9) << latency.per_second << std::setw(10) << micros(latency.p50) << std::setw(10)
+                  << micros(latency.p99) << std::setw(10) << micros(latency.p999) << std::setw(10)
+                  << micros(latency.max) << std::setw(10) << micros(latency.mean) << std::endl;
+    }
+    for (const auto& counter : stats.counters) std::cout << counter.name << " = " << counter.value << std::endl;
+    for (const auto& gauge : stats.gauges) std::cout << gauge.name << " = " << gauge.value << std::endl;
+    return 0;
+}
+
+// Usage: Client ["SELECT ..." | "EXPLAIN SELECT ..." | get KEY | put KEY VALUE | remove KEY |
+//                txn KEY|KEY=VALUE ... | stats [IP:PORT]]
+int main(int argc, char** argv) {
     std::cout << "Client started. Connecting to CoordinatorNode..." << std::endl;
+    Tracing::start("client-" + std::to_string(getpid()));
+    std::string text = argc > 1 ? argv[1] : "";
+    if (argc == 1) return runKeyValue("get", "users", "");
+    if ((text == "get" || text == "remove") && argc == 3) return runKeyValue(text, argv[2], "");
+    if (text == "put" && argc == 4) return runKeyValue(text, argv[2], argv[3]);
+    if (text == "txn" && argc > 2) return runTransaction(argc, argv);
+    if (text == "stats" && argc <= 3) return runStats(argc == 3 ? argv[2] : "");
+    // "EXPLAIN <query>" asks for the plan instead of the rows
+    bool explain = text.size() > 8 && text.compare(0, 8, "EXPLAIN ") == 0;
+    if (!explain) return runCursor(text);
+
     // Connect to CoordinatorNode (server)
-    int sock = Communication::startClient("127.0.0.1", 8080);
+    int sock = connectToCoordinator();
     if (sock < 0) {
         std::cerr << "Failed to connect to CoordinatorNode." << std::endl;
         return 1;
     }
 
-    // Prepare a DATA_REQUEST message
     Message msg;
-    msg.type = MessageType::DATA_REQUEST;
-    msg.key_value.key = "users";
-    msg.key_value.value = ""; // No value for request
-    std::vector<uint8_t> serialized = MessageSerializer::serialize(msg);
+    msg.type = MessageType::EXPLAIN_REQUEST;
+    msg.query.text = text.substr(8);
 
     // Send the serialized message
-    std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
-    if (!Communication::sendMessage(sock, out)) {
+    if (!sendRequest(sock, msg)) {
         std::cerr << "Failed to send message." << std::endl;
         Communication::closeSocket(sock);
         return 1;
     }
 
     // Receive the response
-    std::string response = Communication::receiveMessage(sock);
+    Message respMsg;
+    bool received = receiveResponse(sock, respMsg);
     Communication::closeSocket(sock);
-    if (response.empty()) {
+    if (!received) {
         std::cerr << "No response from CoordinatorNode." << std::endl;
         return 1;
     }
-    std::vector<uint8_t> respBuf(response.begin(), response.end());
-    Message respMsg = MessageDeserializer::deserialize(respBuf);
-    if (respMsg.type == MessageType::DATA_RESPONSE) {
-        std::cout << "Client received data: key='" << respMsg.key_value.key << "', value='" << respMsg.key_value.value << "'" << std::endl;
+    if (respMsg.type == MessageType::QUERY_RESPONSE) {
+        if (!respMsg.query.error.empty()) {
+            std::cerr << "Query failed: " << respMsg.query.error << std::endl;
+            return 1;
+        }
+        printColumns(respMsg.result.columns);
+        printRows(respMsg.result.rows);
+        std::cout << "(" << respMsg.result.rows.size() << " rows)" << std::endl;
     } else {
         std::cout << "Client received unknown response type." << std::endl;
     }
     return 0;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,79 @@
+#include "ColumnIndex.h"
+#include <cmath>
+#include "ColumnStore.h"
+
+namespace {
+
+template <typename T, typename Visit>
+void visitRange(const std::map<T, std::vector<uint32_t>>& keys, const KeyRange<T>& range, Visit visit) {
+    if (range.empty()) return;
+    auto it = !range.hasLow ? keys.begin()
+            : range.lowInclusive ? keys.lower_bound(range.low) : keys.upper_bound(range.low);
+    for (; it != keys.end(); ++it) {
+        if (range.hasHigh && (range.highInclusive ? range.high < it->first : !(it->first < range.high))) break;
+        visit(it->second);
+    }
+}
+
+} // namespace
+
+ColumnIndex::ColumnIndex(ColumnType type) : type(type) {}
+
+void ColumnIndex::add(const Column& column, size_t row) {
+    const ColumnChunk& chunk = column.chunk(row / kBatchSize);
+    size_t offset = row % kBatchSize;
+    uint32_t id = static_cast<uint32_t>(row);
+    switch (type) {
+        case ColumnType::Int64:
+            ints[chunk.ints[offset]].push_back(id);
+            break;
+        case ColumnType::Double: {
+            double value = chunk.doubles[offset];
+            if (std::isnan(value)) break;
+            // -0.0 and 0.0 compare equal and share one key
+            doubles[value == 0.0 ? 0.0 : value].push_back(id);
+            break;
+        }
+        case ColumnType::String: {
+            size_t code = static_cast<size_t>(chunk.codes[offset]);
+            if (code >= byCode.size()) byCode.resize(code + 1);
+            byCode[code].push_back(id);
+            break;
+        }
+    }
+}
+
+size_t ColumnIndex::count(const KeyRange<int64_t>& range) const {
+    size_t rows = 0;
+    visitRange(ints, range, [&rows](const std::vector<uint32_t>& ids) { rows += ids.size(); });
+    return rows;
+}
+
+size_t ColumnIndex::count(const KeyRange<double>& range) const {
+    size_t rows = 0;
+    visitRange(doubles, range, [&rows](const std::vector<uint32_t>& ids) { rows += ids.size(); });
+    return rows;
+}
+
+size_t ColumnIndex::count(const std::vector<int32_t>& codes) const {
+    size_t rows = 0;
+    for (int32_t code : codes) {
+        if (code >= 0 && static_cast<size_t>(code) < byCode.size()) rows += byCode[code].size();
+    }
+    return rows;
+}
+
+void ColumnIndex::collect(const KeyRange<int64_t>& range, std::vector<uint32_t>& rows) const {
+    visitRange(ints, range, [&rows](const std::vector<uint32_t>& ids) { rows.insert(rows.end(), ids.begin(), ids.end()); });
+}
+
+void ColumnIndex::collect(const KeyRange<double>& range, std::vector<uint32_t>& rows) const {
+    visitRange(doubles, range, [&rows](const std::vector<uint32_t>& ids) { rows.insert(rows.end(), ids.begin(), ids.end()); });
+}
+
+void ColumnIndex::collect(const std::vector<int32_t>& codes, std::vector<uint32_t>& rows) const {
+    for (int32_t code : codes) {
+        if (code < 0 || static_cast<size_t>(code) >= byCode.size()) continue;
+        rows.insert(rows.end(), byCode[code].begin(), byCode[code].end());
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "QueryParser.h"
+
+class Column;
+enum class ColumnType : uint8_t;
+
+// Interval of index keys; a side without a bound is open
+template <typename T>
+struct KeyRange {
+    bool hasLow = false;
+    bool hasHigh = false;
+    bool lowInclusive = true;
+    bool highInclusive = true;
+    T low{};
+    T high{};
+
+    // Narrow to keys k with `k op bound`; Ne does not narrow
+    void restrict(CompareOp op, T bound) {
+        bool inclusive = op == CompareOp::Eq || op == CompareOp::Ge || op == CompareOp::Le;
+        if (op == CompareOp::Eq || op == CompareOp::Gt || op == CompareOp::Ge) {
+            if (!hasLow || bound > low || (bound == low && !inclusive)) {
+                low = bound;
+                lowInclusive = inclusive;
+                hasLow = true;
+            }
+        }
+        if (op == CompareOp::Eq || op == CompareOp::Lt || op == CompareOp::Le) {
+            if (!hasHigh || bound < high || (bound == high && !inclusive)) {
+                high = bound;
+                highInclusive = inclusive;
+                hasHigh = true;
+            }
+        }
+    }
+
+    bool empty() const {
+        return hasLow && hasHigh && (high < low || (low == high && !(lowInclusive && highInclusive)));
+    }
+};
+
+// Secondary index over one column of a DataNode's table: the ids of the rows
+// holding each value, ascending per value. Numbers are kept in ordered maps so
+// that a range is one contiguous run of keys; strings are indexed by
+// dictionary code, which already turns string equality into an integer lookup.
+// ColumnTable::appendRow adds every new row, so the index never lags the data.
+class ColumnIndex {
+public:
+    explicit ColumnIndex(ColumnType type);
+
+    // Index the value at `row` of `column`, which must have this type. Rows
+    // must be added in ascending order.
+    void add(const Column& column, size_t row);
+
+    // Number of rows a lookup would return, without collecting them
+    size_t count(const KeyRange<int64_t>& range) const;
+    size_t count(const KeyRange<double>& range) const;
+    size_t count(const std::vector<int32_t>& codes) const;
+
+    // Append the matching row ids to `rows`; ascending only within one key
+    void collect(const KeyRange<int64_t>& range, std::vector<uint32_t>& rows) const;
+    void collect(const KeyRange<double>& range, std::vector<uint32_t>& rows) const;
+    void collect(const std::vector<int32_t>& codes, std::vector<uint32_t>& rows) const;
+
+private:
+    ColumnType type;
+    std::map<int64_t, std::vector<uint32_t>> ints;
+    std::map<double, std::vector<uint32_t>> doubles; // NaN is never indexed; no condition matches it
+    std::vector<std::vector<uint32_t>> byCode;
+};
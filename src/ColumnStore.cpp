@@ -0,0 +1,285 @@
+#include "ColumnStore.h"
+#include <charconv>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+Column::Column(std::string name, ColumnType type)
+    : columnName(std::move(name)), columnType(type), rows(0) {}
+
+bool Column::accepts(std::string_view field) const {
+    const char* end = field.data() + field.size();
+    switch (columnType) {
+        case ColumnType::Int64: {
+            int64_t value;
+            return field.empty() || std::from_chars(field.data(), end, value).ptr == end;
+        }
+        case ColumnType::Double: {
+            double value;
+            return field.empty() || std::from_chars(field.data(), end, value).ptr == end;
+        }
+        case ColumnType::String:
+            return true;
+    }
+    return false;
+}
+
+void Column::append(std::string_view field) {
+    if (!accepts(field)) {
+        throw std::invalid_argument("Invalid value in column " + columnName + ": " + std::string(field));
+    }
+    if (rows % kBatchSize == 0) {
+        chunks.emplace_back();
+        ColumnChunk& fresh = chunks.back();
+        switch (columnType) {
+            case ColumnType::Int64: fresh.ints.reserve(kBatchSize); break;
+            case ColumnType::Double: fresh.doubles.reserve(kBatchSize); break;
+            case ColumnType::String: fresh.codes.reserve(kBatchSize); break;
+        }
+    }
+    ColumnChunk& chunk = chunks.back();
+    const char* end = field.data() + field.size();
+    switch (columnType) {
+        case ColumnType::Int64: {
+            int64_t value = 0;
+            if (!field.empty()) std::from_chars(field.data(), end, value);
+            chunk.ints.push_back(value);
+            break;
+        }
+        case ColumnType::Double: {
+            double value = 0.0;
+            if (!field.empty()) std::from_chars(field.data(), end, value);
+            chunk.doubles.push_back(value);
+            break;
+        }
+        case ColumnType::String: {
+            std::string key(field);
+            auto it = dictIndex.find(key);
+            int32_t code;
+            if (it != dictIndex.end()) {
+                code = it->second;
+            } else {
+                code = static_cast<int32_t>(dict.size());
+                dict.push_back(key);
+                dictIndex.emplace(std::move(key), code);
+            }
+            chunk.codes.push_back(code);
+            break;
+        }
+    }
+    ++rows;
+}
+
+void Column::appendText(size_t row, std::string& out) const {
+    const ColumnChunk& c = chunks[row / kBatchSize];
+    size_t offset = row % kBatchSize;
+    switch (columnType) {
+        case ColumnType::Int64: out += std::to_string(c.ints[offset]); break;
+        case ColumnType::Double: {
+            char buf[32];
+            auto res = std::to_chars(buf, buf + sizeof(buf), c.doubles[offset]);
+            out.append(buf, res.ptr);
+            break;
+        }
+        case ColumnType::String: out += dict[c.codes[offset]]; break;
+    }
+}
+
+int32_t Column::findCode(std::string_view value) const {
+    auto it = dictIndex.find(std::string(value));
+    return it == dictIndex.end() ? -1 : it->second;
+}
+
+ColumnTable::ColumnTable(std::string name, const std::vector<std::pair<std::string, ColumnType>>& schema,
+                         bool trackStatistics)
+    : tableName(std::move(name)),
+      columns(std::make_shared<std::vector<Column>>()),
+      stats(std::make_shared<std::vector<ColumnStatistics>>()),
+      rows(0) {
+    for (const auto& col : schema) {
+        columns->emplace_back(col.first, col.second);
+        if (trackStatistics) stats->emplace_back(col.second);
+    }
+}
+
+ColumnType ColumnTable::inferType(std::string_view field) {
+    const char* end = field.data() + field.size();
+    int64_t i;
+    if (!field.empty() && std::from_chars(field.data(), end, i).ptr == end) return ColumnType::Int64;
+    double d;
+    if (!field.empty() && std::from_chars(field.data(), end, d).ptr == end) return ColumnType::Double;
+    return ColumnType::String;
+}
+
+ColumnTable ColumnTable::loadDelimited(const std::string& name, const std::string& path, char delimiter,
+                                       size_t partitionIndex, size_t partitionCount) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Cannot open " + path);
+    std::string header;
+    if (!std::getline(in, header)) throw std::runtime_error("Missing header in " + path);
+    std::vector<std::string_view> names;
+    splitFields(header, delimiter, names);
+
+    std::string line;
+    std::vector<std::string_view> fields;
+    std::vector<std::pair<std::string, ColumnType>> schema;
+    bool haveRow = static_cast<bool>(std::getline(in, line));
+    if (haveRow) splitFields(line, delimiter, fields);
+    for (size_t i = 0; i < names.size(); ++i) {
+        ColumnType type = haveRow && i < fields.size() ? inferType(fields[i]) : ColumnType::String;
+        schema.emplace_back(std::string(names[i]), type);
+    }
+    ColumnTable table(name, schema);
+    while (haveRow) {
+        if (!line.empty()) {
+            splitFields(line, delimiter, fields);
+            if (partitionCount <= 1 || rowPartition(fields[0], partitionCount) == partitionIndex) {
+                table.appendRow(fields);
+            }
+        }
+        haveRow = static_cast<bool>(std::getline(in, line));
+    }
+    return table;
+}
+
+int ColumnTable::findColumn(std::string_view name) const {
+    for (size_t i = 0; i < columns->size(); ++i) {
+        if ((*columns)[i].name() == name) return static_cast<int>(i);
+    }
+    size_t dot = name.find('.');
+    if (dot != std::string_view::npos) {
+        if (name.substr(0, dot) != tableName) return -1;
+        return findColumn(name.substr(dot + 1));
+    }
+    // A bare name also matches one qualified column, as in a join's output
+    int found = -1;
+    for (size_t i = 0; i < columns->size(); ++i) {
+        std::string_view qualified = (*columns)[i].name();
+        size_t split = qualified.find('.');
+        if (split == std::string_view::npos || qualified.substr(split + 1) != name) continue;
+        if (found >= 0) return -1;
+        found = static_cast<int>(i);
+    }
+    return found;
+}
+
+void ColumnTable::appendRow(const std::vector<std::string_view>& fields) {
+    if (fields.size() != columns->size()) {
+        throw std::invalid_argument("Row has " + std::to_string(fields.size()) + " fields, table " +
+                                    tableName + " has " + std::to_string(columns->size()) + " columns");
+    }
+    // Validate the whole row first so a bad field cannot leave columns uneven
+    for (size_t i = 0; i < columns->size(); ++i) {
+        if (!(*columns)[i].accepts(fields[i])) {
+            throw std::invalid_argument("Invalid value in column " + (*columns)[i].name() + ": " +
+                                        std::string(fields[i]));
+        }
+    }
+    for (size_t i = 0; i < columns->size(); ++i) {
+        (*columns)[i].append(fields[i]);
+    }
+    for (size_t i = 0; i < stats->size(); ++i) {
+        (*stats)[i].add((*columns)[i], rows);
+    }
+    for (auto& entry : indexes) {
+        entry.second->add((*columns)[entry.first], rows);
+    }
+    ++rows;
+}
+
+bool ColumnTable::createIndex(std::string_view column) {
+    int position = findColumn(column);
+    if (position < 0) return false;
+    size_t at = static_cast<size_t>(position);
+    if (!indexes.count(at)) indexes.emplace(at, buildIndex(at));
+    return true;
+}
+
+std::shared_ptr<ColumnIndex> ColumnTable::buildIndex(size_t at) const {
+    auto built = std::make_shared<ColumnIndex>((*columns)[at].type());
+    for (size_t row = 0; row < rows; ++row) built->add((*columns)[at], row);
+    return built;
+}
+
+std::shared_ptr<const ColumnTable> ColumnTable::withIndex(std::string_view column) const {
+    int position = findColumn(column);
+    if (position < 0) return nullptr;
+    size_t at = static_cast<size_t>(position);
+    // Copying shares the columns, statistics and existing indexes
+    std::shared_ptr<ColumnTable> updated(new ColumnTable(*this));
+    if (!indexes.count(at)) updated->indexes.emplace(at, buildIndex(at));
+    return updated;
+}
+
+const ColumnIndex* ColumnTable::index(const Column& column) const {
+    for (const auto& entry : indexes) {
+        if (&(*columns)[entry.first] == &column) return entry.second.get();
+    }
+    return nullptr;
+}
+
+std::vector<std::string> ColumnTable::indexedColumns() const {
+    std::vector<std::string> names;
+    for (const auto& entry : indexes) names.push_back((*columns)[entry.first].name());
+    return names;
+}
+
+TableStatsData ColumnTable::statistics(size_t buckets) const {
+    TableStatsData data;
+    data.name = tableName;
+    data.row_count = rows;
+    for (size_t i = 0; i < stats->size(); ++i) {
+        data.columns.push_back((*stats)[i].summary((*columns)[i].name(), buckets));
+        data.columns.back().indexed = indexes.count(i) > 0;
+    }
+    return data;
+}
+
+void TableCatalog::put(std::shared_ptr<const ColumnTable> table) {
+    std::lock_guard<std::mutex> lock(mtx);
+    tables[table->name()] = std::move(table);
+}
+
+std::shared_ptr<const ColumnTable> TableCatalog::find(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = tables.find(name);
+    return it == tables.end() ? nullptr : it->second;
+}
+
+std::vector<std::shared_ptr<const ColumnTable>> TableCatalog::list() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<std::shared_ptr<const ColumnTable>> all;
+    for (const auto& entry : tables) all.push_back(entry.second);
+    return all;
+}
+
+size_t TableCatalog::createIndex(const std::string& table, std::string_view column) {
+    std::lock_guard<std::mutex> ddl(ddlMutex);
+    std::shared_ptr<const ColumnTable> current = find(table);
+    if (!current) throw std::invalid_argument("Unknown table " + table);
+    int position = current->findColumn(column);
+    if (position >= 0 && current->index(current->column(static_cast<size_t>(position)))) return current->rowCount();
+    std::shared_ptr<const ColumnTable> updated = current->withIndex(column);
+    if (!updated) throw std::invalid_argument("Unknown column " + std::string(column) + " in table " + table);
+    put(updated);
+    return updated->rowCount();
+}
+
+size_t rowPartition(std::string_view key, size_t partitionCount) {
+    return std::hash<std::string_view>{}(key) % partitionCount;
+}
+
+void splitFields(std::string_view line, char delimiter, std::vector<std::string_view>& fields) {
+    fields.clear();
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find(delimiter, start);
+        std::string_view field = line.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        while (!field.empty() && field.front() == ' ') field.remove_prefix(1);
+        while (!field.empty() && field.back() == ' ') field.remove_suffix(1);
+        fields.push_back(field);
+        if (end == std::string_view::npos) break;
+        start = end + 1;
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ColumnIndex.h"
+#include "Statistics.h"
+
+enum class ColumnType : uint8_t { Int64, Double, String };
+
+// Rows per column chunk; also the executor's batch size
+constexpr size_t kBatchSize = 1024;
+
+// Values of one column for up to kBatchSize consecutive rows. Only the vector
+// matching the column type is used; String columns hold dictionary codes.
+struct ColumnChunk {
+    std::vector<int64_t> ints;
+    std::vector<double> doubles;
+    std::vector<int32_t> codes;
+};
+
+class Column {
+public:
+    Column(std::string name, ColumnType type);
+
+    const std::string& name() const { return columnName; }
+    ColumnType type() const { return columnType; }
+    size_t size() const { return rows; }
+    size_t chunkCount() const { return chunks.size(); }
+    const ColumnChunk& chunk(size_t index) const { return chunks[index]; }
+
+    // Whether `field` parses as the column type
+    bool accepts(std::string_view field) const;
+
+    // Parse `field` according to the column type and append it
+    void append(std::string_view field);
+
+    // Append the text form of the value at `row` to `out`
+    void appendText(size_t row, std::string& out) const;
+
+    const std::vector<std::string>& dictionary() const { return dict; }
+    // Dictionary code of a string value, or -1 when no row holds it
+    int32_t findCode(std::string_view value) const;
+
+private:
+    std::string columnName;
+    ColumnType columnType;
+    size_t rows;
+    std::vector<ColumnChunk> chunks;
+    std::vector<std::string> dict;
+    std::unordered_map<std::string, int32_t> dictIndex;
+};
+
+// Table stored column-wise in typed chunks of kBatchSize rows
+class ColumnTable {
+public:
+    // Intermediate tables, such as join output, skip statistics maintenance
+    ColumnTable(std::string name, const std::vector<std::pair<std::string, ColumnType>>& schema,
+                bool trackStatistics = true);
+    ColumnTable(ColumnTable&&) = default;
+
+    // Header line names the columns; types are inferred from the first data row.
+    // Only rows whose first field hashes to partitionIndex are kept.
+    static ColumnTable loadDelimited(const std::string& name, const std::string& path, char delimiter = ',',
+                                     size_t partitionIndex = 0, size_t partitionCount = 1);
+    static ColumnType inferType(std::string_view field);
+
+    const std::string& name() const { return tableName; }
+    size_t rowCount() const { return rows; }
+    size_t columnCount() const { return columns->size(); }
+    const Column& column(size_t index) const { return (*columns)[index]; }
+    // Index of the named column, or -1. Accepts "table.column" for this table,
+    // and a bare name matching exactly one qualified column name.
+    int findColumn(std::string_view name) const;
+
+    // Fields in schema order; throws std::invalid_argument on a bad row. The
+    // row is added to every column and every index, or to none of them.
+    void appendRow(const std::vector<std::string_view>& fields);
+
+    // Index the named column from its existing rows on; appendRow keeps it
+    // current. Returns false for an unknown column.
+    bool createIndex(std::string_view column);
+    // A table sharing this one's rows, with `column` indexed as well; null for
+    // an unknown column. Building the index only reads this table, and neither
+    // table may be appended to afterwards.
+    std::shared_ptr<const ColumnTable> withIndex(std::string_view column) const;
+    // Index over `column` of this table, or nullptr
+    const ColumnIndex* index(const Column& column) const;
+    std::vector<std::string> indexedColumns() const;
+
+    // Statistics of every column, with equi-depth histograms of `buckets`
+    TableStatsData statistics(size_t buckets) const;
+
+private:
+    // Only withIndex() copies a table; the copy shares its rows
+    ColumnTable(const ColumnTable&) = default;
+    std::shared_ptr<ColumnIndex> buildIndex(size_t at) const;
+
+    std::string tableName;
+    std::shared_ptr<std::vector<Column>> columns;
+    std::shared_ptr<std::vector<ColumnStatistics>> stats; // Empty unless statistics are tracked
+    std::map<size_t, std::shared_ptr<ColumnIndex>> indexes; // By column position
+    size_t rows;
+};
+
+// Tables held by a DataNode, by name
+class TableCatalog {
+public:
+    void put(std::shared_ptr<const ColumnTable> table);
+    std::shared_ptr<const ColumnTable> find(const std::string& name) const;
+    std::vector<std::shared_ptr<const ColumnTable>> list() const;
+
+    // CREATE INDEX: publish a table that shares the current one's rows and
+    // adds the index, so queries already running keep their snapshot. Returns the rows indexed;
+    // throws std::invalid_argument for an unknown table or column.
+    size_t createIndex(const std::string& table, std::string_view column);
+
+private:
+    mutable std::mutex mtx;
+    std::mutex ddlMutex; // Serializes replacing a table with an indexed one
+    std::map<std::string, std::shared_ptr<const ColumnTable>> tables;
+};
+
+// Partition of a row among `partitionCount` DataNodes, by its first field
+size_t rowPartition(std::string_view key, size_t partitionCount);
+
+// Split one delimited line into views of its fields
+void splitFields(std::string_view line, char delimiter, std::vector<std::string_view>& fields);
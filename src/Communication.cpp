@@ -1,12 +1,131 @@
 #include "Communication.h"
+#include "UnixTransport.h"
+#include <algorithm>
 #include <iostream>
 #include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 
-int Communication::startServer(int port) {
+static std::atomic<Transport*> installed{nullptr};
+
+// UnixTransport unless DISTDATA_TCP_ONLY is set. Never destroyed: detached
+// threads may still send during exit.
+static Transport& defaultTransport() {
+    static Transport* instance = std::getenv("DISTDATA_TCP_ONLY") ? static_cast<Transport*>(new TcpTransport())
+                                                                  : new UnixTransport();
+    return *instance;
+}
+
+static Transport& transport() {
+    Transport* current = installed.load(std::memory_order_acquire);
+    return current ? *current : defaultTransport();
+}
+
+// --- Injected faults ---
+
+// Linux's minimum retransmission timeout
+static const std::chrono::milliseconds kRetransmitDelay(200);
+
+static bool faultInjectionEnabled() {
+    static const bool enabled = std::getenv("DISTDATA_FAULT_INJECTION") != nullptr;
+    return enabled;
+}
+
+struct FaultState {
+    std::mutex mtx;
+    TransportFaults faults;
+    std::unordered_map<int, std::string> outbound; // "ip:port" of startClient sockets, by socket
+};
+
+// Never destroyed: detached threads may still send during exit
+static FaultState& faultState() {
+    static FaultState* state = new FaultState();
+    return *state;
+}
+
+// Set while any fault is injected; all a healthy send pays is this load
+static std::atomic<bool> faultsActive{false};
+
+static std::string peerOf(int socket) {
+    sockaddr_storage address{};
+    socklen_t size = sizeof(address);
+    if (getpeername(socket, reinterpret_cast<sockaddr*>(&address), &size) < 0) return std::string();
+    // Unix domain peers have no address to compare
+    if (address.ss_family != AF_INET) return std::string();
+    const sockaddr_in& peer = reinterpret_cast<const sockaddr_in&>(address);
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(peer.sin_port));
+}
+
+// Delay what is about to be sent as the faults say; false when it is lost
+static bool applySendFaults(bool datagram) {
+    std::chrono::milliseconds delay;
+    double loss;
+    {
+        FaultState& state = faultState();
+        std::lock_guard<std::mutex> lock(state.mtx);
+        delay = state.faults.delay;
+        loss = state.faults.loss;
+    }
+    thread_local std::mt19937_64 random(std::random_device{}());
+    if (loss > 0 && std::uniform_real_distribution<double>(0, 1)(random) < loss) {
+        if (datagram) return false;
+        delay += kRetransmitDelay;
+    }
+    if (delay.count() > 0) std::this_thread::sleep_for(delay);
+    return true;
+}
+
+bool Communication::injectFaults(const TransportFaults& faults) {
+    if (!faultInjectionEnabled()) return false;
+    FaultState& state = faultState();
+    std::lock_guard<std::mutex> lock(state.mtx);
+    state.faults = faults;
+    faultsActive = faults.delay.count() > 0 || faults.loss > 0 || !faults.blocked.empty();
+    for (auto it = state.outbound.begin(); it != state.outbound.end();) {
+        // A socket closed without closeSocket may have been reused since;
+        // sockets of other transports have no peer name to check
+        std::string name = peerOf(it->first);
+        if (!name.empty() && name != it->second) {
+            it = state.outbound.erase(it);
+            continue;
+        }
+        for (const auto& peer : faults.blocked) {
+            if (peer == it->second) transport().shutdown(it->first);
+        }
+        ++it;
+    }
+    return true;
+}
+
+bool Communication::reachable(const std::string& host, int port) {
+    if (!faultsActive.load(std::memory_order_relaxed)) return true;
+    std::string address = host + ":" + std::to_string(port);
+    FaultState& state = faultState();
+    std::lock_guard<std::mutex> lock(state.mtx);
+    for (const auto& peer : state.faults.blocked) {
+        if (peer == address) return false;
+    }
+    return true;
+}
+
+// --- TCP ---
+
+int TcpTransport::listen(int port) {
     int server_fd;
     struct sockaddr_in address;
     int opt = 1;
@@ -18,23 +137,27 @@ int Communication::startServer(int port) {
 
     if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
         perror("setsockopt");
-        close(server_fd);
+        ::close(server_fd);
         return -1;
     }
 
+    // Accepted connections inherit this; replies sent back to back must not
+    // wait for the client to acknowledge the previous one
+    setsockopt(server_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
 
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("bind failed");
-        close(server_fd);
+        ::close(server_fd);
         return -1;
     }
 
-    if (listen(server_fd, 3) < 0) {
+    if (::listen(server_fd, SOMAXCONN) < 0) {
         perror("listen");
-        close(server_fd);
+        ::close(server_fd);
         return -1;
     }
 
@@ -42,7 +165,17 @@ int Communication::startServer(int port) {
     return server_fd;
 }
 
-int Communication::startClient(const std::string& host, int port) {
+int TcpTransport::accept(int server) {
+    sockaddr_in address{};
+    socklen_t size = sizeof(address);
+    int sock;
+    do {
+        sock = ::accept(server, reinterpret_cast<sockaddr*>(&address), &size);
+    } while (sock < 0 && errno == EINTR);
+    return sock;
+}
+
+int TcpTransport::connect(const std::string& host, int port) {
     int sock = 0;
     struct sockaddr_in serv_addr;
     if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
@@ -53,31 +186,257 @@ int Communication::startClient(const std::string& host, int port) {
     serv_addr.sin_port = htons(port);
     if (inet_pton(AF_INET, host.c_str(), &serv_addr.sin_addr) <= 0) {
         perror("inet_pton failed");
-        close(sock);
+        ::close(sock);
         return -1;
     }
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+    if (::connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
         perror("connect failed");
-        close(sock);
+        ::close(sock);
         return -1;
     }
+    // Every message goes out in one write, so waiting to coalesce small ones
+    // only delays a request sent right behind a one-way message
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return sock;
+}
+
+// Messages are framed with a 4-byte big-endian length so a message can span
+// several reads and several messages can share one connection
+static const uint32_t kMaxFrameSize = 64 * 1024 * 1024;
+
+static bool writeAll(int socket, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            if (sent < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool readAll(int socket, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t got = read(socket, data, size);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+bool TcpTransport::send(int socket, const std::string& message) {
+    uint32_t len = static_cast<uint32_t>(message.size());
+    char header[4] = {
+        static_cast<char>((len >> 24) & 0xFF), static_cast<char>((len >> 16) & 0xFF),
+        static_cast<char>((len >> 8) & 0xFF), static_cast<char>(len & 0xFF)};
+    // Header and body leave in one call. Two small writes on a kept-open
+    // connection let Nagle's algorithm hold the body until the peer's delayed
+    // ACK of the header, which costs tens of milliseconds per request.
+    iovec parts[2] = {{header, sizeof(header)}, {const_cast<char*>(message.data()), message.size()}};
+    msghdr out{};
+    out.msg_iov = parts;
+    out.msg_iovlen = 2;
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &out, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent <= 0) return false;
+    size_t done = static_cast<size_t>(sent);
+    if (done < sizeof(header)) {
+        return writeAll(socket, header + done, sizeof(header) - done) &&
+               writeAll(socket, message.data(), message.size());
+    }
+    done -= sizeof(header);
+    return writeAll(socket, message.data() + done, message.size() - done);
+}
+
+static uint32_t frameLength(const unsigned char* header) {
+    return (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) | (uint32_t(header[2]) << 8) |
+           uint32_t(header[3]);
+}
+
+std::string TcpTransport::receive(int socket) {
+    unsigned char header[4];
+    if (!readAll(socket, reinterpret_cast<char*>(header), sizeof(header))) {
+        return std::string();
+    }
+    uint32_t len = frameLength(header);
+    if (len > kMaxFrameSize) {
+        return std::string();
+    }
+    std::string message(len, '\0');
+    if (!readAll(socket, &message[0], len)) {
+        return std::string();
+    }
+    return message;
+}
+
+ReceiveProgress TcpTransport::receiveSome(int socket, std::string& partial, std::string& message) {
+    // Never reads past this message: what follows is its handler's to read
+    while (true) {
+        size_t want = 4 - std::min<size_t>(partial.size(), 4);
+        if (want == 0) {
+            uint32_t len = frameLength(reinterpret_cast<const unsigned char*>(partial.data()));
+            if (len > kMaxFrameSize) return ReceiveProgress::Closed;
+            want = 4 + size_t(len) - partial.size();
+            if (want == 0) {
+                partial.erase(0, 4);
+                message = std::move(partial);
+                partial.clear();
+                return ReceiveProgress::Complete;
+            }
+        }
+        char chunk[64 * 1024];
+        ssize_t got = recv(socket, chunk, std::min(want, sizeof(chunk)), MSG_DONTWAIT);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return ReceiveProgress::Partial;
+        if (got <= 0) return ReceiveProgress::Closed;
+        partial.append(chunk, static_cast<size_t>(got));
+    }
+}
+
+// Largest UDP payload over IPv4
+static const size_t kMaxDatagramSize = 65507;
+
+int TcpTransport::bindDatagram(int port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+bool TcpTransport::sendDatagram(int socket, const std::string& host, int port, const std::string& payload) {
+    if (payload.size() > kMaxDatagramSize) return false;
+    struct sockaddr_in peer{};
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &peer.sin_addr) <= 0) return false;
+    ssize_t sent;
+    do {
+        sent = sendto(socket, payload.data(), payload.size(), MSG_DONTWAIT,
+                      (struct sockaddr *)&peer, sizeof(peer));
+    } while (sent < 0 && errno == EINTR);
+    return sent == static_cast<ssize_t>(payload.size());
+}
+
+std::string TcpTransport::receiveDatagram(int socket) {
+    std::string payload(kMaxDatagramSize, '\0');
+    ssize_t got;
+    do {
+        got = recv(socket, &payload[0], payload.size(), MSG_DONTWAIT);
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0) return std::string();
+    payload.resize(got);
+    return payload;
+}
+
+void TcpTransport::shutdown(int socket) {
+    ::shutdown(socket, SHUT_RDWR);
+}
+
+void TcpTransport::close(int socket) {
+    ::close(socket);
+}
+
+ReceiveProgress Transport::receiveSome(int socket, std::string& partial, std::string& message) {
+    partial.clear();
+    message = receive(socket);
+    return message.empty() ? ReceiveProgress::Closed : ReceiveProgress::Complete;
+}
+
+void Transport::setSendTimeout(int socket, std::chrono::milliseconds timeout) {
+    timeval limit{static_cast<time_t>(timeout.count() / 1000), static_cast<suseconds_t>(timeout.count() % 1000 * 1000)};
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+}
+
+// --- Communication ---
+
+void Communication::setTransport(Transport* transport) {
+    installed.store(transport, std::memory_order_release);
+}
+
+int Communication::startServer(int port) {
+    return transport().listen(port);
+}
+
+int Communication::acceptClient(int server) {
+    return transport().accept(server);
+}
+
+int Communication::startClient(const std::string& host, int port) {
+    // A blocked peer fails at once rather than after the connect timeout a
+    // real partition would cost
+    if (!reachable(host, port)) return -1;
+    int sock = transport().connect(host, port);
+    if (sock >= 0 && faultInjectionEnabled()) {
+        FaultState& state = faultState();
+        std::lock_guard<std::mutex> lock(state.mtx);
+        state.outbound[sock] = host + ":" + std::to_string(port);
+    }
     return sock;
 }
 
 bool Communication::sendMessage(int socket, const std::string& message) {
-    ssize_t sent = send(socket, message.c_str(), message.size(), 0);
-    return sent == (ssize_t)message.size();
+    if (faultsActive.load(std::memory_order_relaxed)) applySendFaults(false);
+    return transport().send(socket, message);
+}
+
+bool Communication::sendMessage(int socket, std::string&& message) {
+    if (faultsActive.load(std::memory_order_relaxed)) applySendFaults(false);
+    return transport().send(socket, std::move(message));
+}
+
+void Communication::setSendTimeout(int socket, std::chrono::milliseconds timeout) {
+    transport().setSendTimeout(socket, timeout);
 }
 
 std::string Communication::receiveMessage(int socket) {
-    char buffer[1024] = {0};
-    ssize_t valread = read(socket, buffer, 1024);
-    if (valread > 0) {
-        return std::string(buffer, valread);
+    return transport().receive(socket);
+}
+
+ReceiveProgress Communication::receiveSome(int socket, std::string& partial, std::string& message) {
+    return transport().receiveSome(socket, partial, message);
+}
+
+int Communication::startDatagram(int port) {
+    return transport().bindDatagram(port);
+}
+
+bool Communication::sendDatagram(int socket, const std::string& host, int port, const std::string& payload) {
+    // A datagram lost to injected faults still counts as sent, as it would on the wire
+    if (faultsActive.load(std::memory_order_relaxed) && (!reachable(host, port) || !applySendFaults(true))) {
+        return true;
     }
-    return std::string();
+    return transport().sendDatagram(socket, host, port, payload);
+}
+
+std::string Communication::receiveDatagram(int socket) {
+    return transport().receiveDatagram(socket);
 }
 
 void Communication::closeSocket(int socket) {
-    close(socket);
+    if (faultInjectionEnabled()) {
+        FaultState& state = faultState();
+        std::lock_guard<std::mutex> lock(state.mtx);
+        state.outbound.erase(socket);
+    }
+    transport().close(socket);
 } 
\ No newline at end of file
@@ -1,20 +1,123 @@
 #pragma once
+#include <chrono>
 #include <string>
+#include <vector>
+
+// Faults a process injects into what its transport sends, so a real cluster
+// can be tested under failure (see FailureRecoveryTest.cpp). A partition is
+// injected on both sides: each blocks the other, which tears down the
+// connections it opened to it and refuses new ones.
+struct TransportFaults {
+    std::chrono::milliseconds delay{0}; // Before each message and datagram
+    // Share of datagrams dropped. Messages travel over TCP, which resends a
+    // lost segment, so this share of them is held back a retransmission timeout.
+    double loss = 0;
+    std::vector<std::string> blocked; // "ip:port" of peers that cannot be reached
+};
+
+// How far Transport::receiveSome got
+enum class ReceiveProgress {
+    Partial,  // More of the message is still to come
+    Complete, // The whole message is in
+    Closed,   // The connection is gone, or the frame is bad
+};
+
+// Where Communication's sockets lead. Every socket it hands out is a file
+// descriptor that poll() reports readable while a message (or a connection,
+// or a datagram) is waiting, or once the peer has gone. TcpTransport uses
+// TCP and UDP; UnixTransport (UnixTransport.h), the default, adds Unix domain
+// sockets and shared memory between processes on the same host;
+// LoopbackTransport (Loopback.h) connects the nodes of an embedded cluster
+// inside one process.
+class Transport {
+public:
+    virtual ~Transport() = default;
+    virtual int listen(int port) = 0;
+    virtual int accept(int server) = 0;
+    virtual int connect(const std::string& host, int port) = 0;
+    virtual bool send(int socket, const std::string& message) = 0;
+    // A transport that can take the buffer over avoids copying it
+    virtual bool send(int socket, std::string&& message) { return send(socket, static_cast<const std::string&>(message)); }
+    virtual std::string receive(int socket) = 0;
+    // Read what has arrived of the next message without blocking, adding it
+    // to `partial`, which the caller keeps per connection between calls. Once
+    // Complete, the message is in `message` and `partial` is empty again. The
+    // default is for transports whose messages arrive whole, and must only be
+    // called once poll() reports the socket readable.
+    virtual ReceiveProgress receiveSome(int socket, std::string& partial, std::string& message);
+    // Fail a send that waits this long for the peer to make room; zero, the
+    // default, waits for good. The default sets SO_SNDTIMEO.
+    virtual void setSendTimeout(int socket, std::chrono::milliseconds timeout);
+    virtual int bindDatagram(int port) = 0;
+    virtual bool sendDatagram(int socket, const std::string& host, int port, const std::string& payload) = 0;
+    virtual std::string receiveDatagram(int socket) = 0;
+    // Wake whoever is blocked on the socket and fail its later calls, as
+    // shutdown(2) does; the socket still has to be closed
+    virtual void shutdown(int socket) = 0;
+    virtual void close(int socket) = 0;
+};
+
+class TcpTransport : public Transport {
+public:
+    int listen(int port) override;
+    int accept(int server) override;
+    int connect(const std::string& host, int port) override;
+    bool send(int socket, const std::string& message) override;
+    std::string receive(int socket) override;
+    ReceiveProgress receiveSome(int socket, std::string& partial, std::string& message) override;
+    int bindDatagram(int port) override;
+    bool sendDatagram(int socket, const std::string& host, int port, const std::string& payload) override;
+    std::string receiveDatagram(int socket) override;
+    void shutdown(int socket) override;
+    void close(int socket) override;
+};
 
 class Communication {
 public:
+    // Route every socket through `transport`, which must outlive them; null
+    // restores TCP. Install it before the first socket is opened.
+    static void setTransport(Transport* transport);
+
     // Start a server socket listening on the given port
     static int startServer(int port);
 
+    // Take the next connection to a server socket; -1 on error
+    static int acceptClient(int server);
+
     // Connect to a server at host:port
     static int startClient(const std::string& host, int port);
 
-    // Send a message over a socket
+    // Send a length-prefixed message over a socket
     static bool sendMessage(int socket, const std::string& message);
+    static bool sendMessage(int socket, std::string&& message);
 
-    // Receive a message from a socket
+    // Receive one whole message from a socket; empty on EOF or error
     static std::string receiveMessage(int socket);
 
+    // Read what has arrived of the next message without blocking; see
+    // Transport::receiveSome. For event loops that must not wait on a slow
+    // sender.
+    static ReceiveProgress receiveSome(int socket, std::string& partial, std::string& message);
+
+    // Bind a UDP socket on the given port for datagrams from any host
+    static int startDatagram(int port);
+
+    // Send one datagram to host:port; best effort, a datagram is never split
+    static bool sendDatagram(int socket, const std::string& host, int port, const std::string& payload);
+
+    // Receive one datagram; empty when none is waiting or on error
+    static std::string receiveDatagram(int socket);
+
+    // See Transport::setSendTimeout
+    static void setSendTimeout(int socket, std::chrono::milliseconds timeout);
+
     // Close a socket
     static void closeSocket(int socket);
-}; 
\ No newline at end of file
+
+    // Replace the faults in place; default TransportFaults heal. False unless
+    // the process runs with DISTDATA_FAULT_INJECTION set.
+    static bool injectFaults(const TransportFaults& faults);
+
+    // False while host:port is blocked by injected faults
+    static bool reachable(const std::string& host, int port);
+};
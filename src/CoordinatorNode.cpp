@@ -16,6 +16,14 @@
 #include "message.h"
 #include "message_serializer.h"
 #include "message_deserializer.h"
+#include "Aggregation.h"
+#include "Cursor.h"
+#include "KeyValueStore.h"
+#include "Membership.h"
+#include "PartitionMap.h"
+#include "PlanCache.h"
+#include "QueryFragments.h"
+#include "QueryPlanner.h"
 
 // Represents a key-value pair with metadata
 struct KeyValue {
@@ -372,7 +380,7 @@ struct DataRecord {
     std::chrono::system_clock::time_point timestamp;
 };
 
-class ReplicationManager {
+class PeerReplicationManager {
 private:
     std::vector<ReplicationNode> nodes;
     std::vector<DataRecord> data;
@@ -380,7 +388,7 @@ private:
     std::condition_variable cv;
 
 public:
-    ReplicationManager(const std::vector<ReplicationNode>& initial_nodes) : nodes(initial_nodes) {}
+    PeerReplicationManager(const std::vector<ReplicationNode>& initial_nodes) : nodes(initial_nodes) {}
 
     // Function to handle write operations
     void write(const std::string& key, const std::string& value) {
@@ -430,7 +438,7 @@ public:
 //         {"node2", "localhost:8081", true},
 //         {"node3", "localhost:8082", true}
 //     };
-//     ReplicationManager rm(nodes);
+//     PeerReplicationManager rm(nodes);
 //     rm.write("key1", "value1");
 //     std::cout << "Value for key1: " << rm.read("key1") << std::endl;
 //     return 0;
@@ -441,6 +449,8 @@ public:
 #include <map>
 #include <string>
 #include <algorithm>
+#include <bitset>
+#include <stdexcept>
 
 // Represents a node in the system
 struct RFNode {
@@ -448,127 +458,189 @@ struct RFNode {
     std::string address;
 };
 
-// Manages replication factor for data items
+// Manages replication factor per partition. Data items are hashed into a fixed
+// number of partitions and placement is tracked per partition as a bitset of
+// compact node indices, so the metadata size does not grow with the item count.
+// Partitions below the replication factor are kept in an incrementally
+// maintained set, so repair only touches the partitions a membership change
+// actually affected.
 class ReplicationFactorManager {
+public:
+    static constexpr size_t kMaxNodes = 1024;
+    using NodeSet = std::bitset<kMaxNodes>;
+
 private:
-    // Mapping from data item to its replicas
-    std::map<std::string, std::vector<RFNode>> dataReplicas;
-    // Mapping from node ID to its current data items
-    std::map<std::string, std::vector<std::string>> nodeData;
-    // List of available nodes
-    std::vector<RFNode> availableNodes;
+    static constexpr int32_t kNotQueued = -1;
+
+    // Nodes indexed by compact node id; ids of deregistered nodes are reused
+    std::vector<RFNode> nodes;
+    std::unordered_map<std::string, uint16_t> nodeIndex;
+    std::vector<uint16_t> freeIds;
+    // Compact ids of available nodes, used to pick replica targets
+    std::vector<uint16_t> liveNodes;
+    NodeSet liveSet;
+    // Per partition: replica set, replica count and whether it holds any data
+    std::vector<NodeSet> partitionReplicas;
+    std::vector<uint16_t> replicaCount;
+    std::vector<bool> populated;
+    // Per node: partitions it holds a replica of
+    std::vector<std::vector<uint32_t>> nodePartitions;
+    // Under-replicated partitions and each partition's slot in that list
+    std::vector<uint32_t> underReplicated;
+    std::vector<int32_t> underReplicatedPos;
     // Current replication factor
     int replicationFactor;
 
 public:
-    ReplicationFactorManager(int replicationFactor) 
-        : replicationFactor(replicationFactor) {}
+    ReplicationFactorManager(int replicationFactor, uint32_t numPartitions = 4096)
+        : partitionReplicas(numPartitions), replicaCount(numPartitions, 0),
+          populated(numPartitions, false), underReplicatedPos(numPartitions, kNotQueued),
+          replicationFactor(replicationFactor) {}
 
     // Register a new node with the system
     void registerNode(const RFNode& node) {
-        availableNodes.push_back(node);
+        if (nodeIndex.count(node.id)) return;
+        uint16_t idx;
+        if (!freeIds.empty()) {
+            idx = freeIds.back();
+            freeIds.pop_back();
+            nodes[idx] = node;
+        } else {
+            if (nodes.size() >= kMaxNodes) throw std::runtime_error("Too many nodes");
+            idx = static_cast<uint16_t>(nodes.size());
+            nodes.push_back(node);
+            nodePartitions.emplace_back();
+        }
+        nodeIndex[node.id] = idx;
+        liveNodes.push_back(idx);
+        liveSet.set(idx);
+        // New capacity may let under-replicated partitions reach the target
+        repairUnderReplicated();
     }
 
     // Deregister a node from the system
     void deregisterNode(const std::string& nodeId) {
-        // Remove the node from availableNodes
-        availableNodes.erase(std::remove_if(availableNodes.begin(), availableNodes.end(),
-            [&nodeId](const RFNode& n) { return n.id == nodeId; }),
-            availableNodes.end());
-
-        // Migrate data from this node to other nodes
-        if (nodeData.find(nodeId) != nodeData.end()) {
-            for (const auto& dataId : nodeData[nodeId]) {
-                if (dataReplicas[dataId].size() < replicationFactor) {
-                    // Find new nodes to replicate to
-                    replicateData(dataId);
-                }
-            }
-            nodeData.erase(nodeId);
+        auto it = nodeIndex.find(nodeId);
+        if (it == nodeIndex.end()) return;
+        uint16_t idx = it->second;
+        nodeIndex.erase(it);
+        liveSet.reset(idx);
+        liveNodes.erase(std::find(liveNodes.begin(), liveNodes.end(), idx));
+
+        // Only the partitions this node held lose a replica
+        for (uint32_t partition : nodePartitions[idx]) {
+            partitionReplicas[partition].reset(idx);
+            --replicaCount[partition];
+            markUnderReplicated(partition);
         }
+        nodePartitions[idx].clear();
+        freeIds.push_back(idx);
+        repairUnderReplicated();
     }
 
     // Replicate a data item to maintain the replication factor
     void replicateData(const std::string& dataId) {
-        // Determine which nodes should hold replicas
-        std::vector<RFNode> targetNodes;
-        for (const auto& node : availableNodes) {
-            if (std::find_if(dataReplicas[dataId].begin(), dataReplicas[dataId].end(),
-                [&node](const RFNode& n) { return n.id == node.id; }) == dataReplicas[dataId].end()) {
-                targetNodes.push_back(node);
-                if (targetNodes.size() == replicationFactor) {
-                    break;
-                }
-            }
+        uint32_t partition = partitionFor(dataId);
+        if (!populated[partition]) {
+            populated[partition] = true;
+            markUnderReplicated(partition);
         }
+        if (underReplicatedPos[partition] != kNotQueued) {
+            placeReplicas(partition);
+        }
+    }
+
+    // Place replicas for every under-replicated partition; cost is proportional
+    // to the number of affected partitions, not to the amount of data
+    void repairUnderReplicated() {
+        if (liveNodes.empty()) return;
+        size_t i = 0;
+        while (i < underReplicated.size()) {
+            uint32_t partition = underReplicated[i];
+            placeReplicas(partition);
+            // placeReplicas swaps a repaired partition out of slot i
+            if (i < underReplicated.size() && underReplicated[i] == partition) ++i;
+        }
+    }
+
+    uint32_t partitionFor(const std::string& dataId) const {
+        return static_cast<uint32_t>(std::hash<std::string>{}(dataId) % partitionReplicas.size());
+    }
 
-        // Update dataReplicas and nodeData maps
-        for (const auto& node : targetNodes) {
-            dataReplicas[dataId].push_back(node);
-            nodeData[node.id].push_back(dataId);
+    // Nodes currently holding a replica of the data item
+    std::vector<const RFNode*> replicasFor(const std::string& dataId) const {
+        std::vector<const RFNode*> result;
+        const NodeSet& replicas = partitionReplicas[partitionFor(dataId)];
+        for (uint16_t idx : liveNodes) {
+            if (replicas.test(idx)) result.push_back(&nodes[idx]);
         }
+        return result;
+    }
+
+    const std::vector<uint32_t>& underReplicatedPartitions() const {
+        return underReplicated;
     }
 
     // Check if replication factor is maintained for all data items
     bool isReplicationFactorMaintained() const {
-        for (const auto& entry : dataReplicas) {
-            if (entry.second.size() != replicationFactor) {
-                return false;
-            }
+        return underReplicated.empty();
+    }
+
+private:
+    void placeReplicas(uint32_t partition) {
+        NodeSet& replicas = partitionReplicas[partition];
+        // Start at a partition-dependent offset so replicas spread across nodes
+        size_t live = liveNodes.size();
+        for (size_t n = 0; n < live && replicaCount[partition] < replicationFactor; ++n) {
+            uint16_t idx = liveNodes[(partition + n) % live];
+            if (replicas.test(idx)) continue;
+            replicas.set(idx);
+            ++replicaCount[partition];
+            nodePartitions[idx].push_back(partition);
         }
-        return true;
+        if (replicaCount[partition] >= replicationFactor) {
+            clearUnderReplicated(partition);
+        }
+    }
+
+    void markUnderReplicated(uint32_t partition) {
+        if (!populated[partition] || underReplicatedPos[partition] != kNotQueued) return;
+        underReplicatedPos[partition] = static_cast<int32_t>(underReplicated.size());
+        underReplicated.push_back(partition);
+    }
+
+    void clearUnderReplicated(uint32_t partition) {
+        int32_t pos = underReplicatedPos[partition];
+        if (pos == kNotQueued) return;
+        uint32_t last = underReplicated.back();
+        underReplicated[pos] = last;
+        underReplicatedPos[last] = pos;
+        underReplicated.pop_back();
+        underReplicatedPos[partition] = kNotQueued;
     }
 };
 
-int main() {
+// --- Coordinator (see CoordinatorService.h) ---
+#include "CoordinatorService.h"
+#include "Tracing.h"
+
+// Usage: CoordinatorNode [port [peerIp:peerPort ...]]
+// With peers, the coordinators form one Raft group over the membership; each
+// keeps its log in coordinator-<port>.raft in the working directory.
+int main(int argc, char** argv) {
     std::cout << "CoordinatorNode (Registrar) started. Listening for node/client messages..." << std::endl;
-    int server_fd = Communication::startServer(8080);
+    CoordinatorConfig config;
+    config.port = argc > 1 ? std::stoi(argv[1]) : 8080;
+    for (int i = 2; i < argc; ++i) config.peers.push_back(argv[i]);
+    Tracing::start("coordinator-" + std::to_string(config.port));
+    int server_fd = startCoordinator(config);
     if (server_fd < 0) {
         std::cerr << "Failed to start server." << std::endl;
         return 1;
     }
-    while (true) {
-        struct sockaddr_in address;
-        int addrlen = sizeof(address);
-        int client_sock = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen);
-        if (client_sock < 0) {
-            perror("accept");
-            continue;
-        }
-        std::string request = Communication::receiveMessage(client_sock);
-        if (request.empty()) {
-            Communication::closeSocket(client_sock);
-            continue;
-        }
-        std::vector<uint8_t> reqBuf(request.begin(), request.end());
-        Message reqMsg = MessageDeserializer::deserialize(reqBuf);
-        switch (reqMsg.type) {
-            case MessageType::NODE_REGISTRATION:
-                handleRegistration(reqMsg);
-                break;
-            case MessageType::NODE_LIST_REQUEST:
-                handleNodeListRequest(client_sock);
-                break;
-            case MessageType::DATA_REQUEST: {
-                // Demo: respond with stub data
-                Message respMsg;
-                respMsg.type = MessageType::DATA_RESPONSE;
-                respMsg.key_value.key = reqMsg.key_value.key;
-                respMsg.key_value.value = "SampleDataFor:" + reqMsg.key_value.key;
-                std::vector<uint8_t> serialized = MessageSerializer::serialize(respMsg);
-                std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
-                Communication::sendMessage(client_sock, out);
-                break;
-            }
-            default:
-                std::cout << "Unknown message type received." << std::endl;
-                break;
-        }
-        Communication::closeSocket(client_sock);
-    }
-    Communication::closeSocket(server_fd);
+    serveCoordinator(server_fd);
     return 0;
-} 
+}
 
 // --- Data Distribution and Replication Test Suite ---
 #include <iostream>
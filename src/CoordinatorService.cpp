@@ -0,0 +1,644 @@
+#include "CoordinatorService.h"
+#include <poll.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include "Aggregation.h"
+#include "Communication.h"
+#include "Cursor.h"
+#include "KeyValueStore.h"
+#include "Membership.h"
+#include "Metrics.h"
+#include "PartitionMap.h"
+#include "PlanCache.h"
+#include "QueryFragments.h"
+#include "QueryPlanner.h"
+#include "Raft.h"
+#include "Tracing.h"
+#include "WorkStealingPool.h"
+#include "message.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+// The coordinator's state is process-wide, hence one coordinator per process.
+// None of it is destroyed: the I/O thread serving requests and the Raft
+// threads applying membership changes are detached, outlive main, and still
+// use it while static destructors would run.
+namespace {
+
+// Registered DataNodes; every change bumps the membership version (epoch).
+// Changes are only made by applying the committed Raft log (see metadata), so
+// every coordinator of the group has the same versions.
+Membership& membership = *new Membership();
+
+std::shared_ptr<const QueryPlan> planQuery(uint64_t epoch) {
+    // Tables are hash-partitioned over every DataNode, so each one gets a fragment
+    auto plan = std::make_shared<QueryPlan>();
+    plan->epoch = epoch;
+    plan->fragments = membership.snapshot().nodes;
+    return plan;
+}
+
+PlanCache& planCache = *new PlanCache(1024, planQuery);
+StatisticsCache& statisticsCache = *new StatisticsCache(fetchTableStats);
+
+// Executes every decoded request. Handlers block while DataNodes stream their
+// results, so the pool has more workers than cores to keep them busy.
+WorkStealingPool& requestPool = *new WorkStealingPool(std::max(8u, 2 * std::thread::hardware_concurrency()));
+// Connections accepted by the I/O thread whose request has not arrived yet
+std::atomic<size_t> waitingRequests{0};
+// Whole requests the I/O thread holds because the pool's queue is full
+std::atomic<size_t> deferredRequests{0};
+
+// How long a connection has from being accepted to delivering its whole
+// request; a client that trickles a frame in is dropped after this
+constexpr std::chrono::seconds kRequestReadTimeout(5);
+// How often the I/O thread retries handing deferred requests to the pool
+constexpr int kDeferredRetryMs = 1;
+
+// An accepted connection whose request is still arriving
+struct PendingRequest {
+    int sock;
+    std::string partial; // The frame's bytes so far
+    std::chrono::steady_clock::time_point deadline;
+};
+
+// Partial aggregate rows below which merging on one worker is cheaper
+constexpr size_t kParallelMergeRows = 16384;
+
+// Cost-based choices for one execution; statistics are only fetched for
+// statements whose plan depends on them
+PhysicalPlan planPhysical(const Statement& statement, const QueryPlan& plan, const std::vector<Value>& bindings) {
+    return QueryPlanner(statisticsCache.get(plan.fragments, plan.epoch)).plan(statement, bindings, plan.fragments.size());
+}
+
+void sendResponse(int client_sock, const Message& respMsg) {
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(respMsg);
+    std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    Communication::sendMessage(client_sock, std::move(out));
+}
+
+// Longest a registration or leave waits to be committed
+constexpr std::chrono::milliseconds kMetadataWriteTimeout(2000);
+// Longest a metadata read waits for this coordinator's read lease
+constexpr std::chrono::milliseconds kMetadataReadTimeout(1000);
+
+// Apply one committed membership command; runs on every coordinator in log order
+void applyMembershipCommand(const MembershipChangeData& command) {
+    if (static_cast<MembershipChange>(command.kind) == MembershipChange::Leave) {
+        uint64_t epoch = membership.leave(command.node.uuid);
+        if (epoch == 0) return;
+        planCache.invalidatePlans(epoch);
+        std::cout << "Node " << command.node.uuid << " left (membership version " << epoch << ")" << std::endl;
+        return;
+    }
+    std::string refused;
+    uint64_t epoch = membership.join(command.node, refused);
+    if (epoch == 0) {
+        std::cerr << "Refused node " << command.node.uuid << " at " << command.node.ip << ":" << command.node.port
+                  << ": " << refused << std::endl;
+        return;
+    }
+    planCache.invalidatePlans(epoch);
+    std::cout << "Registered node " << command.node.uuid << " at " << command.node.ip
+              << ":" << command.node.port << " (membership version " << epoch << ")" << std::endl;
+}
+
+// Membership and partition map replicated over the coordinator group
+RaftNode* metadata = nullptr;
+
+void proposeMembershipChange(MembershipChange kind, const NodeInfo& node) {
+    MembershipChangeData command;
+    command.kind = static_cast<uint8_t>(kind);
+    command.node = node;
+    ScopedSpan span("raft.replicate");
+    if (!metadata->propose({command}, kMetadataWriteTimeout)) {
+        std::cerr << "Membership change for node " << node.uuid << " was not committed" << std::endl;
+    }
+}
+
+void handleRegistration(const Message& reqMsg) {
+    proposeMembershipChange(MembershipChange::Join, reqMsg.node_info);
+}
+
+void handleLeave(const Message& reqMsg) {
+    proposeMembershipChange(MembershipChange::Leave, reqMsg.node_info);
+}
+
+// Full list for one-off readers such as BulkLoader and SmartClient; peers that
+// follow membership continuously WATCH it instead. A coordinator without a
+// read lease closes the connection rather than answer from a stale map.
+void handleNodeListRequest(int client_sock) {
+    if (!metadata->waitReadable(kMetadataReadTimeout)) return;
+    Message respMsg;
+    respMsg.type = MessageType::NODE_LIST_RESPONSE;
+    PartitionMap map = membership.snapshot();
+    respMsg.node_list.nodes = std::move(map.nodes);
+    respMsg.node_list.epoch = map.epoch;
+    sendResponse(client_sock, respMsg);
+}
+
+// DATA_REQUEST from a client without a partition map: forward it to the
+// owning DataNode and relay the answer. Smart clients skip this hop.
+void handleDataRequest(int client_sock, const Message& reqMsg) {
+    Message respMsg;
+    respMsg.type = MessageType::DATA_RESPONSE;
+    respMsg.key_value.key = reqMsg.key_value.key;
+    respMsg.key_value.op = reqMsg.key_value.op;
+    respMsg.key_value.status = static_cast<uint8_t>(KeyStatus::Unavailable);
+    if (!metadata->waitReadable(kMetadataReadTimeout)) {
+        sendResponse(client_sock, respMsg);
+        return;
+    }
+    PartitionMap map = membership.snapshot();
+    const NodeInfo* owner = map.ownerOf(reqMsg.key_value.key);
+    int sock = owner ? Communication::startClient(owner->ip, owner->port) : -1;
+    if (sock >= 0) {
+        ScopedSpan span("forward");
+        Message forward = reqMsg;
+        forward.key_value.epoch = map.epoch;
+        forward.trace = TraceContext(); // Sent as a child of this span
+        sendResponse(sock, forward);
+        std::string reply = Communication::receiveMessage(sock);
+        Communication::closeSocket(sock);
+        if (!reply.empty()) respMsg = MessageDeserializer::deserialize(std::vector<uint8_t>(reply.begin(), reply.end()));
+    }
+    sendResponse(client_sock, respMsg);
+}
+
+// Check the parameters of a cached statement and build the fragment every
+// DataNode runs. Pushes WHERE and projection down: each DataNode runs the
+// statement on its own partition and only matching rows of the requested
+// columns come back.
+bool prepareStatement(CachedStatement& entry, const std::vector<Value>& bindings,
+                      std::shared_ptr<const QueryPlan>& plan, Message& fragment, std::string& error) {
+    if (bindings.size() != entry.statement->paramCount) {
+        error = "Expected " + std::to_string(entry.statement->paramCount) +
+                " parameter(s), got " + std::to_string(bindings.size());
+        return false;
+    }
+    if (!metadata->waitReadable(kMetadataReadTimeout)) {
+        error = "This coordinator has no current membership";
+        return false;
+    }
+    {
+        ScopedSpan span("plan");
+        plan = planCache.planFor(entry);
+    }
+    if (plan->fragments.empty()) {
+        error = "No DataNodes registered";
+        return false;
+    }
+    fragment.type = MessageType::QUERY_FRAGMENT;
+    fragment.query.text = entry.text;
+    for (const auto& value : bindings) fragment.query.params.push_back(toLiteralData(value));
+    return true;
+}
+
+// Merge the DataNodes' partial aggregate rows. Large GROUP BY results are
+// routed by group key to one merger per pool worker, so decoding and merging
+// the states runs on every core; the disjoint groups are spliced together at
+// the end, which keeps the result ordered by group key.
+ResultSet mergeAggregates(const Statement& statement, const std::vector<std::vector<std::string>>& rows) {
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t parts = rows.size() < kParallelMergeRows || statement.groupByCount == 0 ? 1 : cores;
+    std::vector<AggregateMerger> mergers;
+    mergers.reserve(parts);
+    for (size_t p = 0; p < parts; ++p) mergers.emplace_back(statement);
+    if (parts == 1) {
+        for (const auto& row : rows) mergers[0].add(row);
+        return mergers[0].finish();
+    }
+    std::vector<std::vector<uint32_t>> routed(parts);
+    for (uint32_t i = 0; i < rows.size(); ++i) {
+        size_t hash = 0;
+        // Malformed rows are left for add() to reject
+        for (uint32_t g = 0; g < statement.groupByCount && g < rows[i].size(); ++g) {
+            hash = hash * 31 + std::hash<std::string>{}(rows[i][g]);
+        }
+        routed[hash % parts].push_back(i);
+    }
+    TaskGroup group(requestPool);
+    for (size_t p = 0; p < parts; ++p) {
+        group.run([&, p]() {
+            for (uint32_t i : routed[p]) mergers[p].add(rows[i]);
+        });
+    }
+    group.wait();
+    for (size_t p = 1; p < parts; ++p) mergers[0].absorb(mergers[p]);
+    return mergers[0].finish();
+}
+
+// Run a prepared fragment to completion, merging aggregate partials
+bool collectStatement(CachedStatement& entry, const QueryPlan& plan, const Message& fragment,
+                      const std::vector<Value>& bindings, ResultData& result, std::string& error) {
+    if (entry.statement->type == StatementType::CreateIndex) {
+        // Every DataNode indexes its own partition; report the total
+        ResultData perNode;
+        bool ok = runFragments(plan.fragments, fragment, perNode, error);
+        // Even a partial failure may have changed what some nodes report
+        statisticsCache.invalidate();
+        if (!ok) return false;
+        uint64_t rows = 0;
+        for (const auto& row : perNode.rows) rows += row.empty() ? 0 : std::stoull(row[0]);
+        result.columns = {"indexed_rows"};
+        result.rows = {{std::to_string(rows)}};
+        return true;
+    }
+    {
+        ScopedSpan span("fragments");
+        if (entry.statement->join) {
+            PhysicalPlan physical = planPhysical(*entry.statement, plan, bindings);
+            if (!runJoin(plan.fragments, fragment, physical.joinStrategy, physical.buildSide, result, error)) return false;
+        } else if (!runFragments(plan.fragments, fragment, result, error)) {
+            return false;
+        }
+    }
+    if (!entry.statement->hasAggregates) return true;
+    // Second phase: fold each node's per-group partial states together
+    ScopedSpan span("merge");
+    try {
+        ResultSet merged = mergeAggregates(*entry.statement, result.rows);
+        result.columns = std::move(merged.columns);
+        result.rows = std::move(merged.rows);
+    } catch (const std::exception& e) {
+        error = e.what();
+        return false;
+    }
+    return true;
+}
+
+// Run a cached statement with its parameters bound
+void executeCachedStatement(int client_sock, CachedStatement& entry, const std::vector<Value>& bindings) {
+    Message respMsg;
+    respMsg.type = MessageType::QUERY_RESPONSE;
+    std::shared_ptr<const QueryPlan> plan;
+    Message fragment;
+    if (prepareStatement(entry, bindings, plan, fragment, respMsg.query.error)) {
+        collectStatement(entry, *plan, fragment, bindings, respMsg.result, respMsg.query.error);
+    }
+    if (!respMsg.query.error.empty()) respMsg.result = ResultData();
+    sendResponse(client_sock, respMsg);
+}
+
+void handleQueryRequest(int client_sock, const Message& reqMsg) {
+    QueryArena arena;
+    std::vector<Value> bindings;
+    try {
+        std::shared_ptr<CachedStatement> entry;
+        {
+            ScopedSpan span("parse");
+            entry = planCache.lookup(reqMsg.query.text, arena, bindings);
+        }
+        executeCachedStatement(client_sock, *entry, bindings);
+    } catch (const std::exception& e) {
+        Message respMsg;
+        respMsg.type = MessageType::QUERY_RESPONSE;
+        respMsg.query.error = e.what();
+        sendResponse(client_sock, respMsg);
+    }
+}
+
+// Describe the plan a query would run with, one step per row
+void handleExplainRequest(int client_sock, const Message& reqMsg) {
+    Message respMsg;
+    respMsg.type = MessageType::QUERY_RESPONSE;
+    QueryArena arena;
+    std::vector<Value> bindings;
+    try {
+        std::shared_ptr<CachedStatement> entry = planCache.lookup(reqMsg.query.text, arena, bindings);
+        if (entry->statement->type != StatementType::Select) throw std::invalid_argument("Only SELECT can be explained");
+        std::shared_ptr<const QueryPlan> plan = planCache.planFor(*entry);
+        PhysicalPlan physical = planPhysical(*entry->statement, *plan, bindings);
+        respMsg.result.columns = {"plan"};
+        for (auto& line : physical.describe(*entry->statement)) respMsg.result.rows.push_back({std::move(line)});
+    } catch (const std::exception& e) {
+        respMsg.query.error = e.what();
+    }
+    sendResponse(client_sock, respMsg);
+}
+
+void handlePrepareRequest(int client_sock, const Message& reqMsg) {
+    Message respMsg;
+    respMsg.type = MessageType::PREPARE_RESPONSE;
+    try {
+        std::shared_ptr<CachedStatement> entry = planCache.prepare(reqMsg.query.text);
+        respMsg.query.statement_id = entry->id;
+        respMsg.query.param_count = entry->statement->paramCount;
+    } catch (const std::exception& e) {
+        respMsg.query.error = e.what();
+    }
+    sendResponse(client_sock, respMsg);
+}
+
+void handleExecuteRequest(int client_sock, const Message& reqMsg) {
+    std::shared_ptr<CachedStatement> entry = planCache.find(reqMsg.query.statement_id);
+    if (!entry) {
+        Message respMsg;
+        respMsg.type = MessageType::QUERY_RESPONSE;
+        respMsg.query.error = "Unknown statement id " + std::to_string(reqMsg.query.statement_id) + "; prepare it again";
+        sendResponse(client_sock, respMsg);
+        return;
+    }
+    std::vector<Value> bindings;
+    for (const auto& param : reqMsg.query.params) {
+        Value value;
+        value.type = static_cast<ValueType>(param.type);
+        value.intValue = param.int_value;
+        value.doubleValue = param.double_value;
+        value.text = param.text;
+        bindings.push_back(value);
+    }
+    executeCachedStatement(client_sock, *entry, bindings);
+}
+
+CursorManager& cursors = *new CursorManager();
+
+// Send up to `credits` pages of a cursor; the cursor is dropped after its last
+// page or an error
+void sendCursorPages(int client_sock, uint64_t id, Cursor& cursor, uint32_t credits) {
+    // Hands the cursor back on every way out: released for the next fetch,
+    // or closed after the last page, an error or an exception
+    struct Lease {
+        uint64_t id;
+        bool keep = false;
+        ~Lease() {
+            if (keep) cursors.release(id);
+            else cursors.close(id);
+        }
+    } lease{id};
+    credits = std::clamp<uint32_t>(credits, 1, CursorManager::kMaxCredits);
+    for (uint32_t i = 0; i < credits; ++i) {
+        Message page;
+        page.type = MessageType::CURSOR_BATCH;
+        page.cursor.id = id;
+        bool ok;
+        try {
+            ok = cursor.fetch(page.result, page.query.error);
+        } catch (const std::exception& e) {
+            ok = false;
+            page.query.error = e.what();
+        }
+        if (!ok) page.result = ResultData();
+        sendResponse(client_sock, page);
+        if (!ok || page.result.done) return;
+    }
+    lease.keep = true;
+}
+
+void sendCursorError(int client_sock, uint64_t id, const std::string& error) {
+    Message page;
+    page.type = MessageType::CURSOR_BATCH;
+    page.cursor.id = id;
+    page.query.error = error;
+    sendResponse(client_sock, page);
+}
+
+// Open a cursor over an ad hoc query. Plain selects and joins stream from the
+// DataNodes as pages are fetched; aggregates and CREATE INDEX complete first.
+void handleOpenCursor(int client_sock, const Message& reqMsg) {
+    QueryArena arena;
+    std::vector<Value> bindings;
+    std::string error;
+    std::shared_ptr<Cursor> cursor;
+    size_t pageRows = std::clamp<size_t>(reqMsg.cursor.batch_rows ? reqMsg.cursor.batch_rows : kFragmentBatchRows,
+                                         1, CursorManager::kMaxPageRows);
+    try {
+        std::shared_ptr<CachedStatement> entry = planCache.lookup(reqMsg.query.text, arena, bindings);
+        std::shared_ptr<const QueryPlan> plan;
+        Message fragment;
+        if (prepareStatement(*entry, bindings, plan, fragment, error)) {
+            const Statement& statement = *entry->statement;
+            if (statement.hasAggregates || statement.type != StatementType::Select) {
+                ResultData result;
+                if (collectStatement(*entry, *plan, fragment, bindings, result, error)) {
+                    cursor = std::make_shared<Cursor>(std::move(result), pageRows);
+                }
+            } else if (statement.join) {
+                PhysicalPlan physical = planPhysical(statement, *plan, bindings);
+                Message join;
+                if (prepareJoin(plan->fragments, fragment, physical.joinStrategy, physical.buildSide, join, error)) {
+                    auto stream = std::make_unique<FragmentStream>(plan->fragments, join, prepareJoinNode);
+                    cursor = std::make_shared<Cursor>(std::move(stream), pageRows);
+                }
+            } else {
+                auto stream = std::make_unique<FragmentStream>(plan->fragments, fragment);
+                cursor = std::make_shared<Cursor>(std::move(stream), pageRows);
+            }
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    if (!cursor) {
+        sendCursorError(client_sock, 0, error);
+        return;
+    }
+    uint64_t id = cursors.open(cursor);
+    sendCursorPages(client_sock, id, *cursor, reqMsg.cursor.credits);
+}
+
+void handleFetchCursor(int client_sock, const Message& reqMsg) {
+    uint64_t id = reqMsg.cursor.id;
+    std::shared_ptr<Cursor> cursor = cursors.acquire(id);
+    if (!cursor) {
+        sendCursorError(client_sock, id, "Unknown cursor " + std::to_string(id) + "; it may have expired");
+        return;
+    }
+    sendCursorPages(client_sock, id, *cursor, reqMsg.cursor.credits);
+}
+
+// Pool side of a request: dispatch it and close its connection, unless it
+// became a WATCH stream
+void handleRequest(int client_sock, const Message& reqMsg, std::chrono::system_clock::time_point received) {
+    // Raft traffic between coordinators never starts a trace of its own
+    std::optional<ScopedSpan> span;
+    bool raft = reqMsg.type >= MessageType::RAFT_APPEND && reqMsg.type <= MessageType::RAFT_PROPOSE_RESPONSE;
+    if (!raft || reqMsg.trace.trace_id) {
+        span.emplace(messageTypeName(static_cast<size_t>(reqMsg.type)), reqMsg.trace, received);
+        Tracing::record("queue", received, std::chrono::system_clock::now());
+    }
+    ScopedLatency timer(Metrics::messageLatency(reqMsg.type));
+    try {
+        switch (reqMsg.type) {
+            case MessageType::NODE_REGISTRATION:
+                handleRegistration(reqMsg);
+                break;
+            case MessageType::NODE_LEAVE:
+                handleLeave(reqMsg);
+                break;
+            case MessageType::NODE_LIST_REQUEST:
+                handleNodeListRequest(client_sock);
+                break;
+            case MessageType::WATCH:
+                // The connection stays open; membership pushes changes on it from now on
+                membership.watch(client_sock, reqMsg.membership.version);
+                return;
+            case MessageType::QUERY_REQUEST:
+                handleQueryRequest(client_sock, reqMsg);
+                break;
+            case MessageType::PREPARE_REQUEST:
+                handlePrepareRequest(client_sock, reqMsg);
+                break;
+            case MessageType::EXECUTE_REQUEST:
+                handleExecuteRequest(client_sock, reqMsg);
+                break;
+            case MessageType::EXPLAIN_REQUEST:
+                handleExplainRequest(client_sock, reqMsg);
+                break;
+            case MessageType::OPEN_CURSOR:
+                handleOpenCursor(client_sock, reqMsg);
+                break;
+            case MessageType::FETCH_CURSOR:
+                handleFetchCursor(client_sock, reqMsg);
+                break;
+            case MessageType::CLOSE_CURSOR:
+                cursors.close(reqMsg.cursor.id);
+                break;
+            case MessageType::DATA_REQUEST:
+                handleDataRequest(client_sock, reqMsg);
+                break;
+            case MessageType::RAFT_APPEND:
+                // The leader keeps this connection for all its appends; it
+                // gets its own thread rather than a pool worker for good
+                std::thread([client_sock, reqMsg]() {
+                    metadata->serveAppends(client_sock, reqMsg);
+                    Communication::closeSocket(client_sock);
+                }).detach();
+                return;
+            case MessageType::RAFT_VOTE:
+                sendResponse(client_sock, metadata->handleVote(reqMsg));
+                break;
+            case MessageType::RAFT_PROPOSE:
+                sendResponse(client_sock, metadata->handlePropose(reqMsg));
+                break;
+            case MessageType::STATS_REQUEST: {
+                Message respMsg;
+                respMsg.type = MessageType::STATS_RESPONSE;
+                respMsg.node_stats = Metrics::snapshot();
+                sendResponse(client_sock, respMsg);
+                break;
+            }
+            case MessageType::FAULT_INJECTION: {
+                TransportFaults faults;
+                faults.delay = std::chrono::milliseconds(reqMsg.faults.delay_ms);
+                faults.loss = reqMsg.faults.loss_ppm / 1e6;
+                faults.blocked = reqMsg.faults.blocked;
+                // Left unanswered when this process does not take faults
+                if (Communication::injectFaults(faults)) sendResponse(client_sock, reqMsg);
+                break;
+            }
+            default:
+                std::cout << "Unknown message type received." << std::endl;
+                break;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Request failed: " << e.what() << std::endl;
+    }
+    Communication::closeSocket(client_sock);
+}
+
+} // namespace
+
+int startCoordinator(const CoordinatorConfig& config) {
+    RaftConfig raftConfig;
+    raftConfig.id = "127.0.0.1:" + std::to_string(config.port);
+    raftConfig.peers = config.peers;
+    raftConfig.logPath =
+        config.logPath.empty() ? "coordinator-" + std::to_string(config.port) + ".raft" : config.logPath;
+    metadata = new RaftNode(raftConfig, applyMembershipCommand);
+    int server_fd = Communication::startServer(config.port);
+    if (server_fd < 0) return -1;
+    metadata->start();
+    Metrics::gauge("pool.queued", [] { return static_cast<int64_t>(requestPool.queued()); });
+    Metrics::gauge("io.waiting_requests", [] { return static_cast<int64_t>(waitingRequests.load()); });
+    Metrics::gauge("io.deferred_requests", [] { return static_cast<int64_t>(deferredRequests.load()); });
+    // Abandoned cursors would otherwise hold their DataNode scans open forever
+    std::thread([]() {
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            size_t dropped = cursors.sweep();
+            if (dropped) std::cout << "Dropped " << dropped << " idle cursor(s)" << std::endl;
+        }
+    }).detach();
+    return server_fd;
+}
+
+void serveCoordinator(int server_fd) {
+    // This thread only accepts connections and reads requests as they arrive,
+    // without blocking on any one client: each connection's frame is
+    // collected as its bytes come in, and only whole requests go to the pool.
+    // Everything else runs on the pool, so a long merge never delays the next
+    // client either. Handing a request over never waits: while the pool's
+    // queue is full, requests are held here in order and no new connection
+    // is accepted, so the backlog stays in the kernel's listen queue.
+    std::vector<PendingRequest> waiting;
+    std::deque<Task> deferred;
+    while (true) {
+        while (!deferred.empty() && requestPool.trySubmit(deferred.front())) deferred.pop_front();
+        deferredRequests = deferred.size();
+        auto now = std::chrono::steady_clock::now();
+        int timeoutMs = deferred.empty() ? -1 : kDeferredRetryMs;
+        std::vector<pollfd> fds{{server_fd, static_cast<short>(deferred.empty() ? POLLIN : 0), 0}};
+        for (const PendingRequest& pending : waiting) {
+            fds.push_back({pending.sock, POLLIN, 0});
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(pending.deadline - now).count();
+            int leftMs = static_cast<int>(std::max<long long>(0, left));
+            if (timeoutMs < 0 || leftMs < timeoutMs) timeoutMs = leftMs;
+        }
+        if (poll(fds.data(), fds.size(), timeoutMs) < 0) {
+            if (errno != EINTR) perror("poll");
+            continue;
+        }
+        now = std::chrono::steady_clock::now();
+        std::vector<PendingRequest> stillWaiting;
+        for (size_t i = 1; i < fds.size(); ++i) {
+            PendingRequest& pending = waiting[i - 1];
+            int client_sock = pending.sock;
+            std::string request;
+            ReceiveProgress progress = fds[i].revents == 0
+                                           ? ReceiveProgress::Partial
+                                           : Communication::receiveSome(client_sock, pending.partial, request);
+            if (progress == ReceiveProgress::Partial) {
+                if (now < pending.deadline) {
+                    stillWaiting.push_back(std::move(pending));
+                } else {
+                    Communication::closeSocket(client_sock);
+                }
+                continue;
+            }
+            if (progress == ReceiveProgress::Closed) {
+                Communication::closeSocket(client_sock);
+                continue;
+            }
+            try {
+                std::vector<uint8_t> reqBuf(request.begin(), request.end());
+                Message reqMsg = MessageDeserializer::deserialize(reqBuf);
+                auto received = std::chrono::system_clock::now();
+                Task task = [client_sock, reqMsg = std::move(reqMsg), received]() {
+                    handleRequest(client_sock, reqMsg, received);
+                };
+                if (!deferred.empty() || !requestPool.trySubmit(task)) deferred.push_back(std::move(task));
+            } catch (const std::exception& e) {
+                std::cerr << "Malformed request: " << e.what() << std::endl;
+                Communication::closeSocket(client_sock);
+            }
+        }
+        waiting.swap(stillWaiting);
+        waitingRequests = waiting.size();
+        if (fds[0].revents & POLLIN) {
+            int client_sock = Communication::acceptClient(server_fd);
+            if (client_sock < 0) {
+                perror("accept");
+                continue;
+            }
+            waiting.push_back({client_sock, std::string(), now + kRequestReadTimeout});
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// The coordinator: registrar of the DataNodes, keeper of the membership and
+// partition map (replicated over the coordinator group with Raft), and
+// planner and merger of queries. CoordinatorNode runs one as a process;
+// EmbeddedCluster runs one inside another program. Its state is process-wide,
+// so a process runs at most one.
+
+struct CoordinatorConfig {
+    int port = 8080;
+    std::vector<std::string> peers; // The other coordinators of the group, "ip:port"
+    std::string logPath;            // Raft log; coordinator-<port>.raft when empty
+};
+
+// Listen on the port and start Raft and the coordinator's background threads.
+// Returns the listening socket for serveCoordinator, or -1.
+int startCoordinator(const CoordinatorConfig& config);
+
+// Accept connections and read requests on this thread, running each request
+// on the coordinator's pool. Never returns.
+void serveCoordinator(int server_fd);
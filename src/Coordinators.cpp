@@ -0,0 +1,34 @@
+#include "Coordinators.h"
+#include <atomic>
+#include <cstdlib>
+#include <sstream>
+#include "Communication.h"
+
+std::vector<std::pair<std::string, int>> coordinatorAddresses() {
+    std::vector<std::pair<std::string, int>> addresses;
+    const char* configured = std::getenv("DISTDATA_COORDINATORS");
+    std::stringstream list(configured ? configured : "");
+    std::string address;
+    while (std::getline(list, address, ',')) {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) continue;
+        addresses.emplace_back(address.substr(0, colon), std::stoi(address.substr(colon + 1)));
+    }
+    if (addresses.empty()) addresses.emplace_back("127.0.0.1", 8080);
+    return addresses;
+}
+
+int connectToCoordinator() {
+    static const std::vector<std::pair<std::string, int>> addresses = coordinatorAddresses();
+    static std::atomic<size_t> preferred{0};
+    size_t first = preferred.load();
+    for (size_t i = 0; i < addresses.size(); ++i) {
+        size_t index = (first + i) % addresses.size();
+        int sock = Communication::startClient(addresses[index].first, addresses[index].second);
+        if (sock >= 0) {
+            preferred.store(index);
+            return sock;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+// The coordinator group from DISTDATA_COORDINATORS ("ip:port,ip:port,..."), or
+// the single coordinator at 127.0.0.1:8080 when it is unset. Any member of the
+// group takes any request.
+std::vector<std::pair<std::string, int>> coordinatorAddresses();
+
+// Connect to a coordinator of the group, starting with the one that answered
+// last and moving on while they are down; -1 when none answers
+int connectToCoordinator();
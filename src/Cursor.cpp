@@ -0,0 +1,91 @@
+#include "Cursor.h"
+#include <algorithm>
+#include <iterator>
+
+Cursor::Cursor(std::unique_ptr<FragmentStream> stream, size_t pageRows)
+    : stream(std::move(stream)), pageRows(std::max<size_t>(pageRows, 1)) {}
+
+Cursor::Cursor(ResultData result, size_t pageRows)
+    : pageRows(std::max<size_t>(pageRows, 1)), columns(std::move(result.columns)), pending(std::move(result.rows)) {}
+
+bool Cursor::fetch(ResultData& page, std::string& error) {
+    // Top up to a full page, first dropping the rows already sent
+    while (stream && pending.size() - offset < pageRows) {
+        if (offset > 0) {
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(offset));
+            offset = 0;
+        }
+        Rows batch;
+        if (!stream->next(batch, error)) {
+            if (!error.empty()) return false;
+            columns = stream->columns();
+            stream.reset();
+            break;
+        }
+        if (pending.empty()) pending = std::move(batch);
+        else std::move(batch.begin(), batch.end(), std::back_inserter(pending));
+    }
+    if (stream && columns.empty()) columns = stream->columns();
+
+    page.columns.clear();
+    if (!sentColumns) page.columns = columns;
+    sentColumns = true;
+    size_t end = std::min(pending.size(), offset + pageRows);
+    page.rows.assign(std::make_move_iterator(pending.begin() + static_cast<std::ptrdiff_t>(offset)),
+                     std::make_move_iterator(pending.begin() + static_cast<std::ptrdiff_t>(end)));
+    offset = end;
+    page.done = !stream && offset == pending.size();
+    return true;
+}
+
+uint64_t CursorManager::open(std::shared_ptr<Cursor> cursor) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint64_t id = nextId++;
+    cursors[id] = Entry{std::move(cursor), std::chrono::steady_clock::now(), true};
+    return id;
+}
+
+std::shared_ptr<Cursor> CursorManager::acquire(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = cursors.find(id);
+    if (it == cursors.end() || it->second.busy) return nullptr;
+    it->second.busy = true;
+    return it->second.cursor;
+}
+
+void CursorManager::release(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = cursors.find(id);
+    if (it == cursors.end()) return;
+    it->second.busy = false;
+    it->second.lastUsed = std::chrono::steady_clock::now();
+}
+
+void CursorManager::close(uint64_t id) {
+    std::shared_ptr<Cursor> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = cursors.find(id);
+        if (it == cursors.end()) return;
+        dropped = std::move(it->second.cursor);
+        cursors.erase(it);
+    }
+    // Closing the DataNode connections happens outside the lock
+}
+
+size_t CursorManager::sweep() {
+    std::vector<std::shared_ptr<Cursor>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = cursors.begin(); it != cursors.end();) {
+            if (!it->second.busy && now - it->second.lastUsed > kIdleTimeout) {
+                dropped.push_back(std::move(it->second.cursor));
+                it = cursors.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return dropped.size();
+}
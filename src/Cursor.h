@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "QueryFragments.h"
+#include "message.h"
+
+// A query result paged out to a client. Streamed results pull DataNode
+// batches only as pages are fetched, so a cursor holds at most one page plus
+// one batch whatever the result size; aggregate results are already reduced to
+// one row per group and are paged from memory.
+class Cursor {
+public:
+    Cursor(std::unique_ptr<FragmentStream> stream, size_t pageRows);
+    Cursor(ResultData result, size_t pageRows);
+
+    // Move the next page into `page`. Column names travel with the first page
+    // only; the last page has done set. Returns false with `error` set when a
+    // DataNode fails.
+    bool fetch(ResultData& page, std::string& error);
+
+private:
+    std::unique_ptr<FragmentStream> stream; // Null once drained
+    size_t pageRows;
+    std::vector<std::string> columns;
+    bool sentColumns = false;
+    Rows pending;
+    size_t offset = 0; // Rows of `pending` already sent
+};
+
+// Open cursors of the coordinator by id. A cursor is used by one request at a
+// time; cursors nobody fetched from for kIdleTimeout are dropped by sweep(),
+// which releases their DataNode connections.
+class CursorManager {
+public:
+    static constexpr std::chrono::seconds kIdleTimeout{60};
+    // Upper bounds on what a client may ask for per page and per request
+    static constexpr size_t kMaxPageRows = 8192;
+    static constexpr uint32_t kMaxCredits = 64;
+
+    // The new cursor starts acquired by the caller
+    uint64_t open(std::shared_ptr<Cursor> cursor);
+    // Exclusive use of a cursor until release(); null when the id is unknown,
+    // expired or already in use
+    std::shared_ptr<Cursor> acquire(uint64_t id);
+    void release(uint64_t id);
+    void close(uint64_t id);
+    // Drop idle cursors; returns how many were dropped
+    size_t sweep();
+
+private:
+    struct Entry {
+        std::shared_ptr<Cursor> cursor;
+        std::chrono::steady_clock::time_point lastUsed;
+        bool busy = false;
+    };
+
+    std::mutex mtx;
+    uint64_t nextId = 1;
+    std::unordered_map<uint64_t, Entry> cursors;
+};
@@ -0,0 +1,406 @@
+#include "DataNodeService.h"
+#include <poll.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include "BulkLoad.h"
+#include "Communication.h"
+#include "Coordinators.h"
+#include "Membership.h"
+#include "Metrics.h"
+#include "QueryFragments.h"
+#include "Tracing.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+namespace {
+
+// Simple UUID generator for demo
+std::string generateUUID() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<> dis(0, 15);
+    std::stringstream ss;
+    for (int i = 0; i < 32; ++i) {
+        ss << std::hex << dis(gen);
+    }
+    return ss.str();
+}
+
+// Load this node's partition of the sample tables from the working directory;
+// false when there were none
+bool loadSampleTables(TableCatalog& catalog, size_t partitionIndex, size_t partitionCount) {
+    bool loaded = false;
+    for (const std::string name : {"customers", "orders"}) {
+        std::string path = name + ".txt";
+        if (!std::ifstream(path)) continue;
+        try {
+            auto table = std::make_shared<ColumnTable>(
+                ColumnTable::loadDelimited(name, path, ',', partitionIndex, partitionCount));
+            std::cout << "Loaded " << table->rowCount() << " rows of " << name << std::endl;
+            catalog.put(table);
+            loaded = true;
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to load " << path << ": " << e.what() << std::endl;
+        }
+    }
+    return loaded;
+}
+
+// Send a one-way message (registration, leave) to the CoordinatorNode
+bool notifyCoordinator(const Message& msg) {
+    int sock = connectToCoordinator();
+    if (sock < 0) return false;
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(msg);
+    std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    bool sent = Communication::sendMessage(sock, std::move(out));
+    Communication::closeSocket(sock);
+    return sent;
+}
+
+bool sendTo(int socket, const Message& message) {
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(message);
+    std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    return Communication::sendMessage(socket, std::move(out));
+}
+
+bool receiveFrom(int socket, Message& message) {
+    std::string received = Communication::receiveMessage(socket);
+    if (received.empty()) return false;
+    try {
+        message = MessageDeserializer::deserialize(std::vector<uint8_t>(received.begin(), received.end()));
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// A flag per PartitionMap partition; `partitions` must be in range
+std::vector<bool> partitionMask(const std::vector<uint32_t>& partitions) {
+    std::vector<bool> mask(PartitionMap::kPartitions);
+    for (uint32_t partition : partitions) mask[partition] = true;
+    return mask;
+}
+
+// Gossip datagrams go to the UDP port with the peer's TCP port number
+class UdpGossipTransport : public GossipTransport {
+public:
+    explicit UdpGossipTransport(int socket) : socket(socket) {}
+
+    void send(const std::string& address, const Message& message) override {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) return;
+        std::vector<uint8_t> serialized = MessageSerializer::serialize(message);
+        Communication::sendDatagram(socket, address.substr(0, colon), std::stoi(address.substr(colon + 1)),
+                                    std::string(serialized.begin(), serialized.end()));
+    }
+
+private:
+    int socket;
+};
+
+// Receive gossip datagrams and run protocol rounds
+void runGossip(int socket, SwimNode& swim, std::chrono::milliseconds period) {
+    pollfd readable{socket, POLLIN, 0};
+    int timeoutMs = static_cast<int>(std::max<long long>(1, period.count() / 4));
+    while (true) {
+        if (poll(&readable, 1, timeoutMs) > 0) {
+            while (true) {
+                std::string datagram = Communication::receiveDatagram(socket);
+                if (datagram.empty()) break;
+                try {
+                    Message msg = MessageDeserializer::deserialize(std::vector<uint8_t>(datagram.begin(), datagram.end()));
+                    if (msg.type == MessageType::GOSSIP) swim.receive(msg, GossipClock::now());
+                } catch (const std::exception&) {
+                    // Truncated or foreign datagram
+                }
+            }
+        }
+        swim.tick(GossipClock::now());
+    }
+}
+
+// Keep the partition map current: WATCH membership from the last version
+// seen and apply the pushed changes. When the coordinator goes away, register
+// again once it is back and resume from the same version. Gossip monitors the
+// members of each new map, and a node that finds itself removed from the map
+// (its peers took it for dead) registers again, unless it is leaving.
+void followMembership(Message registration, LocalPartition& partition, SwimNode& swim,
+                      const std::atomic<bool>& leaving) {
+    // The first maps may predate our own registration being committed
+    constexpr std::chrono::seconds kRegistrationGrace(1);
+    auto registered = std::chrono::steady_clock::now();
+    PartitionMap map;
+    Message watch;
+    watch.type = MessageType::WATCH;
+    while (true) {
+        int sock = connectToCoordinator();
+        watch.membership.version = map.epoch;
+        std::vector<uint8_t> serialized = MessageSerializer::serialize(watch);
+        if (sock >= 0 && Communication::sendMessage(sock, std::string(serialized.begin(), serialized.end()))) {
+            while (true) {
+                std::string pushed = Communication::receiveMessage(sock);
+                if (pushed.empty()) break;
+                Message update;
+                try {
+                    update = MessageDeserializer::deserialize(std::vector<uint8_t>(pushed.begin(), pushed.end()));
+                } catch (const std::exception& e) {
+                    std::cerr << "Malformed membership update: " << e.what() << std::endl;
+                    break;
+                }
+                if (update.type != MessageType::MEMBERSHIP_UPDATE) break;
+                if (!applyMembershipUpdate(map, update.membership)) {
+                    // A gap in the versions; start over from a full list
+                    map = PartitionMap();
+                    break;
+                }
+                partition.update(map);
+                swim.setMembers(map.nodes, GossipClock::now());
+                std::cout << "Membership version " << map.epoch << ": " << map.nodes.size() << " node(s)" << std::endl;
+                bool listed = std::any_of(map.nodes.begin(), map.nodes.end(), [&](const NodeInfo& node) {
+                    return node.uuid == registration.node_info.uuid;
+                });
+                if (!listed && !leaving && std::chrono::steady_clock::now() - registered > kRegistrationGrace) {
+                    notifyCoordinator(registration);
+                    registered = std::chrono::steady_clock::now();
+                }
+            }
+        }
+        if (sock >= 0) Communication::closeSocket(sock);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (!leaving) notifyCoordinator(registration);
+        registered = std::chrono::steady_clock::now();
+    }
+}
+
+} // namespace
+
+DataNodeService::DataNodeService(const DataNodeConfig& config)
+    : config(config),
+      self{generateUUID(), config.ip, config.port},
+      partition(self.uuid),
+      transactions(store, partition, self) {}
+
+bool DataNodeService::start() {
+    // Registered with the partition, so the coordinator can refuse a node
+    // whose rows another node already holds
+    if (loadSampleTables(catalog, config.partitionIndex, config.partitionCount)) {
+        self.partition_index = static_cast<uint32_t>(config.partitionIndex);
+        self.partition_count = static_cast<uint32_t>(config.partitionCount);
+    }
+    server_fd = Communication::startServer(config.port);
+    if (server_fd < 0) {
+        std::cerr << "Failed to start server." << std::endl;
+        return false;
+    }
+
+    // Register with CoordinatorNode (Registrar)
+    registration.type = MessageType::NODE_REGISTRATION;
+    registration.node_info = self;
+    if (!notifyCoordinator(registration)) {
+        std::cerr << "Failed to connect to CoordinatorNode for registration." << std::endl;
+        return false;
+    }
+
+    // Failure detection among the DataNodes; a peer this node finds dead is
+    // reported to the coordinator, which removes it from membership
+    int gossip_fd = Communication::startDatagram(config.port);
+    if (gossip_fd < 0) {
+        std::cerr << "Failed to start gossip." << std::endl;
+        return false;
+    }
+    SwimConfig swimConfig;
+    gossipTransport = std::make_unique<UdpGossipTransport>(gossip_fd);
+    swim = std::make_unique<SwimNode>(self.uuid, SwimNode::addressOf(self), swimConfig, *gossipTransport);
+    swim->onDeath([](const std::string& id) {
+        std::cout << "Gossip: node " << id << " is dead" << std::endl;
+        Message leave;
+        leave.type = MessageType::NODE_LEAVE;
+        leave.node_info.uuid = id;
+        notifyCoordinator(leave);
+    });
+    std::thread(runGossip, gossip_fd, std::ref(*swim), swimConfig.period).detach();
+    std::thread(followMembership, registration, std::ref(partition), std::ref(*swim), std::cref(leaving)).detach();
+    std::thread(&DataNodeService::pullPartitions, this).detach();
+    return true;
+}
+
+void DataNodeService::serve() {
+    // Serve query fragments and key-value requests; each connection runs on its own thread
+    while (true) {
+        int client_sock = Communication::acceptClient(server_fd);
+        if (client_sock < 0) {
+            perror("accept");
+            continue;
+        }
+        std::thread(&DataNodeService::handleConnection, this, client_sock).detach();
+    }
+}
+
+bool DataNodeService::leave() {
+    leaving = true;
+    Message leave = registration;
+    leave.type = MessageType::NODE_LEAVE;
+    if (!notifyCoordinator(leave)) return false;
+    // The new owners take the pairs once they see the change, and each
+    // handoff drops what it took
+    auto deadline = std::chrono::steady_clock::now() + kHandoffTimeout;
+    while (store.size() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return true;
+}
+
+void DataNodeService::serveHandoff(int socket, const Message& request) {
+    const HandoffData& handoff = request.handoff;
+    Message reply;
+    reply.type = MessageType::HANDOFF_RESPONSE;
+    reply.handoff.epoch = handoff.epoch;
+    reply.handoff.partitions = handoff.partitions;
+    // Not ready while this node still takes writes for them under an older
+    // map, or a transaction holds one of their keys
+    std::vector<bool> mask;
+    if (partition.disowns(handoff.epoch, handoff.partitions)) {
+        mask = partitionMask(handoff.partitions);
+        reply.handoff.ready = store.exportPartitions(mask, reply.handoff.pairs);
+        if (!reply.handoff.ready) reply.handoff.pairs.clear();
+    }
+    if (!sendTo(socket, reply) || !reply.handoff.ready) return;
+    Message release;
+    if (!receiveFrom(socket, release) || release.type != MessageType::HANDOFF_REQUEST || !release.handoff.release) {
+        return;
+    }
+    // Unless the partitions came back meanwhile
+    if (partition.disowns(handoff.epoch, handoff.partitions)) store.drop(mask);
+}
+
+void DataNodeService::pullPartitions() {
+    // When each previous owner was first found unreachable
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> unreachable;
+    while (true) {
+        bool retry = false;
+        for (const auto& incoming : partition.awaitIncoming()) {
+            size_t taken = 0;
+            size_t pairs = 0;
+            for (size_t first = 0; first < incoming.partitions.size(); first += kHandoffBatch) {
+                Message request;
+                request.type = MessageType::HANDOFF_REQUEST;
+                request.handoff.epoch = incoming.epoch;
+                auto begin = incoming.partitions.begin() + first;
+                request.handoff.partitions.assign(begin, begin + std::min(kHandoffBatch, incoming.partitions.size() - first));
+                Message reply;
+                int sock = Communication::startClient(incoming.from.ip, incoming.from.port);
+                bool answered = sock >= 0 && sendTo(sock, request) && receiveFrom(sock, reply) &&
+                                reply.type == MessageType::HANDOFF_RESPONSE;
+                if (!answered) {
+                    if (sock >= 0) Communication::closeSocket(sock);
+                    auto now = std::chrono::steady_clock::now();
+                    auto since = unreachable.emplace(incoming.from.uuid, now).first->second;
+                    // One still in the map may be restarting or briefly cut off;
+                    // one that is not failed, and its pairs with it
+                    if (partition.isMember(incoming.from.uuid) && now - since < kHandoffTimeout) {
+                        retry = true;
+                        break;
+                    }
+                    std::cerr << "Node " << incoming.from.uuid << " is unreachable; " << incoming.partitions.size()
+                              << " partition(s) taken over from it start out empty" << std::endl;
+                    partition.arrived(incoming.partitions);
+                    unreachable.erase(incoming.from.uuid);
+                    break;
+                }
+                unreachable.erase(incoming.from.uuid);
+                if (!reply.handoff.ready) {
+                    Communication::closeSocket(sock);
+                    retry = true;
+                    break;
+                }
+                store.install(partitionMask(request.handoff.partitions), reply.handoff.pairs);
+                partition.arrived(request.handoff.partitions);
+                request.handoff.release = true;
+                sendTo(sock, request);
+                Communication::closeSocket(sock);
+                taken += request.handoff.partitions.size();
+                pairs += reply.handoff.pairs.size();
+            }
+            if (taken > 0) {
+                std::cout << "Took over " << taken << " partition(s) with " << pairs << " pair(s) from node "
+                          << incoming.from.uuid << std::endl;
+            }
+        }
+        if (retry) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+}
+
+void DataNodeService::handleConnection(int client_sock) {
+    ++connections;
+    std::string request = Communication::receiveMessage(client_sock);
+    Message reqMsg;
+    try {
+        if (!request.empty()) reqMsg = MessageDeserializer::deserialize(std::vector<uint8_t>(request.begin(), request.end()));
+    } catch (const std::exception& e) {
+        // A bad frame from one peer must not take the node down
+        std::cerr << "Malformed request: " << e.what() << std::endl;
+        request.clear();
+    }
+    if (!request.empty()) {
+        // Key-value connections carry many requests; TransactionManager times
+        // and traces each
+        std::optional<ScopedSpan> span;
+        std::optional<ScopedLatency> timer;
+        if (reqMsg.type != MessageType::DATA_REQUEST && reqMsg.type != MessageType::TXN_REQUEST) {
+            span.emplace(messageTypeName(static_cast<size_t>(reqMsg.type)), reqMsg.trace);
+            timer.emplace(Metrics::messageLatency(reqMsg.type));
+        }
+        switch (reqMsg.type) {
+            case MessageType::QUERY_FRAGMENT:
+                serveFragment(client_sock, reqMsg, catalog, shuffles);
+                break;
+            case MessageType::TABLE_STATS_REQUEST:
+                serveTableStats(client_sock, catalog);
+                break;
+            case MessageType::SHUFFLE_DATA:
+                serveShuffleData(client_sock, reqMsg, shuffles);
+                break;
+            case MessageType::BULK_LOAD:
+                serveBulkLoad(client_sock, reqMsg, catalog);
+                break;
+            case MessageType::DATA_REQUEST:
+            case MessageType::TXN_REQUEST:
+                transactions.serve(client_sock, reqMsg);
+                break;
+            case MessageType::HANDOFF_REQUEST:
+                serveHandoff(client_sock, reqMsg);
+                break;
+            case MessageType::STATS_REQUEST: {
+                Message respMsg;
+                respMsg.type = MessageType::STATS_RESPONSE;
+                respMsg.node_stats = Metrics::snapshot();
+                std::vector<uint8_t> serialized = MessageSerializer::serialize(respMsg);
+                Communication::sendMessage(client_sock, std::string(serialized.begin(), serialized.end()));
+                break;
+            }
+            case MessageType::FAULT_INJECTION: {
+                TransportFaults faults;
+                faults.delay = std::chrono::milliseconds(reqMsg.faults.delay_ms);
+                faults.loss = reqMsg.faults.loss_ppm / 1e6;
+                faults.blocked = reqMsg.faults.blocked;
+                // Echoed once in place; left unanswered when this process does not take faults
+                if (Communication::injectFaults(faults)) {
+                    std::vector<uint8_t> serialized = MessageSerializer::serialize(reqMsg);
+                    Communication::sendMessage(client_sock, std::string(serialized.begin(), serialized.end()));
+                }
+                break;
+            }
+            default:
+                std::cout << "Unknown message type received." << std::endl;
+                break;
+        }
+    }
+    Communication::closeSocket(client_sock);
+    --connections;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "ColumnStore.h"
+#include "Gossip.h"
+#include "HashJoin.h"
+#include "KeyValueStore.h"
+#include "Transactions.h"
+#include "message.h"
+
+// One DataNode: its partition of the tables and key-value pairs, the
+// connections it serves, and its part in gossip and membership. DataNode runs
+// one as a process; EmbeddedCluster runs several inside another program.
+
+struct DataNodeConfig {
+    std::string ip = "127.0.0.1";
+    int port = 9000; // TCP for requests, and UDP with the same number for gossip
+    // Which partition of the sample tables in the working directory to load
+    size_t partitionIndex = 0;
+    size_t partitionCount = 1;
+};
+
+class DataNodeService {
+public:
+    // How long a node keeps asking an unreachable previous owner that is
+    // still a member for the partitions it took over, before they start out
+    // empty; also how long a leaving node waits for its pairs to be taken
+    static constexpr std::chrono::seconds kHandoffTimeout{5};
+    // Partitions asked for in one HANDOFF_REQUEST, which bounds the reply
+    static constexpr size_t kHandoffBatch = 64;
+
+    explicit DataNodeService(const DataNodeConfig& config);
+    DataNodeService(const DataNodeService&) = delete;
+    DataNodeService& operator=(const DataNodeService&) = delete;
+
+    // Listen, register with the coordinator, and start gossiping and
+    // following membership on threads of their own. False when any step fails.
+    bool start();
+    // Accept connections on this thread, serving each on its own. Never returns.
+    void serve();
+    // Tell the coordinator this node is leaving, so peers stop routing to it
+    // at once, and wait until they have taken its key-value pairs
+    bool leave();
+
+    const NodeInfo& info() const { return self; }
+    size_t keyCount() const { return store.size(); }
+    // Connection threads currently running
+    int64_t activeConnections() const { return connections.load(); }
+
+private:
+    void handleConnection(int client_sock);
+    // Previous owner's side of a handoff (see LocalPartition)
+    void serveHandoff(int socket, const Message& request);
+    // New owner's side: fetch partitions that became this node's. Never returns.
+    void pullPartitions();
+
+    DataNodeConfig config;
+    NodeInfo self;
+    Message registration;
+    TableCatalog catalog;
+    ShuffleExchange shuffles;
+    // Key-value pairs of this node's partition, which partition that is, and
+    // the transactions on them
+    KeyValueStore store;
+    LocalPartition partition;
+    TransactionManager transactions;
+    std::atomic<int64_t> connections{0};
+    std::atomic<bool> leaving{false};
+    int server_fd = -1;
+    std::unique_ptr<GossipTransport> gossipTransport;
+    std::unique_ptr<SwimNode> swim;
+};
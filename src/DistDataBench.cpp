@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AsyncClient.h"
+#include "Metrics.h"
+
+// YCSB-style load generator for the key-value store.
+//
+// Open loop by default: every generator thread issues operations on a fixed
+// schedule whatever the cluster's response time, and each latency is taken
+// from the operation's scheduled start rather than from when it was sent, so
+// a stall is charged to every operation it delayed (coordinated omission
+// correction). Service time, from send to reply, is reported alongside. With
+// --rate 0 it runs closed loop instead, --concurrency calls at a time.
+//
+// Workloads follow the YCSB core workloads:
+//   A  50% read, 50% update                zipfian
+//   B  95% read, 5% update                 zipfian
+//   C  100% read                           zipfian
+//   D  95% read, 5% insert                 latest
+//   E  95% scan, 5% insert                 zipfian
+//   F  50% read, 50% read-modify-write     zipfian
+// The store is hash-partitioned and has no ordered scan, so a scan reads a
+// run of consecutive record keys with one multiGet.
+//
+// Usage: distdata-bench [--workload A-F] [--distribution uniform|zipfian|latest]
+//                       [--records N] [--value-size BYTES] [--rate OPS_PER_SEC]
+//                       [--duration SECONDS] [--warmup SECONDS] [--threads N]
+//                       [--reactors N] [--concurrency N] [--max-scan N] [--no-load]
+
+using BenchClock = std::chrono::steady_clock;
+
+enum class Op { Read, Update, Insert, Scan, ReadModifyWrite };
+static const char* const kOpNames[] = {"read", "update", "insert", "scan", "rmw"};
+static const size_t kOps = 5;
+
+enum class Distribution { Uniform, Zipfian, Latest };
+
+struct Workload {
+    double proportions[kOps]; // Indexed by Op
+    Distribution distribution;
+};
+
+static bool workloadNamed(char name, Workload& workload) {
+    switch (name) {
+        case 'A': workload = {{0.5, 0.5, 0, 0, 0}, Distribution::Zipfian}; return true;
+        case 'B': workload = {{0.95, 0.05, 0, 0, 0}, Distribution::Zipfian}; return true;
+        case 'C': workload = {{1, 0, 0, 0, 0}, Distribution::Zipfian}; return true;
+        case 'D': workload = {{0.95, 0, 0.05, 0, 0}, Distribution::Latest}; return true;
+        case 'E': workload = {{0, 0, 0.05, 0.95, 0}, Distribution::Zipfian}; return true;
+        case 'F': workload = {{0.5, 0, 0, 0, 0.5}, Distribution::Zipfian}; return true;
+        default: return false;
+    }
+}
+
+struct Options {
+    char workloadName = 'A';
+    Workload workload;
+    uint64_t records = 100000;
+    size_t valueSize = 100;
+    double rate = 10000;     // Operations per second over all threads; 0 runs closed loop
+    double duration = 10;    // Measured seconds, after the warmup
+    double warmup = 2;
+    size_t threads = 2;      // Generator threads
+    size_t reactors = 2;     // AsyncClient reactor threads
+    size_t concurrency = 64; // Closed loop only
+    size_t maxScan = 100;
+    bool load = true;
+    // Open loop: a generator stops issuing while this many calls are
+    // outstanding; the schedule keeps running, so the wait shows in latency
+    size_t maxOutstanding = 100000;
+};
+
+// Gray et al., "Quickly generating billion-record synthetic databases", as in
+// YCSB: ranks 0..n-1 with P(i) proportional to 1/(i+1)^theta. The item count
+// can grow, extending zeta incrementally.
+class ZipfianGenerator {
+public:
+    static constexpr double kTheta = 0.99;
+
+    explicit ZipfianGenerator(uint64_t items) : zeta2(1 + std::pow(0.5, kTheta)) { grow(items); }
+
+    uint64_t next(std::mt19937_64& random, uint64_t items) {
+        if (items > count) grow(items);
+        double u = std::uniform_real_distribution<double>(0, 1)(random);
+        double uz = u * zetan;
+        if (uz < 1) return 0;
+        if (uz < zeta2) return 1;
+        uint64_t rank = static_cast<uint64_t>(count * std::pow(eta * u - eta + 1, alpha));
+        return std::min(rank, count - 1);
+    }
+
+private:
+    void grow(uint64_t items) {
+        for (uint64_t i = count + 1; i <= items; ++i) zetan += 1 / std::pow(static_cast<double>(i), kTheta);
+        count = items;
+        eta = (1 - std::pow(2.0 / count, 1 - kTheta)) / (1 - zeta2 / zetan);
+    }
+
+    const double alpha = 1 / (1 - kTheta);
+    const double zeta2;
+    double zetan = 0;
+    double eta = 0;
+    uint64_t count = 0;
+};
+
+static uint64_t fnv64(uint64_t value) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (int i = 0; i < 8; ++i) {
+        hash ^= value & 0xff;
+        hash *= 0x100000001b3ull;
+        value >>= 8;
+    }
+    return hash;
+}
+
+static std::string keyName(uint64_t record) { return "user" + std::to_string(record); }
+
+// Shared by the generators and the operations they spawn
+struct Bench {
+    Options options;
+    AsyncClient& client;
+    std::vector<LatencyMetric> latency; // From scheduled start, per Op
+    std::vector<LatencyMetric> service; // From send, per Op
+    std::vector<CounterMetric> failures;
+    CounterMetric missing{"missing"};   // Reads of a key not (yet) stored
+    std::atomic<uint64_t> nextInsert;   // Record number of the next insert
+    std::atomic<uint64_t> inserted;     // Records known stored, for the latest distribution
+    std::atomic<size_t> outstanding{0};
+    BenchClock::time_point measureFrom; // Operations scheduled earlier are warmup
+    BenchClock::time_point until;
+    std::string value;
+
+    Bench(const Options& options, AsyncClient& client)
+        : options(options), client(client), nextInsert(options.records), inserted(options.records) {
+        for (size_t op = 0; op < kOps; ++op) {
+            latency.emplace_back(std::string(kOpNames[op]));
+            service.emplace_back(std::string(kOpNames[op]) + ".service");
+            failures.emplace_back(std::string(kOpNames[op]) + ".failed");
+        }
+        value.assign(options.valueSize, 'v');
+    }
+};
+
+// One generator's choices; used by a single thread
+class OperationChooser {
+public:
+    OperationChooser(Bench& bench, uint64_t seed)
+        : bench(bench), random(seed), zipfian(bench.options.records) {}
+
+    Op op() {
+        double pick = std::uniform_real_distribution<double>(0, 1)(random);
+        for (size_t op = 0; op < kOps; ++op) {
+            pick -= bench.options.workload.proportions[op];
+            if (pick < 0) return static_cast<Op>(op);
+        }
+        return Op::Read;
+    }
+
+    // An existing record
+    uint64_t record() {
+        uint64_t stored = bench.inserted.load(std::memory_order_relaxed);
+        switch (bench.options.workload.distribution) {
+            case Distribution::Uniform:
+                return std::uniform_int_distribution<uint64_t>(0, stored - 1)(random);
+            case Distribution::Zipfian:
+                // Scrambled so the popular records are spread over the key space
+                return fnv64(zipfian.next(random, bench.options.records)) % stored;
+            case Distribution::Latest:
+                return stored - 1 - zipfian.next(random, stored);
+        }
+        return 0;
+    }
+
+    size_t scanLength() { return std::uniform_int_distribution<size_t>(1, bench.options.maxScan)(random); }
+
+private:
+    Bench& bench;
+    std::mt19937_64 random;
+    ZipfianGenerator zipfian;
+};
+
+static Task<void> operation(Bench& bench, Op op, uint64_t record, size_t scanLength, BenchClock::time_point scheduled) {
+    auto sent = BenchClock::now();
+    bool ok = true;
+    switch (op) {
+        case Op::Read: {
+            KeyResult result = co_await bench.client.get(keyName(record));
+            ok = result.ok();
+            if (ok && !result.found) bench.missing.add();
+            break;
+        }
+        case Op::Update:
+            ok = (co_await bench.client.put(keyName(record), bench.value)).ok();
+            break;
+        case Op::Insert:
+            ok = (co_await bench.client.put(keyName(record), bench.value)).ok();
+            if (ok) {
+                // Only ever raised, so latest reads stay within stored records
+                uint64_t known = bench.inserted.load();
+                while (known < record + 1 && !bench.inserted.compare_exchange_weak(known, record + 1)) {}
+            }
+            break;
+        case Op::Scan: {
+            std::vector<std::string> keys;
+            uint64_t stored = bench.inserted.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < scanLength; ++i) keys.push_back(keyName((record + i) % stored));
+            std::vector<KeyResult> results = co_await bench.client.multiGet(std::move(keys));
+            ok = std::all_of(results.begin(), results.end(), [](const KeyResult& r) { return r.ok(); });
+            break;
+        }
+        case Op::ReadModifyWrite: {
+            KeyResult read = co_await bench.client.get(keyName(record));
+            ok = read.ok() && (co_await bench.client.put(keyName(record), bench.value)).ok();
+            break;
+        }
+    }
+    auto done = BenchClock::now();
+    if (scheduled >= bench.measureFrom) {
+        size_t index = static_cast<size_t>(op);
+        bench.latency[index].record(done - scheduled);
+        bench.service[index].record(done - sent);
+        if (!ok) bench.failures[index].add();
+    }
+    bench.outstanding.fetch_sub(1, std::memory_order_relaxed);
+}
+
+static void startOperation(Bench& bench, OperationChooser& chooser, BenchClock::time_point scheduled) {
+    Op op = chooser.op();
+    uint64_t record = op == Op::Insert ? bench.nextInsert++ : chooser.record();
+    size_t scanLength = op == Op::Scan ? chooser.scanLength() : 0;
+    bench.outstanding.fetch_add(1, std::memory_order_relaxed);
+    bench.client.spawn(operation(bench, op, record, scanLength, scheduled));
+}
+
+// Issues operations at rate/threads per second; returns how far behind
+// schedule it fell at worst
+static BenchClock::duration openLoop(Bench& bench, size_t index) {
+    OperationChooser chooser(bench, index + 1);
+    auto interval = std::chrono::duration_cast<BenchClock::duration>(
+        std::chrono::duration<double>(bench.options.threads / bench.options.rate));
+    // Threads start staggered across one interval
+    BenchClock::time_point scheduled =
+        BenchClock::now() + interval * static_cast<int64_t>(index) / static_cast<int64_t>(bench.options.threads);
+    BenchClock::duration worstLag{0};
+    while (scheduled < bench.until) {
+        auto now = BenchClock::now();
+        if (now < scheduled) {
+            std::this_thread::sleep_until(scheduled);
+            continue;
+        }
+        if (bench.outstanding.load(std::memory_order_relaxed) >= bench.options.maxOutstanding) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+        worstLag = std::max(worstLag, now - scheduled);
+        // Everything due by now goes out at once
+        while (scheduled <= now && scheduled < bench.until) {
+            startOperation(bench, chooser, scheduled);
+            scheduled += interval;
+        }
+    }
+    return worstLag;
+}
+
+// Closed loop: the next call is scheduled when the previous one returns
+static Task<void> closedLoop(Bench& bench, size_t index, std::atomic<size_t>& running) {
+    OperationChooser chooser(bench, index + 1);
+    while (BenchClock::now() < bench.until) {
+        Op op = chooser.op();
+        uint64_t record = op == Op::Insert ? bench.nextInsert++ : chooser.record();
+        size_t scanLength = op == Op::Scan ? chooser.scanLength() : 0;
+        bench.outstanding.fetch_add(1, std::memory_order_relaxed);
+        co_await operation(bench, op, record, scanLength, BenchClock::now());
+    }
+    --running;
+}
+
+static Task<size_t> loadRecords(AsyncClient& client, uint64_t first, uint64_t count, const std::string& value) {
+    std::vector<Task<KeyResult>> puts;
+    for (uint64_t i = first; i < first + count; ++i) puts.push_back(client.put(keyName(i), value));
+    std::vector<KeyResult> results = co_await whenAll(std::move(puts));
+    co_return static_cast<size_t>(std::count_if(results.begin(), results.end(), [](const KeyResult& r) { return r.ok(); }));
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+    std::string distribution;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--no-load") {
+            options.load = false;
+            continue;
+        }
+        if (i + 1 == argc) return false;
+        std::string value = argv[++i];
+        if (flag == "--workload" && value.size() == 1) {
+            options.workloadName = static_cast<char>(std::toupper(value[0]));
+        } else if (flag == "--distribution") {
+            distribution = value;
+        } else if (flag == "--records") {
+            options.records = std::stoull(value);
+        } else if (flag == "--value-size") {
+            options.valueSize = std::stoul(value);
+        } else if (flag == "--rate") {
+            options.rate = std::stod(value);
+        } else if (flag == "--duration") {
+            options.duration = std::stod(value);
+        } else if (flag == "--warmup") {
+            options.warmup = std::stod(value);
+        } else if (flag == "--threads") {
+            options.threads = std::max<size_t>(1, std::stoul(value));
+        } else if (flag == "--reactors") {
+            options.reactors = std::max<size_t>(1, std::stoul(value));
+        } else if (flag == "--concurrency") {
+            options.concurrency = std::max<size_t>(1, std::stoul(value));
+        } else if (flag == "--max-scan") {
+            options.maxScan = std::max<size_t>(1, std::stoul(value));
+        } else {
+            return false;
+        }
+    }
+    if (!workloadNamed(options.workloadName, options.workload) || options.records == 0) return false;
+    if (distribution == "uniform") options.workload.distribution = Distribution::Uniform;
+    else if (distribution == "zipfian") options.workload.distribution = Distribution::Zipfian;
+    else if (distribution == "latest") options.workload.distribution = Distribution::Latest;
+    else if (!distribution.empty()) return false;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: distdata-bench [--workload A-F] [--distribution uniform|zipfian|latest] [--records N]\n"
+                     "                      [--value-size BYTES] [--rate OPS_PER_SEC] [--duration SECONDS]\n"
+                     "                      [--warmup SECONDS] [--threads N] [--reactors N] [--concurrency N]\n"
+                     "                      [--max-scan N] [--no-load]"
+                  << std::endl;
+        return 2;
+    }
+    AsyncClient client(options.reactors);
+    Bench bench(options, client);
+
+    if (options.load) {
+        auto start = BenchClock::now();
+        size_t stored = 0;
+        for (uint64_t first = 0; first < options.records; first += 1000) {
+            stored += client.run(loadRecords(client, first, std::min<uint64_t>(1000, options.records - first), bench.value));
+        }
+        double seconds = std::chrono::duration<double>(BenchClock::now() - start).count();
+        std::cout << "Loaded " << stored << " of " << options.records << " records in " << std::fixed
+                  << std::setprecision(1) << seconds << "s" << std::defaultfloat << std::endl;
+        if (stored != options.records) return 1;
+    }
+
+    static const char* const kDistributions[] = {"uniform", "zipfian", "latest"};
+    std::cout << "Workload " << options.workloadName << ", "
+              << kDistributions[static_cast<size_t>(options.workload.distribution)] << " keys, "
+              << options.valueSize << "-byte values, ";
+    if (options.rate > 0) {
+        std::cout << "open loop at " << static_cast<uint64_t>(options.rate) << " ops/s from " << options.threads << " threads";
+    } else {
+        std::cout << "closed loop with " << options.concurrency << " outstanding";
+    }
+    std::cout << ", " << options.reactors << " reactor threads" << std::endl;
+
+    auto start = BenchClock::now();
+    auto seconds = [](double s) { return std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(s)); };
+    bench.measureFrom = start + seconds(options.warmup);
+    bench.until = bench.measureFrom + seconds(options.duration);
+
+    BenchClock::duration worstLag{0};
+    if (options.rate > 0) {
+        std::vector<BenchClock::duration> lags(options.threads);
+        std::vector<std::thread> generators;
+        for (size_t i = 0; i < options.threads; ++i) {
+            generators.emplace_back([&bench, &lags, i] { lags[i] = openLoop(bench, i); });
+        }
+        for (auto& generator : generators) generator.join();
+        worstLag = *std::max_element(lags.begin(), lags.end());
+    } else {
+        std::atomic<size_t> running{options.concurrency};
+        for (size_t i = 0; i < options.concurrency; ++i) client.spawn(closedLoop(bench, i, running));
+        while (running > 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    // Calls still in flight finish or time out
+    while (bench.outstanding.load() > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    StatsData stats = Metrics::snapshot();
+    std::map<std::string, const LatencyStatsData*> latencies;
+    for (const auto& latency : stats.latencies) latencies[latency.name] = &latency;
+    std::map<std::string, int64_t> counters;
+    for (const auto& counter : stats.counters) counters[counter.name] = counter.value;
+
+    uint64_t total = 0;
+    int64_t failed = 0;
+    auto micros = [](uint64_t nanos) { return nanos / 1000.0; };
+    std::cout << std::left << std::setw(16) << "operation" << std::right << std::setw(10) << "count" << std::setw(10)
+              << "ops/s" << std::setw(13) << "p50_us" << std::setw(13) << "p99_us" << std::setw(13) << "p999_us"
+              << std::setw(13) << "max_us" << std::setw(9) << "failed" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    for (size_t op = 0; op < kOps; ++op) {
+        for (const std::string& name : {std::string(kOpNames[op]), std::string(kOpNames[op]) + ".service"}) {
+            auto it = latencies.find(name);
+            if (it == latencies.end()) continue;
+            const LatencyStatsData& latency = *it->second;
+            bool corrected = name == kOpNames[op];
+            int64_t failures = corrected ? counters[name + ".failed"] : 0;
+            if (corrected) {
+                total += latency.count;
+                failed += failures;
+            }
+            std::cout << std::left << std::setw(16) << name << std::right << std::setw(10) << latency.count
+                      << std::setw(10) << latency.count / options.duration << std::setw(13) << micros(latency.p50)
+                      << std::setw(13) << micros(latency.p99) << std::setw(13) << micros(latency.p999)
+                      << std::setw(13) << micros(latency.max) << std::setw(9);
+            if (corrected) std::cout << failures;
+            std::cout << std::endl;
+        }
+    }
+    std::cout << "Throughput " << total / options.duration << " ops/s";
+    if (options.rate > 0) std::cout << " of " << static_cast<uint64_t>(options.rate) << " scheduled";
+    std::cout << "; " << failed << " failed, " << counters["missing"] << " reads of missing keys" << std::endl;
+    if (options.rate > 0) {
+        std::cout << "Generators fell at most " << std::chrono::duration<double, std::milli>(worstLag).count()
+                  << "ms behind schedule" << std::endl;
+    }
+    std::cout << "Latency is from each operation's scheduled start; .service is from send to reply" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
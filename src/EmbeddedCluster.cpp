@@ -0,0 +1,90 @@
+#include "EmbeddedCluster.h"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include "Communication.h"
+#include "CoordinatorService.h"
+#include "DataNodeService.h"
+#include "Loopback.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+static bool started = false;
+
+// Registered DataNodes according to the coordinator; 0 while it cannot answer
+static size_t registeredNodes(int coordinatorPort) {
+    int sock = Communication::startClient("127.0.0.1", coordinatorPort);
+    if (sock < 0) return 0;
+    Message request;
+    request.type = MessageType::NODE_LIST_REQUEST;
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(request);
+    std::string response;
+    if (Communication::sendMessage(sock, std::string(serialized.begin(), serialized.end()))) {
+        response = Communication::receiveMessage(sock);
+    }
+    Communication::closeSocket(sock);
+    if (response.empty()) return 0;
+    Message reply = MessageDeserializer::deserialize(std::vector<uint8_t>(response.begin(), response.end()));
+    return reply.type == MessageType::NODE_LIST_RESPONSE ? reply.node_list.nodes.size() : 0;
+}
+
+EmbeddedCluster::EmbeddedCluster(EmbeddedClusterConfig config) : config(config) {}
+
+EmbeddedCluster::~EmbeddedCluster() {
+    if (dataDir.empty()) return;
+    std::error_code error;
+    std::filesystem::remove_all(dataDir, error);
+}
+
+bool EmbeddedCluster::start(std::chrono::milliseconds timeout) {
+    if (started) {
+        std::cerr << "An embedded cluster is already running in this process" << std::endl;
+        return false;
+    }
+    started = true;
+    // Never destroyed, like everything below: the nodes' threads are detached
+    Communication::setTransport(new LoopbackTransport());
+    std::string coordinator = "127.0.0.1:" + std::to_string(config.coordinatorPort);
+    setenv("DISTDATA_COORDINATORS", coordinator.c_str(), 1);
+
+    // A fresh Raft log, so no membership of an earlier run is replayed
+    char dir[] = "/tmp/distdata-embedded-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return false;
+    }
+    dataDir = dir;
+    CoordinatorConfig coordinatorConfig;
+    coordinatorConfig.port = config.coordinatorPort;
+    coordinatorConfig.logPath = std::string(dir) + "/coordinator.raft";
+    int server_fd = startCoordinator(coordinatorConfig);
+    if (server_fd < 0) return false;
+    std::thread(serveCoordinator, server_fd).detach();
+
+    for (size_t i = 0; i < config.dataNodes; ++i) {
+        DataNodeConfig nodeConfig;
+        nodeConfig.port = config.firstDataNodePort + static_cast<int>(i);
+        nodeConfig.partitionIndex = i;
+        nodeConfig.partitionCount = config.dataNodes;
+        auto* node = new DataNodeService(nodeConfig);
+        if (!node->start()) return false;
+        services.push_back(node);
+        members.push_back(node->info());
+        std::thread(&DataNodeService::serve, node).detach();
+    }
+
+    // Registrations only take effect once the coordinator has elected itself
+    // leader of its one-member group; until then the nodes register again
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (registeredNodes(config.coordinatorPort) < config.dataNodes) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+bool EmbeddedCluster::leave(size_t index) {
+    return index < services.size() && services[index]->leave();
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "message.h"
+
+// A whole cluster inside the calling process: a coordinator and DataNodes
+// serving on threads of their own, connected by a LoopbackTransport instead
+// of TCP. SmartClient, AsyncClient and the rest of the client code reach it
+// unchanged, e.g. from a test or a benchmark that wants no processes to
+// manage and no network stack in its numbers.
+//
+// The coordinator's state is process-wide, so a process runs at most one
+// embedded cluster, and no CoordinatorNode of its own. Once started, the
+// nodes run until the process exits; destroying the cluster only removes the
+// directory holding the coordinator's Raft log. Starting sets
+// DISTDATA_COORDINATORS to the embedded coordinator, which must happen before
+// the process first connects to a coordinator (see Coordinators.h).
+
+class DataNodeService;
+
+struct EmbeddedClusterConfig {
+    int coordinatorPort = 8080;
+    int firstDataNodePort = 9001; // DataNodes take consecutive ports from here
+    size_t dataNodes = 3;
+};
+
+class EmbeddedCluster {
+public:
+    explicit EmbeddedCluster(EmbeddedClusterConfig config = EmbeddedClusterConfig());
+    ~EmbeddedCluster();
+    EmbeddedCluster(const EmbeddedCluster&) = delete;
+    EmbeddedCluster& operator=(const EmbeddedCluster&) = delete;
+
+    // Start every node and wait until each DataNode is in the membership.
+    // False when a node cannot start or the cluster is not ready in time.
+    bool start(std::chrono::milliseconds timeout = std::chrono::seconds(10));
+
+    int coordinatorPort() const { return config.coordinatorPort; }
+    // The DataNodes, in port order; empty until started
+    const std::vector<NodeInfo>& nodes() const { return members; }
+    // Have DataNode `index` leave as on SIGTERM: the others take over its
+    // keys, and it no longer serves them
+    bool leave(size_t index);
+
+private:
+    EmbeddedClusterConfig config;
+    std::vector<NodeInfo> members;
+    std::vector<DataNodeService*> services; // Never destroyed; their threads are detached
+    std::string dataDir;                    // Empty until started
+};
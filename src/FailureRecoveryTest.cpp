@@ -1,92 +1,621 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
 #include <thread>
-#include <chrono>
 #include <vector>
-#include <string>
-#include <map>
-#include <mutex>
-#include <set> // Added missing include for std::set
+#include "Communication.h"
+#include "Membership.h"
+#include "SmartClient.h"
+#include "message.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
 
-// Stub Node class for demonstration
-class Node {
-public:
-    Node(const std::string& id, int port) : id_(id), port_(port), active_(true) {}
-    void start() { std::cout << "Node " << id_ << " started on port " << port_ << std::endl; }
-    void crash() { active_ = false; std::cout << "Node " << id_ << " crashed!" << std::endl; }
-    void put(const std::string& key, const std::string& value) {
-        if (active_) {
-            std::lock_guard<std::mutex> lock(mtx_);
-            data_[key] = value;
+// Throughput and recovery under injected failures.
+//
+// Each scenario starts a real cluster as local processes (a CoordinatorNode
+// and --nodes DataNodes, logs and Raft files in a fresh directory under /tmp),
+// runs an open-loop key-value load against it through SmartClient, injects
+// one fault into the last DataNode, heals it, and reports:
+//   time to detect   fault until the coordinator's membership drops the node
+//   time to recover  fault (and healing) until throughput stays at 90% of
+//                    the baseline or more, with no failed operations, for 1s
+//   throughput dip   lowest windowed throughput, the operations short of the
+//                    baseline and the operations that failed
+//   event latency    percentiles of the operations scheduled from the fault
+//                    until recovery after healing, next to the baseline's
+// Latency is taken from each operation's scheduled start, so a stall is
+// charged to every operation it delayed.
+//
+// Scenarios:
+//   crash      SIGKILL the node; after --fault seconds start a new one on its port
+//   partition  cut the node off from the coordinator, the other DataNodes and
+//              the clients for --fault seconds
+//   latency    the node delays everything it sends by --delay-ms
+//   loss       the node loses --loss of its datagrams (gossip), and holds that
+//              share of its messages back a TCP retransmission timeout
+// Faults other than crashes are injected into the nodes' transport (see
+// TransportFaults in Communication.h) with FAULT_INJECTION messages, which
+// processes only accept when started with DISTDATA_FAULT_INJECTION set.
+//
+// Usage: FailureRecoveryTest [--bin DIR] [--nodes N] [--port PORT] [--rate OPS_PER_SEC]
+//                            [--threads N] [--keys N] [--baseline SECONDS] [--fault SECONDS]
+//                            [--after SECONDS] [--delay-ms MS] [--loss SHARE] [--window-ms MS]
+//                            [--timeline] [crash|partition|latency|loss ...]
+
+using Clock = std::chrono::steady_clock;
+
+enum class Scenario { Crash, Partition, Latency, Loss };
+static const char* const kScenarioNames[] = {"crash", "partition", "latency", "loss"};
+
+// A window counts as recovered at this share of the baseline throughput
+static const double kRecoveredShare = 0.9;
+// ... and recovery holds when every window this long is
+static const std::chrono::seconds kSettle(1);
+// Registration and the first membership maps
+static const std::chrono::seconds kStartupTimeout(15);
+
+struct Options {
+    std::string bin;     // Directory with CoordinatorNode and DataNode; defaults to this program's
+    size_t nodes = 3;
+    int port = 18080;    // Coordinator; DataNodes take the ports after port + 1000
+    double rate = 2000;  // Operations per second over all threads
+    size_t threads = 8;
+    size_t keys = 10000;
+    double baseline = 3; // Seconds before the fault, the first third of them warmup
+    double fault = 3;    // Seconds until the fault is healed
+    double after = 5;    // Seconds after healing
+    uint32_t delayMs = 50;
+    double loss = 0.05;
+    double windowMs = 100;
+    bool timeline = false;
+    std::vector<Scenario> scenarios;
+};
+
+static std::chrono::duration<double> seconds(double s) { return std::chrono::duration<double>(s); }
+
+static double secondsBetween(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+// --- Processes ---
+
+// Start `program` in `dir` with its output in `log`; it dies with this process
+static pid_t spawn(const std::string& program, const std::vector<std::string>& args, const std::string& dir,
+                   const std::string& log) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    int out = open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (chdir(dir.c_str()) < 0 || out < 0) _exit(127);
+    dup2(out, STDOUT_FILENO);
+    dup2(out, STDERR_FILENO);
+    std::vector<char*> argv{const_cast<char*>(program.c_str())};
+    for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    execv(program.c_str(), argv.data());
+    _exit(127);
+}
+
+static void kill9(pid_t& pid) {
+    if (pid <= 0) return;
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    pid = -1;
+}
+
+// --- Requests ---
+
+// Send `request` to 127.0.0.1:port and wait for one reply
+static bool exchange(int port, const Message& request, Message& reply) {
+    int sock = Communication::startClient("127.0.0.1", port);
+    if (sock < 0) return false;
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(request);
+    std::string response;
+    if (Communication::sendMessage(sock, std::string(serialized.begin(), serialized.end()))) {
+        response = Communication::receiveMessage(sock);
+    }
+    Communication::closeSocket(sock);
+    if (response.empty()) return false;
+    reply = MessageDeserializer::deserialize(std::vector<uint8_t>(response.begin(), response.end()));
+    return true;
+}
+
+static size_t registeredNodes(int coordinatorPort) {
+    Message request;
+    request.type = MessageType::NODE_LIST_REQUEST;
+    Message reply;
+    if (!exchange(coordinatorPort, request, reply) || reply.type != MessageType::NODE_LIST_RESPONSE) return 0;
+    return reply.node_list.nodes.size();
+}
+
+// Replace the faults of the process on `port`; default faults heal
+static bool injectInto(int port, const TransportFaults& faults) {
+    Message request;
+    request.type = MessageType::FAULT_INJECTION;
+    request.faults.delay_ms = static_cast<uint32_t>(faults.delay.count());
+    request.faults.loss_ppm = static_cast<uint32_t>(faults.loss * 1e6);
+    request.faults.blocked = faults.blocked;
+    Message reply;
+    if (exchange(port, request, reply) && reply.type == MessageType::FAULT_INJECTION) return true;
+    std::cerr << "Process on port " << port << " did not take the faults" << std::endl;
+    return false;
+}
+
+static std::string addressOf(int port) { return "127.0.0.1:" + std::to_string(port); }
+
+// --- Cluster ---
+
+struct Cluster {
+    const Options& options;
+    std::string dir;
+    pid_t coordinator = -1;
+    std::vector<int> ports; // DataNodes'
+    std::vector<pid_t> nodes;
+
+    explicit Cluster(const Options& options) : options(options) {
+        for (size_t i = 0; i < options.nodes; ++i) ports.push_back(options.port + 1001 + static_cast<int>(i));
+        nodes.assign(options.nodes, -1);
+    }
+    ~Cluster() {
+        for (pid_t& node : nodes) kill9(node);
+        kill9(coordinator);
+    }
+
+    void startNode(size_t i) {
+        std::string port = std::to_string(ports[i]);
+        nodes[i] = spawn(options.bin + "/DataNode", {port}, dir, dir + "/datanode-" + port + ".log");
+    }
+
+    // Start the coordinator, then the DataNodes once it answers
+    bool start() {
+        coordinator = spawn(options.bin + "/CoordinatorNode", {std::to_string(options.port)}, dir,
+                            dir + "/coordinator.log");
+        auto deadline = Clock::now() + kStartupTimeout;
+        Message request;
+        request.type = MessageType::NODE_LIST_REQUEST;
+        Message reply;
+        while (!exchange(options.port, request, reply)) {
+            if (Clock::now() > deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        for (size_t i = 0; i < options.nodes; ++i) startNode(i);
+        while (registeredNodes(options.port) < options.nodes) {
+            if (Clock::now() > deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
+        return true;
+    }
+};
+
+// Points stderr at a file until destroyed: clients report every refused
+// connection there
+class StderrTo {
+public:
+    explicit StderrTo(const std::string& path) : saved(dup(STDERR_FILENO)) {
+        int file = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        dup2(file, STDERR_FILENO);
+        close(file);
+    }
+    ~StderrTo() {
+        dup2(saved, STDERR_FILENO);
+        close(saved);
     }
-    std::string get(const std::string& key) {
-        std::lock_guard<std::mutex> lock(mtx_);
-        return data_.count(key) ? data_[key] : "";
+
+private:
+    int saved;
+};
+
+// Membership as the coordinator publishes it, with when each version arrived
+class MembershipLog {
+public:
+    explicit MembershipLog(int coordinatorPort) {
+        sock = Communication::startClient("127.0.0.1", coordinatorPort);
+        if (sock < 0) return;
+        Message watch;
+        watch.type = MessageType::WATCH;
+        watch.membership.version = 0;
+        std::vector<uint8_t> serialized = MessageSerializer::serialize(watch);
+        Communication::sendMessage(sock, std::string(serialized.begin(), serialized.end()));
+        reader = std::thread([this] { follow(); });
     }
-    std::string getId() const { return id_; }
-    void blockCommunication(const std::string& otherId) {
-        blocked_.insert(otherId);
-        std::cout << "Node " << id_ << " blocks communication with " << otherId << std::endl;
+    ~MembershipLog() {
+        if (sock < 0) return;
+        shutdown(sock, SHUT_RDWR);
+        reader.join();
+        Communication::closeSocket(sock);
     }
-    void unblockCommunication(const std::string& otherId) {
-        blocked_.erase(otherId);
-        std::cout << "Node " << id_ << " unblocks communication with " << otherId << std::endl;
+
+    // First version at or after `from` that lists `address` (or not)
+    std::optional<Clock::time_point> firstWhen(const std::string& address, bool listed, Clock::time_point from) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto& version : versions) {
+            if (version.at < from) continue;
+            bool found = std::find(version.addresses.begin(), version.addresses.end(), address) != version.addresses.end();
+            if (found == listed) return version.at;
+        }
+        return std::nullopt;
     }
-    bool isActive() const { return active_; }
+
 private:
-    std::string id_;
-    int port_;
-    bool active_;
-    std::map<std::string, std::string> data_;
-    std::mutex mtx_;
-    std::set<std::string> blocked_;
+    struct Version {
+        Clock::time_point at;
+        std::vector<std::string> addresses;
+    };
+
+    void follow() {
+        PartitionMap map;
+        while (true) {
+            std::string pushed = Communication::receiveMessage(sock);
+            if (pushed.empty()) return;
+            Message update = MessageDeserializer::deserialize(std::vector<uint8_t>(pushed.begin(), pushed.end()));
+            if (update.type != MessageType::MEMBERSHIP_UPDATE || !applyMembershipUpdate(map, update.membership)) return;
+            Version version{Clock::now(), {}};
+            for (const auto& node : map.nodes) version.addresses.push_back(node.ip + ":" + std::to_string(node.port));
+            std::lock_guard<std::mutex> lock(mtx);
+            versions.push_back(std::move(version));
+        }
+    }
+
+    int sock = -1;
+    std::thread reader;
+    std::mutex mtx;
+    std::vector<Version> versions;
 };
 
-void simulateNodeFailure(Node& node) {
-    std::this_thread::sleep_for(std::chrono::seconds(2));
-    node.crash();
-}
-
-void simulateNetworkPartition(Node& node1, Node& node2) {
-    node1.blockCommunication(node2.getId());
-    std::this_thread::sleep_for(std::chrono::seconds(2));
-    node1.unblockCommunication(node2.getId());
-}
-
-int main() {
-    // Node Failure Test
-    Node node1("node1", 8080);
-    Node node2("node2", 8081);
-    Node node3("node3", 8082);
-    node1.start(); node2.start(); node3.start();
-    for (int i = 0; i < 10; ++i) {
-        node1.put("key_" + std::to_string(i), "value_" + std::to_string(i));
-    }
-    std::thread failureThread(simulateNodeFailure, std::ref(node1));
-    for (int i = 10; i < 20; ++i) {
-        node2.put("key_" + std::to_string(i), "value_" + std::to_string(i));
-    }
-    failureThread.join();
-    for (int i = 0; i < 20; ++i) {
-        std::string value = node2.get("key_" + std::to_string(i));
-        std::cout << "Node2 get key_" << i << ": " << value << std::endl;
-    }
-    // Network Partition Test
-    Node nodeA("nodeA", 9000);
-    Node nodeB("nodeB", 9001);
-    nodeA.start(); nodeB.start();
-    for (int i = 0; i < 5; ++i) {
-        nodeA.put("key_" + std::to_string(i), "value_" + std::to_string(i));
-    }
-    std::thread partitionThread(simulateNetworkPartition, std::ref(nodeA), std::ref(nodeB));
-    for (int i = 5; i < 10; ++i) {
-        nodeB.put("key_" + std::to_string(i), "value_" + std::to_string(i));
-    }
-    partitionThread.join();
-    for (int i = 0; i < 10; ++i) {
-        std::string valueA = nodeA.get("key_" + std::to_string(i));
-        std::string valueB = nodeB.get("key_" + std::to_string(i));
-        std::cout << "key_" << i << " nodeA: " << valueA << ", nodeB: " << valueB << std::endl;
-    }
-    return 0;
-} 
\ No newline at end of file
+// --- Load ---
+
+struct Sample {
+    Clock::time_point scheduled;
+    Clock::time_point done;
+    bool ok;
+};
+
+static std::string keyName(uint64_t key) { return "key" + std::to_string(key); }
+
+static bool preload(const Options& options, const std::string& value) {
+    SmartClient client;
+    for (size_t key = 0; key < options.keys; ++key) {
+        uint64_t version;
+        std::string error;
+        if (!client.put(keyName(key), value, version, error)) {
+            std::cerr << "Preload failed: " << error << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Half reads, half writes of uniform keys, one every threads / rate seconds
+static void generate(const Options& options, size_t worker, Clock::time_point start, Clock::time_point until,
+                     const std::string& value, std::vector<Sample>& samples, std::atomic<uint64_t>& missing) {
+    SmartClient client;
+    std::mt19937_64 random(worker + 1);
+    auto interval = seconds(options.threads / options.rate);
+    auto offset = interval * (static_cast<double>(worker) / options.threads);
+    for (uint64_t n = 0;; ++n) {
+        auto scheduled = start + std::chrono::duration_cast<Clock::duration>(offset + interval * static_cast<double>(n));
+        if (scheduled >= until) break;
+        std::this_thread::sleep_until(scheduled);
+        std::string key = keyName(random() % options.keys);
+        std::string error;
+        uint64_t version;
+        bool ok;
+        if (random() & 1) {
+            std::string read;
+            bool found;
+            ok = client.get(key, read, version, found, error);
+            // Every key was stored before the run, so a miss is lost data
+            if (ok && !found) ++missing;
+        } else {
+            ok = client.put(key, value, version, error);
+        }
+        samples.push_back({scheduled, Clock::now(), ok});
+    }
+}
+
+// --- Scenarios ---
+
+struct Timeline {
+    Clock::time_point start;
+    Clock::time_point measured; // End of the warmup
+    Clock::time_point fault;
+    Clock::time_point healed;
+    Clock::time_point until;
+};
+
+static bool injectFault(const Options& options, Scenario scenario, Cluster& cluster) {
+    size_t target = cluster.ports.size() - 1;
+    int port = cluster.ports[target];
+    TransportFaults faults;
+    switch (scenario) {
+        case Scenario::Crash:
+            kill9(cluster.nodes[target]);
+            return true;
+        case Scenario::Partition: {
+            faults.blocked.push_back(addressOf(options.port));
+            for (size_t i = 0; i < target; ++i) faults.blocked.push_back(addressOf(cluster.ports[i]));
+            if (!injectInto(port, faults)) return false;
+            TransportFaults others;
+            others.blocked.push_back(addressOf(port));
+            bool ok = injectInto(options.port, others);
+            for (size_t i = 0; i < target; ++i) ok = injectInto(cluster.ports[i], others) && ok;
+            // The clients are on the coordinator's side
+            return Communication::injectFaults(others) && ok;
+        }
+        case Scenario::Latency:
+            faults.delay = std::chrono::milliseconds(options.delayMs);
+            return injectInto(port, faults);
+        case Scenario::Loss:
+            faults.loss = options.loss;
+            return injectInto(port, faults);
+    }
+    return false;
+}
+
+static bool healFault(const Options& options, Scenario scenario, Cluster& cluster) {
+    size_t target = cluster.ports.size() - 1;
+    switch (scenario) {
+        case Scenario::Crash:
+            cluster.startNode(target);
+            return true;
+        case Scenario::Partition: {
+            bool ok = Communication::injectFaults(TransportFaults());
+            ok = injectInto(cluster.ports[target], TransportFaults()) && ok;
+            ok = injectInto(options.port, TransportFaults()) && ok;
+            for (size_t i = 0; i < target; ++i) ok = injectInto(cluster.ports[i], TransportFaults()) && ok;
+            return ok;
+        }
+        case Scenario::Latency:
+        case Scenario::Loss:
+            return injectInto(cluster.ports[target], TransportFaults());
+    }
+    return false;
+}
+
+static double percentileMs(std::vector<double>& latencies, double quantile) {
+    if (latencies.empty()) return 0;
+    size_t rank = std::min(latencies.size() - 1, static_cast<size_t>(quantile * latencies.size()));
+    std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+    return latencies[rank];
+}
+
+static std::string latencySummary(std::vector<double> latencies) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << "p50 " << percentileMs(latencies, 0.5) << " ms, p99 "
+        << percentileMs(latencies, 0.99) << " ms, p999 " << percentileMs(latencies, 0.999) << " ms, max "
+        << (latencies.empty() ? 0 : *std::max_element(latencies.begin(), latencies.end())) << " ms";
+    return out.str();
+}
+
+static void report(std::ostream& out, const Options& options, const std::string& target, const Timeline& timeline,
+                   const std::vector<Sample>& samples, uint64_t missing, MembershipLog& membership) {
+    auto window = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(options.windowMs));
+    // Completions stop at `until`, so the last window is cut short and left out
+    size_t windowCount = static_cast<size_t>((timeline.until - timeline.start) / window);
+    std::vector<uint64_t> ok(windowCount), failed(windowCount);
+    for (const auto& sample : samples) {
+        size_t index = static_cast<size_t>((sample.done - timeline.start) / window);
+        if (index >= windowCount) continue;
+        (sample.ok ? ok : failed)[index]++;
+    }
+    auto windowOf = [&](Clock::time_point at) { return static_cast<size_t>((at - timeline.start + window - Clock::duration(1)) / window); };
+    size_t measured = windowOf(timeline.measured), fault = windowOf(timeline.fault), healed = windowOf(timeline.healed);
+    double baseline = 0;
+    for (size_t i = measured; i < fault; ++i) baseline += ok[i];
+    baseline /= std::max<size_t>(1, fault - measured); // Per window
+    auto good = [&](size_t i) { return ok[i] >= kRecoveredShare * baseline && failed[i] == 0; };
+    size_t settle = static_cast<size_t>(std::chrono::duration_cast<Clock::duration>(kSettle) / window);
+    auto recoveredFrom = [&](size_t from) -> std::optional<size_t> {
+        for (size_t i = from; i + settle <= windowCount; ++i) {
+            bool held = true;
+            for (size_t j = i; j < i + settle && held; ++j) held = good(j);
+            if (held) return i;
+        }
+        return std::nullopt;
+    };
+    auto timeOf = [&](size_t index) { return timeline.start + window * index; };
+    std::optional<size_t> recovered = recoveredFrom(fault), recoveredAfterHeal = recoveredFrom(healed);
+    size_t eventEnd = recoveredAfterHeal ? *recoveredAfterHeal : windowCount;
+
+    uint64_t lowest = UINT64_MAX, failures = 0;
+    double shortfall = 0;
+    for (size_t i = fault; i < eventEnd; ++i) {
+        lowest = std::min(lowest, ok[i]);
+        shortfall += std::max(0.0, baseline - ok[i]);
+        failures += failed[i];
+    }
+    std::vector<double> baselineLatency, eventLatency;
+    for (const auto& sample : samples) {
+        double latency = std::chrono::duration<double, std::milli>(sample.done - sample.scheduled).count();
+        if (sample.scheduled >= timeline.measured && sample.scheduled < timeline.fault) baselineLatency.push_back(latency);
+        if (sample.scheduled >= timeline.fault && sample.scheduled < timeOf(eventEnd)) eventLatency.push_back(latency);
+    }
+
+    double perSecond = baseline * 1000 / options.windowMs;
+    out << std::fixed << std::setprecision(2);
+    out << "baseline          " << static_cast<uint64_t>(perSecond) << " ops/s, " << latencySummary(baselineLatency)
+              << std::endl;
+    std::optional<Clock::time_point> detected = membership.firstWhen(target, false, timeline.fault);
+    out << "time to detect    ";
+    if (detected) out << secondsBetween(timeline.fault, *detected) << " s (left the membership)" << std::endl;
+    else out << "not detected" << std::endl;
+    out << "time to recover   ";
+    if (recovered) out << secondsBetween(timeline.fault, timeOf(*recovered)) << " s after the fault";
+    else out << "not recovered";
+    if (recoveredAfterHeal) out << ", " << secondsBetween(timeline.healed, timeOf(*recoveredAfterHeal)) << " s after healing";
+    else out << ", not recovered after healing";
+    out << std::endl;
+    if (detected) {
+        std::optional<Clock::time_point> rejoined = membership.firstWhen(target, true, *detected);
+        out << "rejoined          ";
+        if (rejoined) out << secondsBetween(timeline.healed, *rejoined) << " s after healing" << std::endl;
+        else out << "no" << std::endl;
+    }
+    double dip = fault < eventEnd && baseline > 0 ? 100.0 * lowest / baseline : 100;
+    out << "throughput dip    to " << std::setprecision(0) << dip << "% of baseline; "
+              << static_cast<uint64_t>(shortfall) << " operations short, " << failures << " failed" << std::endl;
+    out << std::setprecision(2) << "event latency     " << latencySummary(eventLatency) << std::endl;
+    out << "missing reads     " << missing << std::endl;
+
+    if (!options.timeline) return;
+    out << std::setw(8) << "t_s" << std::setw(10) << "ok" << std::setw(10) << "failed" << std::endl;
+    for (size_t i = 0; i < windowCount; ++i) {
+        out << std::setw(8) << std::setprecision(1) << secondsBetween(timeline.start, timeOf(i)) << std::setw(10)
+                  << ok[i] << std::setw(10) << failed[i];
+        if (i == fault) out << "  fault";
+        if (i == healed) out << "  healed";
+        out << std::endl;
+    }
+}
+
+// The scenario's report, or what went wrong
+static std::string runScenario(const Options& options, Scenario scenario, Cluster& cluster) {
+    StderrTo clientLog(cluster.dir + "/clients.log");
+    if (!cluster.start()) return "the cluster did not come up";
+    std::string value(100, 'v');
+    if (!preload(options, value)) return "the keys could not be stored";
+
+    MembershipLog membership(options.port);
+    Timeline timeline;
+    timeline.start = Clock::now();
+    auto at = [&](double s) { return timeline.start + std::chrono::duration_cast<Clock::duration>(seconds(s)); };
+    timeline.measured = at(options.baseline / 3);
+    timeline.fault = at(options.baseline);
+    timeline.healed = at(options.baseline + options.fault);
+    timeline.until = at(options.baseline + options.fault + options.after);
+    std::vector<std::vector<Sample>> samples(options.threads);
+    std::atomic<uint64_t> missing{0};
+    std::vector<std::thread> generators;
+    for (size_t i = 0; i < options.threads; ++i) {
+        generators.emplace_back(generate, std::cref(options), i, timeline.start, timeline.until, std::cref(value),
+                                std::ref(samples[i]), std::ref(missing));
+    }
+    std::this_thread::sleep_until(timeline.fault);
+    bool injected = injectFault(options, scenario, cluster);
+    std::this_thread::sleep_until(timeline.healed);
+    bool healed = healFault(options, scenario, cluster);
+    for (auto& generator : generators) generator.join();
+    if (!injected || !healed) return "fault injection failed";
+
+    std::vector<Sample> all;
+    for (const auto& worker : samples) all.insert(all.end(), worker.begin(), worker.end());
+    std::ostringstream out;
+    report(out, options, addressOf(cluster.ports.back()), timeline, all, missing, membership);
+    return out.str();
+}
+
+static bool runScenario(const Options& options, Scenario scenario) {
+    Cluster cluster(options);
+    char dir[] = "/tmp/distdata-faults-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return false;
+    }
+    cluster.dir = dir;
+    std::cout << "== " << kScenarioNames[static_cast<size_t>(scenario)] << ": DataNode "
+              << addressOf(cluster.ports.back()) << " of " << options.nodes << ", "
+              << static_cast<uint64_t>(options.rate) << " ops/s" << std::endl;
+    std::string result = runScenario(options, scenario, cluster);
+    bool ok = result.find('\n') != std::string::npos;
+    if (ok) std::cout << result;
+    else std::cerr << "Failed: " << result << std::endl;
+    std::cout << "logs in           " << cluster.dir << std::endl;
+    return ok;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--timeline") {
+            options.timeline = true;
+            continue;
+        }
+        if (flag.compare(0, 2, "--") != 0) {
+            auto name = std::find(std::begin(kScenarioNames), std::end(kScenarioNames), flag);
+            if (name == std::end(kScenarioNames)) return false;
+            options.scenarios.push_back(static_cast<Scenario>(name - std::begin(kScenarioNames)));
+            continue;
+        }
+        if (i + 1 == argc) return false;
+        std::string value = argv[++i];
+        if (flag == "--bin") {
+            options.bin = value;
+        } else if (flag == "--nodes") {
+            options.nodes = std::max<size_t>(2, std::stoul(value));
+        } else if (flag == "--port") {
+            options.port = std::stoi(value);
+        } else if (flag == "--rate") {
+            options.rate = std::max(1.0, std::stod(value));
+        } else if (flag == "--threads") {
+            options.threads = std::max<size_t>(1, std::stoul(value));
+        } else if (flag == "--keys") {
+            options.keys = std::max<size_t>(1, std::stoul(value));
+        } else if (flag == "--baseline") {
+            options.baseline = std::stod(value);
+        } else if (flag == "--fault") {
+            options.fault = std::stod(value);
+        } else if (flag == "--after") {
+            options.after = std::stod(value);
+        } else if (flag == "--delay-ms") {
+            options.delayMs = static_cast<uint32_t>(std::stoul(value));
+        } else if (flag == "--loss") {
+            options.loss = std::stod(value);
+        } else if (flag == "--window-ms") {
+            options.windowMs = std::stod(value);
+        } else {
+            return false;
+        }
+    }
+    if (options.baseline < 1 || options.fault <= 0 || options.after < kSettle.count() || options.windowMs <= 0 ||
+        options.loss < 0 || options.loss > 1) {
+        return false;
+    }
+    if (options.scenarios.empty()) {
+        options.scenarios = {Scenario::Crash, Scenario::Partition, Scenario::Latency, Scenario::Loss};
+    }
+    if (options.bin.empty()) {
+        char self[4096];
+        ssize_t size = readlink("/proc/self/exe", self, sizeof(self) - 1);
+        std::string path = size > 0 ? std::string(self, size) : std::string(argv[0]);
+        size_t slash = path.rfind('/');
+        options.bin = slash == std::string::npos ? "." : path.substr(0, slash);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: FailureRecoveryTest [--bin DIR] [--nodes N] [--port PORT] [--rate OPS_PER_SEC]\n"
+                     "                           [--threads N] [--keys N] [--baseline SECONDS] [--fault SECONDS]\n"
+                     "                           [--after SECONDS] [--delay-ms MS] [--loss SHARE] [--window-ms MS]\n"
+                     "                           [--timeline] [crash|partition|latency|loss ...]"
+                  << std::endl;
+        return 2;
+    }
+    // Set before the first connection: the cluster's processes inherit both,
+    // and this one takes faults too, for the clients' side of a partition
+    setenv("DISTDATA_FAULT_INJECTION", "1", 1);
+    setenv("DISTDATA_COORDINATORS", addressOf(options.port).c_str(), 1);
+    bool ok = true;
+    for (Scenario scenario : options.scenarios) {
+        ok = runScenario(options, scenario) && ok;
+        std::cout << std::endl;
+    }
+    return ok ? 0 : 1;
+}
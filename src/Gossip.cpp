@@ -0,0 +1,339 @@
+#include "Gossip.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+PhiAccrualDetector::PhiAccrualDetector(std::chrono::milliseconds expected, std::chrono::milliseconds minStdDev)
+    : minStdDev(minStdDev) {
+    // Two samples a standard deviation either side of the expected interval
+    double mean = static_cast<double>(expected.count());
+    double deviation = mean / 4.0;
+    for (double interval : {mean - deviation, mean + deviation}) {
+        intervals.push_back(interval);
+        sum += interval;
+        sumSquares += interval * interval;
+    }
+}
+
+void PhiAccrualDetector::heartbeat(GossipTime now) {
+    if (started) {
+        double interval = std::chrono::duration<double, std::milli>(now - last).count();
+        intervals.push_back(interval);
+        sum += interval;
+        sumSquares += interval * interval;
+        if (intervals.size() > kWindow) {
+            double oldest = intervals.front();
+            intervals.pop_front();
+            sum -= oldest;
+            sumSquares -= oldest * oldest;
+        }
+    }
+    last = now;
+    started = true;
+}
+
+double PhiAccrualDetector::phi(GossipTime now) const {
+    if (!started) return 0.0;
+    double n = static_cast<double>(intervals.size());
+    double mean = sum / n;
+    double variance = std::max(0.0, sumSquares / n - mean * mean);
+    double deviation = std::max(std::sqrt(variance), static_cast<double>(minStdDev.count()));
+    double elapsed = std::chrono::duration<double, std::milli>(now - last).count();
+    // Logistic approximation of the normal CDF, as used by Akka and Cassandra;
+    // the two branches keep the tail from rounding to zero
+    double y = (elapsed - mean) / deviation;
+    double e = std::exp(-y * (1.5976 + 0.070566 * y * y));
+    if (elapsed > mean) return -std::log10(e / (1.0 + e));
+    return -std::log10(1.0 - 1.0 / (1.0 + e));
+}
+
+SwimNode::Member::Member(std::string address, const SwimConfig& config)
+    : address(std::move(address)), detector(config.period, config.period / 4) {}
+
+SwimNode::SwimNode(std::string id, std::string address, SwimConfig config, GossipTransport& transport)
+    : self(std::move(id)), selfAddress(std::move(address)), config(config), transport(transport),
+      random(std::hash<std::string>{}(self)) {}
+
+std::string SwimNode::addressOf(const NodeInfo& node) {
+    return node.ip + ":" + std::to_string(node.port);
+}
+
+void SwimNode::onDeath(DeathCallback callback) {
+    std::lock_guard<std::mutex> lock(mtx);
+    deathCallback = std::move(callback);
+}
+
+MemberStatus SwimNode::status(const std::string& id) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = members.find(id);
+    return it == members.end() ? MemberStatus::Dead : it->second.status;
+}
+
+uint64_t SwimNode::incarnation() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return selfIncarnation;
+}
+
+void SwimNode::setMembers(const std::vector<NodeInfo>& nodes, GossipTime now) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::map<std::string, std::string> listed;
+    for (const auto& node : nodes) {
+        if (node.uuid != self) listed.emplace(node.uuid, addressOf(node));
+    }
+    for (auto it = members.begin(); it != members.end();) {
+        it = listed.count(it->first) ? std::next(it) : members.erase(it);
+    }
+    for (const auto& [id, address] : listed) {
+        auto it = members.find(id);
+        if (it == members.end()) {
+            it = members.emplace(id, Member(address, config)).first;
+            it->second.detector.heartbeat(now);
+        } else {
+            it->second.address = address;
+        }
+    }
+    ringDirty = true;
+}
+
+double SwimNode::logMembers() const {
+    return std::log2(static_cast<double>(members.size() + 2));
+}
+
+const std::vector<std::string>& SwimNode::monitored() {
+    if (!ringDirty) return ring;
+    ringDirty = false;
+    std::hash<std::string> hasher;
+    std::vector<std::pair<size_t, std::string>> positions;
+    positions.emplace_back(hasher(self), self);
+    for (const auto& [id, member] : members) {
+        if (member.status != MemberStatus::Dead) positions.emplace_back(hasher(id), id);
+    }
+    std::sort(positions.begin(), positions.end());
+    size_t start = 0;
+    while (positions[start].second != self) ++start;
+    ring.clear();
+    size_t count = std::min(config.monitors, positions.size() - 1);
+    for (size_t i = 1; i <= count; ++i) {
+        ring.push_back(positions[(start + i) % positions.size()].second);
+    }
+    return ring;
+}
+
+void SwimNode::tick(GossipTime now) {
+    std::vector<std::string> deaths;
+    DeathCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!roundsStarted || now - nextRound > config.period * 2) {
+            // First tick, or the caller stalled: resume from now rather than
+            // sending the missed rounds in a burst
+            nextRound = now;
+            roundsStarted = true;
+        }
+        while (now >= nextRound) {
+            startRound(nextRound);
+            nextRound += config.period;
+        }
+        checkMonitored(now);
+        expireSuspicions(now);
+        for (auto it = relays.begin(); it != relays.end();) {
+            it = it->second.expires <= now ? relays.erase(it) : std::next(it);
+        }
+        deaths.swap(localDeaths);
+        callback = deathCallback;
+    }
+    if (callback) {
+        for (const auto& id : deaths) callback(id);
+    }
+}
+
+void SwimNode::startRound(GossipTime now) {
+    (void)now;
+    for (const auto& id : monitored()) {
+        auto it = members.find(id);
+        if (it != members.end()) send(it->second.address, GossipKind::Ping, nextSeq++, id);
+    }
+}
+
+void SwimNode::checkMonitored(GossipTime now) {
+    for (const auto& id : monitored()) {
+        auto it = members.find(id);
+        if (it == members.end() || it->second.status != MemberStatus::Alive) continue;
+        Member& member = it->second;
+        if (member.indirectPending) {
+            if (now - member.indirectSentAt >= config.period) markSuspect(id, member, now);
+            continue;
+        }
+        if (member.detector.phi(now) < config.suspectPhi) continue;
+        // Rule out a problem on our own link before suspecting: other members
+        // ping the target, and any ack they forward counts as a heartbeat
+        std::vector<std::string> helpers;
+        for (const auto& [otherId, other] : members) {
+            if (otherId != id && other.status == MemberStatus::Alive) helpers.push_back(otherId);
+        }
+        std::shuffle(helpers.begin(), helpers.end(), random);
+        helpers.resize(std::min(helpers.size(), config.indirectProbes));
+        for (const auto& helper : helpers) {
+            send(members.at(helper).address, GossipKind::PingReq, nextSeq++, id);
+        }
+        member.indirectPending = true;
+        member.indirectSentAt = now;
+    }
+}
+
+void SwimNode::expireSuspicions(GossipTime now) {
+    auto timeout = std::chrono::duration_cast<GossipClock::duration>(
+        config.period * (config.suspicionRounds * logMembers()));
+    for (auto& [id, member] : members) {
+        if (member.status == MemberStatus::Suspect && now - member.suspectedAt >= timeout) {
+            markDead(id, member, true);
+        }
+    }
+}
+
+void SwimNode::markSuspect(const std::string& id, Member& member, GossipTime now) {
+    member.status = MemberStatus::Suspect;
+    member.suspectedAt = now;
+    member.indirectPending = false;
+    enqueue(id, member);
+}
+
+void SwimNode::markDead(const std::string& id, Member& member, bool local) {
+    member.status = MemberStatus::Dead;
+    member.indirectPending = false;
+    ringDirty = true;
+    enqueue(id, member);
+    if (local) localDeaths.push_back(id);
+}
+
+void SwimNode::restartDetector(Member& member, GossipTime now) {
+    member.detector = PhiAccrualDetector(config.period, config.period / 4);
+    member.detector.heartbeat(now);
+    member.indirectPending = false;
+}
+
+void SwimNode::enqueue(const std::string& id, const Member& member) {
+    GossipUpdateData update;
+    update.id = id;
+    update.address = member.address;
+    update.incarnation = member.incarnation;
+    update.status = static_cast<uint8_t>(member.status);
+    queueUpdate(std::move(update));
+}
+
+void SwimNode::enqueueSelf() {
+    GossipUpdateData update;
+    update.id = self;
+    update.address = selfAddress;
+    update.incarnation = selfIncarnation;
+    update.status = static_cast<uint8_t>(MemberStatus::Alive);
+    queueUpdate(std::move(update));
+}
+
+void SwimNode::queueUpdate(GossipUpdateData update) {
+    // A newer update about a member replaces the one still being spread
+    auto it = std::find_if(queue.begin(), queue.end(),
+                           [&](const QueuedUpdate& queued) { return queued.update.id == update.id; });
+    if (it != queue.end()) queue.erase(it);
+    queue.push_back({std::move(update), 0});
+}
+
+void SwimNode::applyUpdate(const GossipUpdateData& update, GossipTime now) {
+    auto status = static_cast<MemberStatus>(update.status);
+    if (update.id == self) {
+        if (status != MemberStatus::Alive && update.incarnation >= selfIncarnation) {
+            selfIncarnation = update.incarnation + 1;
+            enqueueSelf();
+        }
+        return;
+    }
+    auto it = members.find(update.id);
+    if (it == members.end()) return; // Membership itself comes from the coordinator
+    Member& member = it->second;
+    switch (status) {
+        case MemberStatus::Alive:
+            // Only the member raises its incarnation, so a higher one is a
+            // refutation even of a Dead verdict
+            if (update.incarnation <= member.incarnation) return;
+            if (member.status == MemberStatus::Dead) ringDirty = true;
+            member.incarnation = update.incarnation;
+            member.status = MemberStatus::Alive;
+            restartDetector(member, now);
+            enqueue(update.id, member);
+            break;
+        case MemberStatus::Suspect:
+            if (member.status == MemberStatus::Dead) return;
+            if (update.incarnation < member.incarnation) return;
+            if (update.incarnation == member.incarnation && member.status == MemberStatus::Suspect) return;
+            member.incarnation = update.incarnation;
+            markSuspect(update.id, member, now);
+            break;
+        case MemberStatus::Dead:
+            if (member.status == MemberStatus::Dead) return;
+            member.incarnation = std::max(member.incarnation, update.incarnation);
+            markDead(update.id, member, false);
+            break;
+    }
+}
+
+void SwimNode::receive(const Message& message, GossipTime now) {
+    std::lock_guard<std::mutex> lock(mtx);
+    const GossipData& gossip = message.gossip;
+    for (const auto& update : gossip.updates) applyUpdate(update, now);
+
+    auto sender = members.find(gossip.from);
+    switch (static_cast<GossipKind>(gossip.kind)) {
+        case GossipKind::Ping:
+            if (sender != members.end()) send(sender->second.address, GossipKind::Ack, gossip.seq, self);
+            break;
+        case GossipKind::PingReq: {
+            auto target = members.find(gossip.target);
+            if (sender == members.end() || target == members.end()) break;
+            uint64_t seq = nextSeq++;
+            relays[seq] = {gossip.from, gossip.seq, now + config.period * 2};
+            send(target->second.address, GossipKind::Ping, seq, gossip.target);
+            break;
+        }
+        case GossipKind::Ack: {
+            auto relay = relays.find(gossip.seq);
+            if (relay != relays.end()) {
+                auto requester = members.find(relay->second.requester);
+                if (requester != members.end()) {
+                    send(requester->second.address, GossipKind::Ack, relay->second.seq, gossip.target);
+                }
+                relays.erase(relay);
+            }
+            auto target = members.find(gossip.target);
+            if (target != members.end() && target->second.status == MemberStatus::Alive) {
+                target->second.detector.heartbeat(now);
+                target->second.indirectPending = false;
+            }
+            break;
+        }
+    }
+}
+
+void SwimNode::send(const std::string& address, GossipKind kind, uint64_t seq, const std::string& target) {
+    Message message;
+    message.type = MessageType::GOSSIP;
+    message.gossip.kind = static_cast<uint8_t>(kind);
+    message.gossip.seq = seq;
+    message.gossip.from = self;
+    message.gossip.target = target;
+
+    // Piggyback the updates sent the fewest times; each is dropped once it
+    // has gone out often enough to have reached every member with high
+    // probability
+    std::stable_sort(queue.begin(), queue.end(),
+                     [](const QueuedUpdate& a, const QueuedUpdate& b) { return a.sent < b.sent; });
+    size_t limit = static_cast<size_t>(std::ceil(config.retransmitMultiplier * logMembers()));
+    size_t count = std::min(queue.size(), config.maxPiggyback);
+    for (size_t i = 0; i < count; ++i) {
+        message.gossip.updates.push_back(queue[i].update);
+        ++queue[i].sent;
+    }
+    queue.erase(std::remove_if(queue.begin(), queue.end(),
+                               [&](const QueuedUpdate& queued) { return queued.sent >= limit; }),
+                queue.end());
+    transport.send(address, message);
+}
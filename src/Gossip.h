@@ -0,0 +1,160 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "message.h"
+
+using GossipClock = std::chrono::steady_clock;
+using GossipTime = GossipClock::time_point;
+
+// Suspicion level of one peer from the arrival times of its acks (Hayashibara
+// et al.'s phi-accrual detector). phi is -log10 of the probability that an ack
+// would still be outstanding after the time already waited, under a normal
+// fit of the recent inter-arrival times. A threshold on phi adapts to each
+// link's own jitter where a fixed timeout either flaps or detects late.
+class PhiAccrualDetector {
+public:
+    static constexpr size_t kWindow = 100;
+
+    // `expected` seeds the window so phi is meaningful from the first ack;
+    // `minStdDev` keeps a very regular link from making phi jump on one late ack
+    PhiAccrualDetector(std::chrono::milliseconds expected, std::chrono::milliseconds minStdDev);
+
+    void heartbeat(GossipTime now);
+    double phi(GossipTime now) const;
+
+private:
+    std::chrono::milliseconds minStdDev;
+    std::deque<double> intervals; // Milliseconds
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    GossipTime last;
+    bool started = false;
+};
+
+enum class MemberStatus : uint8_t { Alive, Suspect, Dead };
+
+// Kind of a gossip datagram, carried in GossipData::kind
+enum class GossipKind : uint8_t {
+    Ping,
+    PingReq, // Ask the receiver to ping `target` on the sender's behalf
+    Ack,
+};
+
+struct SwimConfig {
+    std::chrono::milliseconds period{200}; // One probe round
+    size_t monitors = 3;                   // Ring successors each node pings every round
+    size_t indirectProbes = 3;             // Members asked to ping a silent peer on our behalf
+    double suspectPhi = 8.0;               // Phi at which a silent peer is probed indirectly, then suspected
+    // A suspicion not refuted within suspicionRounds * log2(members + 1)
+    // rounds becomes a Dead verdict, which leaves time to gossip it to the
+    // suspect and hear its refutation
+    double suspicionRounds = 4.0;
+    size_t maxPiggyback = 8;               // Updates carried per datagram
+    double retransmitMultiplier = 3.0;     // Each update is sent multiplier * log2(members + 1) times
+};
+
+// Sends one datagram; delivery is best effort
+class GossipTransport {
+public:
+    virtual ~GossipTransport() = default;
+    virtual void send(const std::string& address, const Message& message) = 0;
+};
+
+// SWIM-style failure detector and dissemination for one DataNode. Every round
+// the node pings its `monitors` successors on a hash ring of the members and
+// feeds their acks into one phi-accrual detector each. When a peer's phi
+// crosses suspectPhi, `indirectProbes` other members ping it on our behalf;
+// only if none of them gets an ack within a round is it suspected. Suspicions
+// spread by piggybacking on the pings and acks already being sent, and a
+// suspected member refutes them by gossiping a higher incarnation. Each node
+// sends a constant number of datagrams per round whatever the cluster size.
+//
+// Which nodes exist comes from the coordinator (setMembers); gossip only
+// decides which of them are alive. Time is passed in, so a simulation can run
+// it in virtual time. Thread-safe.
+class SwimNode {
+public:
+    // Called when this node itself reaches a Dead verdict, rather than hearing
+    // it from a peer
+    using DeathCallback = std::function<void(const std::string& id)>;
+
+    SwimNode(std::string id, std::string address, SwimConfig config, GossipTransport& transport);
+
+    // Members that appear become Alive; members that disappear are dropped
+    void setMembers(const std::vector<NodeInfo>& nodes, GossipTime now);
+    // Run the protocol up to `now`; call at least four times per period
+    void tick(GossipTime now);
+    void receive(const Message& message, GossipTime now);
+    void onDeath(DeathCallback callback);
+
+    MemberStatus status(const std::string& id) const;
+    uint64_t incarnation() const;
+    const std::string& id() const { return self; }
+
+    // "ip:port" of a node's gossip endpoint, which shares its TCP port number
+    static std::string addressOf(const NodeInfo& node);
+
+private:
+    struct Member {
+        std::string address;
+        uint64_t incarnation = 0;
+        MemberStatus status = MemberStatus::Alive;
+        GossipTime suspectedAt;
+        PhiAccrualDetector detector;
+        bool indirectPending = false;
+        GossipTime indirectSentAt;
+
+        Member(std::string address, const SwimConfig& config);
+    };
+    // A PingReq we are serving: forward the target's ack to the requester
+    struct Relay {
+        std::string requester;
+        uint64_t seq;
+        GossipTime expires;
+    };
+    struct QueuedUpdate {
+        GossipUpdateData update;
+        size_t sent = 0;
+    };
+
+    void startRound(GossipTime now);
+    void checkMonitored(GossipTime now);
+    void expireSuspicions(GossipTime now);
+    void applyUpdate(const GossipUpdateData& update, GossipTime now);
+    void markSuspect(const std::string& id, Member& member, GossipTime now);
+    void markDead(const std::string& id, Member& member, bool local);
+    void enqueue(const std::string& id, const Member& member);
+    void enqueueSelf();
+    void queueUpdate(GossipUpdateData update);
+    void restartDetector(Member& member, GossipTime now);
+    void send(const std::string& address, GossipKind kind, uint64_t seq, const std::string& target);
+    const std::vector<std::string>& monitored();
+    double logMembers() const;
+
+    mutable std::mutex mtx;
+    std::string self;
+    std::string selfAddress;
+    SwimConfig config;
+    GossipTransport& transport;
+    uint64_t selfIncarnation = 0;
+    std::map<std::string, Member> members; // Without this node
+    std::vector<std::string> ring;         // Monitored successors, rebuilt when members change
+    bool ringDirty = true;
+    std::unordered_map<uint64_t, Relay> relays;
+    std::vector<QueuedUpdate> queue;
+    uint64_t nextSeq = 1;
+    GossipTime nextRound;
+    bool roundsStarted = false;
+    std::mt19937_64 random;
+    std::vector<std::string> localDeaths; // Reported to deathCallback outside the lock
+    DeathCallback deathCallback;
+};
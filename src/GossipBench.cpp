@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Gossip.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+// SWIM failure detection in a simulated cluster, run in virtual time: how
+// long a crash takes to be suspected and declared dead, how often a live node
+// is declared dead under packet loss, and what the protocol costs per node.
+// Usage: GossipBench [seconds of the no-crash run]
+
+using Millis = std::chrono::milliseconds;
+
+// Delivers datagrams after a random latency, dropping a fraction of them.
+// Messages go through the real serializer so sizes are those on the wire.
+class SimulatedNetwork {
+public:
+    SimulatedNetwork(double loss, uint64_t seed) : loss(loss), random(seed) {}
+
+    class Endpoint : public GossipTransport {
+    public:
+        Endpoint(SimulatedNetwork& network) : network(network) {}
+        void send(const std::string& address, const Message& message) override {
+            network.send(address, message);
+        }
+
+    private:
+        SimulatedNetwork& network;
+    };
+
+    void attach(const std::string& address, size_t index) { indexes[address] = index; }
+
+    void send(const std::string& address, const Message& message) {
+        std::vector<uint8_t> bytes = MessageSerializer::serialize(message);
+        ++sentMessages;
+        sentBytes += bytes.size();
+        if (std::uniform_real_distribution<double>(0.0, 1.0)(random) < loss) return;
+        auto it = indexes.find(address);
+        if (it == indexes.end()) return;
+        // 0.5ms base plus an exponential tail averaging 1ms
+        double latency = 0.5 + std::exponential_distribution<double>(1.0)(random);
+        in_flight.push({now + std::chrono::duration_cast<GossipClock::duration>(
+                                  std::chrono::duration<double, std::milli>(latency)),
+                        order++, it->second, std::move(bytes)});
+    }
+
+    // Hand every datagram due by `until` to `deliver`
+    template <typename Deliver>
+    void deliver(GossipTime until, Deliver&& deliverTo) {
+        while (!in_flight.empty() && in_flight.top().at <= until) {
+            Datagram datagram = in_flight.top();
+            in_flight.pop();
+            now = datagram.at;
+            deliverTo(datagram.to, MessageDeserializer::deserialize(datagram.bytes));
+        }
+        now = until;
+    }
+
+    GossipTime now;
+    uint64_t sentMessages = 0;
+    uint64_t sentBytes = 0;
+
+private:
+    struct Datagram {
+        GossipTime at;
+        uint64_t order;
+        size_t to;
+        std::vector<uint8_t> bytes;
+        bool operator>(const Datagram& other) const {
+            return at != other.at ? at > other.at : order > other.order;
+        }
+    };
+
+    double loss;
+    std::mt19937_64 random;
+    std::unordered_map<std::string, size_t> indexes;
+    std::priority_queue<Datagram, std::vector<Datagram>, std::greater<Datagram>> in_flight;
+    uint64_t order = 0;
+};
+
+struct Cluster {
+    SimulatedNetwork network;
+    std::vector<std::unique_ptr<SimulatedNetwork::Endpoint>> endpoints;
+    std::vector<std::unique_ptr<SwimNode>> nodes;
+    std::vector<bool> crashed;
+    uint64_t localDeaths = 0; // Dead verdicts reached by an observer itself
+    std::vector<Millis> firstDeath;
+
+    Cluster(size_t count, double loss, const SwimConfig& config, GossipTime start)
+        : network(loss, count * 1000 + static_cast<uint64_t>(loss * 1e4)), crashed(count, false),
+          firstDeath(count, Millis(-1)) {
+        network.now = start;
+        std::vector<NodeInfo> infos;
+        for (size_t i = 0; i < count; ++i) {
+            infos.push_back({"node-" + std::to_string(i), "10.0." + std::to_string(i / 250) + "." +
+                             std::to_string(i % 250 + 1), 9000});
+        }
+        for (size_t i = 0; i < count; ++i) {
+            endpoints.push_back(std::make_unique<SimulatedNetwork::Endpoint>(network));
+            std::string address = SwimNode::addressOf(infos[i]);
+            network.attach(address, i);
+            nodes.push_back(std::make_unique<SwimNode>(infos[i].uuid, address, config, *endpoints.back()));
+            nodes.back()->onDeath([this, start](const std::string& id) {
+                ++localDeaths;
+                size_t index = std::stoul(id.substr(5));
+                if (firstDeath[index].count() < 0) {
+                    firstDeath[index] = std::chrono::duration_cast<Millis>(network.now - start);
+                }
+            });
+            nodes.back()->setMembers(infos, start);
+        }
+    }
+
+    // Advance virtual time by `step`, ticking every live node
+    void advance(Millis step) {
+        GossipTime until = network.now + step;
+        network.deliver(until, [&](size_t to, const Message& message) {
+            if (!crashed[to]) nodes[to]->receive(message, network.now);
+        });
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (!crashed[i]) nodes[i]->tick(until);
+        }
+    }
+};
+
+static double toSeconds(Millis ms) { return ms.count() / 1000.0; }
+
+int main(int argc, char** argv) {
+    double quietSeconds = argc > 1 ? std::stod(argv[1]) : 120.0;
+    SwimConfig config;
+    const Millis step = config.period / 4;
+    const Millis warmup(10000);
+    const Millis detectLimit(60000);
+    const GossipTime start = GossipTime() + std::chrono::hours(1);
+
+    std::cout << "period=" << config.period.count() << "ms monitors=" << config.monitors
+              << " indirect=" << config.indirectProbes << " suspectPhi=" << config.suspectPhi << std::endl;
+    std::cout << std::left << std::setw(7) << "nodes" << std::setw(7) << "loss" << std::setw(11) << "suspect_s"
+              << std::setw(10) << "first_s" << std::setw(10) << "all_s" << std::setw(12) << "false_dead"
+              << std::setw(12) << "refutations" << std::setw(12) << "msgs/node/s" << "bytes/node/s" << std::endl;
+
+    for (size_t count : {16, 64, 256}) {
+        for (double loss : {0.0, 0.01, 0.05}) {
+            // Crash one node after a warm-up and time the detection
+            Cluster crash(count, loss, config, start);
+            while (crash.network.now - start < warmup) crash.advance(step);
+            const size_t victim = count / 2;
+            const std::string victimId = "node-" + std::to_string(victim);
+            crash.crashed[victim] = true;
+            GossipTime crashedAt = crash.network.now;
+            Millis firstSuspect(-1);
+            Millis allDead(-1);
+            while (crash.network.now - crashedAt < detectLimit && allDead.count() < 0) {
+                crash.advance(step);
+                size_t dead = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    if (i == victim) continue;
+                    MemberStatus status = crash.nodes[i]->status(victimId);
+                    if (status != MemberStatus::Alive && firstSuspect.count() < 0) {
+                        firstSuspect = std::chrono::duration_cast<Millis>(crash.network.now - crashedAt);
+                    }
+                    if (status == MemberStatus::Dead) ++dead;
+                }
+                if (dead == count - 1) allDead = std::chrono::duration_cast<Millis>(crash.network.now - crashedAt);
+            }
+            Millis firstDead = crash.firstDeath[victim].count() < 0
+                                   ? Millis(-1)
+                                   : crash.firstDeath[victim] - std::chrono::duration_cast<Millis>(crashedAt - start);
+
+            // No crash: every Dead verdict is a false positive
+            Cluster quiet(count, loss, config, start);
+            const Millis quietRun(static_cast<long long>(quietSeconds * 1000));
+            while (quiet.network.now - start < quietRun) quiet.advance(step);
+            uint64_t refutations = 0;
+            for (const auto& node : quiet.nodes) refutations += node->incarnation();
+            double nodeSeconds = static_cast<double>(count) * quietSeconds;
+
+            std::cout << std::setw(7) << count << std::setw(7) << loss << std::setw(11) << toSeconds(firstSuspect)
+                      << std::setw(10) << toSeconds(firstDead) << std::setw(10) << toSeconds(allDead)
+                      << std::setw(12) << quiet.localDeaths << std::setw(12) << refutations << std::setw(12)
+                      << std::setprecision(3) << quiet.network.sentMessages / nodeSeconds
+                      << quiet.network.sentBytes / nodeSeconds << std::setprecision(6) << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+#include "HashJoin.h"
+#include <algorithm>
+#include <stdexcept>
+#include "HyperLogLog.h"
+
+PartitionedHashTable::PartitionedHashTable(const std::vector<uint64_t>& hashes) : bits(0) {
+    while ((hashes.size() >> bits) > kPartitionEntries && bits < 16) ++bits;
+    size_t partitions = size_t(1) << bits;
+    std::vector<size_t> counts(partitions, 0);
+    for (uint64_t hash : hashes) ++counts[partitionOf(hash)];
+
+    // Each partition gets a power-of-two table at most half full
+    offsets.resize(partitions + 1);
+    offsets[0] = 0;
+    for (size_t p = 0; p < partitions; ++p) {
+        size_t capacity = 1;
+        while (capacity < counts[p] * 2 + 1) capacity <<= 1;
+        offsets[p + 1] = offsets[p] + capacity;
+    }
+    slots.assign(offsets[partitions], Slot{0, kEmpty});
+    next.assign(hashes.size(), kEmpty);
+
+    std::vector<uint32_t> order;
+    std::vector<size_t> starts;
+    scatter(hashes, order, starts);
+    for (uint32_t row : order) {
+        uint64_t hash = hashes[row];
+        size_t p = partitionOf(hash);
+        size_t base = offsets[p];
+        size_t mask = offsets[p + 1] - base - 1;
+        size_t i = hash & mask;
+        while (slots[base + i].row != kEmpty && slots[base + i].hash != hash) i = (i + 1) & mask;
+        next[row] = slots[base + i].row;
+        slots[base + i] = Slot{hash, row};
+    }
+}
+
+void PartitionedHashTable::scatter(const std::vector<uint64_t>& hashes, std::vector<uint32_t>& order,
+                                   std::vector<size_t>& starts) const {
+    size_t partitions = partitionCount();
+    starts.assign(partitions + 1, 0);
+    for (uint64_t hash : hashes) ++starts[partitionOf(hash) + 1];
+    for (size_t p = 0; p < partitions; ++p) starts[p + 1] += starts[p];
+    std::vector<size_t> cursor(starts.begin(), starts.end() - 1);
+    order.resize(hashes.size());
+    for (size_t row = 0; row < hashes.size(); ++row) {
+        order[cursor[partitionOf(hashes[row])]++] = static_cast<uint32_t>(row);
+    }
+}
+
+void hashJoinRows(const Rows& left, size_t leftKey, const Rows& right, size_t rightKey, ColumnTable& out) {
+    bool buildLeft = left.size() <= right.size();
+    const Rows& build = buildLeft ? left : right;
+    const Rows& probe = buildLeft ? right : left;
+    size_t buildKey = buildLeft ? leftKey : rightKey;
+    size_t probeKey = buildLeft ? rightKey : leftKey;
+
+    std::vector<uint64_t> buildHashes(build.size());
+    for (size_t i = 0; i < build.size(); ++i) buildHashes[i] = hashBytes(build[i][buildKey]);
+    std::vector<uint64_t> probeHashes(probe.size());
+    for (size_t i = 0; i < probe.size(); ++i) probeHashes[i] = hashBytes(probe[i][probeKey]);
+
+    PartitionedHashTable table(buildHashes);
+    std::vector<std::string_view> fields;
+    table.probeAll(probeHashes, [&](uint32_t buildRow, uint32_t probeRow) {
+        const auto& b = build[buildRow];
+        const auto& p = probe[probeRow];
+        if (b[buildKey] != p[probeKey]) return;
+        const auto& l = buildLeft ? b : p;
+        const auto& r = buildLeft ? p : b;
+        fields.clear();
+        fields.insert(fields.end(), l.begin(), l.end());
+        fields.insert(fields.end(), r.begin(), r.end());
+        out.appendRow(fields);
+    });
+}
+
+size_t shufflePartition(const std::string& key, size_t nodeCount) {
+    return static_cast<size_t>(hashBytes(key) % nodeCount);
+}
+
+JoinPlan::JoinPlan(const TableCatalog& catalog, const Statement& statement, QueryArena& arena) {
+    std::string_view names[2] = {statement.table, statement.join->table};
+    for (int side = 0; side < 2; ++side) {
+        tables[side] = catalog.find(std::string(names[side]));
+        if (!tables[side]) throw std::invalid_argument("Unknown table " + std::string(names[side]));
+    }
+
+    int leftKeySide = sideOf(statement.join->leftKey);
+    int rightKeySide = sideOf(statement.join->rightKey);
+    if (leftKeySide == rightKeySide) throw std::invalid_argument("Join condition must compare columns of both tables");
+    std::string_view keyNames[2];
+    keyNames[leftKeySide] = statement.join->leftKey;
+    keyNames[rightKeySide] = statement.join->rightKey;
+    if (statement.itemCount == 0) {
+        for (int side = 0; side < 2; ++side) {
+            for (size_t c = 0; c < tables[side]->columnCount(); ++c) need(side, tables[side]->column(c).name());
+        }
+    }
+    for (int side = 0; side < 2; ++side) need(side, keyNames[side]);
+    for (uint32_t i = 0; i < statement.itemCount; ++i) {
+        if (!statement.items[i].column.empty()) need(sideOf(statement.items[i].column), statement.items[i].column);
+    }
+    for (uint32_t g = 0; g < statement.groupByCount; ++g) need(sideOf(statement.groupBy[g]), statement.groupBy[g]);
+
+    // Split the top-level AND chain between the two scans
+    std::vector<const Expr*> conjuncts[2];
+    std::vector<const Expr*> stack;
+    if (statement.where) stack.push_back(statement.where);
+    while (!stack.empty()) {
+        const Expr* expr = stack.back();
+        stack.pop_back();
+        if (expr->kind == ExprKind::And) {
+            stack.push_back(expr->right);
+            stack.push_back(expr->left);
+            continue;
+        }
+        conjuncts[sideOf(expr)].push_back(expr);
+    }
+
+    for (int side = 0; side < 2; ++side) {
+        Statement& scan = scans[side];
+        scan.table = names[side];
+        SelectItem* items = arena.makeArray<SelectItem>(columns[side].size());
+        for (size_t c = 0; c < columns[side].size(); ++c) {
+            items[c].column = arena.copy(columns[side][c]);
+            if (columns[side][c] == tables[side]->column(tables[side]->findColumn(keyNames[side])).name()) keys[side] = c;
+        }
+        scan.items = items;
+        scan.itemCount = static_cast<uint32_t>(columns[side].size());
+        for (const Expr* conjunct : conjuncts[side]) {
+            if (!scan.where) {
+                scan.where = conjunct;
+                continue;
+            }
+            Expr* both = arena.make<Expr>();
+            both->kind = ExprKind::And;
+            both->left = scan.where;
+            both->right = conjunct;
+            scan.where = both;
+        }
+        scan.paramCount = statement.paramCount;
+    }
+
+    outputStatement = statement;
+    outputStatement.table = arena.copy(std::string(names[0]) + "_" + std::string(names[1]));
+    outputStatement.join = nullptr;
+    outputStatement.where = nullptr;
+}
+
+int JoinPlan::sideOf(std::string_view column) const {
+    bool left = tables[0]->findColumn(column) >= 0;
+    bool right = tables[1]->findColumn(column) >= 0;
+    if (left && right) throw std::invalid_argument("Column " + std::string(column) + " is ambiguous; qualify it with a table name");
+    if (!left && !right) {
+        throw std::invalid_argument("Unknown column " + std::string(column) + " in join of " + tables[0]->name() +
+                                    " and " + tables[1]->name());
+    }
+    return left ? 0 : 1;
+}
+
+int JoinPlan::sideOf(const Expr* expr) const {
+    if (expr->kind != ExprKind::And && expr->kind != ExprKind::Or) return sideOf(expr->column);
+    int left = sideOf(expr->left);
+    if (sideOf(expr->right) != left) {
+        throw std::invalid_argument("Conditions combining columns of both join tables are not supported");
+    }
+    return left;
+}
+
+void JoinPlan::need(int side, std::string_view column) {
+    const std::string& name = tables[side]->column(tables[side]->findColumn(column)).name();
+    if (std::find(columns[side].begin(), columns[side].end(), name) == columns[side].end()) {
+        columns[side].push_back(name);
+    }
+}
+
+ColumnTable JoinPlan::makeOutputTable() const {
+    std::vector<std::pair<std::string, ColumnType>> schema;
+    for (int side = 0; side < 2; ++side) {
+        for (const auto& name : columns[side]) {
+            const Column& column = tables[side]->column(tables[side]->findColumn(name));
+            schema.emplace_back(tables[side]->name() + "." + name, column.type());
+        }
+    }
+    return ColumnTable(std::string(outputStatement.table), schema, false);
+}
+
+void ShuffleExchange::deliver(uint64_t joinId, int side, Rows rows, bool senderDone) {
+    std::lock_guard<std::mutex> lock(mtx);
+    // Drop exchanges whose fragment never came to collect them
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = pending.begin(); it != pending.end();) {
+        if (it->first != joinId && now - it->second.created > std::chrono::minutes(5)) it = pending.erase(it);
+        else ++it;
+    }
+    Pending& entry = pending[joinId];
+    Rows& into = entry.rows[side];
+    for (auto& row : rows) into.push_back(std::move(row));
+    if (senderDone) {
+        ++entry.finished;
+        arrived.notify_all();
+    }
+}
+
+bool ShuffleExchange::collect(uint64_t joinId, size_t senders, std::chrono::milliseconds timeout, Rows& left,
+                              Rows& right) {
+    std::unique_lock<std::mutex> lock(mtx);
+    bool complete = arrived.wait_for(lock, timeout, [&]() {
+        auto it = pending.find(joinId);
+        return senders == 0 || (it != pending.end() && it->second.finished >= senders);
+    });
+    auto it = pending.find(joinId);
+    if (it != pending.end()) {
+        if (complete) {
+            for (auto& row : it->second.rows[0]) left.push_back(std::move(row));
+            for (auto& row : it->second.rows[1]) right.push_back(std::move(row));
+        }
+        pending.erase(it);
+    }
+    return complete;
+}
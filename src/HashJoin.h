@@ -0,0 +1,151 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ColumnStore.h"
+#include "QueryParser.h"
+
+// Steps of a distributed join, carried in JoinData::step
+enum class JoinStep : uint8_t {
+    None,      // Not a join fragment
+    Estimate,  // Reply with the filtered row count of each side
+    ScanSide,  // Reply with the filtered rows of one side
+    Broadcast, // JoinData::rows hold all of one side; join it with the local other side
+    Shuffle,   // Repartition both sides across the nodes by join key, then join locally
+};
+
+// How the coordinator runs a join; Unknown measures both sides first
+enum class JoinStrategy : uint8_t { Unknown, Broadcast, Shuffle };
+
+// Smaller join sides than this, summed over the cluster, are broadcast to
+// every node instead of repartitioning both sides
+constexpr size_t kBroadcastJoinRows = 50000;
+
+using Rows = std::vector<std::vector<std::string>>;
+
+// Hash table over the build side of a join, radix-partitioned on the high hash
+// bits so that each partition's open-addressing table fits in cache. probeAll
+// partitions the probe side the same way and finishes one partition before
+// touching the next, so random accesses stay within one small table.
+class PartitionedHashTable {
+public:
+    explicit PartitionedHashTable(const std::vector<uint64_t>& hashes);
+
+    // Calls emit(buildRow, probeRow) for every pair with equal hashes; callers
+    // still have to compare the keys themselves
+    template <typename Emit>
+    void probeAll(const std::vector<uint64_t>& hashes, Emit emit) const {
+        std::vector<uint32_t> order;
+        std::vector<size_t> starts;
+        scatter(hashes, order, starts);
+        for (size_t p = 0; p + 1 < starts.size(); ++p) {
+            for (size_t i = starts[p]; i < starts[p + 1]; ++i) {
+                uint32_t probeRow = order[i];
+                probe(hashes[probeRow], [&](uint32_t buildRow) { emit(buildRow, probeRow); });
+            }
+        }
+    }
+
+    template <typename Visit>
+    void probe(uint64_t hash, Visit visit) const {
+        size_t p = partitionOf(hash);
+        size_t base = offsets[p];
+        size_t mask = offsets[p + 1] - base - 1;
+        for (size_t i = hash & mask; slots[base + i].row != kEmpty; i = (i + 1) & mask) {
+            if (slots[base + i].hash != hash) continue;
+            for (uint32_t row = slots[base + i].row; row != kEmpty; row = next[row]) visit(row);
+            return;
+        }
+    }
+
+    size_t partitionCount() const { return offsets.size() - 1; }
+
+private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+    // Entries per partition before another radix bit is used (about 128KB of slots)
+    static constexpr size_t kPartitionEntries = 4096;
+
+    // One slot per distinct hash; rows sharing it are chained through `next`
+    struct Slot {
+        uint64_t hash;
+        uint32_t row;
+    };
+
+    size_t partitionOf(uint64_t hash) const { return bits ? static_cast<size_t>(hash >> (64 - bits)) : 0; }
+    // Counting sort of row indices by partition; starts has partitionCount() + 1 entries
+    void scatter(const std::vector<uint64_t>& hashes, std::vector<uint32_t>& order, std::vector<size_t>& starts) const;
+
+    int bits;
+    std::vector<size_t> offsets; // First slot of each partition, plus the end
+    std::vector<Slot> slots;
+    std::vector<uint32_t> next;
+};
+
+// Inner-join two row sets on their key columns, comparing keys as text, and
+// append each joined row (left columns, then right columns) to `out`. The
+// smaller input becomes the build side.
+void hashJoinRows(const Rows& left, size_t leftKey, const Rows& right, size_t rightKey, ColumnTable& out);
+
+// Shuffle partition of a join key among `nodeCount` nodes
+size_t shufflePartition(const std::string& key, size_t nodeCount);
+
+// A JOIN statement resolved against a DataNode's tables. WHERE conjuncts are
+// assigned to the side whose columns they read, so each side is filtered by
+// its own scan before any rows move; only columns the query needs are kept.
+class JoinPlan {
+public:
+    // Throws std::invalid_argument for unknown tables, unknown or ambiguous
+    // columns, and conjuncts that read both sides
+    JoinPlan(const TableCatalog& catalog, const Statement& statement, QueryArena& arena);
+
+    const ColumnTable& table(int side) const { return *tables[side]; }
+    // SELECT of the needed columns of one side, with that side's conjuncts
+    const Statement& scan(int side) const { return scans[side]; }
+    // Position of the join key among scan(side)'s columns
+    size_t keyIndex(int side) const { return keys[side]; }
+
+    // Empty table with both sides' scanned columns, named table.column
+    ColumnTable makeOutputTable() const;
+    // The original select list and GROUP BY, to run over the output table
+    const Statement& output() const { return outputStatement; }
+
+private:
+    int sideOf(std::string_view column) const;
+    int sideOf(const Expr* expr) const;
+    void need(int side, std::string_view column);
+
+    std::shared_ptr<const ColumnTable> tables[2];
+    std::vector<std::string> columns[2];
+    Statement scans[2];
+    size_t keys[2];
+    Statement outputStatement;
+};
+
+// Receiving end of a shuffle: SHUFFLE_DATA batches from peers are buffered per
+// join until the local fragment collects them
+class ShuffleExchange {
+public:
+    // Add rows of `side` sent by a peer; `senderDone` marks its last batch
+    void deliver(uint64_t joinId, int side, Rows rows, bool senderDone);
+
+    // Wait until `senders` peers have finished and move their rows into
+    // `left` / `right`. Returns false if they do not finish within `timeout`.
+    bool collect(uint64_t joinId, size_t senders, std::chrono::milliseconds timeout, Rows& left, Rows& right);
+
+private:
+    struct Pending {
+        Rows rows[2];
+        size_t finished = 0;
+        std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+    };
+
+    std::mutex mtx;
+    std::condition_variable arrived;
+    std::unordered_map<uint64_t, Pending> pending;
+};
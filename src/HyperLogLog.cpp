@@ -0,0 +1,86 @@
+#include "HyperLogLog.h"
+#include <cmath>
+
+uint64_t hashInt64(int64_t value) {
+    uint64_t x = static_cast<uint64_t>(value) + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+uint64_t hashBytes(std::string_view bytes) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : bytes) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return hashInt64(static_cast<int64_t>(h));
+}
+
+HyperLogLog::HyperLogLog() {
+    registers.fill(0);
+}
+
+void HyperLogLog::add(uint64_t hash) {
+    size_t index = hash >> (64 - kPrecision);
+    uint64_t rest = (hash << kPrecision) | (uint64_t(1) << (kPrecision - 1));
+    uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    if (rank > registers[index]) registers[index] = rank;
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    for (size_t i = 0; i < kRegisters; ++i) {
+        if (other.registers[i] > registers[i]) registers[i] = other.registers[i];
+    }
+}
+
+uint64_t HyperLogLog::estimate() const {
+    const double m = static_cast<double>(kRegisters);
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (uint8_t r : registers) {
+        sum += std::ldexp(1.0, -r);
+        zeros += r == 0;
+    }
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    // Linear counting is more accurate while many registers are still empty
+    if (estimate <= 2.5 * m && zeros > 0) estimate = m * std::log(m / static_cast<double>(zeros));
+    return static_cast<uint64_t>(std::llround(estimate));
+}
+
+void HyperLogLog::serialize(std::string& out) const {
+    size_t used = 0;
+    for (uint8_t r : registers) used += r != 0;
+    if (used * 3 < kRegisters) {
+        out.push_back('s');
+        for (size_t i = 0; i < kRegisters; ++i) {
+            if (registers[i] == 0) continue;
+            out.push_back(static_cast<char>(i >> 8));
+            out.push_back(static_cast<char>(i & 0xff));
+            out.push_back(static_cast<char>(registers[i]));
+        }
+        return;
+    }
+    out.push_back('d');
+    out.append(reinterpret_cast<const char*>(registers.data()), kRegisters);
+}
+
+bool HyperLogLog::deserialize(std::string_view in) {
+    registers.fill(0);
+    if (in.empty()) return false;
+    char format = in[0];
+    in.remove_prefix(1);
+    if (format == 'd') {
+        if (in.size() != kRegisters) return false;
+        for (size_t i = 0; i < kRegisters; ++i) registers[i] = static_cast<uint8_t>(in[i]);
+        return true;
+    }
+    if (format != 's' || in.size() % 3 != 0) return false;
+    for (size_t p = 0; p < in.size(); p += 3) {
+        size_t index = (static_cast<uint8_t>(in[p]) << 8) | static_cast<uint8_t>(in[p + 1]);
+        if (index >= kRegisters) return false;
+        registers[index] = static_cast<uint8_t>(in[p + 2]);
+    }
+    return true;
+}
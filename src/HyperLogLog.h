@@ -0,0 +1,32 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 64-bit mix of a value for distinct counting (splitmix64 finalizer)
+uint64_t hashInt64(int64_t value);
+// FNV-1a over the bytes, then mixed
+uint64_t hashBytes(std::string_view bytes);
+
+// HyperLogLog sketch with 2^12 registers (about 1.6% standard error). Sketches
+// built on different nodes merge by taking the register-wise maximum.
+class HyperLogLog {
+public:
+    static constexpr int kPrecision = 12;
+    static constexpr size_t kRegisters = size_t(1) << kPrecision;
+
+    HyperLogLog();
+
+    void add(uint64_t hash);
+    void merge(const HyperLogLog& other);
+    uint64_t estimate() const;
+
+    // Sparse (index, rank) pairs while few registers are set, dense otherwise
+    void serialize(std::string& out) const;
+    // Returns false on malformed input
+    bool deserialize(std::string_view in);
+
+private:
+    std::array<uint8_t, kRegisters> registers;
+};
@@ -0,0 +1,318 @@
+#include "KeyValueStore.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <thread>
+
+size_t KeyValueStore::shardIndex(std::string_view key) const {
+    // The low bits pick the partition, so take the shard from the high ones
+    return (std::hash<std::string_view>{}(key) >> 32) % kShards;
+}
+
+class KeyValueStore::ShardLocks {
+public:
+    ShardLocks(KeyValueStore& store, const std::vector<TxnKeyData>& reads, const std::vector<TxnKeyData>& writes) {
+        std::vector<size_t> indexes;
+        for (const auto& read : reads) indexes.push_back(store.shardIndex(read.key));
+        for (const auto& write : writes) indexes.push_back(store.shardIndex(write.key));
+        std::sort(indexes.begin(), indexes.end());
+        indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+        for (size_t index : indexes) locks.emplace_back(store.shards[index].mtx);
+    }
+
+private:
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+};
+
+static uint64_t blockingReader(const std::vector<uint64_t>& txns, uint64_t txn) {
+    for (uint64_t other : txns) {
+        if (other != txn) return other;
+    }
+    return 0;
+}
+
+KeyStatus KeyValueStore::get(const std::string& key, std::string& value, uint64_t& version, KeyLock& blocker) const {
+    const Shard& shard = shardOf(key);
+    std::shared_lock<std::shared_mutex> lock(shard.mtx);
+    // A prepared transaction may already count as committed, so its writes
+    // must not be read around
+    auto intent = shard.intents.find(key);
+    if (intent != shard.intents.end()) {
+        blocker = {intent->second.txn, intent->second.since};
+        return KeyStatus::Locked;
+    }
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) return KeyStatus::NotFound;
+    value = it->second.value;
+    version = it->second.version;
+    return KeyStatus::Ok;
+}
+
+KeyStatus KeyValueStore::put(const std::string& key, std::string value, uint64_t& version, KeyLock& blocker) {
+    Shard& shard = shardOf(key);
+    std::unique_lock<std::shared_mutex> lock(shard.mtx);
+    auto intent = shard.intents.find(key);
+    if (intent != shard.intents.end()) {
+        blocker = {intent->second.txn, intent->second.since};
+        return KeyStatus::Locked;
+    }
+    auto reader = shard.readLocks.find(key);
+    if (reader != shard.readLocks.end()) {
+        blocker = {reader->second.txns.front(), reader->second.since};
+        return KeyStatus::Locked;
+    }
+    apply(key, std::move(value), false, version);
+    return KeyStatus::Ok;
+}
+
+KeyStatus KeyValueStore::remove(const std::string& key, KeyLock& blocker) {
+    Shard& shard = shardOf(key);
+    std::unique_lock<std::shared_mutex> lock(shard.mtx);
+    auto intent = shard.intents.find(key);
+    if (intent != shard.intents.end()) {
+        blocker = {intent->second.txn, intent->second.since};
+        return KeyStatus::Locked;
+    }
+    auto reader = shard.readLocks.find(key);
+    if (reader != shard.readLocks.end()) {
+        blocker = {reader->second.txns.front(), reader->second.since};
+        return KeyStatus::Locked;
+    }
+    return shard.entries.erase(key) > 0 ? KeyStatus::Ok : KeyStatus::NotFound;
+}
+
+// Callers hold the key's shard exclusively
+void KeyValueStore::apply(const std::string& key, const std::string& value, bool remove, uint64_t& version) {
+    Shard& shard = shardOf(key);
+    if (remove) {
+        shard.entries.erase(key);
+        version = 0;
+        return;
+    }
+    // Taken under the shard lock, so versions of one key increase in write order
+    version = ++clock;
+    Entry& entry = shard.entries[key];
+    entry.value = value;
+    entry.version = version;
+}
+
+size_t KeyValueStore::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mtx);
+        total += shard.entries.size();
+    }
+    return total;
+}
+
+// Callers hold the shards of every key. Reads must be unchanged and not about
+// to change; writes must not touch a key another transaction holds.
+bool KeyValueStore::validate(uint64_t txn, const std::vector<TxnKeyData>& reads,
+                             const std::vector<TxnKeyData>& writes) const {
+    for (const auto& read : reads) {
+        const Shard& shard = shardOf(read.key);
+        auto intent = shard.intents.find(read.key);
+        if (intent != shard.intents.end() && intent->second.txn != txn) return false;
+        auto it = shard.entries.find(read.key);
+        uint64_t current = it == shard.entries.end() ? 0 : it->second.version;
+        if (current != read.version) return false;
+    }
+    for (const auto& write : writes) {
+        const Shard& shard = shardOf(write.key);
+        auto intent = shard.intents.find(write.key);
+        if (intent != shard.intents.end() && intent->second.txn != txn) return false;
+        auto reader = shard.readLocks.find(write.key);
+        if (reader != shard.readLocks.end() && blockingReader(reader->second.txns, txn) != 0) return false;
+    }
+    return true;
+}
+
+TxnStatus KeyValueStore::commit(uint64_t txn, const std::vector<TxnKeyData>& reads, std::vector<TxnKeyData>& writes) {
+    ShardLocks locks(*this, reads, writes);
+    if (!validate(txn, reads, writes)) return TxnStatus::Aborted;
+    for (auto& write : writes) apply(write.key, write.value, write.remove, write.version);
+    return TxnStatus::Committed;
+}
+
+TxnStatus KeyValueStore::prepare(uint64_t txn, const std::vector<TxnKeyData>& reads,
+                                 const std::vector<TxnKeyData>& writes) {
+    ShardLocks locks(*this, reads, writes);
+    if (!validate(txn, reads, writes)) return TxnStatus::Aborted;
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& read : reads) {
+        ReadLock& reader = shardOf(read.key).readLocks[read.key];
+        if (reader.txns.empty()) reader.since = now;
+        reader.txns.push_back(txn);
+    }
+    for (const auto& write : writes) {
+        shardOf(write.key).intents[write.key] = {txn, write.value, write.remove, now};
+    }
+    return TxnStatus::Prepared;
+}
+
+void KeyValueStore::resolve(uint64_t txn, const std::vector<TxnKeyData>& reads, const std::vector<TxnKeyData>& writes,
+                            bool commit) {
+    ShardLocks locks(*this, reads, writes);
+    for (const auto& read : reads) {
+        Shard& shard = shardOf(read.key);
+        auto reader = shard.readLocks.find(read.key);
+        if (reader == shard.readLocks.end()) continue;
+        auto& txns = reader->second.txns;
+        txns.erase(std::remove(txns.begin(), txns.end(), txn), txns.end());
+        if (txns.empty()) shard.readLocks.erase(reader);
+    }
+    for (const auto& write : writes) {
+        Shard& shard = shardOf(write.key);
+        auto intent = shard.intents.find(write.key);
+        if (intent == shard.intents.end() || intent->second.txn != txn) continue;
+        if (commit) {
+            uint64_t version = 0;
+            apply(write.key, intent->second.value, intent->second.remove, version);
+        }
+        shard.intents.erase(intent);
+    }
+}
+
+bool KeyValueStore::exportPartitions(const std::vector<bool>& partitions, std::vector<TxnKeyData>& pairs) const {
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mtx);
+        for (const auto& [key, intent] : shard.intents) {
+            if (partitions[PartitionMap::partitionOf(key)]) return false;
+        }
+        for (const auto& [key, reader] : shard.readLocks) {
+            if (partitions[PartitionMap::partitionOf(key)]) return false;
+        }
+        for (const auto& [key, entry] : shard.entries) {
+            if (!partitions[PartitionMap::partitionOf(key)]) continue;
+            TxnKeyData pair;
+            pair.key = key;
+            pair.value = entry.value;
+            pair.version = entry.version;
+            pairs.push_back(std::move(pair));
+        }
+    }
+    return true;
+}
+
+void KeyValueStore::install(const std::vector<bool>& partitions, const std::vector<TxnKeyData>& pairs) {
+    drop(partitions);
+    for (const auto& pair : pairs) {
+        Shard& shard = shardOf(pair.key);
+        std::unique_lock<std::shared_mutex> lock(shard.mtx);
+        // Later writes here must still get higher versions than these
+        uint64_t seen = clock.load();
+        while (seen < pair.version && !clock.compare_exchange_weak(seen, pair.version)) {
+        }
+        shard.entries[pair.key] = Entry{pair.value, pair.version};
+    }
+}
+
+void KeyValueStore::drop(const std::vector<bool>& partitions) {
+    for (auto& shard : shards) {
+        std::unique_lock<std::shared_mutex> lock(shard.mtx);
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            it = partitions[PartitionMap::partitionOf(it->first)] ? shard.entries.erase(it) : std::next(it);
+        }
+    }
+}
+
+LocalPartition::LocalPartition(std::string uuid) : uuid(std::move(uuid)), owned(PartitionMap::kPartitions) {}
+
+LocalPartition::Admission::Admission(const LocalPartition& partition) : partition(partition) {
+    // Counted in the generation that is current once counted, so an update()
+    // starting a new one either sees this admission or comes before it
+    while (true) {
+        slot = partition.generation.load() & 1;
+        partition.admitted[slot].fetch_add(1);
+        if ((partition.generation.load() & 1) == slot) break;
+        partition.admitted[slot].fetch_sub(1);
+    }
+}
+
+LocalPartition::Admission::~Admission() {
+    partition.admitted[slot].fetch_sub(1);
+}
+
+void LocalPartition::update(const PartitionMap& next) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        bool wasListed = listed;
+        listed = std::any_of(next.nodes.begin(), next.nodes.end(),
+                             [&](const NodeInfo& node) { return node.uuid == uuid; });
+        // Who held each partition before: the previous map, or for a node that
+        // just joined, the map without it
+        PartitionMap before = map;
+        if (!wasListed) {
+            before = next;
+            before.nodes.erase(std::remove_if(before.nodes.begin(), before.nodes.end(),
+                                              [&](const NodeInfo& node) { return node.uuid == uuid; }),
+                               before.nodes.end());
+            before.assign();
+        }
+        for (uint32_t partition = 0; partition < PartitionMap::kPartitions; ++partition) {
+            bool ours = listed && next.ownerOfPartition(partition)->uuid == uuid;
+            bool wasOurs = owned[partition];
+            owned[partition] = ours;
+            if (!ours) {
+                arriving.erase(partition);
+            } else if (!wasOurs) {
+                const NodeInfo* from = before.ownerOfPartition(partition);
+                if (from && from->uuid != uuid) arriving[partition] = Arrival{*from, next.epoch};
+            }
+        }
+        map = next;
+    }
+    changed.notify_all();
+    // Operations admitted under the old map finish before the caller goes on
+    unsigned old = generation.fetch_add(1) & 1;
+    while (admitted[old].load() != 0) std::this_thread::yield();
+}
+
+bool LocalPartition::owns(std::string_view key, uint64_t epoch, uint64_t& current) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    current = map.epoch;
+    size_t partition = PartitionMap::partitionOf(key);
+    return listed && epoch >= map.epoch && owned[partition] &&
+           (arriving.empty() || !arriving.count(static_cast<uint32_t>(partition)));
+}
+
+void LocalPartition::awaitArrival(std::string_view key, std::chrono::steady_clock::time_point deadline) const {
+    uint32_t partition = static_cast<uint32_t>(PartitionMap::partitionOf(key));
+    std::unique_lock<std::mutex> lock(mtx);
+    changed.wait_until(lock, deadline, [&] { return !arriving.count(partition); });
+}
+
+std::vector<LocalPartition::Incoming> LocalPartition::awaitIncoming() const {
+    std::unique_lock<std::mutex> lock(mtx);
+    changed.wait(lock, [&] { return !arriving.empty(); });
+    std::vector<Incoming> incoming;
+    for (const auto& [partition, arrival] : arriving) {
+        auto it = std::find_if(incoming.begin(), incoming.end(), [&](const Incoming& other) {
+            return other.from.uuid == arrival.from.uuid && other.epoch == arrival.epoch;
+        });
+        if (it == incoming.end()) it = incoming.insert(incoming.end(), Incoming{arrival.from, arrival.epoch, {}});
+        it->partitions.push_back(partition);
+    }
+    return incoming;
+}
+
+void LocalPartition::arrived(const std::vector<uint32_t>& partitions) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (uint32_t partition : partitions) arriving.erase(partition);
+    }
+    changed.notify_all();
+}
+
+bool LocalPartition::disowns(uint64_t epoch, const std::vector<uint32_t>& partitions) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (map.epoch < epoch) return false;
+    return std::none_of(partitions.begin(), partitions.end(), [&](uint32_t partition) {
+        return partition >= PartitionMap::kPartitions || owned[partition];
+    });
+}
+
+bool LocalPartition::isMember(const std::string& node) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return std::any_of(map.nodes.begin(), map.nodes.end(), [&](const NodeInfo& other) { return other.uuid == node; });
+}
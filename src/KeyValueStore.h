@@ -0,0 +1,199 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "PartitionMap.h"
+#include "message.h"
+
+// Operation of a DATA_REQUEST, carried in KeyValueData::op
+enum class KeyOp : uint8_t { Get, Put, Remove };
+
+// Outcome of a DATA_REQUEST, carried in KeyValueData::status
+enum class KeyStatus : uint8_t {
+    Ok,
+    NotFound,
+    WrongEpoch,  // The request was routed with a stale map, or the key's partition is still being
+                 // handed over to the node; KeyValueData::epoch holds the node's
+    Unavailable, // The coordinator could not reach the owning node
+    Locked,      // A prepared transaction holds the key and did not resolve in time
+};
+
+// Operation of a TXN_REQUEST, carried in TxnData::op
+enum class TxnOp : uint8_t {
+    Commit,  // One-phase commit of a transaction whose keys all live on one node
+    Prepare, // Validate and lock the node's keys; with participants, also stage the record
+    Resolve, // Apply or drop a prepared transaction; one-way, not answered
+    Status,  // Ask the record node for the outcome, deciding it if still staged
+    Probe,   // Record node to participant: prepared here? If not, never prepare
+};
+
+// Outcome of a TXN_REQUEST, carried in TxnData::status
+enum class TxnStatus : uint8_t {
+    Committed,
+    Aborted,
+    Prepared,
+    Pending,    // Status: some participant could not be reached to decide
+    WrongEpoch, // As KeyStatus::WrongEpoch; nothing was prepared
+};
+
+// The transaction in the way of a key operation and since when
+struct KeyLock {
+    uint64_t txn = 0;
+    std::chrono::steady_clock::time_point since;
+};
+
+// Versioned key-value pairs a DataNode serves for DATA_REQUEST. Keys are
+// spread over independently locked shards so concurrent connections rarely
+// contend. Versions come from one counter per store, so a key that is removed
+// and written again never reuses a version.
+//
+// Transactions are validated optimistically: each read carries the version
+// the client saw (0 for a missing key) and must still be current. A prepared
+// transaction leaves an intent on every key it writes and a read lock on every
+// key it read; until it is resolved, other transactions touching those keys
+// fail validation, and plain operations report the lock so the caller can wait.
+class KeyValueStore {
+public:
+    static constexpr size_t kShards = 64;
+
+    // Ok, NotFound or Locked; `blocker` is set when Locked. A read waits for
+    // intents only, a write for intents and read locks.
+    KeyStatus get(const std::string& key, std::string& value, uint64_t& version, KeyLock& blocker) const;
+    // `version` is the version written
+    KeyStatus put(const std::string& key, std::string value, uint64_t& version, KeyLock& blocker);
+    KeyStatus remove(const std::string& key, KeyLock& blocker);
+    size_t size() const;
+
+    // Validate and apply in one step; on Committed each write's version is set
+    TxnStatus commit(uint64_t txn, const std::vector<TxnKeyData>& reads, std::vector<TxnKeyData>& writes);
+    // Validate and lock: Prepared or Aborted
+    TxnStatus prepare(uint64_t txn, const std::vector<TxnKeyData>& reads, const std::vector<TxnKeyData>& writes);
+    // Apply (commit) or drop the intents of a prepared transaction and release its locks
+    void resolve(uint64_t txn, const std::vector<TxnKeyData>& reads, const std::vector<TxnKeyData>& writes,
+                 bool commit);
+
+    // Handing partitions over (see LocalPartition); `partitions` has a flag
+    // per PartitionMap partition. Copy out their pairs with their versions;
+    // false while a transaction holds one of their keys.
+    bool exportPartitions(const std::vector<bool>& partitions, std::vector<TxnKeyData>& pairs) const;
+    // Replace whatever is held of `partitions` with `pairs`, keeping their versions
+    void install(const std::vector<bool>& partitions, const std::vector<TxnKeyData>& pairs);
+    void drop(const std::vector<bool>& partitions);
+
+private:
+    struct Entry {
+        std::string value;
+        uint64_t version;
+    };
+    struct WriteIntent {
+        uint64_t txn;
+        std::string value;
+        bool remove;
+        std::chrono::steady_clock::time_point since;
+    };
+    struct ReadLock {
+        std::vector<uint64_t> txns;
+        std::chrono::steady_clock::time_point since; // Of the oldest
+    };
+    struct Shard {
+        mutable std::shared_mutex mtx;
+        std::unordered_map<std::string, Entry> entries;
+        std::unordered_map<std::string, WriteIntent> intents;
+        std::unordered_map<std::string, ReadLock> readLocks;
+    };
+    // Exclusive locks on the shards of a transaction's keys, taken in shard order
+    class ShardLocks;
+
+    size_t shardIndex(std::string_view key) const;
+    Shard& shardOf(std::string_view key) { return shards[shardIndex(key)]; }
+    const Shard& shardOf(std::string_view key) const { return shards[shardIndex(key)]; }
+    bool validate(uint64_t txn, const std::vector<TxnKeyData>& reads, const std::vector<TxnKeyData>& writes) const;
+    void apply(const std::string& key, const std::string& value, bool remove, uint64_t& version);
+
+    std::array<Shard, kShards> shards;
+    std::atomic<uint64_t> clock{0};
+};
+
+// A DataNode's view of the partition map: the partitions it owns and as of
+// which epoch.
+//
+// A partition that becomes ours is first handed over by its previous owner:
+// until its pairs arrive, requests for its keys wait, and are refused when
+// they do not arrive in time. The previous owner is the one in the map
+// before, or, for a node that just joined, the one in the map without it.
+// The previous owner gives the pairs up only once its own map is as new, so
+// it no longer takes writes for them; update() waits for operations admitted
+// under the old map (see Admission), so none is still writing either.
+class LocalPartition {
+public:
+    // How long a request waits for its key's partition to arrive
+    static constexpr std::chrono::milliseconds kArrivalWait{2000};
+
+    // Partitions on their way here from one previous owner
+    struct Incoming {
+        NodeInfo from;
+        uint64_t epoch; // Of the map that moved them
+        std::vector<uint32_t> partitions;
+    };
+
+    // Held while checking owns() and applying the operation it admits
+    class Admission {
+    public:
+        explicit Admission(const LocalPartition& partition);
+        ~Admission();
+        Admission(const Admission&) = delete;
+        Admission& operator=(const Admission&) = delete;
+
+    private:
+        const LocalPartition& partition;
+        unsigned slot;
+    };
+
+    explicit LocalPartition(std::string uuid);
+
+    // Replace the map; the node's WATCH stream delivers them in version order
+    void update(const PartitionMap& map);
+    // Whether a request for `key` routed with `epoch` belongs here. A request
+    // routed with an older map is refused even when the key is ours, so the
+    // client learns about the change; so is one whose partition is still
+    // arriving. `current` is set to this node's epoch.
+    bool owns(std::string_view key, uint64_t epoch, uint64_t& current) const;
+    // Wait until `key`'s partition is not arriving, or until `deadline`
+    void awaitArrival(std::string_view key, std::chrono::steady_clock::time_point deadline) const;
+
+    // Block until some partition is arriving; those arriving, by previous owner
+    std::vector<Incoming> awaitIncoming() const;
+    void arrived(const std::vector<uint32_t>& partitions);
+    // Whether this node's map is at least `epoch` and owns none of `partitions`,
+    // so that they can be handed over
+    bool disowns(uint64_t epoch, const std::vector<uint32_t>& partitions) const;
+    bool isMember(const std::string& node) const;
+
+private:
+    struct Arrival {
+        NodeInfo from;
+        uint64_t epoch;
+    };
+
+    std::string uuid;
+    mutable std::mutex mtx;
+    mutable std::condition_variable changed;
+    PartitionMap map;
+    bool listed = false;       // Whether this node is in `map` yet
+    std::vector<bool> owned;   // By partition
+    std::unordered_map<uint32_t, Arrival> arriving;
+    // Admissions running, by the parity of the generation they started in;
+    // update() starts a new generation and waits for the old one to drain
+    std::atomic<unsigned> generation{0};
+    mutable std::atomic<int64_t> admitted[2]{};
+};
+
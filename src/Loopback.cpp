@@ -0,0 +1,292 @@
+#include "Loopback.h"
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <thread>
+
+// Added to an eventfd to wake every read on it from then on
+static const uint64_t kHangup = uint64_t(1) << 40;
+// Datagrams a port holds before it drops new ones, like a full socket buffer
+static const size_t kMaxQueuedDatagrams = 4096;
+
+struct LoopbackTransport::Connection {
+    struct Side {
+        MessageRing inbox;
+        int events = -1;                 // This end's descriptor; counts the messages in `inbox`
+        std::atomic<bool> closed{false}; // Shut down or closed at this end
+        std::atomic<int64_t> sendTimeoutMs{0}; // For sends from this end; 0 waits for good
+    };
+    Side sides[2];
+
+    ~Connection() {
+        // Only now, so a sender never signals a descriptor that was reused
+        for (Side& side : sides) ::close(side.events);
+    }
+};
+
+struct LoopbackTransport::Listener {
+    int events = -1; // Counts the connections waiting in `pending`
+    std::mutex mtx;
+    std::deque<int> pending; // Server ends not accepted yet
+    std::atomic<bool> closed{false};
+
+    ~Listener() { ::close(events); }
+};
+
+struct LoopbackTransport::Mailbox {
+    int events = -1; // Counts the datagrams in `datagrams`
+    std::mutex mtx;
+    std::deque<std::string> datagrams;
+
+    ~Mailbox() { ::close(events); }
+};
+
+static void signal(int events, uint64_t count) {
+    ssize_t written;
+    do {
+        written = write(events, &count, sizeof(count));
+    } while (written < 0 && errno == EINTR);
+}
+
+// Take one off the count, blocking while it is zero unless the eventfd is non-blocking
+static bool wait(int events) {
+    uint64_t value;
+    ssize_t got;
+    do {
+        got = read(events, &value, sizeof(value));
+    } while (got < 0 && errno == EINTR);
+    return got == sizeof(value);
+}
+
+static bool isLocal(const std::string& host) {
+    return host == "localhost" || host.compare(0, 4, "127.") == 0;
+}
+
+LoopbackTransport::LoopbackTransport() {
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    endpointCount = std::min<size_t>(std::max<size_t>(limit.rlim_cur, 1024), size_t(1) << 20);
+    endpoints.reset(new std::atomic<Endpoint*>[endpointCount]);
+    for (size_t i = 0; i < endpointCount; ++i) endpoints[i].store(nullptr, std::memory_order_relaxed);
+}
+
+LoopbackTransport::~LoopbackTransport() {
+    for (size_t i = 0; i < endpointCount; ++i) delete endpoints[i].load();
+}
+
+LoopbackTransport::Endpoint* LoopbackTransport::endpoint(int socket) const {
+    if (socket < 0 || static_cast<size_t>(socket) >= endpointCount) return nullptr;
+    return endpoints[socket].load(std::memory_order_acquire);
+}
+
+int LoopbackTransport::listen(int port) {
+    auto listener = std::make_shared<Listener>();
+    listener->events = eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC);
+    std::lock_guard<std::mutex> lock(mtx);
+    if (listeners.count(port) || listener->events < 0 || static_cast<size_t>(listener->events) >= endpointCount) {
+        std::cerr << "listen failed: port " << port << " is taken in this process" << std::endl;
+        return -1;
+    }
+    listeners[port] = listener;
+    endpoints[listener->events].store(new Endpoint{nullptr, 0, listener, nullptr}, std::memory_order_release);
+    std::cout << "Server listening on port " << port << " (in process)" << std::endl;
+    return listener->events;
+}
+
+int LoopbackTransport::accept(int server) {
+    Endpoint* end = endpoint(server);
+    if (!end) return tcp.accept(server);
+    Listener& listener = *end->listener;
+    if (!wait(listener.events)) return -1;
+    std::lock_guard<std::mutex> lock(listener.mtx);
+    if (listener.pending.empty()) return -1; // Shut down
+    int sock = listener.pending.front();
+    listener.pending.pop_front();
+    return sock;
+}
+
+int LoopbackTransport::connect(const std::string& host, int port) {
+    std::unique_lock<std::mutex> lock(mtx);
+    auto found = listeners.find(port);
+    if (found == listeners.end() || !isLocal(host)) {
+        lock.unlock();
+        return tcp.connect(host, port);
+    }
+    std::shared_ptr<Listener> listener = found->second;
+    auto connection = std::make_shared<Connection>();
+    for (auto& side : connection->sides) {
+        side.events = eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC);
+        if (side.events < 0 || static_cast<size_t>(side.events) >= endpointCount) {
+            std::cerr << "connect failed: out of descriptors" << std::endl;
+            return -1;
+        }
+    }
+    int client = connection->sides[0].events, server = connection->sides[1].events;
+    endpoints[client].store(new Endpoint{connection, 0, nullptr, nullptr}, std::memory_order_release);
+    endpoints[server].store(new Endpoint{connection, 1, nullptr, nullptr}, std::memory_order_release);
+    lock.unlock();
+    bool refused;
+    {
+        std::lock_guard<std::mutex> pending(listener->mtx);
+        refused = listener->closed;
+        if (!refused) listener->pending.push_back(server);
+    }
+    if (refused) {
+        close(server);
+        close(client);
+        return -1;
+    }
+    signal(listener->events, 1);
+    return client;
+}
+
+bool LoopbackTransport::sendOwned(Endpoint& end, std::string& message) {
+    Connection::Side& self = end.connection->sides[end.side];
+    Connection::Side& peer = end.connection->sides[1 - end.side];
+    // Full: the receiver is behind, so wait for it as TCP would. Nothing
+    // signals room, so back off from yielding to short sleeps.
+    int64_t timeoutMs = self.sendTimeoutMs.load(std::memory_order_relaxed);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (int attempt = 0; !peer.inbox.push(message); ++attempt) {
+        if (self.closed || peer.closed) return false;
+        if (attempt < 1000) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (timeoutMs > 0 && std::chrono::steady_clock::now() >= deadline) return false;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    if (self.closed || peer.closed) return false;
+    signal(peer.events, 1);
+    return true;
+}
+
+bool LoopbackTransport::send(int socket, const std::string& message) {
+    Endpoint* end = endpoint(socket);
+    if (!end) return tcp.send(socket, message);
+    std::string copy = message;
+    return sendOwned(*end, copy);
+}
+
+bool LoopbackTransport::send(int socket, std::string&& message) {
+    Endpoint* end = endpoint(socket);
+    if (!end) return tcp.send(socket, message);
+    return sendOwned(*end, message);
+}
+
+std::string LoopbackTransport::receive(int socket) {
+    Endpoint* end = endpoint(socket);
+    if (!end) return tcp.receive(socket);
+    Connection::Side& self = end->connection->sides[end->side];
+    std::string message;
+    // Messages sent before a hangup are still delivered
+    if (!wait(self.events) || !self.inbox.pop(message)) return std::string();
+    return message;
+}
+
+ReceiveProgress LoopbackTransport::receiveSome(int socket, std::string& partial, std::string& message) {
+    // Loopback messages arrive whole
+    if (!endpoint(socket)) return tcp.receiveSome(socket, partial, message);
+    return Transport::receiveSome(socket, partial, message);
+}
+
+void LoopbackTransport::setSendTimeout(int socket, std::chrono::milliseconds timeout) {
+    Endpoint* end = endpoint(socket);
+    if (!end) return tcp.setSendTimeout(socket, timeout);
+    if (end->connection) end->connection->sides[end->side].sendTimeoutMs.store(timeout.count());
+}
+
+int LoopbackTransport::bindDatagram(int port) {
+    auto mailbox = std::make_shared<Mailbox>();
+    mailbox->events = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+    std::lock_guard<std::mutex> lock(mtx);
+    if (mailboxes.count(port) || mailbox->events < 0 || static_cast<size_t>(mailbox->events) >= endpointCount) {
+        std::cerr << "bind failed: datagram port " << port << " is taken in this process" << std::endl;
+        return -1;
+    }
+    mailboxes[port] = mailbox;
+    endpoints[mailbox->events].store(new Endpoint{nullptr, 0, nullptr, mailbox}, std::memory_order_release);
+    return mailbox->events;
+}
+
+bool LoopbackTransport::sendDatagram(int socket, const std::string& host, int port, const std::string& payload) {
+    if (!endpoint(socket)) return tcp.sendDatagram(socket, host, port, payload);
+    std::shared_ptr<Mailbox> mailbox;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto found = mailboxes.find(port);
+        if (found == mailboxes.end() || !isLocal(host)) return false;
+        mailbox = found->second;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mailbox->mtx);
+        if (mailbox->datagrams.size() >= kMaxQueuedDatagrams) return true; // Lost, as UDP would
+        mailbox->datagrams.push_back(payload);
+    }
+    signal(mailbox->events, 1);
+    return true;
+}
+
+std::string LoopbackTransport::receiveDatagram(int socket) {
+    Endpoint* end = endpoint(socket);
+    if (!end) return tcp.receiveDatagram(socket);
+    Mailbox& mailbox = *end->mailbox;
+    std::string payload;
+    {
+        std::lock_guard<std::mutex> lock(mailbox.mtx);
+        if (mailbox.datagrams.empty()) return std::string();
+        payload = std::move(mailbox.datagrams.front());
+        mailbox.datagrams.pop_front();
+    }
+    wait(mailbox.events);
+    return payload;
+}
+
+void LoopbackTransport::shutdown(int socket) {
+    Endpoint* end = endpoint(socket);
+    if (!end) return tcp.shutdown(socket);
+    if (end->connection) {
+        Connection::Side& self = end->connection->sides[end->side];
+        if (self.closed.exchange(true)) return;
+        signal(self.events, kHangup);
+        signal(end->connection->sides[1 - end->side].events, kHangup);
+    } else if (end->listener) {
+        std::lock_guard<std::mutex> lock(end->listener->mtx);
+        if (end->listener->closed.exchange(true)) return;
+        signal(end->listener->events, kHangup);
+    }
+}
+
+void LoopbackTransport::close(int socket) {
+    Endpoint* end = endpoint(socket);
+    if (!end) return tcp.close(socket);
+    shutdown(socket);
+    std::deque<int> unaccepted;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        endpoints[socket].store(nullptr, std::memory_order_release);
+        if (end->listener) {
+            for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+                if (it->second == end->listener) {
+                    listeners.erase(it);
+                    break;
+                }
+            }
+            std::lock_guard<std::mutex> pending(end->listener->mtx);
+            unaccepted.swap(end->listener->pending);
+        } else if (end->mailbox) {
+            for (auto it = mailboxes.begin(); it != mailboxes.end(); ++it) {
+                if (it->second == end->mailbox) {
+                    mailboxes.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+    // The descriptor itself is closed with the last reference to what it is
+    delete end;
+    for (int sock : unaccepted) close(sock);
+}
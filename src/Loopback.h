@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Communication.h"
+
+// Messages one way over a loopback connection: a bounded lock-free ring with
+// one thread sending and one receiving at a time, as on a TCP socket. A
+// message's buffer is moved in and out, never copied.
+class MessageRing {
+public:
+    static constexpr size_t kCapacity = 256;
+
+    // False when the ring is full
+    bool push(std::string& message) {
+        uint64_t head = writeAt.load(std::memory_order_relaxed);
+        if (head - readAt.load(std::memory_order_acquire) == kCapacity) return false;
+        slots[head % kCapacity] = std::move(message);
+        writeAt.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // False when the ring is empty
+    bool pop(std::string& message) {
+        uint64_t tail = readAt.load(std::memory_order_relaxed);
+        if (tail == writeAt.load(std::memory_order_acquire)) return false;
+        message = std::move(slots[tail % kCapacity]);
+        readAt.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<std::string, kCapacity> slots;
+    alignas(64) std::atomic<uint64_t> writeAt{0};
+    alignas(64) std::atomic<uint64_t> readAt{0};
+};
+
+// Transport between the nodes of an embedded cluster (see EmbeddedCluster.h),
+// all in this process. Ports are this process's own: listening never binds a
+// TCP port, and connecting to a port nothing here listens on goes over TCP.
+//
+// A connection is a MessageRing each way. Each end is an eventfd in
+// semaphore mode counting the messages waiting for it, so receiving blocks in
+// read() and poll() works on it unchanged. A message costs no copy and no
+// trip through the network stack, only that eventfd's write and read. A
+// sender that finds the ring full waits for the receiver, up to the send
+// timeout as on a TCP socket.
+// Datagrams go into a locked queue per bound port, as any node may send them.
+// As with sockets, a descriptor may only be closed once no other thread is
+// using it; shutdown() is what wakes a thread blocked on it.
+class LoopbackTransport : public Transport {
+public:
+    LoopbackTransport();
+    ~LoopbackTransport() override;
+
+    int listen(int port) override;
+    int accept(int server) override;
+    int connect(const std::string& host, int port) override;
+    bool send(int socket, const std::string& message) override;
+    bool send(int socket, std::string&& message) override;
+    std::string receive(int socket) override;
+    ReceiveProgress receiveSome(int socket, std::string& partial, std::string& message) override;
+    void setSendTimeout(int socket, std::chrono::milliseconds timeout) override;
+    int bindDatagram(int port) override;
+    bool sendDatagram(int socket, const std::string& host, int port, const std::string& payload) override;
+    std::string receiveDatagram(int socket) override;
+    void shutdown(int socket) override;
+    void close(int socket) override;
+
+private:
+    struct Connection;
+    struct Listener;
+    struct Mailbox;
+    // What a descriptor of this transport is; exactly one member is set
+    struct Endpoint {
+        std::shared_ptr<Connection> connection;
+        int side = 0; // Which end of `connection`
+        std::shared_ptr<Listener> listener;
+        std::shared_ptr<Mailbox> mailbox;
+    };
+
+    // Null for descriptors of other transports
+    Endpoint* endpoint(int socket) const;
+    bool sendOwned(Endpoint& end, std::string& message);
+
+    std::mutex mtx; // Guards the port tables and installing endpoints
+    std::unordered_map<int, std::shared_ptr<Listener>> listeners; // By port
+    std::unordered_map<int, std::shared_ptr<Mailbox>> mailboxes;  // By port
+    // By descriptor, so sending and receiving look their end up without a lock
+    size_t endpointCount;
+    std::unique_ptr<std::atomic<Endpoint*>[]> endpoints;
+    TcpTransport tcp; // For ports outside this process
+};
@@ -0,0 +1,181 @@
+#include "Membership.h"
+#include <algorithm>
+#include <thread>
+#include "Communication.h"
+#include "message_serializer.h"
+#include "Tracing.h"
+
+static void applyChange(std::vector<NodeInfo>& nodes, const MembershipChangeData& change) {
+    auto it = std::find_if(nodes.begin(), nodes.end(),
+                           [&](const NodeInfo& node) { return node.uuid == change.node.uuid; });
+    switch (static_cast<MembershipChange>(change.kind)) {
+        case MembershipChange::Join:
+        case MembershipChange::Update:
+            if (it != nodes.end()) {
+                *it = change.node;
+            } else {
+                nodes.push_back(change.node);
+            }
+            break;
+        case MembershipChange::Leave:
+            if (it != nodes.end()) nodes.erase(it);
+            break;
+    }
+}
+
+bool applyMembershipUpdate(PartitionMap& map, const MembershipData& update) {
+    if (update.snapshot) {
+        map.nodes = update.nodes;
+        map.epoch = update.version;
+        map.assign();
+        return true;
+    }
+    for (const auto& change : update.changes) {
+        if (change.version <= map.epoch) continue;
+        if (change.version != map.epoch + 1) return false;
+        applyChange(map.nodes, change);
+        map.epoch = change.version;
+    }
+    map.assign();
+    return map.epoch == update.version;
+}
+
+static std::shared_ptr<const std::string> serializeUpdate(const MembershipData& update) {
+    Message message;
+    message.type = MessageType::MEMBERSHIP_UPDATE;
+    message.membership = update;
+    // Sent to every watcher, not just the caller's request
+    UntracedScope untraced;
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(message);
+    return std::make_shared<const std::string>(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+}
+
+Membership::Membership() {
+    std::thread(&Membership::sendPushes, this).detach();
+}
+
+void Membership::enqueueLocked(Watcher& watcher, const Update& update) {
+    if (watcher.dropped) return;
+    if (watcher.pending.size() >= kWatchQueueCapacity) {
+        watcher.dropped = true;
+        watcher.pending.clear();
+    } else {
+        watcher.pending.push_back(update);
+    }
+    pushesPending = true;
+}
+
+uint64_t Membership::recordLocked(MembershipChange kind, const NodeInfo& node) {
+    MembershipChangeData change;
+    change.version = map.epoch + 1;
+    change.kind = static_cast<uint8_t>(kind);
+    change.node = node;
+    applyChange(map.nodes, change);
+    map.epoch = change.version;
+    map.assign();
+    log.push_back(change);
+    if (log.size() > kLogCapacity) log.pop_front();
+
+    if (!watchers.empty()) {
+        MembershipData update;
+        update.version = change.version;
+        update.changes.push_back(change);
+        Update out = serializeUpdate(update);
+        for (auto& watcher : watchers) enqueueLocked(*watcher, out);
+        queued.notify_one();
+    }
+    return change.version;
+}
+
+uint64_t Membership::join(const NodeInfo& node, std::string& refused) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const NodeInfo& other : map.nodes) {
+        if (other.uuid == node.uuid || node.partition_count == 0 || other.partition_count == 0) continue;
+        if (other.partition_count == node.partition_count && other.partition_index != node.partition_index) continue;
+        refused = "its partition " + std::to_string(node.partition_index) + " of " +
+                  std::to_string(node.partition_count) + " overlaps partition " +
+                  std::to_string(other.partition_index) + " of " + std::to_string(other.partition_count) +
+                  " on node " + other.uuid;
+        return 0;
+    }
+    bool known = std::any_of(map.nodes.begin(), map.nodes.end(),
+                             [&](const NodeInfo& other) { return other.uuid == node.uuid; });
+    return recordLocked(known ? MembershipChange::Update : MembershipChange::Join, node);
+}
+
+uint64_t Membership::leave(const std::string& uuid) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = std::find_if(map.nodes.begin(), map.nodes.end(), [&](const NodeInfo& node) { return node.uuid == uuid; });
+    if (it == map.nodes.end()) return 0;
+    return recordLocked(MembershipChange::Leave, *it);
+}
+
+PartitionMap Membership::snapshot() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return map;
+}
+
+void Membership::sendPushes() {
+    for (;;) {
+        // Take every watcher's queue, then write without the lock, so
+        // changes keep being recorded while a slow watcher is written to
+        std::vector<std::pair<std::shared_ptr<Watcher>, std::deque<Update>>> work;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            queued.wait(lock, [&] { return pushesPending; });
+            pushesPending = false;
+            for (auto& watcher : watchers) {
+                if (watcher->pending.empty()) continue;
+                work.emplace_back(watcher, std::move(watcher->pending));
+                watcher->pending.clear();
+            }
+        }
+        std::vector<std::shared_ptr<Watcher>> failed;
+        for (auto& [watcher, updates] : work) {
+            for (const auto& update : updates) {
+                if (Communication::sendMessage(watcher->socket, *update)) continue;
+                failed.push_back(watcher);
+                break;
+            }
+        }
+
+        std::vector<int> closing;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto& watcher : failed) watcher->dropped = true;
+            auto gone = std::stable_partition(watchers.begin(), watchers.end(),
+                                              [](const std::shared_ptr<Watcher>& watcher) { return !watcher->dropped; });
+            for (auto it = gone; it != watchers.end(); ++it) closing.push_back((*it)->socket);
+            watchers.erase(gone, watchers.end());
+        }
+        for (int socket : closing) Communication::closeSocket(socket);
+    }
+}
+
+void Membership::watch(int socket, uint64_t since) {
+    Communication::setSendTimeout(socket, std::chrono::seconds(kWatchSendTimeoutSec));
+    std::lock_guard<std::mutex> lock(mtx);
+    MembershipData update;
+    update.version = map.epoch;
+    // The log covers `since` when it holds every change after it
+    bool covered = since <= map.epoch && (since == map.epoch || (!log.empty() && log.front().version <= since + 1));
+    if (covered) {
+        for (const auto& change : log) {
+            if (change.version > since) update.changes.push_back(change);
+        }
+    } else {
+        update.snapshot = true;
+        update.nodes = map.nodes;
+    }
+    // Queued under the same lock as changes are, so nothing is missed or repeated
+    auto watcher = std::make_shared<Watcher>();
+    watcher->socket = socket;
+    watchers.push_back(watcher);
+    enqueueLocked(*watcher, serializeUpdate(update));
+    queued.notify_one();
+}
+
+size_t Membership::watcherCount() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return watchers.size();
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "PartitionMap.h"
+#include "message.h"
+
+// Kind of a membership change, carried in MembershipChangeData::kind
+enum class MembershipChange : uint8_t {
+    Join,   // Added; takes its share of the partitions from the others
+    Update, // A known node registered again, e.g. at a new address
+    Leave,  // Removed; its partitions go to the others
+};
+
+// Watcher side: apply a MEMBERSHIP_UPDATE to a copy of the map. Returns false
+// when the update does not continue from `map.epoch`, in which case the
+// watcher has to WATCH again from version 0.
+bool applyMembershipUpdate(PartitionMap& map, const MembershipData& update);
+
+// Coordinator's versioned membership. Every change gets the next version,
+// which is also the partition map epoch, and is kept in a bounded log, so a
+// watcher that knows version v is sent only the changes after v; one that is
+// further behind than the log reaches gets a snapshot. Watchers are
+// persistent connections that every later change is pushed to, in version
+// order.
+//
+// Recording a change only queues it for each watcher; a sender thread of the
+// Membership's own does the writing, so join and leave, which run on the Raft
+// apply thread, never wait on a watcher's socket. A watcher whose queue grows
+// past kWatchQueueCapacity, or whose socket stays full for
+// kWatchSendTimeoutSec, is dropped and has to WATCH again.
+class Membership {
+public:
+    static constexpr size_t kLogCapacity = 4096;
+    static constexpr size_t kWatchQueueCapacity = 1024;
+    // Longest the sender waits on one watcher's full socket before dropping it
+    static constexpr int kWatchSendTimeoutSec = 1;
+
+    // Starts the sender thread, which is detached: a Membership is never destroyed
+    Membership();
+
+    // Add `node`, or update a node that registered before under its uuid.
+    // Returns the new version, or 0 with `refused` set when the node's
+    // partition of the sample tables overlaps a member's: the same index, or
+    // a different count, so that scatter-gather would return rows twice.
+    uint64_t join(const NodeInfo& node, std::string& refused);
+    // Returns the new version, or 0 when the uuid is unknown
+    uint64_t leave(const std::string& uuid);
+
+    PartitionMap snapshot() const;
+
+    // WATCH from `since`: queue what catches `socket` up, then every later
+    // change. Takes ownership of the socket.
+    void watch(int socket, uint64_t since);
+    size_t watcherCount() const;
+
+private:
+    using Update = std::shared_ptr<const std::string>; // Serialized, shared by all watchers
+    struct Watcher {
+        int socket;
+        std::deque<Update> pending;
+        bool dropped = false; // Fell behind or failed; the sender closes it
+    };
+
+    // Record a change and queue it for every watcher
+    uint64_t recordLocked(MembershipChange kind, const NodeInfo& node);
+    void enqueueLocked(Watcher& watcher, const Update& update);
+    void sendPushes();
+
+    mutable std::mutex mtx; // Guards everything below
+    PartitionMap map;
+    std::deque<MembershipChangeData> log;
+    std::vector<std::shared_ptr<Watcher>> watchers;
+    bool pushesPending = false;
+    std::condition_variable queued;
+};
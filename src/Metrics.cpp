@@ -0,0 +1,218 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr unsigned kSubBits = 5;
+constexpr uint64_t kSubBuckets = 1ull << kSubBits;
+constexpr unsigned kMaxExponent = 40; // 2^41ns is about 36 minutes; longer is clamped
+constexpr size_t kBuckets = (kMaxExponent - kSubBits + 2) * kSubBuckets;
+
+// Values below kSubBuckets get a bucket each; above, a power of two is split
+// into kSubBuckets linear buckets
+size_t bucketOf(uint64_t nanos) {
+    if (nanos < kSubBuckets) return static_cast<size_t>(nanos);
+    unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(nanos));
+    if (exponent > kMaxExponent) return kBuckets - 1;
+    uint64_t sub = (nanos >> (exponent - kSubBits)) & (kSubBuckets - 1);
+    return (exponent - kSubBits + 1) * kSubBuckets + sub;
+}
+
+// Midpoint of a bucket's range
+uint64_t valueOf(size_t bucket) {
+    if (bucket < kSubBuckets) return bucket;
+    unsigned exponent = static_cast<unsigned>(bucket / kSubBuckets) + kSubBits - 1;
+    uint64_t sub = bucket % kSubBuckets;
+    uint64_t width = 1ull << (exponent - kSubBits);
+    return ((kSubBuckets + sub) << (exponent - kSubBits)) + width / 2;
+}
+
+// Only the owning thread writes, so increments need no read-modify-write
+// instruction; relaxed atomics keep concurrent snapshot reads well defined
+void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+struct Histogram {
+    std::array<std::atomic<uint64_t>, kBuckets> counts{};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+};
+
+struct alignas(64) Slab {
+    // Allocated on a thread's first record of each metric
+    std::array<std::atomic<Histogram*>, Metrics::kMaxLatencies> histograms{};
+    std::array<std::atomic<uint64_t>, Metrics::kMaxCounters> counters{};
+};
+
+struct Registry {
+    std::mutex mtx;
+    std::vector<std::string> latencyNames;
+    std::vector<std::string> counterNames;
+    std::vector<std::pair<std::string, std::function<int64_t()>>> gauges;
+    std::vector<std::unique_ptr<Slab>> slabs;
+    std::vector<Slab*> free;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastSnapshot = start;
+    std::vector<uint64_t> lastCounts; // Per latency metric, at lastSnapshot
+
+    size_t name(std::vector<std::string>& names, const std::string& metric, size_t limit) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = std::find(names.begin(), names.end(), metric);
+        if (it != names.end()) return static_cast<size_t>(it - names.begin());
+        if (names.size() == limit) throw std::length_error("Too many metrics registering " + metric);
+        names.push_back(metric);
+        return names.size() - 1;
+    }
+
+    Slab* acquire() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!free.empty()) {
+            Slab* slab = free.back();
+            free.pop_back();
+            return slab;
+        }
+        slabs.push_back(std::make_unique<Slab>());
+        return slabs.back().get();
+    }
+
+    void release(Slab* slab) {
+        std::lock_guard<std::mutex> lock(mtx);
+        free.push_back(slab);
+    }
+};
+
+// Never destroyed: detached threads may still record during exit
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+// This thread's slab, returned for reuse when the thread exits
+struct SlabOwner {
+    Slab* slab = nullptr;
+    ~SlabOwner() {
+        if (slab) registry().release(slab);
+    }
+};
+
+Slab& localSlab() {
+    thread_local SlabOwner owner;
+    if (!owner.slab) owner.slab = registry().acquire();
+    return *owner.slab;
+}
+
+} // namespace
+
+LatencyMetric::LatencyMetric(const std::string& name)
+    : index(registry().name(registry().latencyNames, name, Metrics::kMaxLatencies)) {}
+
+void LatencyMetric::record(uint64_t nanos) const {
+    Slab& slab = localSlab();
+    Histogram* histogram = slab.histograms[index].load(std::memory_order_relaxed);
+    if (!histogram) {
+        histogram = new Histogram();
+        slab.histograms[index].store(histogram, std::memory_order_release);
+    }
+    bump(histogram->counts[bucketOf(nanos)], 1);
+    bump(histogram->sum, nanos);
+    if (nanos > histogram->max.load(std::memory_order_relaxed)) {
+        histogram->max.store(nanos, std::memory_order_relaxed);
+    }
+}
+
+CounterMetric::CounterMetric(const std::string& name)
+    : index(registry().name(registry().counterNames, name, Metrics::kMaxCounters)) {}
+
+void CounterMetric::add(uint64_t amount) const {
+    bump(localSlab().counters[index], amount);
+}
+
+const LatencyMetric& Metrics::messageLatency(MessageType type) {
+    static const std::vector<LatencyMetric>* metrics = [] {
+        auto* all = new std::vector<LatencyMetric>();
+        for (size_t i = 0; i < kMessageTypeCount; ++i) all->emplace_back(std::string("msg.") + messageTypeName(i));
+        return all;
+    }();
+    size_t index = static_cast<size_t>(type);
+    return index < metrics->size() ? (*metrics)[index] : (*metrics)[0];
+}
+
+void Metrics::gauge(const std::string& name, std::function<int64_t()> sample) {
+    Registry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mtx);
+    metrics.gauges.emplace_back(name, std::move(sample));
+}
+
+StatsData Metrics::snapshot() {
+    Registry& metrics = registry();
+    StatsData stats;
+    std::vector<std::pair<std::string, std::function<int64_t()>>> gauges;
+    {
+        std::lock_guard<std::mutex> lock(metrics.mtx);
+        auto now = std::chrono::steady_clock::now();
+        stats.uptime_ms = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - metrics.start).count());
+        stats.window_ms = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - metrics.lastSnapshot).count());
+        metrics.lastSnapshot = now;
+        metrics.lastCounts.resize(metrics.latencyNames.size(), 0);
+
+        std::vector<uint64_t> merged(kBuckets);
+        for (size_t i = 0; i < metrics.latencyNames.size(); ++i) {
+            std::fill(merged.begin(), merged.end(), 0);
+            uint64_t count = 0;
+            uint64_t sum = 0;
+            uint64_t max = 0;
+            for (const auto& slab : metrics.slabs) {
+                const Histogram* histogram = slab->histograms[i].load(std::memory_order_acquire);
+                if (!histogram) continue;
+                for (size_t b = 0; b < kBuckets; ++b) {
+                    uint64_t hits = histogram->counts[b].load(std::memory_order_relaxed);
+                    merged[b] += hits;
+                    count += hits;
+                }
+                sum += histogram->sum.load(std::memory_order_relaxed);
+                max = std::max(max, histogram->max.load(std::memory_order_relaxed));
+            }
+            if (count == 0) continue;
+            LatencyStatsData latency;
+            latency.name = metrics.latencyNames[i];
+            latency.count = count;
+            latency.per_second = stats.window_ms ? (count - metrics.lastCounts[i]) * 1000 / stats.window_ms : 0;
+            metrics.lastCounts[i] = count;
+            latency.max = max;
+            latency.mean = sum / count;
+            // The bucket holding the rank-th value, for each percentile
+            const std::pair<double, uint64_t*> ranks[] = {
+                {0.5, &latency.p50}, {0.99, &latency.p99}, {0.999, &latency.p999}};
+            for (const auto& rank : ranks) {
+                uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(rank.first * count + 0.5));
+                uint64_t seen = 0;
+                for (size_t b = 0; b < kBuckets; ++b) {
+                    seen += merged[b];
+                    if (seen >= target) {
+                        *rank.second = std::min(valueOf(b), max);
+                        break;
+                    }
+                }
+            }
+            stats.latencies.push_back(std::move(latency));
+        }
+        for (size_t i = 0; i < metrics.counterNames.size(); ++i) {
+            uint64_t total = 0;
+            for (const auto& slab : metrics.slabs) total += slab->counters[i].load(std::memory_order_relaxed);
+            stats.counters.push_back({metrics.counterNames[i], static_cast<int64_t>(total)});
+        }
+        gauges = metrics.gauges;
+    }
+    // Samplers may take their own locks; never call them under ours
+    for (const auto& gauge : gauges) stats.gauges.push_back({gauge.first, gauge.second()});
+    return stats;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "message.h"
+
+// Process-wide metrics, served to STATS_REQUEST.
+//
+// Recording is lock-free and never shares a cache line with another thread:
+// every thread records into its own slab of histograms and counters, and
+// only a snapshot walks the slabs and merges them. A slab is handed to a new
+// thread when its thread exits, so connection-per-thread servers do not grow
+// one per connection.
+//
+// Histograms are HDR-style: 32 linear sub-buckets per power of two of
+// nanoseconds, so any recorded value is reported within about 3%, from 1ns
+// to half an hour.
+
+// A named latency histogram. Define them once, as statics.
+class LatencyMetric {
+public:
+    explicit LatencyMetric(const std::string& name);
+    void record(uint64_t nanos) const;
+    void record(std::chrono::steady_clock::duration elapsed) const {
+        record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+private:
+    size_t index;
+};
+
+// A named total. Define them once, as statics.
+class CounterMetric {
+public:
+    explicit CounterMetric(const std::string& name);
+    void add(uint64_t amount = 1) const;
+
+private:
+    size_t index;
+};
+
+// Records the time from construction to destruction
+class ScopedLatency {
+public:
+    explicit ScopedLatency(const LatencyMetric& metric)
+        : metric(metric), start(std::chrono::steady_clock::now()) {}
+    ~ScopedLatency() { metric.record(std::chrono::steady_clock::now() - start); }
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    const LatencyMetric& metric;
+    std::chrono::steady_clock::time_point start;
+};
+
+class Metrics {
+public:
+    static constexpr size_t kMaxLatencies = 128;
+    static constexpr size_t kMaxCounters = 128;
+
+    // Handling time of each message type, "msg.<TYPE>"
+    static const LatencyMetric& messageLatency(MessageType type);
+
+    // A value sampled at snapshot time, such as a queue depth
+    static void gauge(const std::string& name, std::function<int64_t()> sample);
+
+    // Merge every thread's metrics. Rates are over the time since the
+    // previous snapshot, or since start for the first.
+    static StatsData snapshot();
+};
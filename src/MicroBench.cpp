@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#include "Communication.h"
+#include "KeyValueStore.h"
+#include "Loopback.h"
+#include "PartitionMap.h"
+#include "QueryParser.h"
+#include "UnixTransport.h"
+#include "message.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+// Microbenchmarks of the hot components on their own: message
+// (de)serialization, key partitioning, the key-value store, the query parser
+// and a message's round trip over each transport.
+//
+// Each benchmark is warmed up, then timed in samples of a fixed batch of
+// iterations sized so that one sample takes at least --sample-us; the timer is
+// read once per sample, not per iteration. Results are summarized by median
+// and median absolute deviation, which a stray context switch barely moves.
+// Inputs come from fixed seeds, so runs on different commits time the same
+// work: compare the medians of two --json runs on the same machine.
+//
+// Usage: MicroBench [--json] [--filter SUBSTRING] [--samples N] [--sample-us N] [--warmup-ms N]
+
+namespace {
+
+// Timestamp counter ticks on x86-64, which run at a constant rate on any
+// recent CPU; steady_clock nanoseconds elsewhere. The fences keep the
+// measured work from being reordered around the read.
+uint64_t ticks() {
+#if defined(__x86_64__)
+    _mm_lfence();
+    uint64_t now = __rdtsc();
+    _mm_lfence();
+    return now;
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+#endif
+}
+
+const char* timerName() {
+#if defined(__x86_64__)
+    return "rdtsc";
+#else
+    return "steady_clock";
+#endif
+}
+
+double ticksPerNanosecond() {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t first = ticks();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50)) {}
+    uint64_t last = ticks();
+    double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return (last - first) / nanos;
+}
+
+// Keeps the compiler from discarding a result it can see is unused
+template <typename T>
+void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Benchmark {
+    std::string name;
+    std::function<void(size_t iterations)> run; // Runs the operation `iterations` times
+};
+
+struct Options {
+    bool json = false;
+    std::string filter;
+    size_t samples = 30;
+    double sampleMicros = 2000;
+    double warmupMillis = 100;
+};
+
+struct Summary {
+    std::string name;
+    size_t batch = 0; // Iterations per sample
+    std::vector<double> nanos; // Per operation, one per sample, sorted
+    double median = 0;
+    double mad = 0;
+    double mean = 0;
+    double stddev = 0;
+};
+
+Summary measure(const Benchmark& benchmark, const Options& options, double perNano) {
+    Summary summary;
+    summary.name = benchmark.name;
+
+    // Warm up while growing the batch until it fills a sample
+    size_t batch = 1;
+    auto warmupEnd = std::chrono::steady_clock::now() +
+                     std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                         std::chrono::duration<double, std::milli>(options.warmupMillis));
+    while (true) {
+        uint64_t start = ticks();
+        benchmark.run(batch);
+        double micros = (ticks() - start) / perNano / 1000;
+        if (micros < options.sampleMicros) {
+            batch = std::max(batch + 1, static_cast<size_t>(batch * std::min(10.0, options.sampleMicros / std::max(micros, 0.01))));
+        } else if (std::chrono::steady_clock::now() >= warmupEnd) {
+            break;
+        }
+    }
+    summary.batch = batch;
+
+    for (size_t i = 0; i < options.samples; ++i) {
+        uint64_t start = ticks();
+        benchmark.run(batch);
+        summary.nanos.push_back((ticks() - start) / perNano / batch);
+    }
+    std::sort(summary.nanos.begin(), summary.nanos.end());
+    auto median = [](const std::vector<double>& sorted) {
+        size_t n = sorted.size();
+        return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    };
+    summary.median = median(summary.nanos);
+    std::vector<double> deviations;
+    for (double value : summary.nanos) deviations.push_back(std::fabs(value - summary.median));
+    std::sort(deviations.begin(), deviations.end());
+    summary.mad = median(deviations);
+    for (double value : summary.nanos) summary.mean += value / summary.nanos.size();
+    for (double value : summary.nanos) summary.stddev += (value - summary.mean) * (value - summary.mean);
+    summary.stddev = summary.nanos.size() > 1 ? std::sqrt(summary.stddev / (summary.nanos.size() - 1)) : 0;
+    return summary;
+}
+
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// --- Inputs ---
+
+std::string valueOf(std::mt19937_64& random, size_t size) {
+    std::string value(size, ' ');
+    for (char& c : value) c = static_cast<char>('a' + random() % 26);
+    return value;
+}
+
+std::vector<std::string> keysOf(size_t count) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < count; ++i) keys.push_back("user" + std::to_string(i * 7919 % 1000003));
+    return keys;
+}
+
+Message dataRequest() {
+    std::mt19937_64 random(1);
+    Message message;
+    message.type = MessageType::DATA_REQUEST;
+    message.key_value.key = "user12345";
+    message.key_value.value = valueOf(random, 100);
+    message.key_value.op = 1;
+    message.key_value.epoch = 7;
+    return message;
+}
+
+Message queryResponse(size_t rows) {
+    std::mt19937_64 random(2);
+    Message message;
+    message.type = MessageType::QUERY_RESPONSE;
+    message.result.columns = {"id", "name", "city", "total"};
+    for (size_t i = 0; i < rows; ++i) {
+        message.result.rows.push_back(
+            {std::to_string(i), valueOf(random, 12), valueOf(random, 8), std::to_string(random() % 100000)});
+    }
+    return message;
+}
+
+// `request` to an echo thread and back over `transport`, one message at a
+// time. The echo server is only started by the first run, so filtered-out
+// benchmarks leave no threads or ports behind.
+Benchmark roundTrip(const std::string& name, std::shared_ptr<Transport> transport, int port,
+                    const std::string& request) {
+    auto client = std::make_shared<int>(-1);
+    return {name, [transport, port, request, client](size_t iterations) {
+                if (*client < 0) {
+                    // Servers announce themselves on stdout, which --json needs to itself
+                    std::streambuf* out = std::cout.rdbuf(nullptr);
+                    int server = transport->listen(port);
+                    std::cout.rdbuf(out);
+                    std::cout.clear();
+                    if (server < 0) return;
+                    std::thread([transport, server]() {
+                        int sock = transport->accept(server);
+                        while (sock >= 0) {
+                            std::string message = transport->receive(sock);
+                            if (message.empty() || !transport->send(sock, std::move(message))) break;
+                        }
+                    }).detach();
+                    *client = transport->connect("127.0.0.1", port);
+                }
+                for (size_t i = 0; i < iterations; ++i) {
+                    transport->send(*client, request);
+                    keep(transport->receive(*client));
+                }
+            }};
+}
+
+std::vector<Benchmark> benchmarks() {
+    std::vector<Benchmark> all;
+
+    for (const auto& input : {std::make_pair(std::string("data_request"), dataRequest()),
+                              std::make_pair(std::string("query_response_100x4"), queryResponse(100))}) {
+        Message message = input.second;
+        std::vector<uint8_t> bytes = MessageSerializer::serialize(message);
+        all.push_back({"serialize/" + input.first, [message](size_t iterations) {
+                           for (size_t i = 0; i < iterations; ++i) keep(MessageSerializer::serialize(message));
+                       }});
+        all.push_back({"deserialize/" + input.first, [bytes](size_t iterations) {
+                           for (size_t i = 0; i < iterations; ++i) keep(MessageDeserializer::deserialize(bytes));
+                       }});
+    }
+
+    auto keys = std::make_shared<std::vector<std::string>>(keysOf(4096));
+    auto map = std::make_shared<PartitionMap>();
+    for (int i = 0; i < 16; ++i) map->nodes.push_back({"node-" + std::to_string(i), "10.0.0." + std::to_string(i), 9000});
+    map->assign();
+    all.push_back({"partition/owner_of_16", [keys, map](size_t iterations) {
+                       for (size_t i = 0; i < iterations; ++i) keep(map->ownerOf((*keys)[i % keys->size()]));
+                   }});
+
+    // 100k keys of 100 bytes; lookups cycle through a spread-out subset
+    auto store = std::make_shared<KeyValueStore>();
+    auto stored = std::make_shared<std::vector<std::string>>(keysOf(100000));
+    {
+        std::mt19937_64 random(3);
+        KeyLock blocker;
+        uint64_t version;
+        for (const auto& key : *stored) store->put(key, valueOf(random, 100), version, blocker);
+    }
+    all.push_back({"kv/get_hit", [store, keys](size_t iterations) {
+                       std::string value;
+                       uint64_t version;
+                       KeyLock blocker;
+                       for (size_t i = 0; i < iterations; ++i) {
+                           keep(store->get((*keys)[i % keys->size()], value, version, blocker));
+                       }
+                   }});
+    all.push_back({"kv/get_miss", [store](size_t iterations) {
+                       std::string value;
+                       uint64_t version;
+                       KeyLock blocker;
+                       const std::string missing = "no-such-key";
+                       for (size_t i = 0; i < iterations; ++i) keep(store->get(missing, value, version, blocker));
+                   }});
+    auto value = std::make_shared<std::string>(std::string(100, 'w'));
+    all.push_back({"kv/put_overwrite", [store, keys, value](size_t iterations) {
+                       uint64_t version;
+                       KeyLock blocker;
+                       for (size_t i = 0; i < iterations; ++i) {
+                           keep(store->put((*keys)[i % keys->size()], *value, version, blocker));
+                       }
+                   }});
+
+    const std::pair<const char*, const char*> queries[] = {
+        {"simple", "SELECT id, name FROM users WHERE age = 25;"},
+        {"predicates", "SELECT * FROM customers WHERE city = 'Paris' AND (age >= 18 OR vip = TRUE)"},
+        {"group_by", "SELECT city, COUNT(*), AVG(age) FROM customers WHERE age > 21 GROUP BY city"},
+    };
+    for (const auto& query : queries) {
+        std::string text = query.second;
+        all.push_back({std::string("parse/statement_") + query.first, [text](size_t iterations) {
+                           QueryParser parser;
+                           QueryArena arena;
+                           for (size_t i = 0; i < iterations; ++i) {
+                               arena.reset();
+                               keep(parser.parseStatement(text, arena));
+                           }
+                       }});
+    }
+    // As the plan cache keys its entries
+    std::string text = queries[1].second;
+    all.push_back({"parse/normalize_predicates", [text](size_t iterations) {
+                       QueryParser parser;
+                       QueryArena arena;
+                       std::string normalized;
+                       std::vector<Value> literals;
+                       for (size_t i = 0; i < iterations; ++i) {
+                           arena.reset();
+                           normalized.clear();
+                           literals.clear();
+                           parser.normalize(text, true, arena, normalized, literals);
+                           keep(normalized);
+                       }
+                   }});
+    all.push_back({"parse/query_simple", [](size_t iterations) {
+                       QueryParser parser;
+                       const std::string simple = "SELECT id, name FROM users WHERE age = 25;";
+                       for (size_t i = 0; i < iterations; ++i) keep(parser.parse(simple));
+                   }});
+
+    // Each echo thread keeps its transport alive until exit. The bulk message
+    // goes through UnixTransport's shared-memory ring.
+    std::vector<uint8_t> small = MessageSerializer::serialize(dataRequest());
+    std::vector<uint8_t> bulk = MessageSerializer::serialize(queryResponse(20000));
+    const std::tuple<std::string, std::string, int> exchanges[] = {
+        {"round_trip_", std::string(small.begin(), small.end()), 19501},
+        {"round_trip_1mb_", std::string(bulk.begin(), bulk.end()), 19511},
+    };
+    for (const auto& [prefix, message, port] : exchanges) {
+        all.push_back(roundTrip("transport/" + prefix + "tcp", std::make_shared<TcpTransport>(), port, message));
+        all.push_back(roundTrip("transport/" + prefix + "unix", std::make_shared<UnixTransport>(), port + 1, message));
+        all.push_back(
+            roundTrip("transport/" + prefix + "loopback", std::make_shared<LoopbackTransport>(), port + 2, message));
+    }
+    return all;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--json") {
+            options.json = true;
+            continue;
+        }
+        if (i + 1 == argc) return false;
+        std::string value = argv[++i];
+        if (flag == "--filter") {
+            options.filter = value;
+        } else if (flag == "--samples") {
+            options.samples = std::max<size_t>(1, std::stoul(value));
+        } else if (flag == "--sample-us") {
+            options.sampleMicros = std::stod(value);
+        } else if (flag == "--warmup-ms") {
+            options.warmupMillis = std::stod(value);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: MicroBench [--json] [--filter SUBSTRING] [--samples N] [--sample-us N] [--warmup-ms N]"
+                  << std::endl;
+        return 2;
+    }
+    double perNano = ticksPerNanosecond();
+    std::vector<Summary> results;
+    for (const auto& benchmark : benchmarks()) {
+        if (benchmark.name.find(options.filter) == std::string::npos) continue;
+        results.push_back(measure(benchmark, options, perNano));
+        if (options.json) continue;
+        const Summary& r = results.back();
+        if (results.size() == 1) {
+            std::cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(12) << "median_ns"
+                      << std::setw(9) << "mad%" << std::setw(12) << "min_ns" << std::setw(12) << "mean_ns"
+                      << std::setw(12) << "ticks" << std::setw(11) << "batch" << std::endl;
+        }
+        std::cout << std::left << std::setw(32) << r.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << r.median << std::setw(9) << (r.median > 0 ? 100 * r.mad / r.median : 0)
+                  << std::setw(12) << r.nanos.front() << std::setw(12) << r.mean << std::setw(12)
+                  << r.median * perNano << std::setw(11) << r.batch << std::defaultfloat << std::endl;
+    }
+    if (!options.json) return 0;
+
+    std::ostringstream out;
+    out << std::setprecision(6);
+    out << "{\n  \"context\": {\"timer\": " << jsonString(timerName()) << ", \"ticks_per_ns\": " << perNano
+        << ", \"compiler\": " << jsonString(__VERSION__) << ", \"optimized\": "
+#ifdef __OPTIMIZE__
+        << "true"
+#else
+        << "false"
+#endif
+        << ", \"samples\": " << options.samples << ", \"sample_us\": " << options.sampleMicros << "},\n";
+    out << "  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Summary& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": " << jsonString(r.name) << ", \"batch\": " << r.batch
+            << ", \"median_ns\": " << r.median << ", \"mad_ns\": " << r.mad << ", \"min_ns\": " << r.nanos.front()
+            << ", \"max_ns\": " << r.nanos.back() << ", \"mean_ns\": " << r.mean << ", \"stddev_ns\": " << r.stddev
+            << ", \"median_ticks\": " << r.median * perNano << "}";
+    }
+    out << "\n  ]\n}\n";
+    std::cout << out.str();
+    return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "message.h"
+
+// Which DataNode owns a key. Keys hash into a fixed number of partitions, and
+// each partition belongs to the node that ranks it highest (rendezvous
+// hashing on the node's uuid). A node that joins therefore takes about 1/n of
+// the partitions from the others, and one that leaves gives up only its own;
+// the DataNodes hand those partitions over between them (see LocalPartition).
+// The coordinator bumps the epoch on every membership change, which is how
+// clients and nodes tell that their copy is stale.
+struct PartitionMap {
+    static constexpr size_t kPartitions = 1024;
+
+    uint64_t epoch = 0;
+    std::vector<NodeInfo> nodes;
+    // Index into `nodes` of each partition's owner; empty while no node is
+    // registered. Recomputed by assign().
+    std::vector<uint32_t> owners;
+
+    // Call after changing `nodes`
+    void assign();
+
+    static size_t partitionOf(std::string_view key) { return std::hash<std::string_view>{}(key) % kPartitions; }
+    // Null while no node is registered
+    const NodeInfo* ownerOf(std::string_view key) const {
+        return owners.empty() ? nullptr : &nodes[owners[partitionOf(key)]];
+    }
+    const NodeInfo* ownerOfPartition(size_t partition) const {
+        return owners.empty() ? nullptr : &nodes[owners[partition]];
+    }
+};
+
+inline void PartitionMap::assign() {
+    owners.clear();
+    if (nodes.empty()) return;
+    std::vector<uint64_t> seeds;
+    for (const auto& node : nodes) seeds.push_back(std::hash<std::string_view>{}(node.uuid));
+    // A node's rank of a partition: its seed and the partition mixed with the
+    // splitmix64 finalizer, so the ranks of different nodes are independent
+    auto rank = [](uint64_t seed, uint64_t partition) {
+        uint64_t x = seed ^ (partition * 0x9e3779b97f4a7c15ull);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    };
+    owners.resize(kPartitions);
+    for (size_t partition = 0; partition < kPartitions; ++partition) {
+        uint32_t best = 0;
+        uint64_t bestRank = rank(seeds[0], partition);
+        for (uint32_t i = 1; i < seeds.size(); ++i) {
+            uint64_t r = rank(seeds[i], partition);
+            if (r > bestRank) {
+                best = i;
+                bestRank = r;
+            }
+        }
+        owners[partition] = best;
+    }
+}
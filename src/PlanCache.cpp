@@ -0,0 +1,99 @@
+#include "PlanCache.h"
+#include <stdexcept>
+
+PlanCache::PlanCache(size_t capacity, Planner planner)
+    : capacity(capacity), planner(std::move(planner)), epoch(0), nextId(1), hitCount(0), missCount(0) {}
+
+std::shared_ptr<CachedStatement> PlanCache::lookup(std::string_view text, QueryArena& arena,
+                                                   std::vector<Value>& bindings) {
+    // Reused per thread so a cache hit does not allocate for the key
+    thread_local std::string normalized;
+    QueryParser parser;
+    parser.normalize(text, true, arena, normalized, bindings);
+    return findOrInsert(normalized);
+}
+
+std::shared_ptr<CachedStatement> PlanCache::prepare(std::string_view text) {
+    thread_local std::string normalized;
+    QueryArena scratch(256);
+    std::vector<Value> unused;
+    QueryParser parser;
+    parser.normalize(text, false, scratch, normalized, unused);
+    return findOrInsert(normalized);
+}
+
+std::shared_ptr<CachedStatement> PlanCache::find(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = byId.find(id);
+    if (it == byId.end()) return nullptr;
+    lru.splice(lru.begin(), lru, it->second);
+    ++hitCount;
+    return *it->second;
+}
+
+std::shared_ptr<const QueryPlan> PlanCache::planFor(CachedStatement& entry) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!entry.plan || entry.plan->epoch != epoch) {
+        entry.plan = planner(epoch);
+    }
+    return entry.plan;
+}
+
+void PlanCache::invalidatePlans(uint64_t newEpoch) {
+    std::lock_guard<std::mutex> lock(mtx);
+    epoch = newEpoch;
+}
+
+size_t PlanCache::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return lru.size();
+}
+
+uint64_t PlanCache::hits() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return hitCount;
+}
+
+uint64_t PlanCache::misses() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return missCount;
+}
+
+PlanCache::Entry PlanCache::findOrInsert(const std::string& normalized) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = byText.find(normalized);
+        if (it != byText.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            ++hitCount;
+            return *it->second;
+        }
+        ++missCount;
+    }
+
+    // Parse the normalized text so the AST views memory the entry owns, and
+    // without the lock, so a miss does not hold up every other lookup
+    Entry entry = std::make_shared<CachedStatement>();
+    entry->text = normalized;
+    QueryParser parser;
+    entry->statement = parser.parseStatement(entry->text, entry->arena);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    // Another thread may have parsed the same text meanwhile
+    auto it = byText.find(entry->text);
+    if (it != byText.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        return *it->second;
+    }
+    entry->id = nextId++;
+    lru.push_front(entry);
+    byText[entry->text] = lru.begin();
+    byId[entry->id] = lru.begin();
+    while (lru.size() > capacity) {
+        const Entry& victim = lru.back();
+        byText.erase(victim->text);
+        byId.erase(victim->id);
+        lru.pop_back();
+    }
+    return entry;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "QueryParser.h"
+#include "message.h"
+
+// Execution plan of a statement for one cluster membership epoch
+struct QueryPlan {
+    uint64_t epoch = 0;
+    std::vector<NodeInfo> fragments; // DataNodes that each receive a fragment
+};
+
+// Parsed statement shared by every query with the same normalized text.
+// The AST views `text`, which the entry owns.
+struct CachedStatement {
+    uint32_t id = 0;
+    std::string text;
+    QueryArena arena;
+    const Statement* statement = nullptr;
+    std::shared_ptr<const QueryPlan> plan;
+};
+
+// LRU cache of parsed-and-planned statements at the coordinator, keyed by
+// normalized query text. Ad hoc queries are normalized with their literals
+// turned into parameters, so every query of the same shape hits one entry.
+// A membership change only marks plans stale: the next use re-plans without
+// re-parsing, so prepared statement ids stay valid across topology changes.
+// Parsing a miss happens outside the cache's lock.
+class PlanCache {
+public:
+    // Every statement is planned the same way: a fragment on each DataNode
+    using Planner = std::function<std::shared_ptr<const QueryPlan>(uint64_t epoch)>;
+
+    PlanCache(size_t capacity, Planner planner);
+
+    // Ad hoc query text. Extracted literals are appended to `bindings` in
+    // parameter order; they view `text` or `arena`. Parses only on a miss.
+    std::shared_ptr<CachedStatement> lookup(std::string_view text, QueryArena& arena,
+                                            std::vector<Value>& bindings);
+
+    // PREPARE: cache the statement as written; its '?' slots are the parameters
+    std::shared_ptr<CachedStatement> prepare(std::string_view text);
+
+    // EXECUTE: nullptr when the id is unknown or was evicted
+    std::shared_ptr<CachedStatement> find(uint32_t id);
+
+    // Plan for the current epoch, re-planning a stale entry without re-parsing
+    std::shared_ptr<const QueryPlan> planFor(CachedStatement& entry);
+
+    // Cluster membership changed; plans built for older epochs are stale
+    void invalidatePlans(uint64_t epoch);
+
+    size_t size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    using Entry = std::shared_ptr<CachedStatement>;
+
+    Entry findOrInsert(const std::string& normalized);
+
+    mutable std::mutex mtx;
+    size_t capacity;
+    Planner planner;
+    uint64_t epoch;
+    uint32_t nextId;
+    uint64_t hitCount;
+    uint64_t missCount;
+    std::list<Entry> lru; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> byText;
+    std::unordered_map<uint32_t, std::list<Entry>::iterator> byId;
+};
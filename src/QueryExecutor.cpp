@@ -0,0 +1,534 @@
+#include "QueryExecutor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include "SimdKernels.h"
+
+namespace {
+
+const Value& resolve(const Value& value, const std::vector<Value>& bindings) {
+    if (value.type != ValueType::Param) return value;
+    size_t index = static_cast<size_t>(value.intValue);
+    if (index >= bindings.size()) throw std::invalid_argument("Unbound query parameter");
+    return bindings[index];
+}
+
+const Column& lookupColumn(const ColumnTable& table, std::string_view name) {
+    int index = table.findColumn(name);
+    if (index < 0) {
+        throw std::invalid_argument("Unknown column " + std::string(name) + " in table " + table.name());
+    }
+    return table.column(index);
+}
+
+Predicate constantPredicate(bool matches) {
+    Predicate p;
+    p.kind = Predicate::Kind::Constant;
+    p.constant = matches;
+    return p;
+}
+
+bool compareStrings(const std::string& a, std::string_view b, CompareOp op) {
+    int c = std::string_view(a).compare(b);
+    switch (op) {
+        case CompareOp::Eq: return c == 0;
+        case CompareOp::Ne: return c != 0;
+        case CompareOp::Lt: return c < 0;
+        case CompareOp::Le: return c <= 0;
+        case CompareOp::Gt: return c > 0;
+        case CompareOp::Ge: return c >= 0;
+    }
+    return false;
+}
+
+Predicate compileCompare(const Column& column, CompareOp op, const Value& value) {
+    if (value.type == ValueType::Null) return constantPredicate(false);
+    Predicate p;
+    p.column = &column;
+    p.op = op;
+    switch (column.type()) {
+        case ColumnType::Int64:
+            if (value.type == ValueType::Int || value.type == ValueType::Bool) {
+                p.kind = Predicate::Kind::Int64;
+                p.intValue = value.intValue;
+                return p;
+            }
+            if (value.type == ValueType::Double) {
+                // Rewrite against the nearest integers so the int kernel applies
+                double c = value.doubleValue;
+                if (std::isnan(c)) return constantPredicate(op == CompareOp::Ne);
+                // Beyond the int64 range every row compares the same way, and
+                // the cast below would be undefined
+                if (c >= 9223372036854775808.0 || c < -9223372036854775808.0) {
+                    bool above = c > 0; // The constant is above every value
+                    switch (op) {
+                        case CompareOp::Eq: return constantPredicate(false);
+                        case CompareOp::Ne: return constantPredicate(true);
+                        case CompareOp::Lt:
+                        case CompareOp::Le: return constantPredicate(above);
+                        case CompareOp::Gt:
+                        case CompareOp::Ge: return constantPredicate(!above);
+                    }
+                }
+                p.kind = Predicate::Kind::Int64;
+                if (c == std::floor(c)) {
+                    p.intValue = static_cast<int64_t>(c);
+                    return p;
+                }
+                switch (op) {
+                    case CompareOp::Eq: return constantPredicate(false);
+                    case CompareOp::Ne: return constantPredicate(true);
+                    case CompareOp::Lt:
+                    case CompareOp::Le:
+                        p.op = CompareOp::Le;
+                        p.intValue = static_cast<int64_t>(std::floor(c));
+                        return p;
+                    case CompareOp::Gt:
+                    case CompareOp::Ge:
+                        p.op = CompareOp::Ge;
+                        p.intValue = static_cast<int64_t>(std::ceil(c));
+                        return p;
+                }
+            }
+            break;
+        case ColumnType::Double:
+            if (value.type == ValueType::Int || value.type == ValueType::Bool) {
+                p.kind = Predicate::Kind::Double;
+                p.doubleValue = static_cast<double>(value.intValue);
+                return p;
+            }
+            if (value.type == ValueType::Double) {
+                if (std::isnan(value.doubleValue)) return constantPredicate(op == CompareOp::Ne);
+                p.kind = Predicate::Kind::Double;
+                p.doubleValue = value.doubleValue;
+                return p;
+            }
+            break;
+        case ColumnType::String: {
+            if (op == CompareOp::Eq || op == CompareOp::Ne) {
+                int32_t code = column.findCode(value.text);
+                if (code < 0) return constantPredicate(op == CompareOp::Ne);
+                p.kind = Predicate::Kind::Code;
+                p.code = code;
+                return p;
+            }
+            // Ordering on strings: evaluate once per dictionary entry
+            p.kind = Predicate::Kind::CodeTable;
+            const auto& dict = column.dictionary();
+            p.codeMatches.resize(dict.size());
+            for (size_t i = 0; i < dict.size(); ++i) {
+                p.codeMatches[i] = compareStrings(dict[i], value.text, op);
+            }
+            return p;
+        }
+    }
+    throw std::invalid_argument("Cannot compare column " + column.name() + " with '" + std::string(value.text) + "'");
+}
+
+Predicate combine(Predicate::Kind kind, Predicate left, Predicate right) {
+    Predicate p;
+    p.kind = kind;
+    p.children.push_back(std::move(left));
+    p.children.push_back(std::move(right));
+    return p;
+}
+
+void fillBitmap(uint64_t* bitmap, size_t rows, bool matches) {
+    size_t words = (rows + 63) / 64;
+    for (size_t w = 0; w < words; ++w) bitmap[w] = matches ? ~0ULL : 0;
+    if (matches && rows % 64) bitmap[words - 1] = (1ULL << (rows % 64)) - 1;
+}
+
+template <typename T>
+bool compareValues(T a, CompareOp op, T b) {
+    switch (op) {
+        case CompareOp::Eq: return a == b;
+        case CompareOp::Ne: return a != b;
+        case CompareOp::Lt: return a < b;
+        case CompareOp::Le: return a <= b;
+        case CompareOp::Gt: return a > b;
+        case CompareOp::Ge: return a >= b;
+    }
+    return false;
+}
+
+// Row-at-a-time form of evaluate, for rows reached through an index
+bool evaluateRow(const Predicate& p, size_t row) {
+    size_t chunkIndex = row / kBatchSize;
+    size_t offset = row % kBatchSize;
+    switch (p.kind) {
+        case Predicate::Kind::Constant:
+            return p.constant;
+        case Predicate::Kind::Int64:
+            return compareValues(p.column->chunk(chunkIndex).ints[offset], p.op, p.intValue);
+        case Predicate::Kind::Double:
+            return compareValues(p.column->chunk(chunkIndex).doubles[offset], p.op, p.doubleValue);
+        case Predicate::Kind::Code:
+            return compareValues(p.column->chunk(chunkIndex).codes[offset], p.op, p.code);
+        case Predicate::Kind::CodeTable: {
+            size_t code = static_cast<size_t>(p.column->chunk(chunkIndex).codes[offset]);
+            return code < p.codeMatches.size() && p.codeMatches[code];
+        }
+        case Predicate::Kind::And:
+            for (const auto& child : p.children) {
+                if (!evaluateRow(child, row)) return false;
+            }
+            return true;
+        case Predicate::Kind::Or:
+            for (const auto& child : p.children) {
+                if (evaluateRow(child, row)) return true;
+            }
+            return false;
+    }
+    return false;
+}
+
+void flattenAnd(const Predicate& p, std::vector<const Predicate*>& conjuncts) {
+    if (p.kind != Predicate::Kind::And) {
+        conjuncts.push_back(&p);
+        return;
+    }
+    for (const auto& child : p.children) flattenAnd(child, conjuncts);
+}
+
+void evaluate(const Predicate& p, size_t chunkIndex, size_t rows, uint64_t* bitmap) {
+    size_t words = (rows + 63) / 64;
+    switch (p.kind) {
+        case Predicate::Kind::Constant:
+            fillBitmap(bitmap, rows, p.constant);
+            return;
+        case Predicate::Kind::Int64:
+            compareInt64(p.column->chunk(chunkIndex).ints.data(), rows, p.op, p.intValue, bitmap);
+            return;
+        case Predicate::Kind::Double:
+            compareDouble(p.column->chunk(chunkIndex).doubles.data(), rows, p.op, p.doubleValue, bitmap);
+            return;
+        case Predicate::Kind::Code:
+            compareInt32(p.column->chunk(chunkIndex).codes.data(), rows, p.op, p.code, bitmap);
+            return;
+        case Predicate::Kind::CodeTable: {
+            const int32_t* codes = p.column->chunk(chunkIndex).codes.data();
+            size_t known = p.codeMatches.size();
+            for (size_t w = 0; w < words; ++w) {
+                size_t n = std::min<size_t>(64, rows - w * 64);
+                uint64_t word = 0;
+                for (size_t j = 0; j < n; ++j) {
+                    size_t code = static_cast<size_t>(codes[w * 64 + j]);
+                    word |= static_cast<uint64_t>(code < known && p.codeMatches[code]) << j;
+                }
+                bitmap[w] = word;
+            }
+            return;
+        }
+        case Predicate::Kind::And:
+        case Predicate::Kind::Or: {
+            bool isAnd = p.kind == Predicate::Kind::And;
+            evaluate(p.children[0], chunkIndex, rows, bitmap);
+            uint64_t scratch[kBitmapWords];
+            for (size_t c = 1; c < p.children.size(); ++c) {
+                if (isAnd) {
+                    // Skip the remaining conjuncts once nothing survives
+                    uint64_t any = 0;
+                    for (size_t w = 0; w < words; ++w) any |= bitmap[w];
+                    if (any == 0) return;
+                }
+                evaluate(p.children[c], chunkIndex, rows, scratch);
+                for (size_t w = 0; w < words; ++w) {
+                    bitmap[w] = isAnd ? (bitmap[w] & scratch[w]) : (bitmap[w] | scratch[w]);
+                }
+            }
+            return;
+        }
+    }
+}
+
+} // namespace
+
+Predicate QueryExecutor::compile(const ColumnTable& table, const Expr* expr, const std::vector<Value>& bindings) {
+    if (expr == nullptr) return constantPredicate(true);
+    switch (expr->kind) {
+        case ExprKind::And:
+            return combine(Predicate::Kind::And, compile(table, expr->left, bindings),
+                           compile(table, expr->right, bindings));
+        case ExprKind::Or:
+            return combine(Predicate::Kind::Or, compile(table, expr->left, bindings),
+                           compile(table, expr->right, bindings));
+        case ExprKind::Compare:
+            return compileCompare(lookupColumn(table, expr->column), expr->op, resolve(expr->values[0], bindings));
+        case ExprKind::Between: {
+            const Column& column = lookupColumn(table, expr->column);
+            return combine(Predicate::Kind::And,
+                           compileCompare(column, CompareOp::Ge, resolve(expr->values[0], bindings)),
+                           compileCompare(column, CompareOp::Le, resolve(expr->values[1], bindings)));
+        }
+        case ExprKind::In: {
+            const Column& column = lookupColumn(table, expr->column);
+            if (column.type() == ColumnType::String) {
+                Predicate p;
+                p.kind = Predicate::Kind::CodeTable;
+                p.column = &column;
+                p.codeMatches.assign(column.dictionary().size(), 0);
+                for (uint32_t i = 0; i < expr->valueCount; ++i) {
+                    const Value& value = resolve(expr->values[i], bindings);
+                    if (value.type == ValueType::Null) continue;
+                    int32_t code = column.findCode(value.text);
+                    if (code >= 0) p.codeMatches[code] = 1;
+                }
+                return p;
+            }
+            Predicate p;
+            p.kind = Predicate::Kind::Or;
+            for (uint32_t i = 0; i < expr->valueCount; ++i) {
+                p.children.push_back(compileCompare(column, CompareOp::Eq, resolve(expr->values[i], bindings)));
+            }
+            return p;
+        }
+    }
+    throw std::invalid_argument("Unsupported expression");
+}
+
+QueryExecutor::QueryExecutor(const ColumnTable& table, const Statement& statement, const std::vector<Value>& bindings)
+    : table(table), predicate(compile(table, statement.where, bindings)) {
+    if (statement.itemCount == 0) {
+        for (size_t i = 0; i < table.columnCount(); ++i) projection.push_back(i);
+    }
+    for (uint32_t i = 0; i < statement.itemCount; ++i) {
+        if (statement.items[i].aggregate != AggregateKind::None) continue;
+        lookupColumn(table, statement.items[i].column);
+        projection.push_back(static_cast<size_t>(table.findColumn(statement.items[i].column)));
+    }
+    chooseIndex();
+}
+
+void QueryExecutor::chooseIndex() {
+    // Conjuncts on one indexed column combine into one lookup, so
+    // BETWEEN becomes a single key range
+    struct Lookup {
+        const ColumnIndex* index = nullptr;
+        KeyRange<int64_t> ints;
+        KeyRange<double> doubles;
+        std::vector<int32_t> codes;
+        // A numeric IN list, as point ranges
+        std::vector<KeyRange<int64_t>> intKeys;
+        std::vector<KeyRange<double>> doubleKeys;
+        bool numeric = false;
+        bool isDouble = false;
+        bool hasCodes = false;
+        bool hasKeys = false;
+        bool useKeys = false;
+        size_t rows = 0;
+    };
+    std::vector<const Predicate*> conjuncts;
+    flattenAnd(predicate, conjuncts);
+    std::vector<std::pair<const Column*, Lookup>> lookups;
+    auto lookupFor = [&](const Column* column) -> Lookup* {
+        for (auto& entry : lookups) {
+            if (entry.first == column) return &entry.second;
+        }
+        const ColumnIndex* index = table.index(*column);
+        if (!index) return nullptr;
+        lookups.emplace_back(column, Lookup());
+        lookups.back().second.index = index;
+        return &lookups.back().second;
+    };
+    for (const Predicate* p : conjuncts) {
+        switch (p->kind) {
+            case Predicate::Kind::Int64:
+            case Predicate::Kind::Double: {
+                if (p->op == CompareOp::Ne) break;
+                Lookup* lookup = lookupFor(p->column);
+                if (!lookup) break;
+                lookup->numeric = true;
+                lookup->isDouble = p->kind == Predicate::Kind::Double;
+                if (lookup->isDouble) lookup->doubles.restrict(p->op, p->doubleValue);
+                else lookup->ints.restrict(p->op, p->intValue);
+                break;
+            }
+            case Predicate::Kind::Code:
+            case Predicate::Kind::CodeTable: {
+                if (p->kind == Predicate::Kind::Code && p->op != CompareOp::Eq) break;
+                Lookup* lookup = lookupFor(p->column);
+                // A second condition on the same string column is left to the recheck
+                if (!lookup || lookup->hasCodes) break;
+                lookup->hasCodes = true;
+                if (p->kind == Predicate::Kind::Code) {
+                    lookup->codes.push_back(p->code);
+                } else {
+                    for (size_t code = 0; code < p->codeMatches.size(); ++code) {
+                        if (p->codeMatches[code]) lookup->codes.push_back(static_cast<int32_t>(code));
+                    }
+                }
+                break;
+            }
+            case Predicate::Kind::Or: {
+                // A numeric IN list compiles to equalities on one column
+                const Column* column = nullptr;
+                bool isDouble = false;
+                bool keys = true;
+                for (const auto& child : p->children) {
+                    if (child.kind == Predicate::Kind::Constant && !child.constant) continue;
+                    bool equality = (child.kind == Predicate::Kind::Int64 || child.kind == Predicate::Kind::Double) &&
+                                    child.op == CompareOp::Eq;
+                    if (!equality || (column && child.column != column)) {
+                        keys = false;
+                        break;
+                    }
+                    column = child.column;
+                    isDouble = child.kind == Predicate::Kind::Double;
+                }
+                if (!keys || !column) break;
+                Lookup* lookup = lookupFor(column);
+                // A second list on the same column is left to the recheck
+                if (!lookup || lookup->hasKeys) break;
+                lookup->hasKeys = true;
+                lookup->isDouble = isDouble;
+                std::vector<int64_t> ints;
+                std::vector<double> doubles;
+                for (const auto& child : p->children) {
+                    if (child.kind == Predicate::Kind::Int64) ints.push_back(child.intValue);
+                    if (child.kind == Predicate::Kind::Double) doubles.push_back(child.doubleValue);
+                }
+                // Each key once, or its rows would be collected twice
+                std::sort(ints.begin(), ints.end());
+                ints.erase(std::unique(ints.begin(), ints.end()), ints.end());
+                std::sort(doubles.begin(), doubles.end());
+                doubles.erase(std::unique(doubles.begin(), doubles.end()), doubles.end());
+                for (int64_t key : ints) {
+                    lookup->intKeys.emplace_back();
+                    lookup->intKeys.back().restrict(CompareOp::Eq, key);
+                }
+                for (double key : doubles) {
+                    lookup->doubleKeys.emplace_back();
+                    lookup->doubleKeys.back().restrict(CompareOp::Eq, key);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    Lookup* best = nullptr;
+    for (auto& entry : lookups) {
+        Lookup& lookup = entry.second;
+        if (lookup.numeric) {
+            lookup.rows = lookup.isDouble ? lookup.index->count(lookup.doubles) : lookup.index->count(lookup.ints);
+        } else if (lookup.hasCodes) {
+            lookup.rows = lookup.index->count(lookup.codes);
+        } else if (!lookup.hasKeys) {
+            continue;
+        }
+        if (lookup.hasKeys) {
+            // Look the IN list's keys up instead when they reach fewer rows
+            size_t rows = 0;
+            for (const auto& key : lookup.intKeys) rows += lookup.index->count(key);
+            for (const auto& key : lookup.doubleKeys) rows += lookup.index->count(key);
+            if (!lookup.numeric || rows < lookup.rows) {
+                lookup.rows = rows;
+                lookup.useKeys = true;
+            }
+        }
+        if (!best || lookup.rows < best->rows) best = &lookup;
+    }
+    if (!best || static_cast<double>(best->rows) * kIndexRowCost >= static_cast<double>(table.rowCount())) return;
+
+    indexLookup = true;
+    candidates.reserve(best->rows);
+    if (best->useKeys) {
+        for (const auto& key : best->intKeys) best->index->collect(key, candidates);
+        for (const auto& key : best->doubleKeys) best->index->collect(key, candidates);
+    } else if (best->numeric && best->isDouble) {
+        best->index->collect(best->doubles, candidates);
+    } else if (best->numeric) {
+        best->index->collect(best->ints, candidates);
+    } else {
+        best->index->collect(best->codes, candidates);
+    }
+    // Each key's rows are ascending; a range or IN spans several keys
+    if (!std::is_sorted(candidates.begin(), candidates.end())) std::sort(candidates.begin(), candidates.end());
+}
+
+template <typename Visit>
+void QueryExecutor::forEachMatch(Visit visit) const {
+    for (uint32_t row : candidates) {
+        if (evaluateRow(predicate, row)) visit(static_cast<size_t>(row));
+    }
+}
+
+size_t QueryExecutor::chunkRows(size_t chunkIndex) const {
+    return std::min(kBatchSize, table.rowCount() - chunkIndex * kBatchSize);
+}
+
+void QueryExecutor::evaluateChunk(size_t chunkIndex, uint64_t* bitmap) const {
+    if (!indexLookup) {
+        evaluate(predicate, chunkIndex, chunkRows(chunkIndex), bitmap);
+        return;
+    }
+    fillBitmap(bitmap, chunkRows(chunkIndex), false);
+    uint32_t first = static_cast<uint32_t>(chunkIndex * kBatchSize);
+    auto it = std::lower_bound(candidates.begin(), candidates.end(), first);
+    for (; it != candidates.end() && *it - first < kBatchSize; ++it) {
+        if (evaluateRow(predicate, *it)) bitmap[(*it - first) / 64] |= 1ULL << ((*it - first) % 64);
+    }
+}
+
+size_t QueryExecutor::countMatches() const {
+    size_t matches = 0;
+    if (indexLookup) {
+        forEachMatch([&matches](size_t) { ++matches; });
+        return matches;
+    }
+    size_t chunks = (table.rowCount() + kBatchSize - 1) / kBatchSize;
+    uint64_t bitmap[kBitmapWords];
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t rows = chunkRows(c);
+        evaluate(predicate, c, rows, bitmap);
+        for (size_t w = 0; w < (rows + 63) / 64; ++w) {
+            matches += static_cast<size_t>(__builtin_popcountll(bitmap[w]));
+        }
+    }
+    return matches;
+}
+
+ResultSet QueryExecutor::run() const {
+    ResultSet result;
+    runBatched(SIZE_MAX, [&result](ResultSet& batch, bool) { result = std::move(batch); });
+    return result;
+}
+
+void QueryExecutor::runBatched(size_t batchRows, const std::function<void(ResultSet&, bool)>& sink) const {
+    ResultSet batch;
+    for (size_t index : projection) batch.columns.push_back(table.column(index).name());
+    auto emit = [&](size_t row) {
+        std::vector<std::string> values(projection.size());
+        for (size_t i = 0; i < projection.size(); ++i) {
+            table.column(projection[i]).appendText(row, values[i]);
+        }
+        batch.rows.push_back(std::move(values));
+        if (batch.rows.size() == batchRows) {
+            sink(batch, false);
+            batch.rows.clear();
+        }
+    };
+    if (indexLookup) {
+        forEachMatch(emit);
+        sink(batch, true);
+        return;
+    }
+    size_t chunks = (table.rowCount() + kBatchSize - 1) / kBatchSize;
+    uint64_t bitmap[kBitmapWords];
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t rows = chunkRows(c);
+        evaluate(predicate, c, rows, bitmap);
+        for (size_t w = 0; w < (rows + 63) / 64; ++w) {
+            uint64_t word = bitmap[w];
+            while (word) {
+                size_t row = c * kBatchSize + w * 64 + static_cast<size_t>(__builtin_ctzll(word));
+                word &= word - 1;
+                emit(row);
+            }
+        }
+    }
+    sink(batch, true);
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ColumnStore.h"
+#include "QueryParser.h"
+
+// Rows produced by a query, each value in text form
+struct ResultSet {
+    std::vector<std::string> columns;
+    std::vector<std::vector<std::string>> rows;
+};
+
+constexpr size_t kBitmapWords = kBatchSize / 64;
+
+// Cost of fetching one row through an index relative to scanning one row; an
+// index is used when it narrows the table below 1 / kIndexRowCost of its rows
+constexpr double kIndexRowCost = 20.0;
+
+// WHERE clause resolved against one table: columns bound, literals converted
+// to the column's physical type and string literals mapped to dictionary codes
+struct Predicate {
+    enum class Kind : uint8_t {
+        Constant,  // every row matches when `constant` is true, none otherwise
+        Int64,     // int column op intValue
+        Double,    // double column op doubleValue
+        Code,      // string column op dictionary code (Eq / Ne only)
+        CodeTable, // string column, per-code match table
+        And,
+        Or,
+    };
+    Kind kind = Kind::Constant;
+    bool constant = true;
+    CompareOp op = CompareOp::Eq;
+    const Column* column = nullptr;
+    int64_t intValue = 0;
+    double doubleValue = 0.0;
+    int32_t code = 0;
+    std::vector<uint8_t> codeMatches;
+    std::vector<Predicate> children;
+};
+
+// Vectorized SELECT/WHERE over a ColumnTable. The predicate is evaluated one
+// kBatchSize chunk at a time into a selection bitmap with the SIMD kernels,
+// and projection only materializes rows whose bit is set. When an indexed
+// column's equality or range conjunct is selective enough, the executor reads
+// that index's rows instead and checks only them, so the cost follows the
+// matches rather than the table size.
+class QueryExecutor {
+public:
+    // `bindings` supplies values for '?' parameters. Throws std::invalid_argument
+    // for unknown columns or literals that cannot be compared with a column.
+    QueryExecutor(const ColumnTable& table, const Statement& statement, const std::vector<Value>& bindings);
+
+    ResultSet run() const;
+
+    // Project matching rows in batches of at most `batchRows` rows. `sink` is
+    // called for every full batch and once more, with last set, at the end.
+    void runBatched(size_t batchRows, const std::function<void(ResultSet& batch, bool last)>& sink) const;
+
+    // Number of matching rows, without projecting anything
+    size_t countMatches() const;
+
+    // Selection bitmap of chunk `chunkIndex` (kBitmapWords words)
+    void evaluateChunk(size_t chunkIndex, uint64_t* bitmap) const;
+
+    static Predicate compile(const ColumnTable& table, const Expr* expr, const std::vector<Value>& bindings);
+
+    // Whether rows come from an index lookup rather than a scan
+    bool usesIndex() const { return indexLookup; }
+
+private:
+    size_t chunkRows(size_t chunkIndex) const;
+    void chooseIndex();
+    // Visit the matching rows in ascending order
+    template <typename Visit>
+    void forEachMatch(Visit visit) const;
+
+    const ColumnTable& table;
+    Predicate predicate;
+    std::vector<size_t> projection;
+    bool indexLookup = false;
+    std::vector<uint32_t> candidates; // Rows from the index, ascending; the full predicate is rechecked
+};
@@ -0,0 +1,405 @@
+#include "QueryFragments.h"
+#include <poll.h>
+#include <atomic>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include "Aggregation.h"
+#include "Communication.h"
+#include "QueryExecutor.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+LiteralData toLiteralData(const Value& value) {
+    LiteralData literal;
+    literal.type = static_cast<uint8_t>(value.type);
+    literal.int_value = value.intValue;
+    literal.double_value = value.doubleValue;
+    literal.text = std::string(value.text);
+    return literal;
+}
+
+Value fromLiteralData(const LiteralData& literal) {
+    Value value;
+    value.type = static_cast<ValueType>(literal.type);
+    value.intValue = literal.int_value;
+    value.doubleValue = literal.double_value;
+    value.text = literal.text;
+    return value;
+}
+
+static bool sendFramed(int socket, const Message& message) {
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(message);
+    std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    return Communication::sendMessage(socket, std::move(out));
+}
+
+bool runFragments(const std::vector<NodeInfo>& nodes, const Message& fragment,
+                  ResultData& result, std::string& error,
+                  const std::function<void(size_t, Message&)>& customize) {
+    // One thread multiplexes every node's connection, so a coordinator worker
+    // fans out without parking a thread per node. Batches are merged as they
+    // arrive instead of waiting for each node to finish.
+    FragmentStream stream(nodes, fragment, customize);
+    std::vector<std::vector<std::string>> rows;
+    while (stream.next(rows, error)) {
+        for (auto& row : rows) result.rows.push_back(std::move(row));
+    }
+    result.columns = stream.columns();
+    result.done = true;
+    return error.empty();
+}
+
+FragmentStream::FragmentStream(const std::vector<NodeInfo>& nodes, const Message& fragment,
+                               const std::function<void(size_t, Message&)>& customize) {
+    for (size_t index = 0; index < nodes.size(); ++index) {
+        const NodeInfo& node = nodes[index];
+        nodeIds.push_back(node.uuid);
+        int sock = Communication::startClient(node.ip, node.port);
+        sockets.push_back(sock);
+        if (sock < 0) {
+            failure = "Fragment on node " + node.uuid + " failed: cannot connect";
+            break;
+        }
+        bool sent;
+        if (customize) {
+            Message own = fragment;
+            customize(index, own);
+            sent = sendFramed(sock, own);
+        } else {
+            sent = sendFramed(sock, fragment);
+        }
+        if (!sent) {
+            failure = "Fragment on node " + node.uuid + " failed: send failed";
+            break;
+        }
+    }
+}
+
+FragmentStream::~FragmentStream() {
+    for (size_t i = 0; i < sockets.size(); ++i) closeNode(i);
+}
+
+void FragmentStream::closeNode(size_t index) {
+    if (sockets[index] < 0) return;
+    Communication::closeSocket(sockets[index]);
+    sockets[index] = -1;
+}
+
+bool FragmentStream::next(std::vector<std::vector<std::string>>& rows, std::string& error) {
+    if (!failure.empty()) {
+        error = failure;
+        return false;
+    }
+    while (true) {
+        std::vector<pollfd> ready;
+        std::vector<size_t> owners;
+        for (size_t i = 0; i < sockets.size(); ++i) {
+            if (sockets[i] < 0) continue;
+            ready.push_back({sockets[i], POLLIN, 0});
+            owners.push_back(i);
+        }
+        if (ready.empty()) return false;
+        int timeoutMs = static_cast<int>(std::chrono::milliseconds(kReadTimeout).count());
+        int count = poll(ready.data(), ready.size(), timeoutMs);
+        if (count <= 0) {
+            failure = count == 0 ? "Timed out waiting for fragment results" : "poll failed";
+            error = failure;
+            return false;
+        }
+        for (size_t r = 0; r < ready.size(); ++r) {
+            if (ready[r].revents == 0) continue;
+            size_t index = owners[r];
+            auto fail = [&](const std::string& why) {
+                failure = "Fragment on node " + nodeIds[index] + " failed: " + why;
+                error = failure;
+                return false;
+            };
+            std::string response = Communication::receiveMessage(sockets[index]);
+            if (response.empty()) return fail("connection closed");
+            Message batch;
+            try {
+                batch = MessageDeserializer::deserialize(std::vector<uint8_t>(response.begin(), response.end()));
+            } catch (const std::exception&) {
+                return fail("malformed response");
+            }
+            if (batch.type != MessageType::FRAGMENT_RESULT || !batch.query.error.empty()) {
+                return fail(batch.query.error.empty() ? "unexpected response" : batch.query.error);
+            }
+            if (resultColumns.empty()) resultColumns = std::move(batch.result.columns);
+            if (batch.result.done) closeNode(index);
+            if (!batch.result.rows.empty()) {
+                rows = std::move(batch.result.rows);
+                return true;
+            }
+        }
+    }
+}
+
+// Join ids start at a random point so a restarted coordinator does not reuse
+// the id of an exchange a DataNode may still hold
+static uint64_t nextJoinId() {
+    static std::atomic<uint64_t> next{static_cast<uint64_t>(std::random_device{}()) << 32};
+    return next++;
+}
+
+bool prepareJoin(const std::vector<NodeInfo>& nodes, const Message& fragment, JoinStrategy strategy, int buildSide,
+                 Message& join, std::string& error) {
+    if (strategy == JoinStrategy::Unknown) {
+        // No statistics: size both sides after their own WHERE conjuncts
+        Message estimate = fragment;
+        estimate.join.step = static_cast<uint8_t>(JoinStep::Estimate);
+        ResultData counts;
+        if (!runFragments(nodes, estimate, counts, error)) return false;
+        size_t sideRows[2] = {0, 0};
+        for (const auto& row : counts.rows) {
+            if (row.size() != 2) {
+                error = "Malformed join estimate";
+                return false;
+            }
+            sideRows[0] += std::stoull(row[0]);
+            sideRows[1] += std::stoull(row[1]);
+        }
+        buildSide = sideRows[1] < sideRows[0] ? 1 : 0;
+        bool broadcast = nodes.size() > 1 && sideRows[buildSide] <= kBroadcastJoinRows;
+        strategy = broadcast ? JoinStrategy::Broadcast : JoinStrategy::Shuffle;
+    }
+
+    int small = buildSide & 1;
+    join = fragment;
+    if (strategy == JoinStrategy::Broadcast) {
+        Message scan = fragment;
+        scan.join.step = static_cast<uint8_t>(JoinStep::ScanSide);
+        scan.join.side = static_cast<uint8_t>(small);
+        if (!runFragments(nodes, scan, join.join.rows, error)) return false;
+        join.join.step = static_cast<uint8_t>(JoinStep::Broadcast);
+        join.join.side = static_cast<uint8_t>(small);
+        return true;
+    }
+    // With one node this is a plain local join; nothing is exchanged
+    join.join.step = static_cast<uint8_t>(JoinStep::Shuffle);
+    join.join.join_id = nextJoinId();
+    join.join.nodes = nodes;
+    return true;
+}
+
+void prepareJoinNode(size_t index, Message& join) {
+    join.join.node_index = static_cast<uint32_t>(index);
+}
+
+bool runJoin(const std::vector<NodeInfo>& nodes, const Message& fragment, JoinStrategy strategy, int buildSide,
+             ResultData& result, std::string& error) {
+    Message join;
+    if (!prepareJoin(nodes, fragment, strategy, buildSide, join, error)) return false;
+    return runFragments(nodes, join, result, error, prepareJoinNode);
+}
+
+// Stream the executor's matching rows to `socket` as FRAGMENT_RESULT batches
+static void streamRows(int socket, const QueryExecutor& executor, Message& reply) {
+    bool first = true;
+    executor.runBatched(kFragmentBatchRows, [&](ResultSet& batch, bool last) {
+        // Column names only travel with the first batch
+        if (first) reply.result.columns = batch.columns;
+        else reply.result.columns.clear();
+        first = false;
+        reply.result.rows = std::move(batch.rows);
+        reply.result.done = last;
+        // A closed cursor drops the connection; stop the scan instead of finishing it
+        if (!sendFramed(socket, reply)) throw std::runtime_error("Coordinator closed the fragment stream");
+    });
+}
+
+// Reply with `statement` evaluated over `table`
+static void sendStatementResult(int socket, const ColumnTable& table, const Statement& statement,
+                                const std::vector<Value>& bindings, Message& reply) {
+    QueryExecutor executor(table, statement, bindings);
+    if (statement.hasAggregates) {
+        // Ship one partial state per group instead of the matching rows
+        ResultSet partial = PartialAggregator(table, statement, executor).run();
+        reply.result.columns = std::move(partial.columns);
+        reply.result.rows = std::move(partial.rows);
+        sendFramed(socket, reply);
+        return;
+    }
+    streamRows(socket, executor, reply);
+}
+
+// Send every peer the rows whose join key hashes to it and collect the rows
+// the peers send back; rows that hash to this node never leave it
+static void shuffleRows(const JoinData& join, const JoinPlan& plan, const std::vector<Value>& bindings,
+                        ShuffleExchange& shuffles, Rows rows[2]) {
+    size_t nodeCount = join.nodes.size();
+    size_t self = join.node_index;
+    if (self >= nodeCount) throw std::invalid_argument("Malformed shuffle fragment");
+    std::vector<Rows> outgoing[2];
+    for (int side = 0; side < 2; ++side) {
+        outgoing[side].resize(nodeCount);
+        Rows scanned = QueryExecutor(plan.table(side), plan.scan(side), bindings).run().rows;
+        for (auto& row : scanned) {
+            size_t target = shufflePartition(row[plan.keyIndex(side)], nodeCount);
+            if (target == self) rows[side].push_back(std::move(row));
+            else outgoing[side][target].push_back(std::move(row));
+        }
+    }
+
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> senders;
+    for (size_t peer = 0; peer < nodeCount; ++peer) {
+        if (peer == self) continue;
+        senders.emplace_back([&, peer]() {
+            int sock = Communication::startClient(join.nodes[peer].ip, join.nodes[peer].port);
+            if (sock < 0) {
+                failed = true;
+                return;
+            }
+            Message batch;
+            batch.type = MessageType::SHUFFLE_DATA;
+            batch.join.join_id = join.join_id;
+            batch.join.node_index = static_cast<uint32_t>(self);
+            for (int side = 0; side < 2; ++side) {
+                Rows& pending = outgoing[side][peer];
+                for (size_t start = 0; start < pending.size() || side == 1; start += kFragmentBatchRows) {
+                    size_t end = std::min(pending.size(), start + kFragmentBatchRows);
+                    batch.join.side = static_cast<uint8_t>(side);
+                    batch.join.rows.rows.clear();
+                    for (size_t r = start; r < end; ++r) batch.join.rows.rows.push_back(std::move(pending[r]));
+                    // The last batch of the right side ends this sender's stream
+                    batch.join.rows.done = side == 1 && end == pending.size();
+                    if (!sendFramed(sock, batch)) {
+                        failed = true;
+                        break;
+                    }
+                    if (batch.join.rows.done) break;
+                }
+            }
+            Communication::closeSocket(sock);
+        });
+    }
+    for (auto& sender : senders) sender.join();
+    if (failed) throw std::runtime_error("Could not send shuffled rows to a peer");
+    if (!shuffles.collect(join.join_id, nodeCount - 1, kShuffleTimeout, rows[0], rows[1])) {
+        throw std::runtime_error("Timed out waiting for shuffled rows from peers");
+    }
+}
+
+static void serveJoin(int socket, const Message& fragment, const Statement& statement, QueryArena& arena,
+                      const std::vector<Value>& bindings, const TableCatalog& catalog,
+                      ShuffleExchange& shuffles, Message& reply) {
+    JoinPlan plan(catalog, statement, arena);
+    int side = fragment.join.side & 1;
+    Rows rows[2];
+    switch (static_cast<JoinStep>(fragment.join.step)) {
+        case JoinStep::Estimate:
+            reply.result.columns = {"left_rows", "right_rows"};
+            reply.result.rows.push_back({
+                std::to_string(QueryExecutor(plan.table(0), plan.scan(0), bindings).countMatches()),
+                std::to_string(QueryExecutor(plan.table(1), plan.scan(1), bindings).countMatches()),
+            });
+            sendFramed(socket, reply);
+            return;
+        case JoinStep::ScanSide:
+            streamRows(socket, QueryExecutor(plan.table(side), plan.scan(side), bindings), reply);
+            return;
+        case JoinStep::Broadcast:
+            rows[side] = fragment.join.rows.rows;
+            for (const auto& row : rows[side]) {
+                if (row.size() != plan.scan(side).itemCount) {
+                    throw std::invalid_argument("Broadcast rows do not match the join columns");
+                }
+            }
+            rows[1 - side] = QueryExecutor(plan.table(1 - side), plan.scan(1 - side), bindings).run().rows;
+            break;
+        case JoinStep::Shuffle:
+            shuffleRows(fragment.join, plan, bindings, shuffles, rows);
+            break;
+        default:
+            throw std::invalid_argument("JOIN fragment without a join step");
+    }
+    ColumnTable joined = plan.makeOutputTable();
+    hashJoinRows(rows[0], plan.keyIndex(0), rows[1], plan.keyIndex(1), joined);
+    sendStatementResult(socket, joined, plan.output(), bindings, reply);
+}
+
+void serveFragment(int socket, const Message& fragment, TableCatalog& catalog, ShuffleExchange& shuffles) {
+    Message reply;
+    reply.type = MessageType::FRAGMENT_RESULT;
+    try {
+        QueryArena arena;
+        QueryParser parser;
+        const Statement* statement = parser.parseStatement(fragment.query.text, arena);
+        std::vector<Value> bindings;
+        for (const auto& param : fragment.query.params) bindings.push_back(fromLiteralData(param));
+        if (statement->type == StatementType::CreateIndex) {
+            size_t rows = catalog.createIndex(std::string(statement->table), statement->indexColumn);
+            reply.result.columns = {"indexed_rows"};
+            reply.result.rows.push_back({std::to_string(rows)});
+            sendFramed(socket, reply);
+            return;
+        }
+        if (statement->join) {
+            serveJoin(socket, fragment, *statement, arena, bindings, catalog, shuffles, reply);
+            return;
+        }
+        std::shared_ptr<const ColumnTable> table = catalog.find(std::string(statement->table));
+        if (!table) throw std::invalid_argument("Unknown table " + std::string(statement->table));
+        sendStatementResult(socket, *table, *statement, bindings, reply);
+    } catch (const std::exception& e) {
+        reply.query.error = e.what();
+        reply.result = ResultData();
+        sendFramed(socket, reply);
+    }
+}
+
+std::vector<TableStatsData> fetchTableStats(const std::vector<NodeInfo>& nodes) {
+    // Every node starts computing its statistics before the first reply is read
+    Message request;
+    request.type = MessageType::TABLE_STATS_REQUEST;
+    std::vector<int> sockets;
+    for (const auto& node : nodes) {
+        int sock = Communication::startClient(node.ip, node.port);
+        if (sock >= 0 && !sendFramed(sock, request)) {
+            Communication::closeSocket(sock);
+            sock = -1;
+        }
+        sockets.push_back(sock);
+    }
+    std::vector<TableStatsData> reports;
+    for (int sock : sockets) {
+        if (sock < 0) continue;
+        std::string response = Communication::receiveMessage(sock);
+        Communication::closeSocket(sock);
+        if (response.empty()) continue;
+        try {
+            Message reply = MessageDeserializer::deserialize(std::vector<uint8_t>(response.begin(), response.end()));
+            if (reply.type != MessageType::TABLE_STATS_RESPONSE) continue;
+            for (auto& table : reply.stats) reports.push_back(std::move(table));
+        } catch (const std::exception&) {
+            // Planning continues with the statistics of the other nodes
+        }
+    }
+    return reports;
+}
+
+void serveTableStats(int socket, const TableCatalog& catalog) {
+    Message reply;
+    reply.type = MessageType::TABLE_STATS_RESPONSE;
+    for (const auto& table : catalog.list()) reply.stats.push_back(table->statistics(kHistogramBuckets));
+    sendFramed(socket, reply);
+}
+
+void serveShuffleData(int socket, const Message& first, ShuffleExchange& shuffles) {
+    Message batch = first;
+    try {
+        while (true) {
+            bool done = batch.join.rows.done;
+            shuffles.deliver(batch.join.join_id, batch.join.side & 1, std::move(batch.join.rows.rows), done);
+            if (done) return;
+            std::string data = Communication::receiveMessage(socket);
+            if (data.empty()) return;
+            batch = MessageDeserializer::deserialize(std::vector<uint8_t>(data.begin(), data.end()));
+            if (batch.type != MessageType::SHUFFLE_DATA) return;
+        }
+    } catch (const std::exception&) {
+        // A malformed stream never completes; the collecting fragment times out
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ColumnStore.h"
+#include "HashJoin.h"
+#include "QueryParser.h"
+#include "message.h"
+
+// Rows per FRAGMENT_RESULT message streamed back by a DataNode
+constexpr size_t kFragmentBatchRows = 1024;
+
+LiteralData toLiteralData(const Value& value);
+// The returned value views `literal.text`
+Value fromLiteralData(const LiteralData& literal);
+
+// Equi-depth histogram buckets per column in TABLE_STATS_RESPONSE
+constexpr size_t kHistogramBuckets = 32;
+
+// How long a shuffling DataNode waits for its peers' rows
+constexpr std::chrono::seconds kShuffleTimeout(30);
+
+// Coordinator side of scatter-gather: send `fragment` (a QUERY_FRAGMENT) to
+// every node in parallel and merge the row batches into `result` as they
+// stream in. `customize`, when set, adjusts the copy sent to node i.
+// Returns false and sets `error` when any fragment fails.
+bool runFragments(const std::vector<NodeInfo>& nodes, const Message& fragment,
+                  ResultData& result, std::string& error,
+                  const std::function<void(size_t, Message&)>& customize = nullptr);
+
+// Coordinator side of a streamed scatter-gather: `fragment` goes to every node
+// at once, but batches are only read as next() is called. Batches a caller has
+// not asked for yet stay in the nodes' socket buffers, and a node whose buffer
+// is full blocks in send, so its scan pauses until the stream is read further.
+// Destroying the stream drops the connections, which ends the nodes' scans.
+class FragmentStream {
+public:
+    // How long next() waits for any node before failing the stream
+    static constexpr std::chrono::seconds kReadTimeout{60};
+
+    FragmentStream(const std::vector<NodeInfo>& nodes, const Message& fragment,
+                   const std::function<void(size_t, Message&)>& customize = nullptr);
+    ~FragmentStream();
+    FragmentStream(const FragmentStream&) = delete;
+    FragmentStream& operator=(const FragmentStream&) = delete;
+
+    // Move the next non-empty batch from whichever node has one ready into
+    // `rows`. Returns false once every node is done, or on failure with `error`
+    // set.
+    bool next(std::vector<std::vector<std::string>>& rows, std::string& error);
+
+    // Result columns; known after the first batch
+    const std::vector<std::string>& columns() const { return resultColumns; }
+
+private:
+    void closeNode(size_t index);
+
+    std::vector<int> sockets; // -1 once the node is done
+    std::vector<std::string> nodeIds;
+    std::vector<std::string> resultColumns;
+    std::string failure; // Set when a node could not be reached
+};
+
+// Build the final QUERY_FRAGMENT of a JOIN statement into `join`: the
+// Broadcast or Shuffle step every node runs, after measuring the sides when
+// `strategy` is Unknown and gathering the broadcast side. Run it on node i
+// with prepareJoinNode applied.
+bool prepareJoin(const std::vector<NodeInfo>& nodes, const Message& fragment, JoinStrategy strategy, int buildSide,
+                 Message& join, std::string& error);
+void prepareJoinNode(size_t index, Message& join);
+
+// Coordinator side of a JOIN statement. With Broadcast, `buildSide` is
+// gathered and sent to every node, which probes it with its local partition of
+// the other side; with Shuffle the nodes repartition both sides by join key
+// among themselves and join locally. Unknown first measures the filtered size
+// of each side and broadcasts a small one.
+bool runJoin(const std::vector<NodeInfo>& nodes, const Message& fragment, JoinStrategy strategy, int buildSide,
+             ResultData& result, std::string& error);
+
+// Ask every node for its table statistics; nodes that fail are left out
+std::vector<TableStatsData> fetchTableStats(const std::vector<NodeInfo>& nodes);
+
+// DataNode side: execute a QUERY_FRAGMENT against local tables, with its WHERE
+// clause and projection applied locally, and stream the matching rows to
+// `socket` as FRAGMENT_RESULT batches. Aggregate statements reply with the
+// node's partial aggregate states instead (see PartialAggregator). Join
+// fragments run their JoinStep; shuffled rows arrive through `shuffles`.
+// CREATE INDEX builds the index on the local partition and replies with the
+// number of rows indexed.
+void serveFragment(int socket, const Message& fragment, TableCatalog& catalog, ShuffleExchange& shuffles);
+
+// DataNode side of TABLE_STATS_REQUEST
+void serveTableStats(int socket, const TableCatalog& catalog);
+
+// DataNode side of a shuffle: read the SHUFFLE_DATA stream that starts with
+// `first` from a peer into `shuffles`
+void serveShuffleData(int socket, const Message& first, ShuffleExchange& shuffles);
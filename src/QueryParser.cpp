@@ -1,145 +1,681 @@
-#include <string>
-#include <vector>
-#include <sstream>
+#include "QueryParser.h"
 #include <algorithm>
 #include <cctype>
-#include <tuple>
+#include <charconv>
+#include <cstring>
 #include <stdexcept>
-#include <iostream>
 
 using namespace std;
 
-// Structure to represent a query
-struct Query {
-    string type;          // SELECT, INSERT, etc.
-    string table;        // Table name
-    vector<string> columns; // List of columns to select
-    vector<tuple<string, string, string>> conditions; // (column, operator, value)
+QueryArena::QueryArena(size_t blockSize)
+    : blockSize(blockSize), current(0), cursor(nullptr), limit(nullptr) {}
+
+void* QueryArena::allocate(size_t size, size_t align) {
+    uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+    if (cursor == nullptr || p + size > reinterpret_cast<uintptr_t>(limit)) {
+        // Move to the next retained block, or grow when none is large enough
+        size_t needed = size + align;
+        size_t next = cursor == nullptr ? 0 : current + 1;
+        while (next < blocks.size() && blockSizes[next] < needed) ++next;
+        if (next >= blocks.size()) {
+            size_t bytes = max(blockSize, needed);
+            blocks.emplace_back(new char[bytes]);
+            blockSizes.push_back(bytes);
+            next = blocks.size() - 1;
+        }
+        current = next;
+        cursor = blocks[current].get();
+        limit = cursor + blockSizes[current];
+        p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    cursor = reinterpret_cast<char*>(p + size);
+    return reinterpret_cast<void*>(p);
+}
+
+string_view QueryArena::copy(string_view text) {
+    char* out = static_cast<char*>(allocate(text.size(), 1));
+    memcpy(out, text.data(), text.size());
+    return string_view(out, text.size());
+}
+
+void QueryArena::reset() {
+    current = 0;
+    cursor = blocks.empty() ? nullptr : blocks[0].get();
+    limit = blocks.empty() ? nullptr : cursor + blockSizes[0];
+}
+
+const char* compareOpName(CompareOp op) {
+    switch (op) {
+        case CompareOp::Eq: return "=";
+        case CompareOp::Ne: return "!=";
+        case CompareOp::Lt: return "<";
+        case CompareOp::Le: return "<=";
+        case CompareOp::Gt: return ">";
+        case CompareOp::Ge: return ">=";
+    }
+    return "?";
+}
+
+string selectItemName(const SelectItem& item) {
+    switch (item.aggregate) {
+        case AggregateKind::None: return string(item.column);
+        case AggregateKind::Count: return item.column.empty() ? "count(*)" : "count(" + string(item.column) + ")";
+        case AggregateKind::Sum: return "sum(" + string(item.column) + ")";
+        case AggregateKind::Avg: return "avg(" + string(item.column) + ")";
+        case AggregateKind::Min: return "min(" + string(item.column) + ")";
+        case AggregateKind::Max: return "max(" + string(item.column) + ")";
+        case AggregateKind::CountDistinct: return "count(distinct " + string(item.column) + ")";
+    }
+    return string(item.column);
+}
+
+namespace {
+
+enum class TokenKind : uint8_t {
+    End,
+    Identifier,
+    Integer,
+    Float,
+    String,
+    Param,
+    Comma,
+    LParen,
+    RParen,
+    Star,
+    Semicolon,
+    Op,
+    // Keywords
+    Select,
+    From,
+    Where,
+    And,
+    Or,
+    In,
+    Between,
+    Group,
+    By,
+    Distinct,
+    Join,
+    Inner,
+    On,
+    Create,
+    Index,
+    True,
+    False,
+    Null,
+};
+
+struct Token {
+    TokenKind kind = TokenKind::End;
+    CompareOp op = CompareOp::Eq;
+    bool escaped = false; // string literal containing '' escapes
+    string_view text;
+    size_t pos = 0;
 };
 
-// QueryParser class definition
-class QueryParser {
+bool equalsIgnoreCase(string_view word, const char* keyword) {
+    size_t len = strlen(keyword);
+    if (word.size() != len) return false;
+    for (size_t i = 0; i < len; ++i) {
+        if (toupper(static_cast<unsigned char>(word[i])) != keyword[i]) return false;
+    }
+    return true;
+}
+
+TokenKind classifyWord(string_view word) {
+    // Dispatch on length first so most identifiers fail after one compare
+    switch (word.size()) {
+        case 2:
+            if (equalsIgnoreCase(word, "OR")) return TokenKind::Or;
+            if (equalsIgnoreCase(word, "IN")) return TokenKind::In;
+            if (equalsIgnoreCase(word, "BY")) return TokenKind::By;
+            if (equalsIgnoreCase(word, "ON")) return TokenKind::On;
+            break;
+        case 3:
+            if (equalsIgnoreCase(word, "AND")) return TokenKind::And;
+            break;
+        case 4:
+            if (equalsIgnoreCase(word, "FROM")) return TokenKind::From;
+            if (equalsIgnoreCase(word, "TRUE")) return TokenKind::True;
+            if (equalsIgnoreCase(word, "NULL")) return TokenKind::Null;
+            if (equalsIgnoreCase(word, "JOIN")) return TokenKind::Join;
+            break;
+        case 5:
+            if (equalsIgnoreCase(word, "WHERE")) return TokenKind::Where;
+            if (equalsIgnoreCase(word, "FALSE")) return TokenKind::False;
+            if (equalsIgnoreCase(word, "GROUP")) return TokenKind::Group;
+            if (equalsIgnoreCase(word, "INNER")) return TokenKind::Inner;
+            if (equalsIgnoreCase(word, "INDEX")) return TokenKind::Index;
+            break;
+        case 6:
+            if (equalsIgnoreCase(word, "SELECT")) return TokenKind::Select;
+            if (equalsIgnoreCase(word, "CREATE")) return TokenKind::Create;
+            break;
+        case 7:
+            if (equalsIgnoreCase(word, "BETWEEN")) return TokenKind::Between;
+            break;
+        case 8:
+            if (equalsIgnoreCase(word, "DISTINCT")) return TokenKind::Distinct;
+            break;
+    }
+    return TokenKind::Identifier;
+}
+
+bool isIdentStart(char c) {
+    return isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isIdentChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+class Lexer {
 public:
-    Query parse(const string& query) {
-        Query parsedQuery;
-        size_t pos = 0;
-        // Trim whitespace
-        string q = trim(query);
-        // Identify the query type
-        size_t spacePos = q.find(' ');
-        if (spacePos != string::npos) {
-            parsedQuery.type = q.substr(0, spacePos);
-            pos = spacePos + 1;
-        }
-        // Process the rest of the query
-        while (pos < q.length()) {
-            // Skip whitespace
-            while (pos < q.length() && isspace(q[pos])) pos++;
-            if (pos >= q.length()) break;
-            // Check for FROM keyword
-            if (q.substr(pos, 4) == "FROM") {
-                pos += 4;
-                while (pos < q.length() && isspace(q[pos])) pos++;
-                size_t nextSpace = q.find(' ', pos);
-                if (nextSpace == string::npos) {
-                    parsedQuery.table = q.substr(pos);
-                    pos = nextSpace;
-                } else {
-                    parsedQuery.table = q.substr(pos, nextSpace - pos);
-                    pos = nextSpace;
-                }
-                continue;
+    explicit Lexer(string_view src) : src(src), pos(0) {}
+
+    Token next() {
+        while (pos < src.size() && isspace(static_cast<unsigned char>(src[pos]))) ++pos;
+        Token tok;
+        tok.pos = pos;
+        if (pos >= src.size()) return tok;
+        char c = src[pos];
+        size_t start = pos;
+        if (isIdentStart(c)) {
+            while (pos < src.size() && isIdentChar(src[pos])) ++pos;
+            // Qualified column name: table.column is one identifier token
+            if (pos + 1 < src.size() && src[pos] == '.' && isIdentStart(src[pos + 1])) {
+                ++pos;
+                while (pos < src.size() && isIdentChar(src[pos])) ++pos;
+                tok.text = src.substr(start, pos - start);
+                tok.kind = TokenKind::Identifier;
+                return tok;
+            }
+            tok.text = src.substr(start, pos - start);
+            tok.kind = classifyWord(tok.text);
+            return tok;
+        }
+        if (isDigit(c) || (c == '-' && pos + 1 < src.size() && isDigit(src[pos + 1]))) {
+            ++pos;
+            bool isFloat = false;
+            while (pos < src.size() && isDigit(src[pos])) ++pos;
+            if (pos < src.size() && src[pos] == '.') {
+                isFloat = true;
+                ++pos;
+                while (pos < src.size() && isDigit(src[pos])) ++pos;
+            }
+            if (pos < src.size() && (src[pos] == 'e' || src[pos] == 'E')) {
+                isFloat = true;
+                ++pos;
+                if (pos < src.size() && (src[pos] == '+' || src[pos] == '-')) ++pos;
+                while (pos < src.size() && isDigit(src[pos])) ++pos;
             }
-            // Check for SELECT keyword
-            if (q.substr(pos, 6) == "SELECT") {
-                pos += 6;
-                while (pos < q.length() && isspace(q[pos])) pos++;
-                size_t fromPos = q.find("FROM", pos);
-                if (fromPos == string::npos) {
-                    // Error: No FROM clause
+            tok.kind = isFloat ? TokenKind::Float : TokenKind::Integer;
+            tok.text = src.substr(start, pos - start);
+            return tok;
+        }
+        if (c == '\'') {
+            ++pos;
+            size_t contentStart = pos;
+            while (true) {
+                if (pos >= src.size()) throw invalid_argument("Unterminated string literal in query");
+                if (src[pos] == '\'') {
+                    if (pos + 1 < src.size() && src[pos + 1] == '\'') {
+                        tok.escaped = true;
+                        pos += 2;
+                        continue;
+                    }
                     break;
                 }
-                string columnsStr = q.substr(pos, fromPos - pos);
-                parsedQuery.columns = splitColumns(columnsStr);
-                pos = fromPos + 4; // Move past "FROM"
-                continue;
+                ++pos;
             }
-            // Check for WHERE clause
-            if (q.substr(pos, 5) == "WHERE") {
-                pos += 5;
-                while (pos < q.length() && isspace(q[pos])) pos++;
-                string conditionStr = q.substr(pos);
-                size_t semicolonPos = conditionStr.find(';');
-                if (semicolonPos != string::npos) {
-                    conditionStr = conditionStr.substr(0, semicolonPos);
+            tok.kind = TokenKind::String;
+            tok.text = src.substr(contentStart, pos - contentStart);
+            ++pos;
+            return tok;
+        }
+        ++pos;
+        tok.text = src.substr(start, 1);
+        switch (c) {
+            case ',': tok.kind = TokenKind::Comma; return tok;
+            case '(': tok.kind = TokenKind::LParen; return tok;
+            case ')': tok.kind = TokenKind::RParen; return tok;
+            case '*': tok.kind = TokenKind::Star; return tok;
+            case ';': tok.kind = TokenKind::Semicolon; return tok;
+            case '?': tok.kind = TokenKind::Param; return tok;
+            case '=': tok.kind = TokenKind::Op; tok.op = CompareOp::Eq; return tok;
+            case '!':
+                if (pos < src.size() && src[pos] == '=') {
+                    ++pos;
+                    tok.kind = TokenKind::Op;
+                    tok.op = CompareOp::Ne;
+                    tok.text = src.substr(start, 2);
+                    return tok;
+                }
+                break;
+            case '<':
+                tok.kind = TokenKind::Op;
+                tok.op = CompareOp::Lt;
+                if (pos < src.size() && (src[pos] == '=' || src[pos] == '>')) {
+                    tok.op = src[pos] == '=' ? CompareOp::Le : CompareOp::Ne;
+                    ++pos;
+                    tok.text = src.substr(start, 2);
                 }
-                parsedQuery.conditions = parseConditions(conditionStr);
-                pos = q.length(); // End of query
-                continue;
+                return tok;
+            case '>':
+                tok.kind = TokenKind::Op;
+                tok.op = CompareOp::Gt;
+                if (pos < src.size() && src[pos] == '=') {
+                    tok.op = CompareOp::Ge;
+                    ++pos;
+                    tok.text = src.substr(start, 2);
+                }
+                return tok;
+        }
+        throw invalid_argument("Unexpected input in query: " + string(src.substr(start)));
+    }
+
+private:
+    string_view src;
+    size_t pos;
+};
+
+string_view unescape(string_view raw, QueryArena& arena) {
+    char* out = static_cast<char*>(arena.allocate(raw.size(), 1));
+    size_t len = 0;
+    for (size_t i = 0; i < raw.size(); ++i) {
+        out[len++] = raw[i];
+        if (raw[i] == '\'') ++i; // skip the second quote of ''
+    }
+    return string_view(out, len);
+}
+
+// Convert a literal token to a typed value; false if the token is not a literal
+bool literalFromToken(const Token& tok, QueryArena& arena, Value& value) {
+    value.text = tok.text;
+    switch (tok.kind) {
+        case TokenKind::Integer: {
+            value.type = ValueType::Int;
+            const char* end = tok.text.data() + tok.text.size();
+            auto res = from_chars(tok.text.data(), end, value.intValue);
+            if (res.ec != errc() || res.ptr != end) throw invalid_argument("Invalid integer literal: " + string(tok.text));
+            return true;
+        }
+        case TokenKind::Float: {
+            value.type = ValueType::Double;
+            // The lexer takes "1e" as one token; all of it must be the number
+            const char* end = tok.text.data() + tok.text.size();
+            auto res = from_chars(tok.text.data(), end, value.doubleValue);
+            if (res.ec != errc() || res.ptr != end) throw invalid_argument("Invalid numeric literal: " + string(tok.text));
+            return true;
+        }
+        case TokenKind::String:
+            value.type = ValueType::String;
+            if (tok.escaped) value.text = unescape(tok.text, arena);
+            return true;
+        case TokenKind::True:
+        case TokenKind::False:
+            value.type = ValueType::Bool;
+            value.intValue = tok.kind == TokenKind::True;
+            return true;
+        case TokenKind::Null:
+            value.type = ValueType::Null;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Growable array whose storage comes from the arena; on growth the old
+// storage is abandoned, which bounds the waste at the final size
+template <typename T>
+class ArenaVector {
+public:
+    explicit ArenaVector(QueryArena& arena) : arena(arena), items(nullptr), count(0), capacity(0) {}
+
+    void push_back(const T& item) {
+        if (count == capacity) {
+            size_t grown = capacity == 0 ? 8 : capacity * 2;
+            T* bigger = static_cast<T*>(arena.allocate(sizeof(T) * grown, alignof(T)));
+            if (count) memcpy(static_cast<void*>(bigger), items, sizeof(T) * count);
+            items = bigger;
+            capacity = grown;
+        }
+        new (items + count++) T(item);
+    }
+
+    T* data() const { return items; }
+    uint32_t size() const { return static_cast<uint32_t>(count); }
+
+private:
+    QueryArena& arena;
+    T* items;
+    size_t count;
+    size_t capacity;
+};
+
+class Parser {
+public:
+    // Parentheses nest at most this deep, so a hostile query cannot exhaust
+    // the stack of the recursive descent
+    static constexpr uint32_t kMaxNesting = 64;
+
+    Parser(string_view text, QueryArena& arena) : text(text), lexer(text), arena(arena) {
+        advance();
+    }
+
+    const Statement* parseStatement() {
+        Statement* stmt = arena.make<Statement>();
+        if (tok.kind == TokenKind::Create) return parseCreateIndex(*stmt);
+        expect(TokenKind::Select, "SELECT");
+        parseSelectList(*stmt);
+        expect(TokenKind::From, "FROM");
+        stmt->table = expectIdentifier();
+        if (tok.kind == TokenKind::Inner || tok.kind == TokenKind::Join) {
+            if (tok.kind == TokenKind::Inner) advance();
+            expect(TokenKind::Join, "JOIN");
+            JoinClause* join = arena.make<JoinClause>();
+            join->table = expectIdentifier();
+            if (join->table == stmt->table) fail("Self-joins are not supported");
+            expect(TokenKind::On, "ON");
+            join->leftKey = expectIdentifier();
+            if (tok.kind != TokenKind::Op || tok.op != CompareOp::Eq) fail("Expected = in join condition");
+            advance();
+            join->rightKey = expectIdentifier();
+            stmt->join = join;
+        }
+        if (tok.kind == TokenKind::Where) {
+            advance();
+            stmt->where = parseOr();
+        }
+        if (tok.kind == TokenKind::Group) {
+            advance();
+            expect(TokenKind::By, "BY");
+            ArenaVector<string_view> groupBy(arena);
+            groupBy.push_back(expectIdentifier());
+            while (tok.kind == TokenKind::Comma) {
+                advance();
+                groupBy.push_back(expectIdentifier());
             }
-            // If none of the above, treat as unexpected input
-            throw invalid_argument("Unexpected input in query: " + q.substr(pos));
+            stmt->groupBy = groupBy.data();
+            stmt->groupByCount = groupBy.size();
         }
-        return parsedQuery;
+        validateGrouping(*stmt);
+        if (tok.kind == TokenKind::Semicolon) advance();
+        if (tok.kind != TokenKind::End) fail("Unexpected input in query");
+        stmt->paramCount = paramCount;
+        return stmt;
     }
+
 private:
-    vector<string> splitColumns(const string& columnsStr) {
-        vector<string> columns;
-        stringstream ss(columnsStr);
-        string column;
-        while (getline(ss, column, ',')) {
-            columns.push_back(trim(column));
-        }
-        return columns;
-    }
-    vector<tuple<string, string, string>> parseConditions(const string& conditionStr) {
-        vector<tuple<string, string, string>> conditions;
-        // Simple condition parsing (column OP value)
-        size_t andPos = conditionStr.find(" AND ");
-        if (andPos != string::npos) {
-            string cond1 = conditionStr.substr(0, andPos);
-            string cond2 = conditionStr.substr(andPos + 5);
-            vector<tuple<string, string, string>> temp;
-            temp.push_back(parseCondition(cond1));
-            temp.push_back(parseCondition(cond2));
-            conditions.insert(conditions.end(), temp.begin(), temp.end());
+    const Statement* parseCreateIndex(Statement& stmt) {
+        advance();
+        expect(TokenKind::Index, "INDEX");
+        // Indexes are identified by their column; a name is accepted and ignored
+        if (tok.kind == TokenKind::Identifier) advance();
+        expect(TokenKind::On, "ON");
+        stmt.type = StatementType::CreateIndex;
+        stmt.table = expectIdentifier();
+        expect(TokenKind::LParen, "(");
+        stmt.indexColumn = expectIdentifier();
+        expect(TokenKind::RParen, ")");
+        if (tok.kind == TokenKind::Semicolon) advance();
+        if (tok.kind != TokenKind::End) fail("Unexpected input in query");
+        return &stmt;
+    }
+
+    void advance() { tok = lexer.next(); }
+
+    [[noreturn]] void fail(const char* what) {
+        throw invalid_argument(string(what) + " at: " + string(text.substr(min(tok.pos, text.size()))));
+    }
+
+    void expect(TokenKind kind, const char* what) {
+        if (tok.kind != kind) fail((string("Expected ") + what).c_str());
+        advance();
+    }
+
+    string_view expectIdentifier() {
+        if (tok.kind != TokenKind::Identifier) fail("Expected identifier");
+        string_view name = tok.text;
+        advance();
+        return name;
+    }
+
+    void parseSelectList(Statement& stmt) {
+        if (tok.kind == TokenKind::Star) {
+            advance();
+            return;
+        }
+        ArenaVector<SelectItem> items(arena);
+        items.push_back(parseSelectItem(stmt));
+        while (tok.kind == TokenKind::Comma) {
+            advance();
+            items.push_back(parseSelectItem(stmt));
+        }
+        stmt.items = items.data();
+        stmt.itemCount = items.size();
+    }
+
+    SelectItem parseSelectItem(Statement& stmt) {
+        SelectItem item;
+        item.column = expectIdentifier();
+        if (tok.kind != TokenKind::LParen) return item;
+        item.aggregate = aggregateKind(item.column);
+        if (item.aggregate == AggregateKind::None) fail("Unknown function");
+        stmt.hasAggregates = true;
+        advance();
+        if (item.aggregate == AggregateKind::Count && tok.kind == TokenKind::Star) {
+            advance();
+            item.column = string_view();
         } else {
-            conditions.push_back(parseCondition(conditionStr));
+            if (item.aggregate == AggregateKind::Count && tok.kind == TokenKind::Distinct) {
+                advance();
+                item.aggregate = AggregateKind::CountDistinct;
+            }
+            item.column = expectIdentifier();
         }
-        return conditions;
+        expect(TokenKind::RParen, ")");
+        return item;
     }
-    tuple<string, string, string> parseCondition(const string& condition) {
-        size_t opPos = condition.find("=");
-        if (opPos != string::npos) {
-            string column = trim(condition.substr(0, opPos));
-            string op = "=";
-            string value = trim(condition.substr(opPos + 1));
-            return make_tuple(column, op, value);
+
+    static AggregateKind aggregateKind(string_view name) {
+        if (equalsIgnoreCase(name, "COUNT")) return AggregateKind::Count;
+        if (equalsIgnoreCase(name, "SUM")) return AggregateKind::Sum;
+        if (equalsIgnoreCase(name, "AVG")) return AggregateKind::Avg;
+        if (equalsIgnoreCase(name, "MIN")) return AggregateKind::Min;
+        if (equalsIgnoreCase(name, "MAX")) return AggregateKind::Max;
+        return AggregateKind::None;
+    }
+
+    // With aggregates or GROUP BY, plain columns must be grouping columns
+    void validateGrouping(Statement& stmt) {
+        if (!stmt.hasAggregates && stmt.groupByCount == 0) return;
+        if (stmt.itemCount == 0) fail("SELECT * cannot be combined with GROUP BY");
+        stmt.hasAggregates = true;
+        for (uint32_t i = 0; i < stmt.itemCount; ++i) {
+            const SelectItem& item = stmt.items[i];
+            if (item.aggregate != AggregateKind::None) continue;
+            bool grouped = false;
+            for (uint32_t g = 0; g < stmt.groupByCount; ++g) grouped |= stmt.groupBy[g] == item.column;
+            if (!grouped) {
+                throw invalid_argument("Column " + string(item.column) + " must appear in GROUP BY");
+            }
         }
-        // Add more operators as needed (>, <, !=, etc.)
-        throw invalid_argument("Unsupported operator in condition: " + condition);
     }
-    string trim(const string& s) {
-        size_t start = s.find_first_not_of(" \t");
-        size_t end = s.find_last_not_of(" \t");
-        if (start == string::npos) return "";
-        return s.substr(start, end - start + 1);
+
+    const Expr* parseOr() {
+        const Expr* left = parseAnd();
+        while (tok.kind == TokenKind::Or) {
+            advance();
+            left = arena.make<Expr>(ExprKind::Or, CompareOp::Eq, string_view(), nullptr, 0u, left, parseAnd());
+        }
+        return left;
     }
+
+    const Expr* parseAnd() {
+        const Expr* left = parsePrimary();
+        while (tok.kind == TokenKind::And) {
+            advance();
+            left = arena.make<Expr>(ExprKind::And, CompareOp::Eq, string_view(), nullptr, 0u, left, parsePrimary());
+        }
+        return left;
+    }
+
+    const Expr* parsePrimary() {
+        if (tok.kind == TokenKind::LParen) {
+            if (nesting == kMaxNesting) fail("Conditions nested too deeply");
+            advance();
+            ++nesting;
+            const Expr* inner = parseOr();
+            --nesting;
+            expect(TokenKind::RParen, ")");
+            return inner;
+        }
+        if (conditions == QueryParser::kMaxConditions) fail("Too many conditions");
+        ++conditions;
+        Expr* expr = arena.make<Expr>();
+        expr->column = expectIdentifier();
+        switch (tok.kind) {
+            case TokenKind::Op: {
+                expr->kind = ExprKind::Compare;
+                expr->op = tok.op;
+                advance();
+                Value* value = arena.make<Value>();
+                *value = parseLiteral();
+                expr->values = value;
+                expr->valueCount = 1;
+                return expr;
+            }
+            case TokenKind::In: {
+                advance();
+                expect(TokenKind::LParen, "(");
+                ArenaVector<Value> values(arena);
+                values.push_back(parseLiteral());
+                while (tok.kind == TokenKind::Comma) {
+                    advance();
+                    values.push_back(parseLiteral());
+                }
+                expect(TokenKind::RParen, ")");
+                expr->kind = ExprKind::In;
+                expr->values = values.data();
+                expr->valueCount = values.size();
+                return expr;
+            }
+            case TokenKind::Between: {
+                advance();
+                Value* bounds = arena.makeArray<Value>(2);
+                bounds[0] = parseLiteral();
+                expect(TokenKind::And, "AND");
+                bounds[1] = parseLiteral();
+                expr->kind = ExprKind::Between;
+                expr->values = bounds;
+                expr->valueCount = 2;
+                return expr;
+            }
+            default:
+                fail("Unsupported operator in condition");
+        }
+    }
+
+    Value parseLiteral() {
+        Value value;
+        if (tok.kind == TokenKind::Param) {
+            value.type = ValueType::Param;
+            value.intValue = paramCount++;
+            value.text = tok.text;
+        } else if (!literalFromToken(tok, arena, value)) {
+            fail("Expected literal");
+        }
+        advance();
+        return value;
+    }
+
+    string_view text;
+    Lexer lexer;
+    QueryArena& arena;
+    Token tok;
+    uint32_t paramCount = 0;
+    uint32_t nesting = 0;    // Open parentheses around the current condition
+    uint32_t conditions = 0; // Comparisons parsed so far
 };
 
-int main() {
-    QueryParser parser;
-    string query = "SELECT id, name FROM users WHERE age = 25;";
-    Query parsed = parser.parse(query);
-    std::cout << "type: " << parsed.type << std::endl;
-    std::cout << "table: " << parsed.table << std::endl;
-    std::cout << "columns: ";
-    for (const auto& col : parsed.columns) std::cout << col << " ";
-    std::cout << std::endl;
-    std::cout << "conditions: ";
-    for (const auto& cond : parsed.conditions) {
-        std::cout << "(" << std::get<0>(cond) << ", " << std::get<1>(cond) << ", " << std::get<2>(cond) << ") ";
-    }
-    std::cout << std::endl;
-    return 0;
-} 
\ No newline at end of file
+string literalText(const Value& value) {
+    if (value.type == ValueType::String) return "'" + string(value.text) + "'";
+    return string(value.text);
+}
+
+void flattenConditions(const Expr* expr, Query& query) {
+    if (expr == nullptr) return;
+    switch (expr->kind) {
+        case ExprKind::And:
+            flattenConditions(expr->left, query);
+            flattenConditions(expr->right, query);
+            return;
+        case ExprKind::Compare:
+            query.conditions.emplace_back(string(expr->column), compareOpName(expr->op), literalText(expr->values[0]));
+            return;
+        case ExprKind::Between:
+            query.conditions.emplace_back(string(expr->column), ">=", literalText(expr->values[0]));
+            query.conditions.emplace_back(string(expr->column), "<=", literalText(expr->values[1]));
+            return;
+        default:
+            throw invalid_argument("Condition cannot be expressed as a list of AND-ed comparisons");
+    }
+}
+
+} // namespace
+
+void QueryParser::normalize(string_view text, bool parameterizeLiterals, QueryArena& arena,
+                            string& normalized, vector<Value>& literals) {
+    size_t firstLiteral = literals.size();
+    normalized.clear();
+    Lexer lexer(text);
+    for (Token tok = lexer.next(); tok.kind != TokenKind::End; tok = lexer.next()) {
+        if (tok.kind == TokenKind::Semicolon) continue;
+        if (parameterizeLiterals && tok.kind == TokenKind::Param) {
+            // The query has placeholders of its own: start over keeping its
+            // literals, so they stay apart from the placeholders in the text
+            literals.resize(firstLiteral);
+            normalize(text, false, arena, normalized, literals);
+            return;
+        }
+        if (!normalized.empty()) normalized.push_back(' ');
+        Value literal;
+        if (parameterizeLiterals && literalFromToken(tok, arena, literal)) {
+            literals.push_back(literal);
+            normalized.push_back('?');
+        } else if (tok.kind == TokenKind::String) {
+            normalized.push_back('\'');
+            normalized.append(tok.text);
+            normalized.push_back('\'');
+        } else if (tok.kind >= TokenKind::Select) {
+            for (char c : tok.text) normalized.push_back(static_cast<char>(toupper(static_cast<unsigned char>(c))));
+        } else {
+            normalized.append(tok.text);
+        }
+    }
+}
+
+const Statement* QueryParser::parseStatement(string_view text, QueryArena& arena) {
+    Parser parser(text, arena);
+    return parser.parseStatement();
+}
+
+Query QueryParser::parse(const string& query) {
+    QueryArena arena;
+    const Statement* stmt = parseStatement(query, arena);
+    if (stmt->type != StatementType::Select) throw invalid_argument("Only SELECT can be represented as a Query");
+    if (stmt->join) throw invalid_argument("JOIN cannot be represented as a Query");
+    Query parsedQuery;
+    parsedQuery.type = "SELECT";
+    parsedQuery.table = string(stmt->table);
+    for (uint32_t i = 0; i < stmt->itemCount; ++i) {
+        parsedQuery.columns.push_back(selectItemName(stmt->items[i]));
+    }
+    flattenConditions(stmt->where, parsedQuery);
+    return parsedQuery;
+}
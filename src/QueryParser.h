@@ -0,0 +1,162 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Bump allocator owning everything produced while parsing one query.
+// reset() rewinds to the first block and keeps the memory, so a parser that
+// reuses one arena per connection stops allocating after warmup.
+class QueryArena {
+public:
+    explicit QueryArena(size_t blockSize = 4096);
+
+    void* allocate(size_t size, size_t align);
+
+    // Objects are never destroyed, so T must be trivially destructible
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+    }
+
+    template <typename T>
+    T* makeArray(size_t count) {
+        T* items = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; ++i) new (items + i) T();
+        return items;
+    }
+
+    std::string_view copy(std::string_view text);
+    void reset();
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<size_t> blockSizes;
+    size_t blockSize;
+    size_t current;
+    char* cursor;
+    char* limit;
+};
+
+enum class ValueType : uint8_t {
+    Null,
+    Int,
+    Double,
+    String,
+    Bool,
+    Param, // '?' placeholder; intValue holds the parameter index
+};
+
+// Typed literal; string contents view the query text or the arena
+struct Value {
+    ValueType type = ValueType::Null;
+    int64_t intValue = 0;
+    double doubleValue = 0.0;
+    std::string_view text;
+};
+
+enum class CompareOp : uint8_t { Eq, Ne, Lt, Le, Gt, Ge };
+
+enum class ExprKind : uint8_t {
+    Compare, // column op values[0]
+    In,      // column IN (values[0..valueCount))
+    Between, // column BETWEEN values[0] AND values[1]
+    And,
+    Or,
+};
+
+struct Expr {
+    ExprKind kind = ExprKind::Compare;
+    CompareOp op = CompareOp::Eq;
+    std::string_view column;
+    const Value* values = nullptr;
+    uint32_t valueCount = 0;
+    const Expr* left = nullptr;
+    const Expr* right = nullptr;
+};
+
+enum class AggregateKind : uint8_t { None, Count, Sum, Avg, Min, Max, CountDistinct };
+
+// One select-list entry: a plain column or an aggregate over a column
+struct SelectItem {
+    AggregateKind aggregate = AggregateKind::None;
+    std::string_view column; // empty for COUNT(*)
+};
+
+// Inner equi-join with a second table. Key columns may be qualified with
+// their table name; which side each belongs to is resolved at execution.
+struct JoinClause {
+    std::string_view table;
+    std::string_view leftKey;
+    std::string_view rightKey;
+};
+
+enum class StatementType : uint8_t { Select, CreateIndex };
+
+// Parsed statement; all pointers live in the QueryArena passed to the parser
+struct Statement {
+    StatementType type = StatementType::Select;
+    std::string_view table;
+    const JoinClause* join = nullptr;
+    const SelectItem* items = nullptr; // empty for SELECT *
+    uint32_t itemCount = 0;
+    const Expr* where = nullptr;
+    const std::string_view* groupBy = nullptr;
+    uint32_t groupByCount = 0;
+    bool hasAggregates = false;
+    uint32_t paramCount = 0;
+    std::string_view indexColumn; // CREATE INDEX
+};
+
+// Structure to represent a query
+struct Query {
+    std::string type;          // SELECT, INSERT, etc.
+    std::string table;        // Table name
+    std::vector<std::string> columns; // List of columns to select
+    std::vector<std::tuple<std::string, std::string, std::string>> conditions; // (column, operator, value)
+};
+
+const char* compareOpName(CompareOp op);
+
+// Result column name of a select item, e.g. "age" or "count(distinct city)"
+std::string selectItemName(const SelectItem& item);
+
+// Recursive-descent parser over a string_view lexer. Grammar:
+//   SELECT (* | item, ...) FROM table [[INNER] JOIN table ON col = col]
+//          [WHERE expr] [GROUP BY col, ...] [;]
+//   CREATE INDEX [name] ON table (col) [;]
+//   item      := col | COUNT(*) | COUNT([DISTINCT] col) | SUM|AVG|MIN|MAX(col)
+//   col       := name | table.name
+//   expr      := conj (OR conj)*
+//   conj      := primary (AND primary)*
+//   primary   := ( expr ) | col op literal | col IN (literal, ...)
+//              | col BETWEEN literal AND literal
+//   op        := = | != | <> | < | <= | > | >=
+//   literal   := integer | float | 'string' | TRUE | FALSE | NULL | ?
+class QueryParser {
+public:
+    // A WHERE clause holds at most this many comparisons. AND and OR build a
+    // left-deep tree, one level per comparison, which the planner and the
+    // executors walk recursively; the cap bounds how deep they go.
+    static constexpr uint32_t kMaxConditions = 1024;
+
+    // Parse into an AST allocated from `arena`. Views reference `text`, which
+    // must outlive the returned statement. Throws std::invalid_argument.
+    const Statement* parseStatement(std::string_view text, QueryArena& arena);
+
+    // Canonical text of a query: tokens separated by single spaces, keywords
+    // upper-cased and ';' dropped. With parameterizeLiterals every literal is
+    // replaced by '?' and appended to `literals`, so queries differing only in
+    // constants share one normalized form. A query that has '?' placeholders
+    // of its own keeps its literals, so "a = ? AND b = 1" and
+    // "a = 1 AND b = ?" do not share one.
+    void normalize(std::string_view text, bool parameterizeLiterals, QueryArena& arena,
+                   std::string& normalized, std::vector<Value>& literals);
+
+    // Owning form for callers that only handle AND-ed comparisons
+    Query parse(const std::string& query);
+};
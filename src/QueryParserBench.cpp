@@ -0,0 +1,46 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "QueryParser.h"
+
+int main(int argc, char** argv) {
+    QueryParser parser;
+    std::string query = "SELECT id, name FROM users WHERE age = 25;";
+    Query parsed = parser.parse(query);
+    std::cout << "type: " << parsed.type << std::endl;
+    std::cout << "table: " << parsed.table << std::endl;
+    std::cout << "columns: ";
+    for (const auto& col : parsed.columns) std::cout << col << " ";
+    std::cout << std::endl;
+    std::cout << "conditions: ";
+    for (const auto& cond : parsed.conditions) {
+        std::cout << "(" << std::get<0>(cond) << ", " << std::get<1>(cond) << ", " << std::get<2>(cond) << ") ";
+    }
+    std::cout << std::endl;
+
+    // Parse throughput over a mix of query shapes, reusing one arena
+    std::vector<std::string> queries = {
+        "SELECT id, name FROM users WHERE age = 25;",
+        "SELECT * FROM customers WHERE city = 'Paris' AND (age >= 18 OR vip = TRUE)",
+        "SELECT id, total FROM orders WHERE total BETWEEN 10.5 AND 99.99 AND status != 'void'",
+        "SELECT name FROM customers WHERE id IN (1, 2, 3, 5, 8, 13) OR (age < 30 AND age > 20)",
+        "SELECT id FROM orders WHERE customer_id = ? AND created <= ?",
+        "SELECT city, COUNT(*), AVG(age) FROM customers WHERE age > 21 GROUP BY city",
+    };
+    long iterations = argc > 1 ? std::stol(argv[1]) : 2000000;
+    QueryArena arena;
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        arena.reset();
+        const Statement* stmt = parser.parseStatement(queries[i % queries.size()], arena);
+        checksum += stmt->itemCount;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "parsed " << iterations << " queries in " << elapsed.count() << " s: "
+              << static_cast<long>(iterations / elapsed.count()) << " queries/sec"
+              << " (checksum " << checksum << ")" << std::endl;
+    return 0;
+}
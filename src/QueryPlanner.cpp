@@ -0,0 +1,341 @@
+#include "QueryPlanner.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "ColumnStore.h"
+#include "HyperLogLog.h"
+
+namespace {
+
+// Used when a column has no statistics or a value cannot be placed
+constexpr double kDefaultEqSelectivity = 0.1;
+constexpr double kDefaultRangeSelectivity = 1.0 / 3.0;
+
+const Value* resolve(const Value& value, const std::vector<Value>& bindings) {
+    if (value.type != ValueType::Param) return &value;
+    size_t index = static_cast<size_t>(value.intValue);
+    return index < bindings.size() ? &bindings[index] : nullptr;
+}
+
+bool isNumeric(const Value& value) {
+    return value.type == ValueType::Int || value.type == ValueType::Double || value.type == ValueType::Bool;
+}
+
+double numericValue(const Value& value) {
+    return value.type == ValueType::Double ? value.doubleValue : static_cast<double>(value.intValue);
+}
+
+std::string formatRows(double rows) {
+    return std::to_string(static_cast<long long>(std::llround(rows)));
+}
+
+// Fraction of one node's rows below `value` according to its histogram
+double fractionBelow(const ColumnStatsData& column, uint64_t rows, const Value& value) {
+    if (rows == 0 || column.bounds.empty()) return kDefaultRangeSelectivity;
+    bool numeric = static_cast<ColumnType>(column.type) != ColumnType::String;
+    if (numeric != isNumeric(value)) return kDefaultRangeSelectivity;
+    double below = 0.0;
+    std::string lower = column.min;
+    for (size_t b = 0; b < column.bounds.size(); ++b) {
+        const std::string& upper = column.bounds[b];
+        double bucket = static_cast<double>(column.bucket_rows[b]);
+        if (numeric) {
+            double v = numericValue(value);
+            double lo = std::strtod(lower.c_str(), nullptr);
+            double hi = std::strtod(upper.c_str(), nullptr);
+            if (v > hi) {
+                below += bucket;
+            } else {
+                // Values are assumed uniform within a bucket
+                if (v > lo && hi > lo) below += bucket * (v - lo) / (hi - lo);
+                break;
+            }
+        } else {
+            if (value.text > upper) {
+                below += bucket;
+            } else {
+                if (value.text > lower) below += bucket / 2;
+                break;
+            }
+        }
+        lower = upper;
+    }
+    return below / static_cast<double>(rows);
+}
+
+void flattenAnd(const Expr* expr, std::vector<const Expr*>& out) {
+    if (!expr) return;
+    if (expr->kind == ExprKind::And) {
+        flattenAnd(expr->left, out);
+        flattenAnd(expr->right, out);
+        return;
+    }
+    out.push_back(expr);
+}
+
+} // namespace
+
+ClusterStats::ClusterStats(std::vector<TableStatsData> reported) : reports(std::move(reported)) {
+    std::map<std::pair<std::string, std::string>, HyperLogLog> sketches;
+    for (const auto& table : reports) {
+        TableEstimate& estimate = tables[table.name];
+        estimate.rows += table.row_count;
+        for (const auto& column : table.columns) {
+            ColumnEstimate& merged = estimate.columns[column.name];
+            merged.type = column.type;
+            merged.indexed = merged.indexed && column.indexed;
+            merged.nodes.push_back(&column);
+            merged.nodeRows.push_back(table.row_count);
+            HyperLogLog sketch;
+            if (sketch.deserialize(column.sketch)) sketches[{table.name, column.name}].merge(sketch);
+        }
+    }
+    for (const auto& entry : sketches) {
+        tables[entry.first.first].columns[entry.first.second].distinct = static_cast<double>(entry.second.estimate());
+    }
+}
+
+const TableEstimate* ClusterStats::find(std::string_view table) const {
+    auto it = tables.find(table);
+    return it == tables.end() ? nullptr : &it->second;
+}
+
+QueryPlanner::QueryPlanner(std::shared_ptr<const ClusterStats> stats) : stats(std::move(stats)) {}
+
+const ColumnEstimate* QueryPlanner::column(const TableEstimate& table, std::string_view tableName,
+                                           std::string_view name) const {
+    size_t dot = name.find('.');
+    if (dot != std::string_view::npos) {
+        if (name.substr(0, dot) != tableName) return nullptr;
+        name = name.substr(dot + 1);
+    }
+    auto it = table.columns.find(name);
+    return it == table.columns.end() ? nullptr : &it->second;
+}
+
+double QueryPlanner::compareSelectivity(const ColumnEstimate& column, CompareOp op, const Value& value) const {
+    if (value.type == ValueType::Null) return 0.0;
+    double total = 0.0;
+    for (uint64_t rows : column.nodeRows) total += static_cast<double>(rows);
+    if (total == 0.0) return 0.0;
+    if (op == CompareOp::Eq || op == CompareOp::Ne) {
+        double eq = column.distinct > 0 ? 1.0 / column.distinct : kDefaultEqSelectivity;
+        return op == CompareOp::Eq ? eq : 1.0 - eq;
+    }
+    double below = 0.0;
+    for (size_t n = 0; n < column.nodes.size(); ++n) {
+        below += fractionBelow(*column.nodes[n], column.nodeRows[n], value) * static_cast<double>(column.nodeRows[n]);
+    }
+    below /= total;
+    return op == CompareOp::Lt || op == CompareOp::Le ? below : 1.0 - below;
+}
+
+double QueryPlanner::selectivity(const TableEstimate& table, std::string_view tableName, const Expr* expr,
+                                 const std::vector<Value>& bindings) const {
+    if (!expr) return 1.0;
+    switch (expr->kind) {
+        case ExprKind::And:
+            return selectivity(table, tableName, expr->left, bindings) *
+                   selectivity(table, tableName, expr->right, bindings);
+        case ExprKind::Or: {
+            double a = selectivity(table, tableName, expr->left, bindings);
+            double b = selectivity(table, tableName, expr->right, bindings);
+            return a + b - a * b;
+        }
+        default:
+            break;
+    }
+    const ColumnEstimate* estimate = column(table, tableName, expr->column);
+    bool range = expr->kind == ExprKind::Compare && expr->op != CompareOp::Eq && expr->op != CompareOp::Ne;
+    if (!estimate) return range || expr->kind == ExprKind::Between ? kDefaultRangeSelectivity : kDefaultEqSelectivity;
+    switch (expr->kind) {
+        case ExprKind::Compare: {
+            const Value* value = resolve(expr->values[0], bindings);
+            if (!value) return range ? kDefaultRangeSelectivity : kDefaultEqSelectivity;
+            return compareSelectivity(*estimate, expr->op, *value);
+        }
+        case ExprKind::In: {
+            double sum = 0.0;
+            for (uint32_t i = 0; i < expr->valueCount; ++i) {
+                const Value* value = resolve(expr->values[i], bindings);
+                sum += value ? compareSelectivity(*estimate, CompareOp::Eq, *value) : kDefaultEqSelectivity;
+            }
+            return std::min(1.0, sum);
+        }
+        case ExprKind::Between: {
+            const Value* lo = resolve(expr->values[0], bindings);
+            const Value* hi = resolve(expr->values[1], bindings);
+            if (!lo || !hi) return kDefaultRangeSelectivity;
+            return std::max(0.0, compareSelectivity(*estimate, CompareOp::Le, *hi) -
+                                     compareSelectivity(*estimate, CompareOp::Lt, *lo));
+        }
+        default:
+            return 1.0;
+    }
+}
+
+PhysicalPlan QueryPlanner::plan(const Statement& statement, const std::vector<Value>& bindings,
+                                size_t nodeCount) const {
+    PhysicalPlan plan;
+    plan.nodes = nodeCount;
+    std::string_view names[2] = {statement.table, statement.join ? statement.join->table : std::string_view()};
+    int sides = statement.join ? 2 : 1;
+    const TableEstimate* tables[2] = {nullptr, nullptr};
+    plan.hasStatistics = stats != nullptr;
+    for (int side = 0; side < sides; ++side) {
+        tables[side] = stats ? stats->find(names[side]) : nullptr;
+        plan.hasStatistics = plan.hasStatistics && tables[side];
+    }
+    auto sideOf = [&](std::string_view name) {
+        if (sides == 2 && tables[1] && column(*tables[1], names[1], name) &&
+            !(tables[0] && column(*tables[0], names[0], name))) {
+            return 1;
+        }
+        return 0;
+    };
+
+    // Conditions are split by table the same way DataNodes split them
+    std::vector<const Expr*> conjuncts[2];
+    std::vector<const Expr*> all;
+    flattenAnd(statement.where, all);
+    for (const Expr* expr : all) {
+        const Expr* leaf = expr;
+        while (leaf->kind == ExprKind::Or || leaf->kind == ExprKind::And) leaf = leaf->left;
+        conjuncts[sideOf(leaf->column)].push_back(expr);
+    }
+
+    for (int side = 0; side < sides; ++side) {
+        TableAccess access;
+        access.table = std::string(names[side]);
+        if (tables[side]) {
+            const TableEstimate& table = *tables[side];
+            access.rows = static_cast<double>(table.rows);
+            double selectivity = 1.0;
+            double bestIndex = 1.0;
+            for (const Expr* expr : conjuncts[side]) {
+                double s = this->selectivity(table, names[side], expr, bindings);
+                selectivity *= s;
+                // Equality, IN and range lookups on an indexed column can replace the scan
+                bool lookup = (expr->kind == ExprKind::Compare && expr->op != CompareOp::Ne) ||
+                              expr->kind == ExprKind::In || expr->kind == ExprKind::Between;
+                const ColumnEstimate* col = lookup ? column(table, names[side], expr->column) : nullptr;
+                if (col && col->indexed && s < bestIndex) {
+                    bestIndex = s;
+                    access.indexColumn = std::string(expr->column);
+                }
+            }
+            access.estimatedRows = access.rows * selectivity;
+            if (!access.indexColumn.empty() && bestIndex * kIndexRowCost < 1.0) access.path = AccessPath::Index;
+            else access.indexColumn.clear();
+        }
+        plan.accesses.push_back(access);
+    }
+
+    double inputRows = plan.accesses[0].estimatedRows;
+    if (statement.join) {
+        double rows[2] = {plan.accesses[0].estimatedRows, plan.accesses[1].estimatedRows};
+        plan.buildSide = rows[1] < rows[0] ? 1 : 0;
+        double keyDistinct = 1.0;
+        for (std::string_view key : {statement.join->leftKey, statement.join->rightKey}) {
+            int side = sideOf(key);
+            const ColumnEstimate* col = tables[side] ? column(*tables[side], names[side], key) : nullptr;
+            if (col) keyDistinct = std::max(keyDistinct, col->distinct);
+        }
+        plan.joinRows = rows[0] * rows[1] / keyDistinct;
+        inputRows = plan.joinRows;
+        if (!plan.hasStatistics) {
+            plan.joinStrategy = JoinStrategy::Unknown;
+        } else if (nodeCount <= 1) {
+            plan.joinStrategy = JoinStrategy::Shuffle;
+        } else {
+            // Rows crossing the network: a broadcast gathers the small side and
+            // sends it to every node; a shuffle moves the share of both sides
+            // that hashes to another node
+            double n = static_cast<double>(nodeCount);
+            double small = rows[plan.buildSide];
+            double broadcastCost = small * (n + 1);
+            double shuffleCost = (rows[0] + rows[1]) * (n - 1) / n;
+            bool broadcast = small <= static_cast<double>(kBroadcastJoinRows) && broadcastCost <= shuffleCost;
+            plan.joinStrategy = broadcast ? JoinStrategy::Broadcast : JoinStrategy::Shuffle;
+        }
+    }
+
+    if (statement.hasAggregates) {
+        double groups = 1.0;
+        for (uint32_t g = 0; g < statement.groupByCount; ++g) {
+            int side = sideOf(statement.groupBy[g]);
+            const ColumnEstimate* col = tables[side] ? column(*tables[side], names[side], statement.groupBy[g]) : nullptr;
+            groups *= col && col->distinct > 0 ? col->distinct : 1.0;
+        }
+        plan.groups = statement.groupByCount ? std::min(groups, std::max(inputRows, 1.0)) : 1.0;
+    }
+    return plan;
+}
+
+std::vector<std::string> PhysicalPlan::describe(const Statement& statement) const {
+    std::vector<std::string> lines;
+    std::string onNodes = " on " + std::to_string(nodes) + (nodes == 1 ? " node" : " nodes");
+    if (!hasStatistics) lines.push_back("No statistics for every table; estimates are unavailable");
+    for (const auto& access : accesses) {
+        std::string line = access.path == AccessPath::Index
+            ? "Index lookup " + access.table + "." + access.indexColumn
+            : "Scan " + access.table;
+        line += onNodes + ": " + formatRows(access.rows) + " rows, ~" + formatRows(access.estimatedRows) + " match";
+        lines.push_back(line);
+    }
+    if (statement.join) {
+        const std::string& build = accesses[buildSide].table;
+        const std::string& probe = accesses[1 - buildSide].table;
+        std::string on = " ON " + std::string(statement.join->leftKey) + " = " + std::string(statement.join->rightKey);
+        switch (joinStrategy) {
+            case JoinStrategy::Broadcast:
+                lines.push_back("Broadcast hash join" + on + ": " + build + " sent to every node, probed with " +
+                                probe + "; ~" + formatRows(joinRows) + " rows");
+                break;
+            case JoinStrategy::Shuffle:
+                lines.push_back((nodes <= 1 ? "Local hash join" : "Shuffle hash join") + on + ": build " + build +
+                                ", probe " + probe + "; ~" + formatRows(joinRows) + " rows");
+                break;
+            case JoinStrategy::Unknown:
+                lines.push_back("Hash join" + on + ": strategy chosen after measuring both sides");
+                break;
+        }
+    }
+    if (statement.hasAggregates) {
+        lines.push_back("Partial aggregation on each node, merged on the coordinator: ~" + formatRows(groups) +
+                        (groups == 1.0 ? " group" : " groups"));
+    }
+    lines.push_back("Gather results from " + std::to_string(nodes) + (nodes == 1 ? " node" : " nodes"));
+    return lines;
+}
+
+StatisticsCache::StatisticsCache(Fetcher fetch) : fetch(std::move(fetch)) {}
+
+std::shared_ptr<const ClusterStats> StatisticsCache::get(const std::vector<NodeInfo>& nodes, uint64_t currentEpoch) {
+    auto now = std::chrono::steady_clock::now();
+    uint64_t startGeneration;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (current && epoch == currentEpoch && now - fetched < kMaxAge) return current;
+        startGeneration = generation;
+    }
+    // Fetch without the lock so planning of other queries is not held up by
+    // round trips to every DataNode
+    auto stats = std::make_shared<const ClusterStats>(fetch(nodes));
+    std::lock_guard<std::mutex> lock(mtx);
+    // Keep a fetch that started later or saw a newer epoch, and do not cache
+    // one an invalidate() overtook
+    bool newer = !current || currentEpoch > epoch || (currentEpoch == epoch && now >= fetched);
+    if (generation == startGeneration && newer) {
+        current = stats;
+        epoch = currentEpoch;
+        fetched = now;
+    }
+    return stats;
+}
+
+void StatisticsCache::invalidate() {
+    std::lock_guard<std::mutex> lock(mtx);
+    current.reset();
+    ++generation;
+}
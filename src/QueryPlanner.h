@@ -0,0 +1,115 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "HashJoin.h"
+#include "QueryExecutor.h"
+#include "QueryParser.h"
+#include "message.h"
+
+// Statistics of one column merged over the cluster; the per-node histograms
+// stay separate and are weighted by each node's row count when estimating
+struct ColumnEstimate {
+    uint8_t type = 0;
+    double distinct = 0.0; // From the merged HyperLogLog sketches
+    bool indexed = true;   // Only when every node has an index
+    std::vector<const ColumnStatsData*> nodes;
+    std::vector<uint64_t> nodeRows;
+};
+
+struct TableEstimate {
+    uint64_t rows = 0;
+    std::map<std::string, ColumnEstimate, std::less<>> columns;
+};
+
+// Table statistics reported by every DataNode
+class ClusterStats {
+public:
+    explicit ClusterStats(std::vector<TableStatsData> reports);
+    // Estimates point into `reports`
+    ClusterStats(const ClusterStats&) = delete;
+    ClusterStats& operator=(const ClusterStats&) = delete;
+
+    const TableEstimate* find(std::string_view table) const;
+
+private:
+    std::vector<TableStatsData> reports;
+    std::map<std::string, TableEstimate, std::less<>> tables;
+};
+
+enum class AccessPath : uint8_t { Scan, Index };
+
+struct TableAccess {
+    std::string table;
+    AccessPath path = AccessPath::Scan;
+    std::string indexColumn;     // For AccessPath::Index
+    double rows = 0.0;           // Rows in the table
+    double estimatedRows = 0.0;  // Rows left after the table's own conditions
+};
+
+// Physical choices for one execution of a statement
+struct PhysicalPlan {
+    bool hasStatistics = false;
+    std::vector<TableAccess> accesses; // FROM table, then the JOIN table
+    JoinStrategy joinStrategy = JoinStrategy::Unknown;
+    int buildSide = 0;           // Side that is broadcast or built into the hash table
+    double joinRows = 0.0;
+    double groups = 0.0;         // Estimated GROUP BY groups
+    size_t nodes = 0;
+
+    // One line per step, as returned for EXPLAIN
+    std::vector<std::string> describe(const Statement& statement) const;
+};
+
+// Cost-based planner over ClusterStats. Selectivities come from the
+// equi-depth histograms and distinct counts; conditions on different columns
+// are assumed independent. The index rule (kIndexRowCost) is the one each
+// DataNode's executor applies to its exact index counts. Without statistics for a table it falls back to
+// a full scan and lets runJoin measure the sides at execution time.
+class QueryPlanner {
+public:
+    explicit QueryPlanner(std::shared_ptr<const ClusterStats> stats);
+
+    PhysicalPlan plan(const Statement& statement, const std::vector<Value>& bindings, size_t nodeCount) const;
+
+    // Fraction of `table`'s rows satisfying `expr`
+    double selectivity(const TableEstimate& table, std::string_view tableName, const Expr* expr,
+                       const std::vector<Value>& bindings) const;
+
+private:
+    const ColumnEstimate* column(const TableEstimate& table, std::string_view tableName, std::string_view name) const;
+    double compareSelectivity(const ColumnEstimate& column, CompareOp op, const Value& value) const;
+
+    std::shared_ptr<const ClusterStats> stats;
+};
+
+// Coordinator cache of ClusterStats. Statistics are fetched again once they
+// are older than kMaxAge or the membership epoch changes. Fetching happens
+// outside the lock, so concurrent misses may each fetch.
+class StatisticsCache {
+public:
+    static constexpr std::chrono::seconds kMaxAge{30};
+
+    using Fetcher = std::function<std::vector<TableStatsData>(const std::vector<NodeInfo>&)>;
+
+    explicit StatisticsCache(Fetcher fetch);
+
+    std::shared_ptr<const ClusterStats> get(const std::vector<NodeInfo>& nodes, uint64_t epoch);
+    // Refetch on the next get, e.g. after CREATE INDEX
+    void invalidate();
+
+private:
+    Fetcher fetch;
+    std::mutex mtx;
+    std::shared_ptr<const ClusterStats> current;
+    uint64_t epoch = 0;
+    std::chrono::steady_clock::time_point fetched; // When the fetch of `current` started
+    uint64_t generation = 0;                       // Bumped by invalidate()
+};
@@ -0,0 +1,224 @@
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ColumnStore.h"
+#include "QueryExecutor.h"
+#include "QueryParser.h"
+#include "SimdKernels.h"
+
+// Parser, predicate compiler and executor on a small table, without a
+// cluster. Registered with ctest; exits non-zero at the first failure.
+
+static bool fail(const std::string& what) {
+    std::cerr << "FAIL: " << what << std::endl;
+    return false;
+}
+
+// people(id, age, score, city): ages 1, 25 and 40 on the first three rows,
+// then filler rows enough for the index to pay off
+static ColumnTable makePeople() {
+    ColumnTable people("people", {{"id", ColumnType::Int64}, {"age", ColumnType::Int64},
+                                  {"score", ColumnType::Double}, {"city", ColumnType::String}});
+    const std::vector<std::string> cities = {"Paris", "Oslo", "Rome"};
+    std::vector<std::string_view> fields(4);
+    for (int i = 0; i < 5000; ++i) {
+        std::string id = std::to_string(i);
+        std::string age = std::to_string(i == 0 ? 1 : i == 1 ? 25 : i == 2 ? 40 : 50 + i % 40);
+        std::string score = std::to_string(i % 100) + ".5";
+        fields = {id, age, score, cities[i % cities.size()]};
+        people.appendRow(fields);
+    }
+    return people;
+}
+
+// Rows of `table` matching the WHERE clause of `query`; throws what the
+// parser or compiler throw
+static size_t count(const ColumnTable& table, const std::string& query, const std::vector<Value>& bindings = {}) {
+    QueryParser parser;
+    QueryArena arena;
+    const Statement* statement = parser.parseStatement(query, arena);
+    return QueryExecutor(table, *statement, bindings).countMatches();
+}
+
+static bool expectCount(const ColumnTable& table, const std::string& query, size_t expected,
+                        const std::vector<Value>& bindings = {}) {
+    size_t matches = count(table, query, bindings);
+    if (matches == expected) return true;
+    return fail(query + " matched " + std::to_string(matches) + " rows, expected " + std::to_string(expected));
+}
+
+// Literals an integer column cannot hold compare the same way with every row
+static bool literals(const ColumnTable& people) {
+    size_t all = people.rowCount();
+    const std::vector<std::pair<std::string, size_t>> cases = {
+        {"age < 1e300", all},
+        {"age < 100000000000000000000.0", all},
+        {"age <= 9223372036854775808.0", all},
+        {"age > -1e300", all},
+        {"age >= 1e300", 0},
+        {"age = 1e300", 0},
+        {"age != 1e300", all},
+        {"age <= -1e300", 0},
+        {"age > -9223372036854775808.0", all},
+        {"age BETWEEN -1e300 AND 1e300", all},
+        {"age < 1.5", 1},
+        {"age > 39.5", all - 2},
+    };
+    for (const auto& c : cases) {
+        if (!expectCount(people, "SELECT id FROM people WHERE " + c.first, c.second)) return false;
+    }
+    // NaN matches no row, except that != matches them all
+    Value nan;
+    nan.type = ValueType::Double;
+    nan.doubleValue = std::numeric_limits<double>::quiet_NaN();
+    for (const char* column : {"age", "score"}) {
+        for (const char* op : {"=", "<", "<=", ">", ">="}) {
+            if (!expectCount(people, std::string("SELECT id FROM people WHERE ") + column + " " + op + " ?", 0, {nan})) {
+                return false;
+            }
+        }
+        if (!expectCount(people, std::string("SELECT id FROM people WHERE ") + column + " != ?", all, {nan})) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string chain(size_t terms, const char* op) {
+    std::string query = "SELECT id FROM people WHERE id >= 0";
+    for (size_t i = 1; i < terms; ++i) query += std::string(" ") + op + " id >= 0";
+    return query;
+}
+
+static bool longChains(const ColumnTable& people) {
+    // The longest chain accepted still runs on a thread's default stack, as
+    // DataNodes run fragments
+    for (const char* op : {"AND", "OR"}) {
+        bool ok = false;
+        std::string error;
+        std::thread([&]() {
+            try {
+                ok = count(people, chain(QueryParser::kMaxConditions, op)) == people.rowCount();
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+        }).join();
+        if (!ok) return fail(std::string("a chain of ") + op + " at the limit: " + error);
+    }
+    // A longer one is refused rather than left to overflow the stack
+    for (size_t terms : {size_t(QueryParser::kMaxConditions) + 1, size_t(60000)}) {
+        try {
+            count(people, chain(terms, "AND"));
+            return fail(std::to_string(terms) + " ANDed conditions were accepted");
+        } catch (const std::invalid_argument&) {
+        }
+        try {
+            QueryParser().parse(chain(terms, "AND"));
+            return fail(std::to_string(terms) + " ANDed conditions were accepted by parse");
+        } catch (const std::invalid_argument&) {
+        }
+    }
+    return true;
+}
+
+// Every kernel level this CPU has gives the scalar kernels' bitmap, for each
+// operator, on counts that do and do not fill the last word
+template <typename T, typename Compare>
+static bool sameBitmaps(const char* type, const std::vector<T>& values, const std::vector<T>& constants,
+                        Compare compare) {
+    const CompareOp ops[] = {CompareOp::Eq, CompareOp::Ne, CompareOp::Lt,
+                             CompareOp::Le, CompareOp::Gt, CompareOp::Ge};
+    for (size_t n : {size_t(0), size_t(5), size_t(64), size_t(1000), values.size()}) {
+        size_t words = (n + 63) / 64;
+        for (T constant : constants) {
+            for (CompareOp op : ops) {
+                std::vector<uint64_t> expected(words + 1, ~0ULL);
+                std::vector<uint64_t> actual(words + 1, ~0ULL);
+                compare(SimdLevel::Scalar, values.data(), n, op, constant, expected.data());
+                for (SimdLevel level : {SimdLevel::SSE42, SimdLevel::AVX2}) {
+                    if (!compare(level, values.data(), n, op, constant, actual.data())) continue;
+                    if (actual != expected) {
+                        return fail(std::string(type) + " kernels at " + simdLevelName(level) + " differ from scalar for " +
+                                    compareOpName(op) + " over " + std::to_string(n) + " values");
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool kernels() {
+    std::mt19937_64 rng(7);
+    const size_t n = 1029;
+    std::vector<int64_t> ints(n);
+    std::vector<double> doubles(n);
+    std::vector<int32_t> codes(n);
+    for (size_t i = 0; i < n; ++i) {
+        ints[i] = static_cast<int64_t>(rng() % 21) - 10;
+        doubles[i] = static_cast<double>(static_cast<int64_t>(rng() % 21) - 10) / 2;
+        codes[i] = static_cast<int32_t>(rng() % 8);
+    }
+    ints[3] = std::numeric_limits<int64_t>::min();
+    ints[4] = std::numeric_limits<int64_t>::max();
+    doubles[3] = std::numeric_limits<double>::quiet_NaN();
+    doubles[4] = -std::numeric_limits<double>::infinity();
+    codes[3] = std::numeric_limits<int32_t>::max();
+    return sameBitmaps<int64_t>("int64", ints,
+                                {0, -10, 10, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()},
+                                compareInt64With) &&
+           sameBitmaps<double>("double", doubles, {0.0, -2.5, 4.5, std::numeric_limits<double>::infinity()},
+                               compareDoubleWith) &&
+           sameBitmaps<int32_t>("int32", codes, {0, 3, 7, -1}, compareInt32With);
+}
+
+// The index chooser picks its lookups only where they reach the same rows a
+// scan finds
+static bool indexedMatchesScanned(const ColumnTable& people) {
+    std::shared_ptr<const ColumnTable> indexed = people.withIndex("id");
+    indexed = indexed->withIndex("age");
+    indexed = indexed->withIndex("score");
+    indexed = indexed->withIndex("city");
+    const std::vector<std::pair<std::string, bool>> cases = {
+        {"age = 25", true},
+        {"age IN (1, 40, 41)", true},
+        {"age IN (1, 1.5, 40) AND age > 20", true},
+        {"age BETWEEN 50 AND 51", false},
+        {"id IN (1, 2, 3, 4999, 70000)", true},
+        {"id < 10 AND city = 'Oslo'", true},
+        {"score IN (1.5, 2.5)", true},
+        {"score < 0.6", true},
+        {"city IN ('Oslo', 'Nowhere')", false},
+        {"city = 'Paris' AND age = 25", true},
+        {"age = 25 OR id = 7", false},
+        {"age < 1e300", false},
+    };
+    QueryParser parser;
+    std::vector<Value> bindings;
+    for (const auto& c : cases) {
+        std::string query = "SELECT id, age, city FROM people WHERE " + c.first;
+        QueryArena arena;
+        const Statement* statement = parser.parseStatement(query, arena);
+        QueryExecutor scan(people, *statement, bindings);
+        QueryExecutor lookup(*indexed, *statement, bindings);
+        if (scan.usesIndex()) return fail(query + " used an index on a table without any");
+        if (c.second && !lookup.usesIndex()) return fail(query + " did not use an index");
+        if (lookup.countMatches() != scan.countMatches()) return fail(query + " counts differently through the index");
+        if (lookup.run().rows != scan.run().rows) return fail(query + " returns other rows through the index");
+    }
+    return true;
+}
+
+int main() {
+    ColumnTable people = makePeople();
+    if (!longChains(people) || !literals(people) || !kernels() || !indexedMatchesScanned(people)) return 1;
+    std::cout << "PASS" << std::endl;
+    return 0;
+}
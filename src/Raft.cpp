@@ -0,0 +1,681 @@
+#include "Raft.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include "Communication.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+static const LatencyMetric raftSync("raft.fsync");
+static const LatencyMetric raftReplicate("raft.append_rtt"); // Leader to follower and back
+static const LatencyMetric raftPropose("raft.propose");       // Until applied here
+static const CounterMetric raftElections("raft.elections");
+
+// --- Storage ---
+// Each log record is a RAFT_APPEND message holding one entry, framed like the
+// wire protocol. The state file is a RAFT_VOTE message with term and vote.
+
+static std::string frame(const Message& message) {
+    UntracedScope untraced;
+    std::vector<uint8_t> body = MessageSerializer::serialize(message);
+    uint32_t len = static_cast<uint32_t>(body.size());
+    std::string out = {static_cast<char>((len >> 24) & 0xFF), static_cast<char>((len >> 16) & 0xFF),
+                       static_cast<char>((len >> 8) & 0xFF), static_cast<char>(len & 0xFF)};
+    out.append(body.begin(), body.end());
+    return out;
+}
+
+static std::string entryRecord(const RaftEntryData& entry) {
+    Message record;
+    record.type = MessageType::RAFT_APPEND;
+    record.raft.entries.push_back(entry);
+    return frame(record);
+}
+
+static void writeAllOrThrow(int fd, const std::string& data, const std::string& path) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t written = write(fd, data.data() + done, data.size() - done);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) throw std::runtime_error("Cannot write " + path);
+        done += static_cast<size_t>(written);
+    }
+}
+
+// Write `data` to `path` through a temporary file, so a crash leaves either
+// the old or the new contents
+static void replaceFile(const std::string& path, const std::string& data) {
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("Cannot create " + temporary);
+    writeAllOrThrow(fd, data, temporary);
+    ScopedLatency timer(raftSync);
+    if (fsync(fd) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot sync " + temporary);
+    }
+    close(fd);
+    if (rename(temporary.c_str(), path.c_str()) != 0) throw std::runtime_error("Cannot replace " + path);
+}
+
+RaftStorage::RaftStorage(std::string path) : path(std::move(path)) {
+    std::ifstream state(this->path + ".state", std::ios::binary);
+    if (state) {
+        std::string bytes((std::istreambuf_iterator<char>(state)), std::istreambuf_iterator<char>());
+        if (bytes.size() > 4) {
+            Message saved = MessageDeserializer::deserialize(std::vector<uint8_t>(bytes.begin() + 4, bytes.end()));
+            savedTerm = saved.raft.term;
+            savedVote = saved.raft.from;
+        }
+    }
+    std::ifstream in(this->path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t pos = 0;
+    while (pos + 4 <= bytes.size()) {
+        const auto* header = reinterpret_cast<const unsigned char*>(bytes.data() + pos);
+        size_t len = (size_t(header[0]) << 24) | (size_t(header[1]) << 16) | (size_t(header[2]) << 8) | header[3];
+        if (pos + 4 + len > bytes.size()) break;
+        try {
+            Message record = MessageDeserializer::deserialize(
+                std::vector<uint8_t>(bytes.begin() + pos + 4, bytes.begin() + pos + 4 + len));
+            if (record.raft.entries.size() != 1) break;
+            loaded.push_back(std::move(record.raft.entries[0]));
+        } catch (const std::exception&) {
+            break;
+        }
+        pos += 4 + len;
+    }
+    fd = open(this->path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) throw std::runtime_error("Cannot open " + this->path);
+    // Drop a record torn by a crash during its write
+    if (pos < bytes.size() && ftruncate(fd, static_cast<off_t>(pos)) != 0) {
+        throw std::runtime_error("Cannot truncate " + this->path);
+    }
+}
+
+RaftStorage::~RaftStorage() {
+    if (fd >= 0) close(fd);
+}
+
+void RaftStorage::saveState(uint64_t term, const std::string& votedFor) {
+    Message state;
+    state.type = MessageType::RAFT_VOTE;
+    state.raft.term = term;
+    state.raft.from = votedFor;
+    replaceFile(path + ".state", frame(state));
+    savedTerm = term;
+    savedVote = votedFor;
+}
+
+void RaftStorage::append(const std::vector<RaftEntryData>& entries) {
+    std::string records;
+    for (const auto& entry : entries) records += entryRecord(entry);
+    writeAllOrThrow(fd, records, path);
+    ScopedLatency timer(raftSync);
+    if (fdatasync(fd) != 0) throw std::runtime_error("Cannot sync " + path);
+}
+
+void RaftStorage::rewrite(const std::vector<RaftEntryData>& entries) {
+    std::string records;
+    for (const auto& entry : entries) records += entryRecord(entry);
+    replaceFile(path, records);
+    close(fd);
+    fd = open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path);
+}
+
+// --- Transport ---
+
+// Like Communication::startClient, but silent: peers being down is routine
+static int connectTo(const std::string& address, std::chrono::milliseconds timeout) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) return -1;
+    sockaddr_in peer{};
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(static_cast<uint16_t>(std::stoi(address.substr(colon + 1))));
+    if (inet_pton(AF_INET, address.substr(0, colon).c_str(), &peer.sin_addr) <= 0) return -1;
+    if (!Communication::reachable(address.substr(0, colon), ntohs(peer.sin_port))) return -1;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, reinterpret_cast<sockaddr*>(&peer), sizeof(peer)) < 0) {
+        close(sock);
+        return -1;
+    }
+    timeval limit{static_cast<time_t>(timeout.count() / 1000), static_cast<suseconds_t>(timeout.count() % 1000 * 1000)};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+    return sock;
+}
+
+static bool sendRaft(int socket, const Message& message) {
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(message);
+    return Communication::sendMessage(socket, std::string(serialized.begin(), serialized.end()));
+}
+
+static bool receiveRaft(int socket, Message& message) {
+    std::string reply = Communication::receiveMessage(socket);
+    if (reply.empty()) return false;
+    try {
+        message = MessageDeserializer::deserialize(std::vector<uint8_t>(reply.begin(), reply.end()));
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// --- Node ---
+
+RaftNode::RaftNode(RaftConfig config, Apply apply)
+    : config(std::move(config)), apply(std::move(apply)), storage(this->config.logPath),
+      random(std::hash<std::string>{}(this->config.id) ^
+             static_cast<uint64_t>(RaftClock::now().time_since_epoch().count())) {
+    currentTerm = storage.term();
+    votedFor = storage.votedFor();
+    log = storage.entries();
+    persistedIndex = lastIndex();
+    for (const auto& address : this->config.peers) {
+        peers.push_back(std::make_unique<Peer>());
+        peers.back()->address = address;
+    }
+    resetElectionDeadline();
+}
+
+void RaftNode::start() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (peers.empty()) startElection();
+    }
+    Metrics::gauge("raft.pending_proposals", [this] {
+        std::lock_guard<std::mutex> lock(mtx);
+        return static_cast<int64_t>(pending.size());
+    });
+    Metrics::gauge("raft.appends_in_flight", [this] {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t inFlight = 0;
+        for (const auto& peer : peers) inFlight += peer->inFlight;
+        return static_cast<int64_t>(inFlight);
+    });
+    Metrics::gauge("raft.unapplied", [this] {
+        std::lock_guard<std::mutex> lock(mtx);
+        return static_cast<int64_t>(lastIndex() - lastApplied);
+    });
+    std::thread(&RaftNode::tickLoop, this).detach();
+    std::thread(&RaftNode::appendLoop, this).detach();
+    std::thread(&RaftNode::applyLoop, this).detach();
+    for (auto& peer : peers) std::thread(&RaftNode::replicateLoop, this, std::ref(*peer)).detach();
+}
+
+bool RaftNode::isLeader() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return role == Role::Leader;
+}
+
+std::string RaftNode::leader() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return leaderId;
+}
+
+void RaftNode::resetElectionDeadline() {
+    auto spread = std::uniform_int_distribution<long long>(0, config.electionTimeout.count())(random);
+    electionDeadline = RaftClock::now() + config.electionTimeout + std::chrono::milliseconds(spread);
+}
+
+void RaftNode::tickLoop() {
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::lock_guard<std::mutex> lock(mtx);
+        auto now = RaftClock::now();
+        if (role != Role::Leader) {
+            if (now >= electionDeadline) startElection();
+        } else if (!peers.empty() &&
+                   now - std::max(leaseStartLocked(now), leaderSince) > config.electionTimeout * 2) {
+            // Cut off from a majority; stop taking writes that cannot commit
+            std::cout << "Raft: lost contact with a majority in term " << currentTerm << std::endl;
+            becomeFollower(currentTerm);
+        }
+    }
+}
+
+void RaftNode::startElection() {
+    raftElections.add();
+    ++currentTerm;
+    role = Role::Candidate;
+    votedFor = config.id;
+    leaderId.clear();
+    {
+        std::lock_guard<std::mutex> writing(storageMutex);
+        storage.saveState(currentTerm, votedFor);
+    }
+    votes = 1;
+    resetElectionDeadline();
+    if (votes >= majority()) {
+        becomeLeader();
+        return;
+    }
+    Message request;
+    request.type = MessageType::RAFT_VOTE;
+    request.raft.term = currentTerm;
+    request.raft.from = config.id;
+    request.raft.prevIndex = lastIndex();
+    request.raft.prevTerm = termAt(lastIndex());
+    for (const auto& peer : peers) std::thread(&RaftNode::requestVote, this, peer->address, request).detach();
+}
+
+void RaftNode::requestVote(const std::string& address, Message request) {
+    int sock = connectTo(address, config.electionTimeout);
+    if (sock < 0) return;
+    Message reply;
+    bool answered = sendRaft(sock, request) && receiveRaft(sock, reply);
+    close(sock);
+    if (!answered) return;
+    std::lock_guard<std::mutex> lock(mtx);
+    if (reply.raft.term > currentTerm) {
+        becomeFollower(reply.raft.term);
+        return;
+    }
+    if (role == Role::Candidate && currentTerm == request.raft.term && reply.raft.success) {
+        if (++votes >= majority()) becomeLeader();
+    }
+}
+
+Message RaftNode::handleVote(const Message& request) {
+    std::lock_guard<std::mutex> lock(mtx);
+    const RaftData& in = request.raft;
+    auto now = RaftClock::now();
+    // While a leader is being heard from, a vote could elect a second one
+    // inside its lease; a node that was merely cut off must not disrupt it
+    bool leaderAlive = role == Role::Leader || (!leaderId.empty() && now < leaderContact + config.electionTimeout);
+    if (in.term > currentTerm && !leaderAlive) becomeFollower(in.term);
+    bool upToDate = in.prevTerm > termAt(lastIndex()) ||
+                    (in.prevTerm == termAt(lastIndex()) && in.prevIndex >= lastIndex());
+    Message reply;
+    reply.type = MessageType::RAFT_VOTE_RESPONSE;
+    if (in.term == currentTerm && !leaderAlive && (votedFor.empty() || votedFor == in.from) && upToDate) {
+        votedFor = in.from;
+        {
+            std::lock_guard<std::mutex> writing(storageMutex);
+            storage.saveState(currentTerm, votedFor);
+        }
+        resetElectionDeadline();
+        reply.raft.success = true;
+    }
+    reply.raft.term = currentTerm;
+    return reply;
+}
+
+void RaftNode::becomeLeader() {
+    role = Role::Leader;
+    leaderId = config.id;
+    leaderSince = RaftClock::now();
+    persistedIndex = lastIndex();
+    for (auto& peer : peers) {
+        peer->nextIndex = lastIndex() + 1;
+        peer->matchIndex = 0;
+        peer->acked = RaftClock::time_point();
+        peer->sentCommit = 0;
+        // Responses still in flight belong to the old connection
+        if (peer->socket >= 0) shutdown(peer->socket, SHUT_RDWR);
+    }
+    // An entry of the new term commits everything before it (Raft section 5.4.2)
+    pending.push_back(std::make_shared<Proposal>());
+    std::cout << "Raft: leader for term " << currentTerm << std::endl;
+    changed.notify_all();
+}
+
+void RaftNode::becomeFollower(uint64_t term) {
+    if (term > currentTerm) {
+        currentTerm = term;
+        votedFor.clear();
+        std::lock_guard<std::mutex> writing(storageMutex);
+        storage.saveState(currentTerm, votedFor);
+    }
+    role = Role::Follower;
+    leaderId.clear();
+    pending.clear();
+    resetElectionDeadline();
+    changed.notify_all();
+}
+
+void RaftNode::advanceCommit() {
+    std::vector<uint64_t> matched{persistedIndex};
+    for (const auto& peer : peers) matched.push_back(peer->matchIndex);
+    std::sort(matched.begin(), matched.end(), std::greater<uint64_t>());
+    uint64_t index = matched[majority() - 1];
+    // Entries of earlier terms only commit through one of the current term
+    if (index > commitIndex && termAt(index) == currentTerm) {
+        commitIndex = index;
+        changed.notify_all();
+    }
+}
+
+void RaftNode::appendLoop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        changed.wait(lock, [&] { return role == Role::Leader && !pending.empty(); });
+        // Everything proposed while the previous entry was being written goes
+        // into one entry and one fsync
+        std::vector<std::shared_ptr<Proposal>> batch;
+        batch.swap(pending);
+        RaftEntryData entry;
+        entry.term = currentTerm;
+        for (const auto& proposal : batch) {
+            entry.commands.insert(entry.commands.end(), proposal->commands.begin(), proposal->commands.end());
+        }
+        log.push_back(entry);
+        uint64_t index = lastIndex();
+        for (const auto& proposal : batch) {
+            proposal->index = index;
+            proposal->term = entry.term;
+        }
+        // Followers may store the entry while it is written here
+        changed.notify_all();
+        std::unique_lock<std::mutex> writing(storageMutex);
+        lock.unlock();
+        storage.append({entry});
+        writing.unlock();
+        lock.lock();
+        if (role == Role::Leader && currentTerm == entry.term) {
+            persistedIndex = std::max(persistedIndex, index);
+            advanceCommit();
+        }
+    }
+}
+
+void RaftNode::applyLoop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        changed.wait(lock, [&] { return lastApplied < commitIndex; });
+        uint64_t upTo = commitIndex;
+        // Committed entries are never truncated, so a copy stays valid
+        std::vector<RaftEntryData> entries(log.begin() + lastApplied, log.begin() + upTo);
+        lock.unlock();
+        for (const auto& entry : entries) {
+            for (const auto& command : entry.commands) apply(command);
+        }
+        lock.lock();
+        lastApplied = upTo;
+        changed.notify_all();
+    }
+}
+
+void RaftNode::replicateLoop(Peer& peer) {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        if (peer.broken) {
+            // Appends in flight on the old connection are lost; resend from
+            // the last one known to have matched
+            int sock = peer.socket;
+            std::thread reader = std::move(peer.reader);
+            peer.socket = -1;
+            peer.broken = false;
+            peer.inFlight = 0;
+            peer.sent.clear();
+            peer.nextIndex = peer.matchIndex + 1;
+            peer.resyncSeq = peer.seq;
+            lock.unlock();
+            reader.join();
+            close(sock);
+            lock.lock();
+            continue;
+        }
+        if (role != Role::Leader) {
+            if (peer.socket >= 0) shutdown(peer.socket, SHUT_RDWR);
+            changed.wait_for(lock, config.heartbeat);
+            continue;
+        }
+        if (peer.socket < 0) {
+            lock.unlock();
+            int sock = connectTo(peer.address, config.electionTimeout * 10);
+            if (sock < 0) std::this_thread::sleep_for(config.heartbeat * 2);
+            lock.lock();
+            if (sock < 0) continue;
+            if (role != Role::Leader) {
+                close(sock);
+                continue;
+            }
+            peer.socket = sock;
+            peer.reader = std::thread(&RaftNode::readResponses, this, std::ref(peer), sock);
+            continue;
+        }
+
+        auto now = RaftClock::now();
+        bool hasEntries = peer.nextIndex <= lastIndex();
+        bool hasCommit = peer.sentCommit < commitIndex;
+        if (peer.inFlight >= config.maxInFlight) {
+            changed.wait_for(lock, config.heartbeat);
+            continue;
+        }
+        if (!hasEntries && !hasCommit && now < peer.lastSend + config.heartbeat) {
+            changed.wait_until(lock, peer.lastSend + config.heartbeat);
+            continue;
+        }
+        // Send without waiting for the previous append's response; nextIndex
+        // moves ahead optimistically and a rejection moves it back
+        Message request;
+        request.type = MessageType::RAFT_APPEND;
+        request.raft.term = currentTerm;
+        request.raft.from = config.id;
+        request.raft.seq = ++peer.seq;
+        request.raft.prevIndex = peer.nextIndex - 1;
+        request.raft.prevTerm = termAt(request.raft.prevIndex);
+        request.raft.commit = commitIndex;
+        uint64_t count = hasEntries ? std::min<uint64_t>(config.maxEntriesPerAppend, lastIndex() - request.raft.prevIndex) : 0;
+        request.raft.entries.assign(log.begin() + request.raft.prevIndex, log.begin() + request.raft.prevIndex + count);
+        peer.nextIndex += count;
+        peer.sent.emplace_back(request.raft.seq, now);
+        peer.inFlight = peer.sent.size();
+        peer.lastSend = now;
+        peer.sentCommit = commitIndex;
+        int sock = peer.socket;
+        lock.unlock();
+        bool sent = sendRaft(sock, request);
+        lock.lock();
+        if (!sent) shutdown(sock, SHUT_RDWR);
+    }
+}
+
+void RaftNode::readResponses(Peer& peer, int socket) {
+    while (true) {
+        Message reply;
+        bool received = receiveRaft(socket, reply);
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!received) {
+            peer.broken = true;
+            changed.notify_all();
+            return;
+        }
+        handleAppendResponse(peer, reply.raft);
+    }
+}
+
+void RaftNode::handleAppendResponse(Peer& peer, const RaftData& response) {
+    if (response.term > currentTerm) {
+        becomeFollower(response.term);
+        return;
+    }
+    // Responses come back in request order on the connection
+    auto it = std::find_if(peer.sent.begin(), peer.sent.end(),
+                           [&](const auto& sent) { return sent.first == response.seq; });
+    if (it == peer.sent.end()) return;
+    RaftClock::time_point sentAt = it->second;
+    raftReplicate.record(RaftClock::now() - sentAt);
+    peer.sent.erase(peer.sent.begin(), it + 1);
+    peer.inFlight = peer.sent.size();
+    if (role != Role::Leader || response.term != currentTerm) return;
+    // Even a rejected append acknowledges this leader for the lease
+    peer.acked = std::max(peer.acked, sentAt);
+    if (response.success) {
+        peer.matchIndex = std::max(peer.matchIndex, response.index);
+        advanceCommit();
+    } else if (response.seq > peer.resyncSeq) {
+        // The appends already sent after this one fail the same way
+        peer.nextIndex = std::max(peer.matchIndex, response.index) + 1;
+        peer.resyncSeq = peer.seq;
+    }
+    changed.notify_all();
+}
+
+RaftData RaftNode::handleAppend(const RaftData& request) {
+    RaftData reply;
+    reply.seq = request.seq;
+    if (request.term < currentTerm) {
+        reply.term = currentTerm;
+        reply.index = lastIndex();
+        return reply;
+    }
+    if (request.term > currentTerm || role != Role::Follower) becomeFollower(request.term);
+    leaderId = request.from;
+    leaderContact = RaftClock::now();
+    resetElectionDeadline();
+    reply.term = currentTerm;
+    if (request.prevIndex > lastIndex() || termAt(request.prevIndex) != request.prevTerm) {
+        reply.index = std::min(lastIndex(), request.prevIndex == 0 ? 0 : request.prevIndex - 1);
+        changed.notify_all();
+        return reply;
+    }
+    std::vector<RaftEntryData> fresh;
+    bool truncated = false;
+    for (size_t i = 0; i < request.entries.size(); ++i) {
+        uint64_t index = request.prevIndex + 1 + i;
+        if (index <= lastIndex()) {
+            if (termAt(index) == request.entries[i].term) continue;
+            log.resize(index - 1);
+            truncated = true;
+        }
+        log.push_back(request.entries[i]);
+        fresh.push_back(request.entries[i]);
+    }
+    {
+        std::lock_guard<std::mutex> writing(storageMutex);
+        if (truncated) {
+            storage.rewrite(log);
+        } else if (!fresh.empty()) {
+            storage.append(fresh);
+        }
+    }
+    uint64_t matched = request.prevIndex + request.entries.size();
+    leaderCommit = request.commit;
+    commitIndex = std::max(commitIndex, std::min(request.commit, matched));
+    reply.success = true;
+    reply.index = matched;
+    changed.notify_all();
+    return reply;
+}
+
+void RaftNode::serveAppends(int socket, const Message& first) {
+    Message request = first;
+    while (request.type == MessageType::RAFT_APPEND) {
+        Message reply;
+        reply.type = MessageType::RAFT_APPEND_RESPONSE;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            reply.raft = handleAppend(request.raft);
+        }
+        if (!sendRaft(socket, reply) || !receiveRaft(socket, request)) return;
+    }
+}
+
+bool RaftNode::proposeLocal(std::unique_lock<std::mutex>& lock, const std::vector<MembershipChangeData>& commands,
+                            RaftClock::time_point deadline, uint64_t& index) {
+    auto proposal = std::make_shared<Proposal>();
+    proposal->commands = commands;
+    uint64_t term = currentTerm;
+    pending.push_back(proposal);
+    changed.notify_all();
+    changed.wait_until(lock, deadline, [&] {
+        return role != Role::Leader || currentTerm != term || (proposal->index != 0 && lastApplied >= proposal->index);
+    });
+    auto it = std::find(pending.begin(), pending.end(), proposal);
+    if (it != pending.end()) pending.erase(it);
+    index = proposal->index;
+    // The entry at our index may have been replaced after losing leadership
+    return index != 0 && lastApplied >= index && index <= lastIndex() && termAt(index) == proposal->term;
+}
+
+bool RaftNode::propose(const std::vector<MembershipChangeData>& commands, std::chrono::milliseconds timeout) {
+    ScopedLatency timer(raftPropose);
+    auto deadline = RaftClock::now() + timeout;
+    std::unique_lock<std::mutex> lock(mtx);
+    while (RaftClock::now() < deadline) {
+        if (role == Role::Leader) {
+            uint64_t index = 0;
+            return proposeLocal(lock, commands, deadline, index);
+        }
+        if (leaderId.empty()) {
+            // An election is under way
+            changed.wait_for(lock, config.heartbeat);
+            continue;
+        }
+        std::string target = leaderId;
+        lock.unlock();
+        Message request;
+        request.type = MessageType::RAFT_PROPOSE;
+        request.raft.from = config.id;
+        request.raft.entries.push_back({0, commands});
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - RaftClock::now());
+        int sock = connectTo(target, std::max(remaining, std::chrono::milliseconds(1)));
+        Message reply;
+        bool answered = sock >= 0 && sendRaft(sock, request) && receiveRaft(sock, reply);
+        if (sock >= 0) close(sock);
+        lock.lock();
+        if (answered && reply.raft.success) {
+            // Committed on the leader; wait until this coordinator applied it
+            // too, so a read here right after sees it
+            uint64_t index = reply.raft.index;
+            return changed.wait_until(lock, deadline, [&] { return lastApplied >= index; });
+        }
+        changed.wait_for(lock, config.heartbeat);
+    }
+    return false;
+}
+
+Message RaftNode::handlePropose(const Message& request) {
+    Message reply;
+    reply.type = MessageType::RAFT_PROPOSE_RESPONSE;
+    std::unique_lock<std::mutex> lock(mtx);
+    if (role == Role::Leader && !request.raft.entries.empty()) {
+        uint64_t index = 0;
+        auto deadline = RaftClock::now() + config.electionTimeout * 4;
+        reply.raft.success = proposeLocal(lock, request.raft.entries[0].commands, deadline, index);
+        reply.raft.index = index;
+    }
+    reply.raft.term = currentTerm;
+    reply.raft.from = leaderId;
+    return reply;
+}
+
+RaftClock::time_point RaftNode::leaseStartLocked(RaftClock::time_point now) const {
+    // The send time of the newest append a majority, counting this node, has
+    // acknowledged
+    std::vector<RaftClock::time_point> acked{now};
+    for (const auto& peer : peers) acked.push_back(peer->acked);
+    std::sort(acked.begin(), acked.end(), std::greater<RaftClock::time_point>());
+    return acked[majority() - 1];
+}
+
+bool RaftNode::readableLocked(RaftClock::time_point now) const {
+    if (role == Role::Leader) {
+        // Until an entry of its own term commits, a new leader may not have
+        // applied everything its predecessor committed
+        bool current = commitIndex > 0 && termAt(commitIndex) == currentTerm && lastApplied >= commitIndex;
+        return current && (peers.empty() || now < leaseStartLocked(now) + config.lease);
+    }
+    return role == Role::Follower && !leaderId.empty() && now < leaderContact + config.lease &&
+           lastApplied >= leaderCommit;
+}
+
+bool RaftNode::waitReadable(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mtx);
+    return changed.wait_for(lock, timeout, [&] { return readableLocked(RaftClock::now()); });
+}
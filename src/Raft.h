@@ -0,0 +1,177 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "message.h"
+
+using RaftClock = std::chrono::steady_clock;
+
+// Term, vote and log of one coordinator, kept in `path` (log records) and
+// `path`.state (term and vote). Entries are appended to the file; only a
+// conflicting suffix from a new leader makes it rewrite the file.
+class RaftStorage {
+public:
+    explicit RaftStorage(std::string path);
+    ~RaftStorage();
+    RaftStorage(const RaftStorage&) = delete;
+    RaftStorage& operator=(const RaftStorage&) = delete;
+
+    uint64_t term() const { return savedTerm; }
+    const std::string& votedFor() const { return savedVote; }
+    // The log as loaded; index i is entries()[i - 1]
+    const std::vector<RaftEntryData>& entries() const { return loaded; }
+
+    // Both return only once the data is on disk
+    void saveState(uint64_t term, const std::string& votedFor);
+    void append(const std::vector<RaftEntryData>& entries);
+    // Replace the whole log, e.g. after truncating a conflicting suffix
+    void rewrite(const std::vector<RaftEntryData>& entries);
+
+private:
+    std::string path;
+    int fd = -1;
+    uint64_t savedTerm = 0;
+    std::string savedVote;
+    std::vector<RaftEntryData> loaded;
+};
+
+struct RaftConfig {
+    std::string id;                 // This coordinator's ip:port
+    std::vector<std::string> peers; // The other coordinators' ip:port
+    std::string logPath;
+    std::chrono::milliseconds heartbeat{50};
+    // Followers wait a random time between one and two of these without
+    // hearing from a leader before starting an election
+    std::chrono::milliseconds electionTimeout{300};
+    // How long after hearing from a majority (leader) or from the leader
+    // (follower) a coordinator may serve reads; shorter than electionTimeout,
+    // so no other leader can have committed anything in the meantime
+    std::chrono::milliseconds lease{250};
+    size_t maxInFlight = 8;          // Unacknowledged appends per follower
+    size_t maxEntriesPerAppend = 64;
+};
+
+// Raft replication of the coordinators' membership changes. Every coordinator
+// applies committed commands in log order through `apply`, so they all
+// assign the same membership versions and any of them can serve WATCH.
+//
+// Writes are batched and pipelined. Concurrent proposals on the leader are
+// group-committed into one log entry with one fsync. Each follower has one
+// connection carrying up to maxInFlight appends, sent ahead of their
+// responses. Followers forward proposals to the leader.
+//
+// Reads use leases instead of a round trip to the leader. The leader may
+// serve them while a majority acknowledged an append within `lease`. A
+// follower may serve them while it heard from the leader within `lease` and
+// has applied what the leader had committed then, so its reads lag the
+// leader by at most that long. Votes are refused within electionTimeout of
+// hearing from a leader, which keeps a lease from outliving its leader.
+class RaftNode {
+public:
+    using Apply = std::function<void(const MembershipChangeData& command)>;
+
+    // Loads the log; nothing is applied until it is known to be committed
+    RaftNode(RaftConfig config, Apply apply);
+
+    // Start the node's threads, which run for the life of the process
+    void start();
+
+    // Replicate `commands` as part of one entry and wait until they have been
+    // applied here. Returns false when there was no leader to take them or
+    // they were not committed within `timeout`.
+    bool propose(const std::vector<MembershipChangeData>& commands, std::chrono::milliseconds timeout);
+
+    // Wait up to `timeout` for a read lease
+    bool waitReadable(std::chrono::milliseconds timeout);
+
+    // Coordinator side of the RAFT_* messages. serveAppends answers appends on
+    // `socket`, starting with `first`, until the leader closes it.
+    void serveAppends(int socket, const Message& first);
+    Message handleVote(const Message& request);
+    Message handlePropose(const Message& request);
+
+    bool isLeader() const;
+    std::string leader() const;
+
+private:
+    enum class Role { Follower, Candidate, Leader };
+
+    struct Peer {
+        std::string address;
+        int socket = -1;
+        bool broken = false;   // Set by the reader when the connection fails
+        std::thread reader;
+        uint64_t nextIndex = 1;
+        uint64_t matchIndex = 0;
+        size_t inFlight = 0;
+        uint64_t seq = 0;
+        uint64_t resyncSeq = 0; // Failures of appends up to here are already handled
+        std::vector<std::pair<uint64_t, RaftClock::time_point>> sent; // Seq and send time of appends in flight
+        RaftClock::time_point acked; // Send time of the latest acknowledged append
+        RaftClock::time_point lastSend;
+        uint64_t sentCommit = 0; // Commit index the follower was last told
+    };
+
+    struct Proposal {
+        std::vector<MembershipChangeData> commands;
+        uint64_t index = 0;
+        uint64_t term = 0;
+    };
+
+    uint64_t lastIndex() const { return log.size(); }
+    uint64_t termAt(uint64_t index) const { return index == 0 ? 0 : log[index - 1].term; }
+    size_t majority() const { return (peers.size() + 1) / 2 + 1; }
+
+    void tickLoop();
+    void appendLoop();
+    void applyLoop();
+    void replicateLoop(Peer& peer);
+    void readResponses(Peer& peer, int socket);
+    void requestVote(const std::string& address, Message request);
+
+    void startElection();
+    void becomeLeader();
+    void becomeFollower(uint64_t term);
+    void resetElectionDeadline();
+    void advanceCommit();
+    void handleAppendResponse(Peer& peer, const RaftData& response);
+    RaftData handleAppend(const RaftData& request);
+    bool readableLocked(RaftClock::time_point now) const;
+    RaftClock::time_point leaseStartLocked(RaftClock::time_point now) const;
+    bool proposeLocal(std::unique_lock<std::mutex>& lock, const std::vector<MembershipChangeData>& commands,
+                      RaftClock::time_point deadline, uint64_t& index);
+
+    RaftConfig config;
+    Apply apply;
+    RaftStorage storage;
+    // Orders writes to `storage`. Taken only with `mtx` held, and `mtx` is
+    // never waited for while holding it; the leader drops `mtx` for its fsync
+    std::mutex storageMutex;
+
+    mutable std::mutex mtx;
+    std::condition_variable changed; // Any change of role, log, commit or application
+    Role role = Role::Follower;
+    uint64_t currentTerm = 0;
+    std::string votedFor;
+    std::string leaderId;
+    std::vector<RaftEntryData> log;
+    uint64_t persistedIndex = 0; // Leader: entries on its own disk
+    uint64_t commitIndex = 0;
+    uint64_t lastApplied = 0;
+    uint64_t leaderCommit = 0;   // Follower: leader's commit index at leaderContact
+    RaftClock::time_point leaderContact;
+    RaftClock::time_point electionDeadline;
+    RaftClock::time_point leaderSince;
+    size_t votes = 0;
+    std::vector<std::unique_ptr<Peer>> peers;
+    std::vector<std::shared_ptr<Proposal>> pending; // Leader: proposals waiting for the next entry
+    std::mt19937_64 random;
+};
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "ColumnStore.h"
+#include "QueryExecutor.h"
+#include "QueryParser.h"
+#include "SimdKernels.h"
+
+// Full-scan filter throughput over a synthetic customers table
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? std::stoul(argv[1]) : 4000000;
+    const std::vector<std::string> cities = {"Paris", "London", "Berlin", "Madrid", "Rome", "Oslo", "Vienna", "Prague"};
+    ColumnTable customers("customers", {{"id", ColumnType::Int64}, {"name", ColumnType::String},
+                                        {"age", ColumnType::Int64}, {"city", ColumnType::String},
+                                        {"balance", ColumnType::Double}});
+    std::mt19937_64 rng(42);
+    std::vector<std::string_view> fields(5);
+    for (size_t i = 0; i < rows; ++i) {
+        std::string id = std::to_string(i);
+        std::string name = "customer" + std::to_string(i % 100000);
+        std::string age = std::to_string(18 + rng() % 70);
+        std::string balance = std::to_string(static_cast<double>(rng() % 1000000) / 100.0);
+        fields = {id, name, age, cities[rng() % cities.size()], balance};
+        customers.appendRow(fields);
+    }
+    std::cout << "kernels: " << simdLevelName(activeSimdLevel()) << ", rows: " << rows << std::endl;
+
+    struct Case {
+        const char* query;
+        size_t bytesPerRow; // bytes of column data the predicate reads
+    };
+    const std::vector<Case> cases = {
+        {"SELECT id FROM customers WHERE age = 30", 8},
+        {"SELECT id FROM customers WHERE age BETWEEN 25 AND 35", 8},
+        {"SELECT id FROM customers WHERE balance > 9000.5", 8},
+        {"SELECT id FROM customers WHERE city = 'Paris'", 4},
+        {"SELECT id FROM customers WHERE age > 60 AND (city = 'Oslo' OR balance < 100)", 20},
+    };
+    QueryParser parser;
+    QueryArena arena;
+    std::vector<Value> noBindings;
+    for (const auto& c : cases) {
+        arena.reset();
+        const Statement* stmt = parser.parseStatement(c.query, arena);
+        QueryExecutor executor(customers, *stmt, noBindings);
+        const int iterations = 5;
+        size_t matches = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) matches = executor.countMatches();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double seconds = elapsed.count() / iterations;
+        std::cout << c.query << "\n  matches=" << matches << " time=" << seconds * 1000 << " ms, "
+                  << rows / seconds / 1e6 << " Mrows/s, "
+                  << rows * c.bytesPerRow / seconds / 1e9 << " GB/s" << std::endl;
+    }
+
+    // Projection cost is paid only for surviving rows
+    arena.reset();
+    const Statement* stmt = parser.parseStatement("SELECT id, name FROM customers WHERE age = 30 AND city = 'Rome'", arena);
+    auto start = std::chrono::steady_clock::now();
+    ResultSet result = QueryExecutor(customers, *stmt, noBindings).run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "projected " << result.rows.size() << " rows in " << elapsed.count() * 1000 << " ms" << std::endl;
+
+    // Selective lookups, scanned and then through secondary indexes
+    const std::vector<const char*> lookups = {
+        "SELECT id FROM customers WHERE name = 'customer4242'",
+        "SELECT id FROM customers WHERE balance BETWEEN 5000 AND 5001",
+    };
+    for (bool indexed : {false, true}) {
+        if (indexed) {
+            customers.createIndex("name");
+            customers.createIndex("balance");
+        }
+        for (const char* query : lookups) {
+            arena.reset();
+            const Statement* lookup = parser.parseStatement(query, arena);
+            start = std::chrono::steady_clock::now();
+            QueryExecutor executor(customers, *lookup, noBindings);
+            size_t matches = executor.countMatches();
+            elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << query << (executor.usesIndex() ? " [index]" : " [scan]") << "\n  matches=" << matches
+                      << " time=" << elapsed.count() * 1e6 << " us" << std::endl;
+        }
+    }
+    return 0;
+}
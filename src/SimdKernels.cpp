@@ -0,0 +1,314 @@
+#include "SimdKernels.h"
+#include <algorithm>
+#include <array>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DISTDATA_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+template <CompareOp Op, typename T>
+inline bool compare(T a, T b) {
+    if constexpr (Op == CompareOp::Eq) return a == b;
+    else if constexpr (Op == CompareOp::Ne) return a != b;
+    else if constexpr (Op == CompareOp::Lt) return a < b;
+    else if constexpr (Op == CompareOp::Le) return a <= b;
+    else if constexpr (Op == CompareOp::Gt) return a > b;
+    else return a >= b;
+}
+
+// Ops evaluated as the negation of the compare instruction the ISA provides
+template <CompareOp Op>
+constexpr bool invertedIntCompare() {
+    return Op == CompareOp::Ne || Op == CompareOp::Le || Op == CompareOp::Ge;
+}
+
+template <typename T>
+struct Scalar {
+    template <CompareOp Op>
+    static void run(const T* values, size_t count, T constant, uint64_t* bitmap) {
+        size_t words = (count + 63) / 64;
+        for (size_t w = 0; w < words; ++w) {
+            const T* p = values + w * 64;
+            size_t n = std::min<size_t>(64, count - w * 64);
+            uint64_t word = 0;
+            for (size_t j = 0; j < n; ++j) {
+                word |= static_cast<uint64_t>(compare<Op>(p[j], constant)) << j;
+            }
+            bitmap[w] = word;
+        }
+    }
+};
+
+#ifdef DISTDATA_X86_SIMD
+
+struct Avx2Int64 {
+    template <CompareOp Op>
+    __attribute__((target("avx2")))
+    static void run(const int64_t* values, size_t count, int64_t constant, uint64_t* bitmap) {
+        const __m256i k = _mm256_set1_epi64x(constant);
+        size_t full = count / 64;
+        for (size_t w = 0; w < full; ++w) {
+            const int64_t* p = values + w * 64;
+            uint64_t word = 0;
+            for (size_t j = 0; j < 64; j += 4) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j));
+                __m256i m;
+                if constexpr (Op == CompareOp::Eq || Op == CompareOp::Ne) m = _mm256_cmpeq_epi64(x, k);
+                else if constexpr (Op == CompareOp::Gt || Op == CompareOp::Le) m = _mm256_cmpgt_epi64(x, k);
+                else m = _mm256_cmpgt_epi64(k, x);
+                uint64_t bits = static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+                if constexpr (invertedIntCompare<Op>()) bits ^= 0xF;
+                word |= bits << j;
+            }
+            bitmap[w] = word;
+        }
+        Scalar<int64_t>::run<Op>(values + full * 64, count - full * 64, constant, bitmap + full);
+    }
+};
+
+template <CompareOp Op>
+constexpr int avxDoublePredicate() {
+    if constexpr (Op == CompareOp::Eq) return _CMP_EQ_OQ;
+    else if constexpr (Op == CompareOp::Ne) return _CMP_NEQ_UQ;
+    else if constexpr (Op == CompareOp::Lt) return _CMP_LT_OQ;
+    else if constexpr (Op == CompareOp::Le) return _CMP_LE_OQ;
+    else if constexpr (Op == CompareOp::Gt) return _CMP_GT_OQ;
+    else return _CMP_GE_OQ;
+}
+
+struct Avx2Double {
+    template <CompareOp Op>
+    __attribute__((target("avx2")))
+    static void run(const double* values, size_t count, double constant, uint64_t* bitmap) {
+        const __m256d k = _mm256_set1_pd(constant);
+        constexpr int predicate = avxDoublePredicate<Op>();
+        size_t full = count / 64;
+        for (size_t w = 0; w < full; ++w) {
+            const double* p = values + w * 64;
+            uint64_t word = 0;
+            for (size_t j = 0; j < 64; j += 4) {
+                __m256d m = _mm256_cmp_pd(_mm256_loadu_pd(p + j), k, predicate);
+                word |= static_cast<uint64_t>(_mm256_movemask_pd(m)) << j;
+            }
+            bitmap[w] = word;
+        }
+        Scalar<double>::run<Op>(values + full * 64, count - full * 64, constant, bitmap + full);
+    }
+};
+
+struct Avx2Int32 {
+    template <CompareOp Op>
+    __attribute__((target("avx2")))
+    static void run(const int32_t* values, size_t count, int32_t constant, uint64_t* bitmap) {
+        const __m256i k = _mm256_set1_epi32(constant);
+        size_t full = count / 64;
+        for (size_t w = 0; w < full; ++w) {
+            const int32_t* p = values + w * 64;
+            uint64_t word = 0;
+            for (size_t j = 0; j < 64; j += 8) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j));
+                __m256i m;
+                if constexpr (Op == CompareOp::Eq || Op == CompareOp::Ne) m = _mm256_cmpeq_epi32(x, k);
+                else if constexpr (Op == CompareOp::Gt || Op == CompareOp::Le) m = _mm256_cmpgt_epi32(x, k);
+                else m = _mm256_cmpgt_epi32(k, x);
+                uint64_t bits = static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+                if constexpr (invertedIntCompare<Op>()) bits ^= 0xFF;
+                word |= bits << j;
+            }
+            bitmap[w] = word;
+        }
+        Scalar<int32_t>::run<Op>(values + full * 64, count - full * 64, constant, bitmap + full);
+    }
+};
+
+struct Sse42Int64 {
+    template <CompareOp Op>
+    __attribute__((target("sse4.2")))
+    static void run(const int64_t* values, size_t count, int64_t constant, uint64_t* bitmap) {
+        const __m128i k = _mm_set1_epi64x(constant);
+        size_t full = count / 64;
+        for (size_t w = 0; w < full; ++w) {
+            const int64_t* p = values + w * 64;
+            uint64_t word = 0;
+            for (size_t j = 0; j < 64; j += 2) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + j));
+                __m128i m;
+                if constexpr (Op == CompareOp::Eq || Op == CompareOp::Ne) m = _mm_cmpeq_epi64(x, k);
+                else if constexpr (Op == CompareOp::Gt || Op == CompareOp::Le) m = _mm_cmpgt_epi64(x, k);
+                else m = _mm_cmpgt_epi64(k, x);
+                uint64_t bits = static_cast<uint64_t>(_mm_movemask_pd(_mm_castsi128_pd(m)));
+                if constexpr (invertedIntCompare<Op>()) bits ^= 0x3;
+                word |= bits << j;
+            }
+            bitmap[w] = word;
+        }
+        Scalar<int64_t>::run<Op>(values + full * 64, count - full * 64, constant, bitmap + full);
+    }
+};
+
+struct Sse42Double {
+    template <CompareOp Op>
+    __attribute__((target("sse4.2")))
+    static void run(const double* values, size_t count, double constant, uint64_t* bitmap) {
+        const __m128d k = _mm_set1_pd(constant);
+        size_t full = count / 64;
+        for (size_t w = 0; w < full; ++w) {
+            const double* p = values + w * 64;
+            uint64_t word = 0;
+            for (size_t j = 0; j < 64; j += 2) {
+                __m128d x = _mm_loadu_pd(p + j);
+                __m128d m;
+                if constexpr (Op == CompareOp::Eq) m = _mm_cmpeq_pd(x, k);
+                else if constexpr (Op == CompareOp::Ne) m = _mm_cmpneq_pd(x, k);
+                else if constexpr (Op == CompareOp::Lt) m = _mm_cmplt_pd(x, k);
+                else if constexpr (Op == CompareOp::Le) m = _mm_cmple_pd(x, k);
+                else if constexpr (Op == CompareOp::Gt) m = _mm_cmpgt_pd(x, k);
+                else m = _mm_cmpge_pd(x, k);
+                word |= static_cast<uint64_t>(_mm_movemask_pd(m)) << j;
+            }
+            bitmap[w] = word;
+        }
+        Scalar<double>::run<Op>(values + full * 64, count - full * 64, constant, bitmap + full);
+    }
+};
+
+struct Sse42Int32 {
+    template <CompareOp Op>
+    __attribute__((target("sse4.2")))
+    static void run(const int32_t* values, size_t count, int32_t constant, uint64_t* bitmap) {
+        const __m128i k = _mm_set1_epi32(constant);
+        size_t full = count / 64;
+        for (size_t w = 0; w < full; ++w) {
+            const int32_t* p = values + w * 64;
+            uint64_t word = 0;
+            for (size_t j = 0; j < 64; j += 4) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + j));
+                __m128i m;
+                if constexpr (Op == CompareOp::Eq || Op == CompareOp::Ne) m = _mm_cmpeq_epi32(x, k);
+                else if constexpr (Op == CompareOp::Gt || Op == CompareOp::Le) m = _mm_cmpgt_epi32(x, k);
+                else m = _mm_cmplt_epi32(x, k);
+                uint64_t bits = static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(m)));
+                if constexpr (invertedIntCompare<Op>()) bits ^= 0xF;
+                word |= bits << j;
+            }
+            bitmap[w] = word;
+        }
+        Scalar<int32_t>::run<Op>(values + full * 64, count - full * 64, constant, bitmap + full);
+    }
+};
+
+#endif // DISTDATA_X86_SIMD
+
+template <typename T>
+using Kernel = void (*)(const T*, size_t, T, uint64_t*);
+
+// One kernel per CompareOp, indexed by the enum value
+template <typename T>
+using KernelSet = std::array<Kernel<T>, 6>;
+
+template <typename Family, typename T>
+KernelSet<T> makeKernels() {
+    return {{&Family::template run<CompareOp::Eq>, &Family::template run<CompareOp::Ne>,
+             &Family::template run<CompareOp::Lt>, &Family::template run<CompareOp::Le>,
+             &Family::template run<CompareOp::Gt>, &Family::template run<CompareOp::Ge>}};
+}
+
+SimdLevel detectSimdLevel() {
+#ifdef DISTDATA_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return SimdLevel::SSE42;
+#endif
+    return SimdLevel::Scalar;
+}
+
+struct Dispatch {
+    SimdLevel level;
+    KernelSet<int64_t> int64Kernels;
+    KernelSet<double> doubleKernels;
+    KernelSet<int32_t> int32Kernels;
+
+    explicit Dispatch(SimdLevel level) : level(level) {
+        int64Kernels = makeKernels<Scalar<int64_t>, int64_t>();
+        doubleKernels = makeKernels<Scalar<double>, double>();
+        int32Kernels = makeKernels<Scalar<int32_t>, int32_t>();
+#ifdef DISTDATA_X86_SIMD
+        if (level == SimdLevel::AVX2) {
+            int64Kernels = makeKernels<Avx2Int64, int64_t>();
+            doubleKernels = makeKernels<Avx2Double, double>();
+            int32Kernels = makeKernels<Avx2Int32, int32_t>();
+        } else if (level == SimdLevel::SSE42) {
+            int64Kernels = makeKernels<Sse42Int64, int64_t>();
+            doubleKernels = makeKernels<Sse42Double, double>();
+            int32Kernels = makeKernels<Sse42Int32, int32_t>();
+        }
+#endif
+    }
+};
+
+const Dispatch& dispatch() {
+    static const Dispatch instance(detectSimdLevel());
+    return instance;
+}
+
+// Kernels of `level`, or null when this CPU or build lacks it
+const Dispatch* dispatchAt(SimdLevel level) {
+    static const Dispatch levels[] = {Dispatch(SimdLevel::Scalar), Dispatch(SimdLevel::SSE42),
+                                      Dispatch(SimdLevel::AVX2)};
+    if (level > dispatch().level) return nullptr;
+    return &levels[static_cast<size_t>(level)];
+}
+
+} // namespace
+
+SimdLevel activeSimdLevel() {
+    return dispatch().level;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::SSE42: return "sse4.2";
+        case SimdLevel::Scalar: return "scalar";
+    }
+    return "unknown";
+}
+
+void compareInt64(const int64_t* values, size_t count, CompareOp op, int64_t constant, uint64_t* bitmap) {
+    dispatch().int64Kernels[static_cast<size_t>(op)](values, count, constant, bitmap);
+}
+
+void compareDouble(const double* values, size_t count, CompareOp op, double constant, uint64_t* bitmap) {
+    dispatch().doubleKernels[static_cast<size_t>(op)](values, count, constant, bitmap);
+}
+
+void compareInt32(const int32_t* values, size_t count, CompareOp op, int32_t constant, uint64_t* bitmap) {
+    dispatch().int32Kernels[static_cast<size_t>(op)](values, count, constant, bitmap);
+}
+
+bool compareInt64With(SimdLevel level, const int64_t* values, size_t count, CompareOp op, int64_t constant,
+                      uint64_t* bitmap) {
+    const Dispatch* kernels = dispatchAt(level);
+    if (!kernels) return false;
+    kernels->int64Kernels[static_cast<size_t>(op)](values, count, constant, bitmap);
+    return true;
+}
+
+bool compareDoubleWith(SimdLevel level, const double* values, size_t count, CompareOp op, double constant,
+                       uint64_t* bitmap) {
+    const Dispatch* kernels = dispatchAt(level);
+    if (!kernels) return false;
+    kernels->doubleKernels[static_cast<size_t>(op)](values, count, constant, bitmap);
+    return true;
+}
+
+bool compareInt32With(SimdLevel level, const int32_t* values, size_t count, CompareOp op, int32_t constant,
+                      uint64_t* bitmap) {
+    const Dispatch* kernels = dispatchAt(level);
+    if (!kernels) return false;
+    kernels->int32Kernels[static_cast<size_t>(op)](values, count, constant, bitmap);
+    return true;
+}
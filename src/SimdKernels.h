@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "QueryParser.h"
+
+// Instruction set used by the comparison kernels, picked once at startup
+enum class SimdLevel : uint8_t { Scalar, SSE42, AVX2 };
+
+SimdLevel activeSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+// Compare `count` values against a constant and write one bit per value into
+// `bitmap` (bit i of word i / 64). All (count + 63) / 64 words are written and
+// bits past `count` are zero.
+void compareInt64(const int64_t* values, size_t count, CompareOp op, int64_t constant, uint64_t* bitmap);
+void compareDouble(const double* values, size_t count, CompareOp op, double constant, uint64_t* bitmap);
+void compareInt32(const int32_t* values, size_t count, CompareOp op, int32_t constant, uint64_t* bitmap);
+
+// The same with the kernels of one level, so tests can check that the levels
+// agree. False, writing nothing, when this CPU or build lacks the level.
+bool compareInt64With(SimdLevel level, const int64_t* values, size_t count, CompareOp op, int64_t constant,
+                      uint64_t* bitmap);
+bool compareDoubleWith(SimdLevel level, const double* values, size_t count, CompareOp op, double constant,
+                       uint64_t* bitmap);
+bool compareInt32With(SimdLevel level, const int32_t* values, size_t count, CompareOp op, int32_t constant,
+                      uint64_t* bitmap);
@@ -0,0 +1,288 @@
+#include "SmartClient.h"
+#include "Communication.h"
+#include "Coordinators.h"
+#include "Tracing.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+static bool sendRequest(int sock, const Message& msg) {
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(msg);
+    std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    return Communication::sendMessage(sock, std::move(out));
+}
+
+static bool receiveResponse(int sock, Message& respMsg) {
+    std::string response = Communication::receiveMessage(sock);
+    if (response.empty()) return false;
+    try {
+        respMsg = MessageDeserializer::deserialize(std::vector<uint8_t>(response.begin(), response.end()));
+    } catch (const std::exception&) {
+    // A garbled reply counts as no reply, so callers report an error rather
+    // than see the exception
+        return false;
+    }
+    return true;
+}
+
+SmartClient::SmartClient() = default;
+
+SmartClient::SmartClient(std::string coordinatorIp, int coordinatorPort)
+    : coordinatorIp(std::move(coordinatorIp)), coordinatorPort(coordinatorPort) {}
+
+SmartClient::~SmartClient() {
+    for (const auto& connection : connections) Communication::closeSocket(connection.second);
+}
+
+bool SmartClient::refresh(std::string& error) {
+    ScopedSpan span("client.refresh_map");
+    int sock = coordinatorIp.empty() ? connectToCoordinator()
+                                     : Communication::startClient(coordinatorIp, coordinatorPort);
+    if (sock < 0) {
+        error = "Cannot reach the coordinator";
+        return false;
+    }
+    Message request;
+    request.type = MessageType::NODE_LIST_REQUEST;
+    Message reply;
+    bool ok = sendRequest(sock, request) && receiveResponse(sock, reply);
+    Communication::closeSocket(sock);
+    if (!ok || reply.type != MessageType::NODE_LIST_RESPONSE) {
+        error = "No partition map from the coordinator";
+        return false;
+    }
+    ++refreshCount;
+    map.epoch = reply.node_list.epoch;
+    map.nodes = std::move(reply.node_list.nodes);
+    map.assign();
+    haveMap = true;
+    return true;
+}
+
+int SmartClient::connectionTo(const NodeInfo& node) {
+    auto it = connections.find(node.uuid);
+    if (it != connections.end()) return it->second;
+    int sock = Communication::startClient(node.ip, node.port);
+    if (sock >= 0) connections[node.uuid] = sock;
+    return sock;
+}
+
+void SmartClient::dropConnection(const std::string& uuid) {
+    auto it = connections.find(uuid);
+    if (it == connections.end()) return;
+    Communication::closeSocket(it->second);
+    connections.erase(it);
+}
+
+bool SmartClient::call(Message& request, Message& reply, std::string& error) {
+    for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+        if ((!haveMap || attempt > 0) && !refresh(error)) return false;
+        const NodeInfo* owner = map.ownerOf(request.key_value.key);
+        if (!owner) {
+            error = "No DataNodes registered";
+            return false;
+        }
+        NodeInfo node = *owner;
+        request.key_value.epoch = map.epoch;
+        int sock = connectionTo(node);
+        if (sock < 0) continue;
+        if (!sendRequest(sock, request) || !receiveResponse(sock, reply) || reply.type != MessageType::DATA_RESPONSE) {
+            // The node restarted or left; the map will say where the key lives now
+            dropConnection(node.uuid);
+            continue;
+        }
+        KeyStatus status = static_cast<KeyStatus>(reply.key_value.status);
+        if (status == KeyStatus::Locked) {
+            error = "Key '" + request.key_value.key + "' is held by a transaction that did not resolve";
+            return false;
+        }
+        if (status != KeyStatus::WrongEpoch) return true;
+    }
+    error = "Request for key '" + request.key_value.key + "' failed after " + std::to_string(kMaxAttempts) +
+            " partition map refreshes";
+    return false;
+}
+
+bool SmartClient::get(const std::string& key, std::string& value, uint64_t& version, bool& found, std::string& error) {
+    ScopedSpan span("client.get", Tracing::current());
+    Message request;
+    request.type = MessageType::DATA_REQUEST;
+    request.key_value.key = key;
+    request.key_value.op = static_cast<uint8_t>(KeyOp::Get);
+    Message reply;
+    if (!call(request, reply, error)) return false;
+    found = static_cast<KeyStatus>(reply.key_value.status) == KeyStatus::Ok;
+    value = found ? std::move(reply.key_value.value) : std::string();
+    version = found ? reply.key_value.version : 0;
+    return true;
+}
+
+bool SmartClient::put(const std::string& key, const std::string& value, uint64_t& version, std::string& error) {
+    ScopedSpan span("client.put", Tracing::current());
+    Message request;
+    request.type = MessageType::DATA_REQUEST;
+    request.key_value.key = key;
+    request.key_value.value = value;
+    request.key_value.op = static_cast<uint8_t>(KeyOp::Put);
+    Message reply;
+    if (!call(request, reply, error)) return false;
+    version = reply.key_value.version;
+    return true;
+}
+
+bool SmartClient::remove(const std::string& key, bool& found, std::string& error) {
+    ScopedSpan span("client.remove", Tracing::current());
+    Message request;
+    request.type = MessageType::DATA_REQUEST;
+    request.key_value.key = key;
+    request.key_value.op = static_cast<uint8_t>(KeyOp::Remove);
+    Message reply;
+    if (!call(request, reply, error)) return false;
+    found = static_cast<KeyStatus>(reply.key_value.status) == KeyStatus::Ok;
+    return true;
+}
+
+bool SmartClient::read(Transaction& txn, const std::string& key, std::string& value, bool& found, std::string& error) {
+    auto written = txn.writes.find(key);
+    if (written != txn.writes.end()) {
+        found = written->second.has_value();
+        value = found ? *written->second : std::string();
+        return true;
+    }
+    uint64_t version = 0;
+    if (!get(key, value, version, found, error)) return false;
+    // A key read twice keeps the first version, so a change in between aborts
+    txn.reads.emplace(key, version);
+    return true;
+}
+
+TxnStatus SmartClient::askStatus(const NodeInfo& record, uint64_t txn) {
+    int sock = Communication::startClient(record.ip, record.port);
+    if (sock < 0) return TxnStatus::Pending;
+    Message request;
+    request.type = MessageType::TXN_REQUEST;
+    request.txn.op = static_cast<uint8_t>(TxnOp::Status);
+    request.txn.id = txn;
+    Message reply;
+    bool ok = sendRequest(sock, request) && receiveResponse(sock, reply) && reply.type == MessageType::TXN_RESPONSE;
+    Communication::closeSocket(sock);
+    return ok ? static_cast<TxnStatus>(reply.txn.status) : TxnStatus::Pending;
+}
+
+bool SmartClient::commit(const Transaction& txn, TxnStatus& outcome, std::string& error) {
+    outcome = TxnStatus::Committed;
+    if (txn.reads.empty() && txn.writes.empty()) return true;
+    ScopedSpan span("client.commit", Tracing::current());
+    struct Participant {
+        NodeInfo node;
+        Message request;
+        int sock = -1;
+        TxnStatus status = TxnStatus::Pending;
+    };
+    for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+        if ((!haveMap || attempt > 0) && !refresh(error)) return false;
+        if (map.nodes.empty()) {
+            error = "No DataNodes registered";
+            return false;
+        }
+        // Each attempt is a new transaction: nodes remember the outcome of an id
+        uint64_t id = 0;
+        while (id == 0) id = random();
+
+        std::vector<Participant> participants;
+        std::unordered_map<std::string, size_t> byNode;
+        auto participantOf = [&](const std::string& key) -> TxnData& {
+            const NodeInfo& owner = *map.ownerOf(key);
+            auto it = byNode.emplace(owner.uuid, participants.size()).first;
+            if (it->second == participants.size()) {
+                participants.emplace_back();
+                participants.back().node = owner;
+            }
+            return participants[it->second].request.txn;
+        };
+        for (const auto& read : txn.reads) participantOf(read.first).reads.push_back({read.first, "", read.second, false});
+        for (const auto& write : txn.writes) {
+            participantOf(write.first).writes.push_back(
+                {write.first, write.second.value_or(""), 0, !write.second.has_value()});
+        }
+        // The record lives with the first write, so a transaction that writes
+        // one node's keys and only reads another's still stages it there
+        const std::string& recordKey = txn.writes.empty() ? txn.reads.begin()->first : txn.writes.begin()->first;
+        const NodeInfo record = *map.ownerOf(recordKey);
+        bool onePhase = participants.size() == 1;
+        for (auto& participant : participants) {
+            TxnData& request = participant.request.txn;
+            participant.request.type = MessageType::TXN_REQUEST;
+            request.op = static_cast<uint8_t>(onePhase ? TxnOp::Commit : TxnOp::Prepare);
+            request.id = id;
+            request.epoch = map.epoch;
+            request.record = record;
+            if (!onePhase && participant.node.uuid == record.uuid) {
+                for (const auto& other : participants) request.participants.push_back(other.node);
+            }
+        }
+
+        // Send every prepare before waiting for any reply
+        for (auto& participant : participants) {
+            participant.sock = connectionTo(participant.node);
+            if (participant.sock >= 0 && !sendRequest(participant.sock, participant.request)) {
+                dropConnection(participant.node.uuid);
+                participant.sock = -1;
+            }
+        }
+        bool unsent = false;     // Never reached a participant, which therefore did nothing
+        bool lost = false;       // Sent, but the reply did not come back
+        bool wrongEpoch = false;
+        bool aborted = false;
+        for (auto& participant : participants) {
+            if (participant.sock < 0) {
+                unsent = true;
+                continue;
+            }
+            Message reply;
+            if (!receiveResponse(participant.sock, reply) || reply.type != MessageType::TXN_RESPONSE) {
+                dropConnection(participant.node.uuid);
+                participant.sock = -1;
+                lost = true;
+                continue;
+            }
+            participant.status = static_cast<TxnStatus>(reply.txn.status);
+            wrongEpoch |= participant.status == TxnStatus::WrongEpoch;
+            aborted |= participant.status == TxnStatus::Aborted;
+        }
+
+        if (onePhase) {
+            if (lost) {
+                error = "Lost contact with the node holding the transaction's keys; its outcome is unknown";
+                return false;
+            }
+            if (unsent || wrongEpoch) continue;
+            outcome = participants.front().status;
+            return true;
+        }
+        TxnStatus decided = TxnStatus::Committed;
+        if (aborted || wrongEpoch || unsent) {
+            decided = TxnStatus::Aborted;
+        } else if (lost) {
+            // Some prepare may or may not have happened; the record node decides
+            decided = askStatus(record, id);
+            if (decided != TxnStatus::Committed && decided != TxnStatus::Aborted) {
+                error = "Lost contact with the transaction's nodes; its outcome is unknown";
+                return false;
+            }
+        }
+        Message resolve;
+        resolve.type = MessageType::TXN_REQUEST;
+        resolve.txn.op = static_cast<uint8_t>(TxnOp::Resolve);
+        resolve.txn.status = static_cast<uint8_t>(decided);
+        resolve.txn.id = id;
+        for (auto& participant : participants) {
+            if (participant.sock >= 0 && !sendRequest(participant.sock, resolve)) dropConnection(participant.node.uuid);
+        }
+        // Refused only for a stale map or an unreachable node: retry with a fresh map
+        if (decided == TxnStatus::Aborted && !aborted && (wrongEpoch || unsent)) continue;
+        outcome = decided;
+        return true;
+    }
+    error = "Transaction failed after " + std::to_string(kMaxAttempts) + " partition map refreshes";
+    return false;
+}
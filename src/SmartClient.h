@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "KeyValueStore.h"
+#include "PartitionMap.h"
+#include "message.h"
+
+// Keys read and writes buffered by a transaction until SmartClient::commit
+struct Transaction {
+    std::map<std::string, uint64_t> reads;                    // Version read, 0 when the key was missing
+    std::map<std::string, std::optional<std::string>> writes; // No value removes the key
+};
+
+// Client library for DATA_REQUESTs that bypasses the coordinator. The
+// partition map is fetched once and cached with its epoch; every request then
+// goes straight to the owning DataNode over a connection kept open per node,
+// so steady-state requests take a single hop. The map is only fetched again
+// when a node answers WrongEpoch or cannot be reached.
+//
+// Transactions over keys on any nodes are optimistic: reads record versions,
+// writes are buffered, and commit validates both on the owning nodes in one
+// round trip (see TransactionManager).
+// Not thread-safe: use one SmartClient per thread.
+class SmartClient {
+public:
+    // Attempts per request, each after refreshing the map
+    static constexpr int kMaxAttempts = 3;
+
+    // Fetch maps from any coordinator of the group (see Coordinators.h)
+    SmartClient();
+    SmartClient(std::string coordinatorIp, int coordinatorPort);
+    ~SmartClient();
+    SmartClient(const SmartClient&) = delete;
+    SmartClient& operator=(const SmartClient&) = delete;
+
+    // All return false with `error` set when the cluster cannot be reached.
+    // `found` is false and `version` 0 for a missing key.
+    bool get(const std::string& key, std::string& value, uint64_t& version, bool& found, std::string& error);
+    bool put(const std::string& key, const std::string& value, uint64_t& version, std::string& error);
+    bool remove(const std::string& key, bool& found, std::string& error);
+
+    // Read through `txn`: its own write of `key` if any, else the stored value,
+    // whose version commit checks
+    bool read(Transaction& txn, const std::string& key, std::string& value, bool& found, std::string& error);
+    void write(Transaction& txn, const std::string& key, std::string value) { txn.writes[key] = std::move(value); }
+    void erase(Transaction& txn, const std::string& key) { txn.writes[key] = std::nullopt; }
+    // Sets `outcome` to Committed, or Aborted when another write got in the
+    // way. Returns false with `error` set when the outcome cannot be learned.
+    bool commit(const Transaction& txn, TxnStatus& outcome, std::string& error);
+
+    uint64_t epoch() const { return map.epoch; }
+    // Partition maps fetched from the coordinator so far
+    uint64_t refreshes() const { return refreshCount; }
+
+private:
+    bool refresh(std::string& error);
+    // Route `request` to the key's owner, refreshing the map as needed
+    bool call(Message& request, Message& reply, std::string& error);
+    // Kept-open connection to `node`; -1 when it cannot be reached
+    int connectionTo(const NodeInfo& node);
+    void dropConnection(const std::string& uuid);
+    // Ask the record node of `txn` for its outcome over a new connection
+    TxnStatus askStatus(const NodeInfo& record, uint64_t txn);
+
+    std::string coordinatorIp; // Empty for the whole group
+    int coordinatorPort = 0;
+    PartitionMap map;
+    bool haveMap = false;
+    uint64_t refreshCount = 0;
+    std::unordered_map<std::string, int> connections; // By node uuid
+    std::mt19937_64 random{std::random_device{}()};   // Transaction ids
+};
@@ -0,0 +1,116 @@
+#include "Statistics.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include "ColumnStore.h"
+
+namespace {
+
+std::string formatDouble(double value) {
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    return std::string(buf, res.ptr);
+}
+
+} // namespace
+
+ColumnStatistics::ColumnStatistics(ColumnType type)
+    : type(type), rows(0), intMin(0), intMax(0), doubleMin(0.0), doubleMax(0.0), rngState(0x9e3779b97f4a7c15ULL) {}
+
+void ColumnStatistics::add(const Column& column, size_t row) {
+    const ColumnChunk& chunk = column.chunk(row / kBatchSize);
+    size_t offset = row % kBatchSize;
+    bool first = rows == 0;
+    ++rows;
+
+    // Reservoir sampling: the new value replaces a random slot with
+    // probability kSampleSize / rows
+    size_t slot = kSampleSize;
+    size_t sampled = type == ColumnType::String ? textSample.size() : numericSample.size();
+    if (sampled < kSampleSize) {
+        slot = sampled;
+    } else {
+        rngState ^= rngState << 13;
+        rngState ^= rngState >> 7;
+        rngState ^= rngState << 17;
+        uint64_t pick = rngState % rows;
+        if (pick < kSampleSize) slot = static_cast<size_t>(pick);
+    }
+
+    switch (type) {
+        case ColumnType::Int64: {
+            int64_t value = chunk.ints[offset];
+            if (first || value < intMin) intMin = value;
+            if (first || value > intMax) intMax = value;
+            distinct.add(hashInt64(value));
+            if (slot == sampled) numericSample.push_back(static_cast<double>(value));
+            else if (slot < kSampleSize) numericSample[slot] = static_cast<double>(value);
+            break;
+        }
+        case ColumnType::Double: {
+            double value = chunk.doubles[offset];
+            if (first || value < doubleMin) doubleMin = value;
+            if (first || value > doubleMax) doubleMax = value;
+            double normalized = value == 0.0 ? 0.0 : value;
+            int64_t bits;
+            std::memcpy(&bits, &normalized, sizeof(bits));
+            distinct.add(hashInt64(bits));
+            if (slot == sampled) numericSample.push_back(value);
+            else if (slot < kSampleSize) numericSample[slot] = value;
+            break;
+        }
+        case ColumnType::String: {
+            const std::string& value = column.dictionary()[chunk.codes[offset]];
+            if (first || value < textMin) textMin = value;
+            if (first || value > textMax) textMax = value;
+            distinct.add(hashBytes(value));
+            if (slot == sampled) textSample.push_back(value);
+            else if (slot < kSampleSize) textSample[slot] = value;
+            break;
+        }
+    }
+}
+
+ColumnStatsData ColumnStatistics::summary(const std::string& name, size_t buckets) const {
+    ColumnStatsData data;
+    data.name = name;
+    data.type = static_cast<uint8_t>(type);
+    distinct.serialize(data.sketch);
+    if (rows == 0) return data;
+    switch (type) {
+        case ColumnType::Int64:
+            data.min = std::to_string(intMin);
+            data.max = std::to_string(intMax);
+            break;
+        case ColumnType::Double:
+            data.min = formatDouble(doubleMin);
+            data.max = formatDouble(doubleMax);
+            break;
+        case ColumnType::String:
+            data.min = textMin;
+            data.max = textMax;
+            break;
+    }
+
+    // Equi-depth: every bucket holds the same share of the sample, so its
+    // upper bound is a sample quantile
+    size_t sampled = type == ColumnType::String ? textSample.size() : numericSample.size();
+    buckets = std::min(buckets, sampled);
+    std::vector<double> numbers(numericSample);
+    std::vector<std::string> texts(textSample);
+    std::sort(numbers.begin(), numbers.end());
+    std::sort(texts.begin(), texts.end());
+    uint64_t assigned = 0;
+    for (size_t b = 0; b < buckets; ++b) {
+        size_t index = (b + 1) * sampled / buckets - 1;
+        if (type == ColumnType::String) data.bounds.push_back(texts[index]);
+        else if (type == ColumnType::Int64) data.bounds.push_back(std::to_string(static_cast<int64_t>(numbers[index])));
+        else data.bounds.push_back(formatDouble(numbers[index]));
+        uint64_t upTo = rows * (b + 1) / buckets;
+        data.bucket_rows.push_back(upTo - assigned);
+        assigned = upTo;
+    }
+    // The sample may have missed the extremes; the histogram must still cover them
+    if (!data.bounds.empty()) data.bounds.back() = data.max;
+    return data;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "HyperLogLog.h"
+#include "message.h"
+
+class Column;
+enum class ColumnType : uint8_t;
+
+// Statistics of one column, maintained as rows are appended: row count,
+// min/max, a HyperLogLog of the values and a reservoir sample from which
+// equi-depth histograms are cut on demand
+class ColumnStatistics {
+public:
+    static constexpr size_t kSampleSize = 1024;
+
+    explicit ColumnStatistics(ColumnType type);
+
+    // Account for the value at `row` of `column`, which must have this type
+    void add(const Column& column, size_t row);
+
+    uint64_t count() const { return rows; }
+
+    // Snapshot for the coordinator with at most `buckets` histogram buckets
+    ColumnStatsData summary(const std::string& name, size_t buckets) const;
+
+private:
+    ColumnType type;
+    uint64_t rows;
+    int64_t intMin, intMax;
+    double doubleMin, doubleMax;
+    std::string textMin, textMax;
+    HyperLogLog distinct;
+    // Numeric values sample as doubles, strings as text
+    std::vector<double> numericSample;
+    std::vector<std::string> textSample;
+    uint64_t rngState;
+};
@@ -16,9 +16,7 @@ int main() {
     }
     logMessage("TestServer listening on port 8081...");
     while (true) {
-        struct sockaddr_in address;
-        int addrlen = sizeof(address);
-        int client_sock = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen);
+        int client_sock = Communication::acceptClient(server_fd);
         if (client_sock < 0) {
             logMessage("accept failed");
             continue;
@@ -0,0 +1,226 @@
+#include "Tracing.h"
+#include <unistd.h>
+#include "Metrics.h"
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t kRingSpans = 4096;
+constexpr auto kFlushInterval = std::chrono::milliseconds(200);
+
+struct SpanRecord {
+    uint64_t trace;
+    uint64_t span;
+    uint64_t parent;
+    const char* name;
+    int64_t startNs; // Since the Unix epoch, so nodes' files line up
+    int64_t durationNs;
+};
+
+// Written only by its owning thread and drained only by the flusher
+struct Ring {
+    std::array<SpanRecord, kRingSpans> spans;
+    std::atomic<uint64_t> head{0}; // Next slot to write
+    std::atomic<uint64_t> tail{0}; // Next slot to drain
+    uint32_t lane;                 // The "tid" of its events
+};
+
+struct Registry {
+    std::mutex mtx;
+    std::mutex flushMtx; // Held by the flusher thread and the exit handler
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::vector<Ring*> free;
+    std::atomic<bool> started{false};
+    double sampleRate = 0;
+    std::atomic<uint64_t> dropped{0};
+    FILE* file = nullptr;
+    int pid = 0;
+
+    Ring* acquire() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!free.empty()) {
+            Ring* ring = free.back();
+            free.pop_back();
+            return ring;
+        }
+        rings.push_back(std::make_unique<Ring>());
+        rings.back()->lane = static_cast<uint32_t>(rings.size());
+        return rings.back().get();
+    }
+
+    void release(Ring* ring) {
+        std::lock_guard<std::mutex> lock(mtx);
+        free.push_back(ring);
+    }
+
+    // Write every ring's finished spans
+    void flush() {
+        std::lock_guard<std::mutex> flushing(flushMtx);
+        std::vector<Ring*> all;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (const auto& ring : rings) all.push_back(ring.get());
+        }
+        for (Ring* ring : all) {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            for (; tail < head; ++tail) {
+                const SpanRecord& span = ring->spans[tail % kRingSpans];
+                std::fprintf(file,
+                             "{\"name\":\"%s\",\"cat\":\"distdata\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"pid\":%d,\"tid\":%u,\"args\":{\"trace\":\"%016" PRIx64 "\",\"span\":\"%016" PRIx64
+                             "\",\"parent\":\"%016" PRIx64 "\"}},\n",
+                             span.name, span.startNs / 1000.0, span.durationNs / 1000.0, pid, ring->lane, span.trace,
+                             span.span, span.parent);
+            }
+            ring->tail.store(tail, std::memory_order_release);
+        }
+        std::fflush(file);
+    }
+};
+
+// Never destroyed: detached threads may still record during exit
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+struct RingOwner {
+    Ring* ring = nullptr;
+    ~RingOwner() {
+        if (ring) registry().release(ring);
+    }
+};
+
+// Rings are only taken by threads that record a sampled span
+Ring& localRing() {
+    thread_local RingOwner owner;
+    if (!owner.ring) owner.ring = registry().acquire();
+    return *owner.ring;
+}
+
+thread_local TraceContext currentContext;
+
+uint64_t randomId() {
+    thread_local std::mt19937_64 random(std::random_device{}());
+    uint64_t id;
+    do {
+        id = random();
+    } while (id == 0);
+    return id;
+}
+
+int64_t sinceEpoch(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+void push(const SpanRecord& span) {
+    Ring& ring = localRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) == kRingSpans) {
+        registry().dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ring.spans[head % kRingSpans] = span;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+} // namespace
+
+void Tracing::start(const std::string& process) {
+    Registry& tracing = registry();
+    const char* rate = std::getenv("DISTDATA_TRACE_SAMPLE");
+    if (tracing.started || !rate) return;
+    tracing.sampleRate = std::atof(rate);
+    const char* dir = std::getenv("DISTDATA_TRACE_DIR");
+    std::string path = std::string(dir ? dir : ".") + "/trace-" + process + ".json";
+    tracing.file = std::fopen(path.c_str(), "w");
+    if (!tracing.file) {
+        std::perror(path.c_str());
+        return;
+    }
+    tracing.pid = static_cast<int>(getpid());
+    // The array is left open so a killed process still leaves a loadable file
+    std::fprintf(tracing.file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                 tracing.pid, process.c_str());
+    std::fflush(tracing.file);
+    tracing.started = true;
+    Metrics::gauge("trace.dropped_spans", [&tracing] { return static_cast<int64_t>(tracing.dropped.load()); });
+    // Short-lived processes such as Client exit before the next flush
+    std::atexit([] { registry().flush(); });
+    std::thread([&tracing]() {
+        while (true) {
+            std::this_thread::sleep_for(kFlushInterval);
+            tracing.flush();
+        }
+    }).detach();
+}
+
+const TraceContext& Tracing::current() {
+    return currentContext;
+}
+
+void Tracing::record(const char* name, std::chrono::system_clock::time_point start,
+                     std::chrono::system_clock::time_point end) {
+    const TraceContext& parent = currentContext;
+    if (!parent.sampled || !registry().started.load(std::memory_order_relaxed)) return;
+    push({parent.trace_id, randomId(), parent.span_id, name, sinceEpoch(start), sinceEpoch(end) - sinceEpoch(start)});
+}
+
+ScopedSpan::ScopedSpan(const char* name, const TraceContext& parent, std::chrono::system_clock::time_point start)
+    : name(name), start(start) {
+    if (parent.trace_id != 0) {
+        open(parent);
+        return;
+    }
+    Registry& tracing = registry();
+    if (!tracing.started.load(std::memory_order_relaxed) || tracing.sampleRate <= 0) return;
+    thread_local std::mt19937_64 random(std::random_device{}());
+    TraceContext root;
+    root.trace_id = randomId();
+    root.sampled = std::uniform_real_distribution<double>(0, 1)(random) < tracing.sampleRate;
+    open(root);
+}
+
+ScopedSpan::ScopedSpan(const char* name) : name(name) {
+    if (currentContext.trace_id == 0) return;
+    start = std::chrono::system_clock::now();
+    open(currentContext);
+}
+
+void ScopedSpan::open(const TraceContext& parentContext) {
+    own.trace_id = parentContext.trace_id;
+    own.sampled = parentContext.sampled;
+    parent = parentContext.span_id;
+    // Unsampled traces still pass their context on, so no node downstream
+    // samples the request as a trace of its own
+    own.span_id = own.sampled ? randomId() : 0;
+    previous = currentContext;
+    currentContext = own;
+    active = true;
+}
+
+ScopedSpan::~ScopedSpan() {
+    if (!active) return;
+    currentContext = previous;
+    if (!own.sampled || !registry().started.load(std::memory_order_relaxed)) return;
+    auto end = std::chrono::system_clock::now();
+    push({own.trace_id, own.span_id, parent, name, sinceEpoch(start), sinceEpoch(end) - sinceEpoch(start)});
+}
+
+UntracedScope::UntracedScope() : previous(currentContext) {
+    currentContext = TraceContext();
+}
+
+UntracedScope::~UntracedScope() {
+    currentContext = previous;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "message.h"
+
+// Per-request distributed tracing.
+//
+// A message sent by a thread that is working on a traced request carries
+// that request's TraceContext in its header, so the span the receiving node
+// opens for it is a child of the sender's span. A request that arrives
+// without a context becomes the root of a new trace, which is sampled at the
+// rate in DISTDATA_TRACE_SAMPLE (0 to 1). A process records spans only when
+// the variable is set; 0 records the traces that other processes sampled but
+// starts none. When tracing is off, a span costs one branch.
+//
+// Spans of sampled traces are recorded into a ring that only the recording
+// thread writes. A background thread drains the rings into
+// trace-<process>.json, in $DISTDATA_TRACE_DIR or the working directory, as
+// Chrome trace events (chrome://tracing, Perfetto). Every event carries its
+// trace, span and parent ids, so a request's tree and critical path can be
+// rebuilt offline from the nodes' files. When a ring is full, new spans are
+// dropped rather than blocking the request.
+
+class Tracing {
+public:
+    // Record spans from now on into trace-<process>.json, if DISTDATA_TRACE_SAMPLE is set
+    static void start(const std::string& process);
+    // The span this thread is in; empty outside any trace
+    static const TraceContext& current();
+    // A finished child of this thread's current span, e.g. the time a request
+    // waited in a queue before this thread took it
+    static void record(const char* name, std::chrono::system_clock::time_point start,
+                       std::chrono::system_clock::time_point end);
+};
+
+// A span from construction to destruction. While it is open it is the
+// thread's current span, and messages the thread sends carry its context.
+// Names must outlive the process, e.g. string literals.
+class ScopedSpan {
+public:
+    // Child of `parent`, usually an incoming message's trace. When `parent`
+    // has no trace and sampling is on, this starts a new trace, sampled or not.
+    // `start` backdates the span, e.g. to when its request arrived.
+    ScopedSpan(const char* name, const TraceContext& parent,
+               std::chrono::system_clock::time_point start = std::chrono::system_clock::now());
+    // Child of this thread's current span; records nothing outside a trace
+    explicit ScopedSpan(const char* name);
+    ~ScopedSpan();
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+    void open(const TraceContext& parent);
+
+    const char* name;
+    bool active = false; // Whether this span changed the thread's current context
+    TraceContext previous;
+    TraceContext own;
+    uint64_t parent = 0;
+    std::chrono::system_clock::time_point start;
+};
+
+// Suspends the thread's current span, so messages serialized meanwhile carry
+// no context; for bytes that are stored or shared rather than sent for this
+// request, e.g. Raft log records
+class UntracedScope {
+public:
+    UntracedScope();
+    ~UntracedScope();
+    UntracedScope(const UntracedScope&) = delete;
+    UntracedScope& operator=(const UntracedScope&) = delete;
+
+private:
+    TraceContext previous;
+};
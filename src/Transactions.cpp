@@ -0,0 +1,342 @@
+#include "Transactions.h"
+#include <algorithm>
+#include "Communication.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include "message_deserializer.h"
+#include "message_serializer.h"
+
+using SteadyClock = std::chrono::steady_clock;
+
+static const LatencyMetric storeGet("kv.get");
+static const LatencyMetric storePut("kv.put");
+static const LatencyMetric storeRemove("kv.remove");
+static const LatencyMetric storeCommit("txn.commit");   // One-phase, validate and apply
+static const LatencyMetric storePrepare("txn.prepare");
+static const LatencyMetric storeResolve("txn.resolve");
+static const CounterMetric lockWaits("kv.lock_waits");  // Key operations that found a key locked
+static const CounterMetric recoveries("txn.recoveries"); // Abandoned transactions looked up at their record node
+static const CounterMetric aborts("txn.aborted");
+
+static bool sendReply(int socket, const Message& reply) {
+    std::vector<uint8_t> serialized = MessageSerializer::serialize(reply);
+    std::string out(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    return Communication::sendMessage(socket, std::move(out));
+}
+
+static bool receiveReply(int socket, Message& reply) {
+    std::string response = Communication::receiveMessage(socket);
+    if (response.empty()) return false;
+    try {
+        reply = MessageDeserializer::deserialize(std::vector<uint8_t>(response.begin(), response.end()));
+    } catch (const std::exception&) {
+    // A garbled reply counts as no reply: the caller treats the participant
+    // as unreachable, and recovery settles the transaction
+        return false;
+    }
+    return true;
+}
+
+// Whether every key of `txn` belongs here under its epoch
+static bool ownsAll(const LocalPartition& partition, const TxnData& txn, uint64_t& current) {
+    for (const auto* keys : {&txn.reads, &txn.writes}) {
+        for (const auto& key : *keys) {
+            if (!partition.owns(key.key, txn.epoch, current)) return false;
+        }
+    }
+    return true;
+}
+
+TransactionManager::TransactionManager(KeyValueStore& store, const LocalPartition& partition, NodeInfo self)
+    : store(store), partition(partition), self(std::move(self)) {
+    Metrics::gauge("txn.prepared", [this] {
+        std::lock_guard<std::mutex> lock(mtx);
+        return static_cast<int64_t>(prepared.size());
+    });
+}
+
+void TransactionManager::serve(int socket, const Message& first) {
+    Message request = first;
+    while (request.type == MessageType::DATA_REQUEST || request.type == MessageType::TXN_REQUEST) {
+        Message reply;
+        bool answer;
+        {
+            ScopedSpan span(messageTypeName(static_cast<size_t>(request.type)), request.trace);
+            ScopedLatency timer(Metrics::messageLatency(request.type));
+            answer = handle(request, reply);
+        }
+        if (answer && !sendReply(socket, reply)) return;
+        if (!receiveReply(socket, request)) return;
+    }
+}
+
+bool TransactionManager::handle(const Message& request, Message& reply) {
+    if (request.type == MessageType::DATA_REQUEST) {
+        reply.type = MessageType::DATA_RESPONSE;
+        handleKey(request.key_value, reply.key_value);
+        return true;
+    }
+    const TxnData& txn = request.txn;
+    reply.type = MessageType::TXN_RESPONSE;
+    TxnData& out = reply.txn;
+    out.op = txn.op;
+    out.id = txn.id;
+    TxnStatus status = TxnStatus::Aborted;
+    switch (static_cast<TxnOp>(txn.op)) {
+        case TxnOp::Commit: {
+            LocalPartition::Admission admission(partition);
+            if (!ownsAll(partition, txn, out.epoch)) {
+                status = TxnStatus::WrongEpoch;
+                break;
+            }
+            out.writes = txn.writes;
+            {
+                ScopedSpan span("txn.commit");
+                ScopedLatency timer(storeCommit);
+                status = store.commit(txn.id, txn.reads, out.writes);
+            }
+            if (status == TxnStatus::Aborted) aborts.add();
+            break;
+        }
+        case TxnOp::Prepare: {
+            LocalPartition::Admission admission(partition);
+            status = ownsAll(partition, txn, out.epoch) ? handlePrepare(txn) : TxnStatus::WrongEpoch;
+            break;
+        }
+        case TxnOp::Resolve:
+            resolveLocal(txn.id, static_cast<TxnStatus>(txn.status));
+            return false;
+        case TxnOp::Status:
+            status = decide(txn.id);
+            break;
+        case TxnOp::Probe:
+            status = probe(txn.id);
+            break;
+    }
+    out.status = static_cast<uint8_t>(status);
+    return true;
+}
+
+void TransactionManager::handleKey(const KeyValueData& request, KeyValueData& out) {
+    out.key = request.key;
+    out.op = request.op;
+    partition.awaitArrival(request.key, SteadyClock::now() + LocalPartition::kArrivalWait);
+    const auto deadline = SteadyClock::now() + kLockWait;
+    while (true) {
+        uint64_t seen;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            seen = resolutions;
+        }
+        KeyLock blocker;
+        KeyStatus status = KeyStatus::Ok;
+        {
+            // Admitted again on every attempt, so waiting for a lock does not
+            // hold up a change of the map
+            LocalPartition::Admission admission(partition);
+            if (!partition.owns(request.key, request.epoch, out.epoch)) {
+                out.status = static_cast<uint8_t>(KeyStatus::WrongEpoch);
+                return;
+            }
+            switch (static_cast<KeyOp>(request.op)) {
+                case KeyOp::Get: {
+                    ScopedSpan span("kv.get");
+                    ScopedLatency timer(storeGet);
+                    status = store.get(request.key, out.value, out.version, blocker);
+                    break;
+                }
+                case KeyOp::Put: {
+                    ScopedSpan span("kv.put");
+                    ScopedLatency timer(storePut);
+                    status = store.put(request.key, request.value, out.version, blocker);
+                    break;
+                }
+                case KeyOp::Remove: {
+                    ScopedSpan span("kv.remove");
+                    ScopedLatency timer(storeRemove);
+                    status = store.remove(request.key, blocker);
+                    break;
+                }
+            }
+        }
+        out.status = static_cast<uint8_t>(status);
+        auto now = SteadyClock::now();
+        if (status != KeyStatus::Locked || now >= deadline) return;
+        lockWaits.add();
+
+        // Give the transaction a chance to resolve on its own before
+        // presuming its client gone
+        auto wakeAt = deadline;
+        if (now >= blocker.since + kRecoverAfter) {
+            recover(blocker);
+            wakeAt = std::min(deadline, now + std::chrono::milliseconds(100));
+        } else {
+            wakeAt = std::min(deadline, blocker.since + kRecoverAfter);
+        }
+        ScopedSpan span("kv.lock_wait");
+        std::unique_lock<std::mutex> lock(mtx);
+        resolved.wait_until(lock, wakeAt, [&] { return resolutions != seen; });
+    }
+}
+
+TxnStatus TransactionManager::handlePrepare(const TxnData& request) {
+    std::lock_guard<std::mutex> lock(mtx);
+    // Refused after a probe, or already resolved without this prepare
+    if (outcomes.count(request.id)) return TxnStatus::Aborted;
+    if (prepared.count(request.id)) return TxnStatus::Prepared;
+    TxnStatus status;
+    {
+        ScopedSpan span("txn.prepare");
+        ScopedLatency timer(storePrepare);
+        status = store.prepare(request.id, request.reads, request.writes);
+    }
+    if (status != TxnStatus::Prepared) {
+        aborts.add();
+        return status;
+    }
+    prepared[request.id] = {request.reads, request.writes, request.record};
+    if (!request.participants.empty()) records[request.id].participants = request.participants;
+    return status;
+}
+
+TxnStatus TransactionManager::probe(uint64_t txn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto done = outcomes.find(txn);
+    if (done != outcomes.end()) return done->second.status;
+    if (prepared.count(txn)) return TxnStatus::Prepared;
+    outcomes[txn] = {TxnStatus::Aborted, SteadyClock::now()};
+    return TxnStatus::Aborted;
+}
+
+TxnStatus TransactionManager::decide(uint64_t txn) {
+    std::vector<NodeInfo> participants;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto record = records.find(txn);
+        if (record == records.end()) {
+            // The record was never staged here, so the prepare carrying it has
+            // not arrived; refusing it settles the transaction
+            auto done = outcomes.find(txn);
+            if (done != outcomes.end()) return done->second.status;
+            outcomes[txn] = {TxnStatus::Aborted, SteadyClock::now()};
+            return TxnStatus::Aborted;
+        }
+        if (record->second.decided) return record->second.outcome;
+        participants = record->second.participants;
+    }
+
+    TxnStatus outcome = TxnStatus::Committed;
+    for (const auto& node : participants) {
+        TxnStatus status;
+        if (node.uuid == self.uuid) {
+            status = probe(txn);
+        } else {
+            Message request;
+            request.type = MessageType::TXN_REQUEST;
+            request.txn.op = static_cast<uint8_t>(TxnOp::Probe);
+            request.txn.id = txn;
+            Message reply;
+            if (!ask(node, request, reply) || reply.type != MessageType::TXN_RESPONSE) return TxnStatus::Pending;
+            status = static_cast<TxnStatus>(reply.txn.status);
+        }
+        if (status == TxnStatus::Aborted) {
+            outcome = TxnStatus::Aborted;
+            break;
+        }
+    }
+
+    for (const auto& node : participants) {
+        if (node.uuid == self.uuid) {
+            resolveLocal(txn, outcome);
+            continue;
+        }
+        Message resolve;
+        resolve.type = MessageType::TXN_REQUEST;
+        resolve.txn.op = static_cast<uint8_t>(TxnOp::Resolve);
+        resolve.txn.status = static_cast<uint8_t>(outcome);
+        resolve.txn.id = txn;
+        tell(node, resolve);
+    }
+    return outcome;
+}
+
+void TransactionManager::resolveLocal(uint64_t txn, TxnStatus outcome) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto now = SteadyClock::now();
+        expireLocked(now);
+        auto it = prepared.find(txn);
+        if (it != prepared.end()) {
+            ScopedSpan span("txn.resolve");
+            ScopedLatency timer(storeResolve);
+            store.resolve(txn, it->second.reads, it->second.writes, outcome == TxnStatus::Committed);
+            prepared.erase(it);
+        }
+        outcomes[txn] = {outcome, now};
+        auto record = records.find(txn);
+        if (record != records.end() && !record->second.decided) {
+            record->second.decided = true;
+            record->second.outcome = outcome;
+            record->second.decidedAt = now;
+        }
+        ++resolutions;
+    }
+    resolved.notify_all();
+}
+
+void TransactionManager::recover(const KeyLock& blocker) {
+    NodeInfo record;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = prepared.find(blocker.txn);
+        if (it == prepared.end() || !recovering.insert(blocker.txn).second) return;
+        record = it->second.record;
+    }
+    recoveries.add();
+    ScopedSpan span("txn.recover");
+    TxnStatus outcome = TxnStatus::Pending;
+    if (record.uuid == self.uuid) {
+        outcome = decide(blocker.txn);
+    } else {
+        Message request;
+        request.type = MessageType::TXN_REQUEST;
+        request.txn.op = static_cast<uint8_t>(TxnOp::Status);
+        request.txn.id = blocker.txn;
+        Message reply;
+        if (ask(record, request, reply) && reply.type == MessageType::TXN_RESPONSE) {
+            outcome = static_cast<TxnStatus>(reply.txn.status);
+        }
+    }
+    // The record node resolves the participants it knows of; this node may
+    // not be among them when the record was never staged
+    if (outcome == TxnStatus::Committed || outcome == TxnStatus::Aborted) resolveLocal(blocker.txn, outcome);
+    std::lock_guard<std::mutex> lock(mtx);
+    recovering.erase(blocker.txn);
+}
+
+bool TransactionManager::ask(const NodeInfo& node, const Message& request, Message& reply) {
+    int sock = Communication::startClient(node.ip, node.port);
+    if (sock < 0) return false;
+    bool ok = sendReply(sock, request) && receiveReply(sock, reply);
+    Communication::closeSocket(sock);
+    return ok;
+}
+
+void TransactionManager::tell(const NodeInfo& node, const Message& message) {
+    int sock = Communication::startClient(node.ip, node.port);
+    if (sock < 0) return;
+    sendReply(sock, message);
+    Communication::closeSocket(sock);
+}
+
+void TransactionManager::expireLocked(SteadyClock::time_point now) {
+    if (now - lastExpiry < std::chrono::seconds(1)) return;
+    lastExpiry = now;
+    for (auto it = outcomes.begin(); it != outcomes.end();) {
+        it = now - it->second.at > kRetention ? outcomes.erase(it) : std::next(it);
+    }
+    for (auto it = records.begin(); it != records.end();) {
+        bool expired = it->second.decided && now - it->second.decidedAt > kRetention;
+        it = expired ? records.erase(it) : std::next(it);
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "KeyValueStore.h"
+#include "message.h"
+
+// DataNode side of DATA_REQUEST and TXN_REQUEST.
+//
+// Transactions commit in one round trip from the client. A transaction whose
+// keys live on one node commits there in one step (TxnOp::Commit). Otherwise
+// the client sends Prepare to every participant at once, and the prepare sent
+// to the record node (the owner of the first key written) also stages the
+// transaction record with the participant list. The transaction is committed
+// as soon as every participant has prepared, which the client learns from the
+// replies; the Resolve that applies the intents follows asynchronously.
+//
+// When a client disappears before resolving, a node whose keys stay locked
+// asks the record node for the outcome. The record node decides a staged
+// transaction by probing the participants: one that has not prepared refuses
+// to do so later, so the transaction aborts; if all have, it committed.
+class TransactionManager {
+public:
+    // Plain key operations wait this long for a prepared transaction to resolve
+    static constexpr std::chrono::milliseconds kLockWait{2000};
+    // A transaction prepared this long ago is presumed abandoned and recovered
+    static constexpr std::chrono::milliseconds kRecoverAfter{1000};
+    // Outcomes are remembered this long, for late prepares, probes and status requests
+    static constexpr std::chrono::seconds kRetention{60};
+
+    TransactionManager(KeyValueStore& store, const LocalPartition& partition, NodeInfo self);
+
+    // Serve `first` and every further request the client sends on the same
+    // connection, which smart clients and peer nodes keep open
+    void serve(int socket, const Message& first);
+
+private:
+    struct Prepared {
+        std::vector<TxnKeyData> reads;
+        std::vector<TxnKeyData> writes;
+        NodeInfo record;
+    };
+    // Transaction record, held by the record node
+    struct Record {
+        std::vector<NodeInfo> participants;
+        bool decided = false;
+        TxnStatus outcome = TxnStatus::Aborted;
+        std::chrono::steady_clock::time_point decidedAt;
+    };
+    struct Outcome {
+        TxnStatus status;
+        std::chrono::steady_clock::time_point at;
+    };
+
+    // False when the request is one-way
+    bool handle(const Message& request, Message& reply);
+    void handleKey(const KeyValueData& request, KeyValueData& out);
+    TxnStatus handlePrepare(const TxnData& request);
+    TxnStatus probe(uint64_t txn);
+    // Record node: the outcome of `txn`, deciding it if still staged
+    TxnStatus decide(uint64_t txn);
+    // Apply an outcome here and remember it
+    void resolveLocal(uint64_t txn, TxnStatus outcome);
+    // Ask the record node for the outcome of a transaction that has held a
+    // key for kRecoverAfter, and apply it here
+    void recover(const KeyLock& blocker);
+    // Send `request` to `node` and wait for the reply; false when unreachable
+    bool ask(const NodeInfo& node, const Message& request, Message& reply);
+    void tell(const NodeInfo& node, const Message& message);
+    void expireLocked(std::chrono::steady_clock::time_point now);
+
+    KeyValueStore& store;
+    const LocalPartition& partition;
+    NodeInfo self;
+
+    std::mutex mtx;
+    std::condition_variable resolved; // Any transaction resolved here
+    uint64_t resolutions = 0;
+    std::unordered_map<uint64_t, Prepared> prepared;
+    std::unordered_map<uint64_t, Record> records;
+    std::unordered_map<uint64_t, Outcome> outcomes; // Resolved here, or refused after a probe
+    std::unordered_set<uint64_t> recovering;
+    std::chrono::steady_clock::time_point lastExpiry;
+};
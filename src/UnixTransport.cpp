@@ -0,0 +1,455 @@
+#include "UnixTransport.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+
+// As TcpTransport's framing
+static const uint32_t kMaxFrameSize = 64 * 1024 * 1024;
+
+// Shared by the two processes; the bytes follow it in the mapping
+struct RingHeader {
+    alignas(64) std::atomic<uint64_t> written{0}; // Bytes put in, ever
+    alignas(64) std::atomic<uint64_t> taken{0};   // Bytes taken out, ever
+};
+
+static const size_t kMapBytes = sizeof(RingHeader) + UnixTransport::kRingBytes;
+// Set by the sender before handing a ring over, and required by the receiver
+static const int kRingSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+struct UnixTransport::Ring {
+    int memory = -1; // The memfd, until the receiving side has it
+    int space = -1;  // Eventfd the receiver signals as it takes messages out
+    void* mapping = MAP_FAILED;
+    RingHeader* header = nullptr;
+    char* bytes = nullptr;
+
+    ~Ring() {
+        if (mapping != MAP_FAILED) munmap(mapping, kMapBytes);
+        if (memory >= 0) ::close(memory);
+        if (space >= 0) ::close(space);
+    }
+
+    bool map(bool create) {
+        mapping = mmap(nullptr, kMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+        if (mapping == MAP_FAILED) return false;
+        header = create ? new (mapping) RingHeader() : static_cast<RingHeader*>(mapping);
+        bytes = static_cast<char*>(mapping) + sizeof(RingHeader);
+        return true;
+    }
+};
+
+static std::unique_ptr<UnixTransport::Ring> createRing() {
+    auto ring = std::make_unique<UnixTransport::Ring>();
+    ring->memory = memfd_create("distdata-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    ring->space = eventfd(0, EFD_CLOEXEC);
+    if (ring->memory < 0 || ring->space < 0 || ftruncate(ring->memory, kMapBytes) < 0 ||
+        fcntl(ring->memory, F_ADD_SEALS, kRingSeals) < 0 || !ring->map(true)) {
+        perror("shared-memory ring");
+        return nullptr;
+    }
+    return ring;
+}
+
+// The ring a peer handed over; null if it is not one
+static std::unique_ptr<UnixTransport::Ring> openRing(int memory, int space) {
+    auto ring = std::make_unique<UnixTransport::Ring>();
+    ring->memory = memory;
+    ring->space = space;
+    // Unless its size is sealed, the peer could shrink the file under our
+    // mapping and the next access would fault
+    int seals = fcntl(memory, F_GET_SEALS);
+    struct stat info{};
+    if (seals < 0 || (seals & kRingSeals) != kRingSeals || fstat(memory, &info) < 0 ||
+        static_cast<size_t>(info.st_size) < kMapBytes || !ring->map(false)) {
+        return nullptr;
+    }
+    ::close(ring->memory);
+    ring->memory = -1;
+    return ring;
+}
+
+static void copyIn(UnixTransport::Ring& ring, uint64_t at, const char* data, size_t size) {
+    size_t offset = at % UnixTransport::kRingBytes;
+    size_t first = std::min(size, UnixTransport::kRingBytes - offset);
+    std::memcpy(ring.bytes + offset, data, first);
+    std::memcpy(ring.bytes, data + first, size - first);
+}
+
+static void copyOut(const UnixTransport::Ring& ring, uint64_t at, char* data, size_t size) {
+    size_t offset = at % UnixTransport::kRingBytes;
+    size_t first = std::min(size, UnixTransport::kRingBytes - offset);
+    std::memcpy(data, ring.bytes + offset, first);
+    std::memcpy(data + first, ring.bytes, size - first);
+}
+
+// Block until `size` bytes are free; false once the connection is gone or
+// the socket's send timeout (SO_SNDTIMEO) passes
+static bool waitForSpace(int socket, UnixTransport::Ring& ring, size_t size) {
+    uint64_t written = ring.header->written.load(std::memory_order_relaxed);
+    if (UnixTransport::kRingBytes - (written - ring.header->taken.load(std::memory_order_acquire)) >= size) return true;
+    timeval limit{};
+    socklen_t length = sizeof(limit);
+    getsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &limit, &length);
+    auto timeout = std::chrono::seconds(limit.tv_sec) + std::chrono::microseconds(limit.tv_usec);
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (UnixTransport::kRingBytes - (written - ring.header->taken.load(std::memory_order_acquire)) < size) {
+        int waitMs = -1;
+        if (timeout.count() > 0) {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) return false;
+            waitMs = static_cast<int>(left.count());
+        }
+        pollfd fds[2] = {{ring.space, POLLIN, 0}, {socket, POLLRDHUP, 0}};
+        if (poll(fds, 2, waitMs) < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (fds[1].revents & (POLLRDHUP | POLLHUP | POLLERR)) return false;
+        uint64_t signals;
+        if (fds[0].revents & POLLIN) (void)!read(ring.space, &signals, sizeof(signals));
+    }
+    return true;
+}
+
+// One recvmsg of up to `size` bytes, keeping any descriptors sent along with them
+static ssize_t receiveWithRights(int socket, char* data, size_t size, std::vector<int>& rights, int flags) {
+    iovec part{data, size};
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+    msghdr in{};
+    in.msg_iov = &part;
+    in.msg_iovlen = 1;
+    in.msg_control = control;
+    in.msg_controllen = sizeof(control);
+    ssize_t got = recvmsg(socket, &in, MSG_CMSG_CLOEXEC | flags);
+    for (cmsghdr* c = got > 0 ? CMSG_FIRSTHDR(&in) : nullptr; c; c = CMSG_NXTHDR(&in, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* fds = reinterpret_cast<const int*>(CMSG_DATA(c));
+        rights.insert(rights.end(), fds, fds + count);
+    }
+    return got;
+}
+
+// Read exactly `size` bytes, keeping any descriptors sent along with them
+static bool readWithRights(int socket, char* data, size_t size, std::vector<int>& rights) {
+    while (size > 0) {
+        ssize_t got = receiveWithRights(socket, data, size, rights, 0);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+// Abstract names have no permissions, so any local user could bind ours
+// first or connect to it; only our own user's processes are trusted with
+// a connection, and the shared memory that comes with it
+static bool samePeerUser(int socket) {
+    ucred peer{};
+    socklen_t size = sizeof(peer);
+    return getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &peer, &size) == 0 && peer.uid == geteuid();
+}
+
+static sockaddr_un abstractAddress(int port, socklen_t& size) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    // The leading NUL makes it abstract: no file, gone with its socket
+    std::string name = "distdata-" + std::to_string(port);
+    std::memcpy(address.sun_path + 1, name.data(), name.size());
+    size = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+    return address;
+}
+
+UnixTransport::UnixTransport() {
+    ifaddrs* interfaces = nullptr;
+    if (getifaddrs(&interfaces) == 0) {
+        for (ifaddrs* it = interfaces; it; it = it->ifa_next) {
+            if (!it->ifa_addr || it->ifa_addr->sa_family != AF_INET) continue;
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(it->ifa_addr)->sin_addr, ip, sizeof(ip));
+            localAddresses.insert(ip);
+        }
+        freeifaddrs(interfaces);
+    }
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    channelCount = std::min<size_t>(std::max<size_t>(limit.rlim_cur, 1024), size_t(1) << 20);
+    // Zeroed, i.e. all null, and its pages only touched once used
+    channels = static_cast<std::atomic<Channel*>*>(std::calloc(channelCount, sizeof(std::atomic<Channel*>)));
+}
+
+UnixTransport::~UnixTransport() {
+    for (size_t i = 0; i < channelCount; ++i) delete channels[i].load();
+    std::free(channels);
+}
+
+UnixTransport::Channel* UnixTransport::channel(int socket) const {
+    if (socket < 0 || static_cast<size_t>(socket) >= channelCount) return nullptr;
+    return channels[socket].load(std::memory_order_acquire);
+}
+
+int UnixTransport::track(int socket) {
+    if (static_cast<size_t>(socket) >= channelCount) {
+        ::close(socket);
+        return -1;
+    }
+    channels[socket].store(new Channel(), std::memory_order_release);
+    return socket;
+}
+
+bool UnixTransport::isLocal(const std::string& host) const {
+    return host == "localhost" || host.compare(0, 4, "127.") == 0 || localAddresses.count(host) > 0;
+}
+
+int UnixTransport::listen(int port) {
+    int tcpSocket = tcp.listen(port);
+    if (tcpSocket < 0) return -1;
+    socklen_t size;
+    sockaddr_un address = abstractAddress(port, size);
+    int local = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (local < 0 || bind(local, reinterpret_cast<sockaddr*>(&address), size) < 0 ||
+        ::listen(local, SOMAXCONN) < 0) {
+        // Same-host peers then connect over TCP
+        perror("unix listen");
+        if (local >= 0) ::close(local);
+        return tcpSocket;
+    }
+    int both = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event tcpReady{EPOLLIN, {}};
+    tcpReady.data.fd = tcpSocket;
+    epoll_event localReady{EPOLLIN, {}};
+    localReady.data.fd = local;
+    if (both < 0 || epoll_ctl(both, EPOLL_CTL_ADD, tcpSocket, &tcpReady) < 0 ||
+        epoll_ctl(both, EPOLL_CTL_ADD, local, &localReady) < 0) {
+        perror("epoll");
+        if (both >= 0) ::close(both);
+        ::close(local);
+        return tcpSocket;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    listeners[both] = Listener{tcpSocket, local};
+    return both;
+}
+
+int UnixTransport::accept(int server) {
+    Listener listener;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto found = listeners.find(server);
+        if (found == listeners.end()) return tcp.accept(server);
+        listener = found->second;
+    }
+    while (true) {
+        epoll_event ready;
+        int count;
+        do {
+            count = epoll_wait(server, &ready, 1, -1);
+        } while (count < 0 && errno == EINTR);
+        if (count <= 0) return -1;
+        if (ready.data.fd == listener.tcp) return tcp.accept(listener.tcp);
+        int sock;
+        do {
+            sock = accept4(listener.local, nullptr, nullptr, SOCK_CLOEXEC);
+        } while (sock < 0 && errno == EINTR);
+        if (sock < 0) return -1;
+        if (samePeerUser(sock)) return track(sock);
+        ::close(sock);
+    }
+}
+
+int UnixTransport::connect(const std::string& host, int port) {
+    if (isLocal(host)) {
+        socklen_t size;
+        sockaddr_un address = abstractAddress(port, size);
+        int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock >= 0 && ::connect(sock, reinterpret_cast<sockaddr*>(&address), size) == 0 && samePeerUser(sock)) {
+            sock = track(sock);
+            if (sock >= 0) return sock;
+        } else if (sock >= 0) {
+            ::close(sock);
+        }
+    }
+    return tcp.connect(host, port);
+}
+
+bool UnixTransport::send(int socket, const std::string& message) {
+    Channel* own = channel(socket);
+    if (!own || message.size() < kBulkBytes || message.size() > kRingBytes) return tcp.send(socket, message);
+    bool handover = !own->out;
+    if (handover) {
+        own->out = createRing();
+        if (!own->out) return tcp.send(socket, message);
+    }
+    Ring& ring = *own->out;
+    if (!waitForSpace(socket, ring, message.size())) return false;
+    uint64_t written = ring.header->written.load(std::memory_order_relaxed);
+    copyIn(ring, written, message.data(), message.size());
+    ring.header->written.store(written + message.size(), std::memory_order_release);
+
+    uint32_t len = kInRing | static_cast<uint32_t>(message.size());
+    char header[4] = {
+        static_cast<char>((len >> 24) & 0xFF), static_cast<char>((len >> 16) & 0xFF),
+        static_cast<char>((len >> 8) & 0xFF), static_cast<char>(len & 0xFF)};
+    iovec part{header, sizeof(header)};
+    msghdr out{};
+    out.msg_iov = &part;
+    out.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+    if (handover) {
+        out.msg_control = control;
+        out.msg_controllen = sizeof(control);
+        cmsghdr* rights = CMSG_FIRSTHDR(&out);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(2 * sizeof(int));
+        int fds[2] = {ring.memory, ring.space};
+        std::memcpy(CMSG_DATA(rights), fds, sizeof(fds));
+    }
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &out, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (handover) {
+        // The mapping stays; the receiver has its own descriptor now
+        ::close(ring.memory);
+        ring.memory = -1;
+    }
+    // A Unix stream socket takes a 4-byte write whole or not at all
+    return sent == sizeof(header);
+}
+
+void UnixTransport::adopt(Channel& own, std::vector<int>& rights) {
+    if (rights.size() == 2 && !own.in) {
+        own.in = openRing(rights[0], rights[1]);
+    } else {
+        for (int fd : rights) ::close(fd);
+    }
+    rights.clear();
+}
+
+bool UnixTransport::takeFromRing(Channel& own, uint32_t size, std::string& message) {
+    if (!own.in || size > kRingBytes) return false;
+    Ring& ring = *own.in;
+    uint64_t taken = ring.header->taken.load(std::memory_order_relaxed);
+    if (ring.header->written.load(std::memory_order_acquire) - taken < size) return false;
+    message.assign(size, '\0');
+    copyOut(ring, taken, &message[0], size);
+    ring.header->taken.store(taken + size, std::memory_order_release);
+    uint64_t one = 1;
+    (void)!write(ring.space, &one, sizeof(one));
+    return true;
+}
+
+std::string UnixTransport::receive(int socket) {
+    Channel* own = channel(socket);
+    if (!own) return tcp.receive(socket);
+    unsigned char header[4];
+    std::vector<int> rights;
+    bool ok = readWithRights(socket, reinterpret_cast<char*>(header), sizeof(header), rights);
+    adopt(*own, rights);
+    if (!ok) return std::string();
+    uint32_t len = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) |
+                   (uint32_t(header[2]) << 8) | uint32_t(header[3]);
+    std::string message;
+    if (!(len & kInRing)) {
+        if (len > kMaxFrameSize) return std::string();
+        message.assign(len, '\0');
+        if (!readWithRights(socket, &message[0], len, rights)) message.clear();
+        adopt(*own, rights);
+        return message;
+    }
+    if (!takeFromRing(*own, len & ~kInRing, message)) return std::string();
+    return message;
+}
+
+ReceiveProgress UnixTransport::receiveSome(int socket, std::string& partial, std::string& message) {
+    Channel* own = channel(socket);
+    if (!own) return tcp.receiveSome(socket, partial, message);
+    // The header is read here, where a ring handed over with it is taken in;
+    // an inline body is then read as on TCP
+    while (partial.size() < 4) {
+        char header[4];
+        std::vector<int> rights;
+        ssize_t got = receiveWithRights(socket, header, 4 - partial.size(), rights, MSG_DONTWAIT);
+        int error = errno;
+        adopt(*own, rights);
+        if (got < 0 && error == EINTR) continue;
+        if (got < 0 && (error == EAGAIN || error == EWOULDBLOCK)) return ReceiveProgress::Partial;
+        if (got <= 0) return ReceiveProgress::Closed;
+        partial.append(header, static_cast<size_t>(got));
+    }
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(partial.data());
+    uint32_t len = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) |
+                   (uint32_t(header[2]) << 8) | uint32_t(header[3]);
+    if (!(len & kInRing)) return tcp.receiveSome(socket, partial, message);
+    partial.clear();
+    return takeFromRing(*own, len & ~kInRing, message) ? ReceiveProgress::Complete : ReceiveProgress::Closed;
+}
+
+int UnixTransport::bindDatagram(int port) {
+    return tcp.bindDatagram(port);
+}
+
+bool UnixTransport::sendDatagram(int socket, const std::string& host, int port, const std::string& payload) {
+    return tcp.sendDatagram(socket, host, port, payload);
+}
+
+std::string UnixTransport::receiveDatagram(int socket) {
+    return tcp.receiveDatagram(socket);
+}
+
+void UnixTransport::shutdown(int socket) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto found = listeners.find(socket);
+        if (found != listeners.end()) {
+            ::shutdown(found->second.tcp, SHUT_RDWR);
+            ::shutdown(found->second.local, SHUT_RDWR);
+            return;
+        }
+    }
+    tcp.shutdown(socket);
+}
+
+void UnixTransport::close(int socket) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto found = listeners.find(socket);
+        if (found != listeners.end()) {
+            ::close(found->second.tcp);
+            ::close(found->second.local);
+            listeners.erase(found);
+            ::close(socket);
+            return;
+        }
+    }
+    if (Channel* own = channel(socket)) {
+        channels[socket].store(nullptr, std::memory_order_release);
+        delete own;
+    }
+    tcp.close(socket);
+}
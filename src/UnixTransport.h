@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Communication.h"
+
+// The default transport: TCP between hosts, and between processes on the
+// same host a Unix domain socket with a shared-memory ring for bulk data.
+//
+// A server listens on its TCP port and on the abstract Unix socket
+// "distdata-<port>"; the descriptor listen() returns is an epoll set of the
+// two, so poll() and accept() see connections from either. connect() to a
+// host that is one of this machine's addresses tries that Unix socket first
+// and falls back to TCP when nothing there listens, so peers on other hosts,
+// and servers started with DISTDATA_TCP_ONLY, are reached as before. Both
+// ends check that the other runs as the same user (SO_PEERCRED); a socket
+// under that name owned by anyone else is not used.
+//
+// On a Unix connection, messages are framed as on TCP. A message of at least
+// kBulkBytes is instead copied into a ring in a memfd that the sending side
+// maps, seals against resizing, and hands over with its first bulk message
+// (SCM_RIGHTS); the receiver refuses an unsealed one. Only its length goes
+// over the socket, marked with kInRing. The socket therefore keeps the order
+// of all messages and stays what poll() waits on. A sender that finds the
+// ring full waits on an eventfd that the receiver signals as it takes
+// messages out, up to the socket's send timeout.
+class UnixTransport : public Transport {
+public:
+    // Messages from this size go through the ring when it can hold them
+    static constexpr size_t kBulkBytes = 64 * 1024;
+    static constexpr size_t kRingBytes = 4 * 1024 * 1024;
+    // Length-prefix bit of a message that is in the ring
+    static constexpr uint32_t kInRing = 0x80000000u;
+
+    // One direction's shared-memory ring
+    struct Ring;
+
+    UnixTransport();
+    ~UnixTransport() override;
+
+    int listen(int port) override;
+    int accept(int server) override;
+    int connect(const std::string& host, int port) override;
+    bool send(int socket, const std::string& message) override;
+    std::string receive(int socket) override;
+    ReceiveProgress receiveSome(int socket, std::string& partial, std::string& message) override;
+    int bindDatagram(int port) override;
+    bool sendDatagram(int socket, const std::string& host, int port, const std::string& payload) override;
+    std::string receiveDatagram(int socket) override;
+    void shutdown(int socket) override;
+    void close(int socket) override;
+
+private:
+    // The rings of one Unix connection, each made by its sending side
+    struct Channel {
+        std::unique_ptr<Ring> out; // Used only by the sending thread
+        std::unique_ptr<Ring> in;  // Used only by the receiving thread
+    };
+    struct Listener {
+        int tcp;
+        int local; // The abstract Unix socket
+    };
+
+    // Null for TCP sockets
+    Channel* channel(int socket) const;
+    // Take the ring a peer handed over with a message's header
+    static void adopt(Channel& own, std::vector<int>& rights);
+    // The next `size` bytes of the incoming ring; false when they are not there
+    static bool takeFromRing(Channel& own, uint32_t size, std::string& message);
+    int track(int socket);
+    bool isLocal(const std::string& host) const;
+
+    std::unordered_set<std::string> localAddresses; // This host's IPv4 addresses
+    std::mutex mtx;                                 // Guards listeners
+    std::unordered_map<int, Listener> listeners;    // By epoll descriptor
+    // By descriptor, so sending and receiving look their channel up without a lock
+    size_t channelCount;
+    std::atomic<Channel*>* channels;
+    TcpTransport tcp;
+};
@@ -0,0 +1,140 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// Pool and queue index of the calling worker thread
+thread_local WorkStealingPool* currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(size_t threads) : injection(kInjectionCapacity) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < threads; ++i) queues.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < threads; ++i) workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    while (pending.load() > 0) {
+        if (!runOne()) std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void WorkStealingPool::submit(Task task) {
+    if (currentPool == this) {
+        Worker& own = *queues[currentWorker];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        own.tasks.push_back(std::move(task));
+    } else {
+        while (!injection.tryPush(task)) std::this_thread::yield();
+    }
+    submitted();
+}
+
+bool WorkStealingPool::trySubmit(Task& task) {
+    if (!injection.tryPush(task)) return false;
+    submitted();
+    return true;
+}
+
+void WorkStealingPool::submitted() {
+    pending.fetch_add(1);
+    if (sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+bool WorkStealingPool::take(size_t self, Task& task) {
+    if (self < queues.size()) {
+        Worker& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+    if (injection.tryPop(task)) {
+        pending.fetch_sub(1);
+        return true;
+    }
+    // Steal the oldest task, starting after ourselves so thieves spread out
+    for (size_t i = 1; i <= queues.size(); ++i) {
+        size_t victim = (self + i) % queues.size();
+        if (victim == self) continue;
+        Worker& other = *queues[victim];
+        std::lock_guard<std::mutex> lock(other.mtx);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingPool::runOne() {
+    Task task;
+    size_t self = currentPool == this ? currentWorker : queues.size();
+    if (!take(self, task)) return false;
+    task();
+    return true;
+}
+
+void WorkStealingPool::workerLoop(size_t self) {
+    currentPool = this;
+    currentWorker = self;
+    while (true) {
+        Task task;
+        if (take(self, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepers.fetch_add(1);
+        // submit bumps pending before it checks sleepers, so this cannot miss a task
+        wake.wait(lock, [this]() { return pending.load() > 0 || stopping.load(); });
+        sleepers.fetch_sub(1);
+        if (stopping && pending.load() == 0) return;
+    }
+}
+
+void TaskGroup::run(Task task) {
+    outstanding.fetch_add(1);
+    pool.submit([this, task = std::move(task)]() {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) error = std::current_exception();
+        }
+        outstanding.fetch_sub(1);
+    });
+}
+
+void TaskGroup::drain() {
+    while (outstanding.load() > 0) {
+        if (!pool.runOne()) std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+void TaskGroup::wait() {
+    drain();
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (error) {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Task = std::function<void()>;
+
+// Bounded lock-free multi-producer multi-consumer queue (Vyukov's ring): each
+// cell carries a sequence number that tells producers and consumers whether it
+// is free or filled for their lap, so neither side takes a lock
+template <typename T>
+class MpmcQueue {
+public:
+    // `capacity` is rounded up to a power of two
+    explicit MpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        cells = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // False when the queue is full
+    bool tryPush(T& value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // False when the queue is empty
+    bool tryPop(T& value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    // Producers and consumers update different cache lines
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<size_t> head{0};
+};
+
+// Work-stealing task scheduler. Tasks submitted from outside the pool go
+// through a lock-free injection queue; tasks a worker submits go to the back
+// of its own deque, where it takes them LIFO while cache-warm. An idle worker
+// takes from the injection queue, then steals the oldest task of another
+// worker, and only sleeps when nothing is pending anywhere.
+class WorkStealingPool {
+public:
+    static constexpr size_t kInjectionCapacity = 4096;
+
+    // `threads` of 0 uses every hardware thread
+    explicit WorkStealingPool(size_t threads = 0);
+    // Runs every task already submitted, then joins the workers
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // From a worker, onto its own deque. From any other thread, through the
+    // injection queue, waiting while that is full; a thread that must never
+    // wait uses trySubmit.
+    void submit(Task task);
+    // Through the injection queue without waiting: false when it is full, and
+    // `task` is left as it was
+    bool trySubmit(Task& task);
+    // Run one pending task on the calling thread; false when none was found
+    bool runOne();
+    size_t size() const { return workers.size(); }
+    // Tasks submitted and not yet started; a task taken the moment it is
+    // pushed briefly counts as -1, reported as 0
+    size_t queued() const {
+        size_t count = pending.load(std::memory_order_relaxed);
+        return count > (SIZE_MAX >> 1) ? 0 : count;
+    }
+
+private:
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    // Count a queued task and wake a sleeping worker for it
+    void submitted();
+    bool take(size_t self, Task& task);
+    void workerLoop(size_t self);
+
+    std::vector<std::unique_ptr<Worker>> queues;
+    MpmcQueue<Task> injection;
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> sleepers{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::vector<std::thread> workers;
+};
+
+// Tasks forked from one request. wait() runs pending pool tasks on the waiting
+// thread instead of blocking, so a worker waiting for its subtasks never idles
+// a core and nested fork/join cannot starve the pool.
+class TaskGroup {
+public:
+    explicit TaskGroup(WorkStealingPool& pool) : pool(pool) {}
+    // Waits for the tasks still running; their exceptions are dropped
+    ~TaskGroup() { drain(); }
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void run(Task task);
+    // Rethrows the first exception thrown by a task
+    void wait();
+
+private:
+    void drain();
+
+    WorkStealingPool& pool;
+    std::atomic<size_t> outstanding{0};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+};
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 
 enum class MessageType : uint8_t {
     UNKNOWN = 0,
@@ -12,6 +13,69 @@ enum class MessageType : uint8_t {
     DATA_RESPONSE = 3,
     NODE_LIST_REQUEST = 4,
     NODE_LIST_RESPONSE = 5,
+    QUERY_REQUEST = 6,
+    QUERY_RESPONSE = 7,
+    PREPARE_REQUEST = 8,
+    PREPARE_RESPONSE = 9,
+    EXECUTE_REQUEST = 10,
+    QUERY_FRAGMENT = 11,
+    FRAGMENT_RESULT = 12,
+    SHUFFLE_DATA = 13,
+    EXPLAIN_REQUEST = 14,
+    TABLE_STATS_REQUEST = 15,
+    TABLE_STATS_RESPONSE = 16,
+    OPEN_CURSOR = 17,
+    FETCH_CURSOR = 18,
+    CLOSE_CURSOR = 19,
+    CURSOR_BATCH = 20,
+    BULK_LOAD = 21,
+    WATCH = 22,
+    MEMBERSHIP_UPDATE = 23,
+    NODE_LEAVE = 24,
+    GOSSIP = 25,
+    RAFT_APPEND = 26,
+    RAFT_APPEND_RESPONSE = 27,
+    RAFT_VOTE = 28,
+    RAFT_VOTE_RESPONSE = 29,
+    RAFT_PROPOSE = 30,
+    RAFT_PROPOSE_RESPONSE = 31,
+    TXN_REQUEST = 32,
+    TXN_RESPONSE = 33,
+    STATS_REQUEST = 34,
+    STATS_RESPONSE = 35,
+    FAULT_INJECTION = 36,
+    HANDOFF_REQUEST = 37,
+    HANDOFF_RESPONSE = 38,
+};
+
+// Names of the message types, indexed by their value
+inline constexpr const char* kMessageTypeNames[] = {
+    "UNKNOWN", "NODE_REGISTRATION", "DATA_REQUEST", "DATA_RESPONSE", "NODE_LIST_REQUEST",
+    "NODE_LIST_RESPONSE", "QUERY_REQUEST", "QUERY_RESPONSE", "PREPARE_REQUEST", "PREPARE_RESPONSE",
+    "EXECUTE_REQUEST", "QUERY_FRAGMENT", "FRAGMENT_RESULT", "SHUFFLE_DATA", "EXPLAIN_REQUEST",
+    "TABLE_STATS_REQUEST", "TABLE_STATS_RESPONSE", "OPEN_CURSOR", "FETCH_CURSOR", "CLOSE_CURSOR",
+    "CURSOR_BATCH", "BULK_LOAD", "WATCH", "MEMBERSHIP_UPDATE", "NODE_LEAVE",
+    "GOSSIP", "RAFT_APPEND", "RAFT_APPEND_RESPONSE", "RAFT_VOTE", "RAFT_VOTE_RESPONSE",
+    "RAFT_PROPOSE", "RAFT_PROPOSE_RESPONSE", "TXN_REQUEST", "TXN_RESPONSE", "STATS_REQUEST",
+    "STATS_RESPONSE", "FAULT_INJECTION", "HANDOFF_REQUEST", "HANDOFF_RESPONSE",
+};
+constexpr size_t kMessageTypeCount = sizeof(kMessageTypeNames) / sizeof(kMessageTypeNames[0]);
+
+// Name of a message type, e.g. "QUERY_FRAGMENT". A type byte past the last
+// type, which the deserializer lets through, is "UNKNOWN".
+inline const char* messageTypeName(size_t type) {
+    return type < kMessageTypeCount ? kMessageTypeNames[type] : kMessageTypeNames[0];
+}
+
+// Set on the type byte when a trace context follows it
+constexpr uint8_t kTracedMessage = 0x80;
+
+// Which request a message belongs to (see Tracing.h). On the wire only when
+// trace_id is set, as 17 bytes after the type byte.
+struct TraceContext {
+    uint64_t trace_id = 0;
+    uint64_t span_id = 0; // The sender's span, parent of the receiver's
+    bool sampled = false;
 };
 
 struct RegistrationData {
@@ -22,24 +86,243 @@ struct RegistrationData {
 struct KeyValueData {
     std::string key;
     std::string value;
+    uint8_t op = 0;       // KeyOp from KeyValueStore.h; DATA_REQUEST
+    uint8_t status = 0;   // KeyStatus from KeyValueStore.h; DATA_RESPONSE
+    uint64_t epoch = 0;   // Partition map epoch the request was routed with, or the node's on WrongEpoch
+    uint64_t version = 0; // DATA_RESPONSE: version of the value read or written; 0 when absent
 };
 
 struct NodeInfo {
     std::string uuid;
     std::string ip;
     int port;
+    // Partition of the sample tables the node loaded; a count of 0 when it
+    // loaded none
+    uint32_t partition_index = 0;
+    uint32_t partition_count = 0;
 };
 
+// The registered nodes; see PartitionMap
 struct NodeListData {
     std::vector<NodeInfo> nodes;
+    uint64_t epoch = 0; // Membership epoch the list belongs to
+};
+
+// Typed literal bound to a prepared statement parameter
+struct LiteralData {
+    uint8_t type = 0; // ValueType from QueryParser.h
+    int64_t int_value = 0;
+    double double_value = 0.0;
+    std::string text;
+};
+
+struct QueryData {
+    std::string text;                // QUERY_REQUEST, PREPARE_REQUEST, EXPLAIN_REQUEST, OPEN_CURSOR, QUERY_FRAGMENT
+    uint32_t statement_id = 0;       // PREPARE_RESPONSE, EXECUTE_REQUEST
+    uint32_t param_count = 0;        // PREPARE_RESPONSE
+    std::vector<LiteralData> params; // EXECUTE_REQUEST, QUERY_FRAGMENT
+    std::string error;               // Responses and CURSOR_BATCH; empty on success
+};
+
+// Rows in text form; a result stream ends with the batch that has done set
+struct ResultData {
+    std::vector<std::string> columns;
+    std::vector<std::vector<std::string>> rows;
+    bool done = true;
+};
+
+// Join execution state carried by a QUERY_FRAGMENT of a JOIN statement and by
+// the SHUFFLE_DATA batches DataNodes exchange with each other
+struct JoinData {
+    uint8_t step = 0;            // JoinStep from HashJoin.h; 0 for non-join fragments
+    uint8_t side = 0;            // 0 = FROM table, 1 = JOIN table
+    uint64_t join_id = 0;
+    uint32_t node_index = 0;     // Receiver's shuffle partition, or the sender for SHUFFLE_DATA
+    std::vector<NodeInfo> nodes; // Shuffle peers in partition order
+    ResultData rows;             // Broadcast build side, or shuffled rows
+};
+
+// Server-side cursor paging. Each OPEN_CURSOR / FETCH_CURSOR grants `credits`
+// CURSOR_BATCH replies of at most `batch_rows` rows; the stream ends with the
+// batch whose result has done set.
+struct CursorData {
+    uint64_t id = 0;         // FETCH_CURSOR, CLOSE_CURSOR, CURSOR_BATCH
+    uint32_t credits = 0;    // OPEN_CURSOR, FETCH_CURSOR
+    uint32_t batch_rows = 0; // OPEN_CURSOR
+};
+
+// Statistics of one column on one DataNode
+struct ColumnStatsData {
+    std::string name;
+    uint8_t type = 0;                    // ColumnType from ColumnStore.h
+    std::string min;                     // Text form; empty for an empty table
+    std::string max;
+    std::string sketch;                  // Serialized HyperLogLog of the values
+    std::vector<std::string> bounds;     // Upper bound of each equi-depth histogram bucket
+    std::vector<uint64_t> bucket_rows;   // Rows in each bucket
+    bool indexed = false;
+};
+
+struct TableStatsData {
+    std::string name;
+    uint64_t row_count = 0;
+    std::vector<ColumnStatsData> columns;
+};
+
+// One batch of a bulk load stream to a DataNode: whole delimited lines of the
+// rows that belong to it. Every batch names the table and schema so that the
+// DataNode can start from any of them; done marks the stream's last batch.
+struct BulkLoadData {
+    std::string table;
+    uint8_t delimiter = ',';
+    std::vector<std::string> columns;
+    std::vector<uint8_t> types;          // ColumnType per column, inferred once by the loader
+    std::string lines;
+    bool done = false;
+};
+
+// One membership change; see Membership.h
+struct MembershipChangeData {
+    uint64_t version = 0;
+    uint8_t kind = 0; // MembershipChange from Membership.h
+    NodeInfo node;    // Leave only needs the uuid
+};
+
+// WATCH subscribes to membership changes after `version`. The coordinator
+// answers on the same, persistent connection with MEMBERSHIP_UPDATE messages:
+// either the missed changes or, when the watcher is too far behind, a snapshot
+// of the whole list, then every later change as it happens.
+struct MembershipData {
+    uint64_t version = 0;                      // WATCH: last version seen; MEMBERSHIP_UPDATE: version once applied
+    bool snapshot = false;                     // MEMBERSHIP_UPDATE: `nodes` replaces the watcher's list
+    std::vector<NodeInfo> nodes;               // Snapshot
+    std::vector<MembershipChangeData> changes; // In version order
+};
+
+// Membership update piggybacked on gossip datagrams
+struct GossipUpdateData {
+    std::string id;
+    std::string address;      // ip:port of the member's gossip endpoint
+    uint64_t incarnation = 0; // Bumped by the member itself to refute a suspicion
+    uint8_t status = 0;       // MemberStatus from Gossip.h
+};
+
+// One SWIM datagram between DataNodes; see SwimNode
+struct GossipData {
+    uint8_t kind = 0;   // GossipKind from Gossip.h
+    uint64_t seq = 0;
+    std::string from;   // Sender id
+    std::string target; // PingReq: member to probe; Ack: member the ack proves alive
+    std::vector<GossipUpdateData> updates;
+};
+
+// One Raft log entry: membership commands proposed together. Versions are
+// assigned when an entry is applied, so `version` is 0 in the log.
+struct RaftEntryData {
+    uint64_t term = 0;
+    std::vector<MembershipChangeData> commands; // Empty for a new leader's no-op
+};
+
+// Raft messages between coordinators; see RaftNode
+struct RaftData {
+    uint64_t term = 0;
+    std::string from;       // Sending coordinator's ip:port
+    uint64_t seq = 0;       // Pairs a pipelined append with its response
+    uint64_t prevIndex = 0; // Append: index before `entries`; vote: candidate's last index
+    uint64_t prevTerm = 0;  // Term at prevIndex
+    uint64_t commit = 0;    // Append: leader's commit index
+    uint64_t index = 0;     // Append response: last index known to match; propose response: entry index
+    bool success = false;   // Append matched, vote granted, or proposal committed
+    std::vector<RaftEntryData> entries; // Append: entries to store; propose: one entry of commands
+};
+
+// A key a transaction read or writes
+struct TxnKeyData {
+    std::string key;
+    std::string value;    // Writes: the new value
+    uint64_t version = 0; // Reads: version seen, 0 when absent; commit replies: version written
+    bool remove = false;  // Writes: remove the key instead
+};
+
+// Transaction messages between a SmartClient and DataNodes, and between
+// DataNodes recovering an abandoned transaction; see TransactionManager
+struct TxnData {
+    uint8_t op = 0;     // TxnOp from KeyValueStore.h
+    uint8_t status = 0; // TxnStatus from KeyValueStore.h; Resolve: the outcome to apply
+    uint64_t id = 0;
+    uint64_t epoch = 0; // Partition map epoch the keys were routed with
+    std::vector<TxnKeyData> reads;
+    std::vector<TxnKeyData> writes;
+    NodeInfo record;                    // Node holding the transaction record
+    std::vector<NodeInfo> participants; // Prepare at the record node: every node with keys
+};
+
+// One latency histogram of a node's metrics, in nanoseconds
+struct LatencyStatsData {
+    std::string name;
+    uint64_t count = 0;
+    uint64_t per_second = 0; // Since the node's previous STATS_RESPONSE
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+    uint64_t mean = 0;
+};
+
+struct StatValueData {
+    std::string name;
+    int64_t value = 0;
+};
+
+// A node's metrics as of a STATS_REQUEST; see Metrics.h
+struct StatsData {
+    uint64_t uptime_ms = 0;
+    uint64_t window_ms = 0; // What per_second is measured over
+    std::vector<LatencyStatsData> latencies;
+    std::vector<StatValueData> counters; // Totals since start
+    std::vector<StatValueData> gauges;   // Sampled when asked, e.g. queue depths
+};
+
+// Faults a node injects into its own transport from now on; all zero heals.
+// The node echoes the message once they are in place. See Communication.h.
+struct FaultData {
+    uint32_t delay_ms = 0;             // Added before each message and datagram it sends
+    uint32_t loss_ppm = 0;             // Loss rate in parts per million
+    std::vector<std::string> blocked;  // "ip:port" of peers it can no longer reach
+};
+
+// Partitions of the key space moving to a new owner; see LocalPartition. The
+// new owner asks the previous one for their pairs, installs them, and then
+// sends the same request with release set, after which the previous owner
+// drops its copy.
+struct HandoffData {
+    uint64_t epoch = 0;              // Epoch of the map that moved the partitions
+    std::vector<uint32_t> partitions;
+    bool release = false;            // Request: one-way, the pairs are installed
+    bool ready = false;              // Response: false when the pairs cannot be handed over yet; ask again
+    std::vector<TxnKeyData> pairs;   // Response: key, value and version of each pair
 };
 
 struct Message {
     MessageType type;
+    TraceContext trace;            // Header: the sender's span, when it is part of a trace
     RegistrationData registration; // Used for NODE_REGISTRATION
     KeyValueData key_value;        // Used for DATA_REQUEST and DATA_RESPONSE
-    NodeInfo node_info;            // Used for NODE_REGISTRATION and NODE_LIST
+    NodeInfo node_info;            // Used for NODE_REGISTRATION, NODE_LEAVE and NODE_LIST
     NodeListData node_list;        // Used for NODE_LIST_RESPONSE
+    QueryData query;               // Used for QUERY_*, PREPARE_*, EXECUTE_REQUEST and QUERY_FRAGMENT
+    ResultData result;             // Used for QUERY_RESPONSE, FRAGMENT_RESULT and CURSOR_BATCH
+    JoinData join;                 // Used for QUERY_FRAGMENT and SHUFFLE_DATA
+    std::vector<TableStatsData> stats; // Used for TABLE_STATS_RESPONSE
+    CursorData cursor;             // Used for *_CURSOR and CURSOR_BATCH
+    BulkLoadData bulk;             // Used for BULK_LOAD
+    MembershipData membership;     // Used for WATCH and MEMBERSHIP_UPDATE
+    GossipData gossip;             // Used for GOSSIP
+    RaftData raft;                 // Used for RAFT_*
+    TxnData txn;                   // Used for TXN_REQUEST and TXN_RESPONSE
+    StatsData node_stats;          // Used for STATS_RESPONSE
+    FaultData faults;              // Used for FAULT_INJECTION
+    HandoffData handoff;           // Used for HANDOFF_REQUEST and HANDOFF_RESPONSE
 };
 
 #endif // MESSAGE_H 
\ No newline at end of file
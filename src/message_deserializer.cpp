@@ -1,6 +1,7 @@
 #include "message_deserializer.h"
 #include <cstring>
 #include <stdexcept>
+#include <algorithm>
 
 static uint32_t readUint32(const std::vector<uint8_t>& buffer, size_t& pos) {
     if (pos + 4 > buffer.size()) throw std::runtime_error("Buffer underflow");
@@ -20,6 +21,15 @@ static int readInt(const std::vector<uint8_t>& buffer, size_t& pos) {
     return value;
 }
 
+static uint64_t readUint64(const std::vector<uint8_t>& buffer, size_t& pos) {
+    if (pos + 8 > buffer.size()) throw std::runtime_error("Buffer underflow");
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | buffer[pos++];
+    }
+    return value;
+}
+
 static std::string readString(const std::vector<uint8_t>& buffer, size_t& pos) {
     uint32_t len = readUint32(buffer, pos);
     if (pos + len > buffer.size()) throw std::runtime_error("Buffer underflow");
@@ -33,18 +43,282 @@ static NodeInfo readNodeInfo(const std::vector<uint8_t>& buffer, size_t& pos) {
     node.uuid = readString(buffer, pos);
     node.ip = readString(buffer, pos);
     node.port = readInt(buffer, pos);
+    node.partition_index = readUint32(buffer, pos);
+    node.partition_count = readUint32(buffer, pos);
     return node;
 }
 
+static LiteralData readLiteral(const std::vector<uint8_t>& buffer, size_t& pos) {
+    LiteralData literal;
+    if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+    literal.type = buffer[pos++];
+    literal.int_value = static_cast<int64_t>(readUint64(buffer, pos));
+    uint64_t bits = readUint64(buffer, pos);
+    std::memcpy(&literal.double_value, &bits, sizeof(bits));
+    literal.text = readString(buffer, pos);
+    return literal;
+}
+
+static ResultData readResult(const std::vector<uint8_t>& buffer, size_t& pos) {
+    ResultData result;
+    uint32_t columnCount = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < columnCount; ++i) {
+        result.columns.push_back(readString(buffer, pos));
+    }
+    uint32_t rowCount = readUint32(buffer, pos);
+    // Every row takes at least 4 bytes, which bounds a reservation from a bad count
+    result.rows.reserve(std::min<size_t>(rowCount, (buffer.size() - pos) / 4));
+    for (uint32_t r = 0; r < rowCount; ++r) {
+        uint32_t valueCount = readUint32(buffer, pos);
+        std::vector<std::string> row;
+        row.reserve(std::min<size_t>(valueCount, (buffer.size() - pos) / 4));
+        for (uint32_t i = 0; i < valueCount; ++i) {
+            row.push_back(readString(buffer, pos));
+        }
+        result.rows.push_back(std::move(row));
+    }
+    if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+    result.done = buffer[pos++] != 0;
+    return result;
+}
+
+static JoinData readJoin(const std::vector<uint8_t>& buffer, size_t& pos) {
+    JoinData join;
+    if (pos + 2 > buffer.size()) throw std::runtime_error("Buffer underflow");
+    join.step = buffer[pos++];
+    join.side = buffer[pos++];
+    join.join_id = readUint64(buffer, pos);
+    join.node_index = readUint32(buffer, pos);
+    uint32_t count = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < count; ++i) {
+        join.nodes.push_back(readNodeInfo(buffer, pos));
+    }
+    join.rows = readResult(buffer, pos);
+    return join;
+}
+
+static TableStatsData readTableStats(const std::vector<uint8_t>& buffer, size_t& pos) {
+    TableStatsData table;
+    table.name = readString(buffer, pos);
+    table.row_count = readUint64(buffer, pos);
+    uint32_t columnCount = readUint32(buffer, pos);
+    for (uint32_t c = 0; c < columnCount; ++c) {
+        ColumnStatsData column;
+        column.name = readString(buffer, pos);
+        if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+        column.type = buffer[pos++];
+        column.min = readString(buffer, pos);
+        column.max = readString(buffer, pos);
+        column.sketch = readString(buffer, pos);
+        uint32_t buckets = readUint32(buffer, pos);
+        for (uint32_t b = 0; b < buckets; ++b) {
+            column.bounds.push_back(readString(buffer, pos));
+            column.bucket_rows.push_back(readUint64(buffer, pos));
+        }
+        if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+        column.indexed = buffer[pos++] != 0;
+        table.columns.push_back(std::move(column));
+    }
+    return table;
+}
+
+static MembershipData readMembership(const std::vector<uint8_t>& buffer, size_t& pos) {
+    MembershipData membership;
+    membership.version = readUint64(buffer, pos);
+    if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+    membership.snapshot = buffer[pos++] != 0;
+    uint32_t nodeCount = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < nodeCount; ++i) {
+        membership.nodes.push_back(readNodeInfo(buffer, pos));
+    }
+    uint32_t changeCount = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < changeCount; ++i) {
+        MembershipChangeData change;
+        change.version = readUint64(buffer, pos);
+        if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+        change.kind = buffer[pos++];
+        change.node = readNodeInfo(buffer, pos);
+        membership.changes.push_back(std::move(change));
+    }
+    return membership;
+}
+
+static GossipData readGossip(const std::vector<uint8_t>& buffer, size_t& pos) {
+    GossipData gossip;
+    if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+    gossip.kind = buffer[pos++];
+    gossip.seq = readUint64(buffer, pos);
+    gossip.from = readString(buffer, pos);
+    gossip.target = readString(buffer, pos);
+    uint32_t count = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < count; ++i) {
+        GossipUpdateData update;
+        update.id = readString(buffer, pos);
+        update.address = readString(buffer, pos);
+        update.incarnation = readUint64(buffer, pos);
+        if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+        update.status = buffer[pos++];
+        gossip.updates.push_back(std::move(update));
+    }
+    return gossip;
+}
+
+static RaftData readRaft(const std::vector<uint8_t>& buffer, size_t& pos) {
+    RaftData raft;
+    raft.term = readUint64(buffer, pos);
+    raft.from = readString(buffer, pos);
+    raft.seq = readUint64(buffer, pos);
+    raft.prevIndex = readUint64(buffer, pos);
+    raft.prevTerm = readUint64(buffer, pos);
+    raft.commit = readUint64(buffer, pos);
+    raft.index = readUint64(buffer, pos);
+    if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+    raft.success = buffer[pos++] != 0;
+    uint32_t entryCount = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        RaftEntryData entry;
+        entry.term = readUint64(buffer, pos);
+        uint32_t commandCount = readUint32(buffer, pos);
+        for (uint32_t c = 0; c < commandCount; ++c) {
+            MembershipChangeData command;
+            command.version = readUint64(buffer, pos);
+            if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+            command.kind = buffer[pos++];
+            command.node = readNodeInfo(buffer, pos);
+            entry.commands.push_back(std::move(command));
+        }
+        raft.entries.push_back(std::move(entry));
+    }
+    return raft;
+}
+
+static std::vector<TxnKeyData> readTxnKeys(const std::vector<uint8_t>& buffer, size_t& pos) {
+    std::vector<TxnKeyData> keys;
+    uint32_t count = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < count; ++i) {
+        TxnKeyData key;
+        key.key = readString(buffer, pos);
+        key.value = readString(buffer, pos);
+        key.version = readUint64(buffer, pos);
+        if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+        key.remove = buffer[pos++] != 0;
+        keys.push_back(std::move(key));
+    }
+    return keys;
+}
+
+static TxnData readTxn(const std::vector<uint8_t>& buffer, size_t& pos) {
+    TxnData txn;
+    if (pos + 2 > buffer.size()) throw std::runtime_error("Buffer underflow");
+    txn.op = buffer[pos++];
+    txn.status = buffer[pos++];
+    txn.id = readUint64(buffer, pos);
+    txn.epoch = readUint64(buffer, pos);
+    txn.reads = readTxnKeys(buffer, pos);
+    txn.writes = readTxnKeys(buffer, pos);
+    txn.record = readNodeInfo(buffer, pos);
+    uint32_t count = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < count; ++i) {
+        txn.participants.push_back(readNodeInfo(buffer, pos));
+    }
+    return txn;
+}
+
+static std::vector<StatValueData> readStatValues(const std::vector<uint8_t>& buffer, size_t& pos) {
+    std::vector<StatValueData> values;
+    uint32_t count = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < count; ++i) {
+        StatValueData value;
+        value.name = readString(buffer, pos);
+        value.value = static_cast<int64_t>(readUint64(buffer, pos));
+        values.push_back(std::move(value));
+    }
+    return values;
+}
+
+static StatsData readNodeStats(const std::vector<uint8_t>& buffer, size_t& pos) {
+    StatsData stats;
+    stats.uptime_ms = readUint64(buffer, pos);
+    stats.window_ms = readUint64(buffer, pos);
+    uint32_t count = readUint32(buffer, pos);
+    for (uint32_t i = 0; i < count; ++i) {
+        LatencyStatsData latency;
+        latency.name = readString(buffer, pos);
+        latency.count = readUint64(buffer, pos);
+        latency.per_second = readUint64(buffer, pos);
+        latency.p50 = readUint64(buffer, pos);
+        latency.p99 = readUint64(buffer, pos);
+        latency.p999 = readUint64(buffer, pos);
+        latency.max = readUint64(buffer, pos);
+        latency.mean = readUint64(buffer, pos);
+        stats.latencies.push_back(std::move(latency));
+    }
+    stats.counters = readStatValues(buffer, pos);
+    stats.gauges = readStatValues(buffer, pos);
+    return stats;
+}
+
 Message MessageDeserializer::deserialize(const std::vector<uint8_t>& buffer) {
     Message message;
     size_t pos = 0;
     if (buffer.empty()) throw std::runtime_error("Empty buffer");
-    message.type = static_cast<MessageType>(buffer[pos++]);
+    uint8_t type = buffer[pos++];
+    if (type & kTracedMessage) {
+        message.trace.trace_id = readUint64(buffer, pos);
+        message.trace.span_id = readUint64(buffer, pos);
+        if (pos >= buffer.size()) throw std::runtime_error("Buffer underflow");
+        message.trace.sampled = buffer[pos++] != 0;
+    }
+    message.type = static_cast<MessageType>(type & ~kTracedMessage);
     switch (message.type) {
         case MessageType::NODE_REGISTRATION:
+        case MessageType::NODE_LEAVE:
             message.node_info = readNodeInfo(buffer, pos);
             break;
+        case MessageType::WATCH:
+        case MessageType::MEMBERSHIP_UPDATE:
+            message.membership = readMembership(buffer, pos);
+            break;
+        case MessageType::GOSSIP:
+            message.gossip = readGossip(buffer, pos);
+            break;
+        case MessageType::RAFT_APPEND:
+        case MessageType::RAFT_APPEND_RESPONSE:
+        case MessageType::RAFT_VOTE:
+        case MessageType::RAFT_VOTE_RESPONSE:
+        case MessageType::RAFT_PROPOSE:
+        case MessageType::RAFT_PROPOSE_RESPONSE:
+            message.raft = readRaft(buffer, pos);
+            break;
+        case MessageType::TXN_REQUEST:
+        case MessageType::TXN_RESPONSE:
+            message.txn = readTxn(buffer, pos);
+            break;
+        case MessageType::STATS_RESPONSE:
+            message.node_stats = readNodeStats(buffer, pos);
+            break;
+        case MessageType::HANDOFF_REQUEST:
+        case MessageType::HANDOFF_RESPONSE: {
+            message.handoff.epoch = readUint64(buffer, pos);
+            uint32_t count = readUint32(buffer, pos);
+            for (uint32_t i = 0; i < count; ++i) {
+                message.handoff.partitions.push_back(readUint32(buffer, pos));
+            }
+            if (pos + 2 > buffer.size()) throw std::runtime_error("Buffer underflow");
+            message.handoff.release = buffer[pos++] != 0;
+            message.handoff.ready = buffer[pos++] != 0;
+            message.handoff.pairs = readTxnKeys(buffer, pos);
+            break;
+        }
+        case MessageType::FAULT_INJECTION: {
+            message.faults.delay_ms = readUint32(buffer, pos);
+            message.faults.loss_ppm = readUint32(buffer, pos);
+            uint32_t count = readUint32(buffer, pos);
+            for (uint32_t i = 0; i < count; ++i) {
+                message.faults.blocked.push_back(readString(buffer, pos));
+            }
+            break;
+        }
         case MessageType::NODE_LIST_REQUEST:
             // No payload
             break;
@@ -53,13 +327,101 @@ Message MessageDeserializer::deserialize(const std::vector<uint8_t>& buffer) {
             for (uint32_t i = 0; i < count; ++i) {
                 message.node_list.nodes.push_back(readNodeInfo(buffer, pos));
             }
+            message.node_list.epoch = readUint64(buffer, pos);
             break;
         }
         case MessageType::DATA_REQUEST:
         case MessageType::DATA_RESPONSE:
             message.key_value.key = readString(buffer, pos);
             message.key_value.value = readString(buffer, pos);
+            if (pos + 2 > buffer.size()) throw std::runtime_error("Buffer underflow");
+            message.key_value.op = buffer[pos++];
+            message.key_value.status = buffer[pos++];
+            message.key_value.epoch = readUint64(buffer, pos);
+            message.key_value.version = readUint64(buffer, pos);
+            break;
+        case MessageType::QUERY_REQUEST:
+        case MessageType::PREPARE_REQUEST:
+        case MessageType::EXPLAIN_REQUEST:
+            message.query.text = readString(buffer, pos);
+            break;
+        case MessageType::TABLE_STATS_REQUEST:
+        case MessageType::STATS_REQUEST:
+            // No payload
+            break;
+        case MessageType::OPEN_CURSOR:
+            message.query.text = readString(buffer, pos);
+            message.cursor.credits = readUint32(buffer, pos);
+            message.cursor.batch_rows = readUint32(buffer, pos);
+            break;
+        case MessageType::FETCH_CURSOR:
+            message.cursor.id = readUint64(buffer, pos);
+            message.cursor.credits = readUint32(buffer, pos);
+            break;
+        case MessageType::CLOSE_CURSOR:
+            message.cursor.id = readUint64(buffer, pos);
+            break;
+        case MessageType::BULK_LOAD: {
+            message.bulk.table = readString(buffer, pos);
+            if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+            message.bulk.delimiter = buffer[pos++];
+            uint32_t count = readUint32(buffer, pos);
+            for (uint32_t i = 0; i < count; ++i) {
+                message.bulk.columns.push_back(readString(buffer, pos));
+                if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+                message.bulk.types.push_back(buffer[pos++]);
+            }
+            message.bulk.lines = readString(buffer, pos);
+            if (pos + 1 > buffer.size()) throw std::runtime_error("Buffer underflow");
+            message.bulk.done = buffer[pos++] != 0;
+            break;
+        }
+        case MessageType::CURSOR_BATCH:
+            message.cursor.id = readUint64(buffer, pos);
+            message.query.error = readString(buffer, pos);
+            message.result = readResult(buffer, pos);
+            break;
+        case MessageType::TABLE_STATS_RESPONSE: {
+            uint32_t count = readUint32(buffer, pos);
+            for (uint32_t i = 0; i < count; ++i) {
+                message.stats.push_back(readTableStats(buffer, pos));
+            }
+            break;
+        }
+        case MessageType::QUERY_RESPONSE:
+            message.query.text = readString(buffer, pos);
+            message.query.error = readString(buffer, pos);
+            message.result = readResult(buffer, pos);
+            break;
+        case MessageType::PREPARE_RESPONSE:
+            message.query.statement_id = readUint32(buffer, pos);
+            message.query.param_count = readUint32(buffer, pos);
+            message.query.error = readString(buffer, pos);
+            break;
+        case MessageType::QUERY_FRAGMENT: {
+            message.query.text = readString(buffer, pos);
+            uint32_t count = readUint32(buffer, pos);
+            for (uint32_t i = 0; i < count; ++i) {
+                message.query.params.push_back(readLiteral(buffer, pos));
+            }
+            message.join = readJoin(buffer, pos);
+            break;
+        }
+        case MessageType::SHUFFLE_DATA:
+            message.join = readJoin(buffer, pos);
+            break;
+        case MessageType::FRAGMENT_RESULT:
+            message.query.error = readString(buffer, pos);
+            message.result = readResult(buffer, pos);
             break;
+        case MessageType::EXECUTE_REQUEST: {
+            message.query.statement_id = readUint32(buffer, pos);
+            uint32_t count = readUint32(buffer, pos);
+            for (uint32_t i = 0; i < count; ++i) {
+                message.query.params.push_back(readLiteral(buffer, pos));
+            }
+            break;
+        }
         default:
             // Unknown type: do nothing or throw
             break;
@@ -1,5 +1,6 @@
 #include "message_serializer.h"
 #include <cstring>
+#include "Tracing.h"
 
 static void writeUint32(std::vector<uint8_t>& buffer, uint32_t value) {
     for (int i = 0; i < 4; ++i)
@@ -11,6 +12,11 @@ static void writeInt(std::vector<uint8_t>& buffer, int value) {
         buffer.push_back((value >> (24 - i * 8)) & 0xFF);
 }
 
+static void writeUint64(std::vector<uint8_t>& buffer, uint64_t value) {
+    for (int i = 0; i < 8; ++i)
+        buffer.push_back((value >> (56 - i * 8)) & 0xFF);
+}
+
 static void writeString(std::vector<uint8_t>& buffer, const std::string& str) {
     writeUint32(buffer, static_cast<uint32_t>(str.size()));
     buffer.insert(buffer.end(), str.begin(), str.end());
@@ -20,15 +26,223 @@ static void writeNodeInfo(std::vector<uint8_t>& buffer, const NodeInfo& node) {
     writeString(buffer, node.uuid);
     writeString(buffer, node.ip);
     writeInt(buffer, node.port);
+    writeUint32(buffer, node.partition_index);
+    writeUint32(buffer, node.partition_count);
+}
+
+static void writeLiteral(std::vector<uint8_t>& buffer, const LiteralData& literal) {
+    buffer.push_back(literal.type);
+    writeUint64(buffer, static_cast<uint64_t>(literal.int_value));
+    uint64_t bits;
+    std::memcpy(&bits, &literal.double_value, sizeof(bits));
+    writeUint64(buffer, bits);
+    writeString(buffer, literal.text);
+}
+
+static void writeResult(std::vector<uint8_t>& buffer, const ResultData& result) {
+    writeUint32(buffer, static_cast<uint32_t>(result.columns.size()));
+    for (const auto& column : result.columns) {
+        writeString(buffer, column);
+    }
+    writeUint32(buffer, static_cast<uint32_t>(result.rows.size()));
+    for (const auto& row : result.rows) {
+        writeUint32(buffer, static_cast<uint32_t>(row.size()));
+        for (const auto& value : row) {
+            writeString(buffer, value);
+        }
+    }
+    buffer.push_back(result.done ? 1 : 0);
+}
+
+static void writeJoin(std::vector<uint8_t>& buffer, const JoinData& join) {
+    buffer.push_back(join.step);
+    buffer.push_back(join.side);
+    writeUint64(buffer, join.join_id);
+    writeUint32(buffer, join.node_index);
+    writeUint32(buffer, static_cast<uint32_t>(join.nodes.size()));
+    for (const auto& node : join.nodes) {
+        writeNodeInfo(buffer, node);
+    }
+    writeResult(buffer, join.rows);
+}
+
+static void writeTableStats(std::vector<uint8_t>& buffer, const TableStatsData& table) {
+    writeString(buffer, table.name);
+    writeUint64(buffer, table.row_count);
+    writeUint32(buffer, static_cast<uint32_t>(table.columns.size()));
+    for (const auto& column : table.columns) {
+        writeString(buffer, column.name);
+        buffer.push_back(column.type);
+        writeString(buffer, column.min);
+        writeString(buffer, column.max);
+        writeString(buffer, column.sketch);
+        writeUint32(buffer, static_cast<uint32_t>(column.bounds.size()));
+        for (size_t i = 0; i < column.bounds.size(); ++i) {
+            writeString(buffer, column.bounds[i]);
+            writeUint64(buffer, i < column.bucket_rows.size() ? column.bucket_rows[i] : 0);
+        }
+        buffer.push_back(column.indexed ? 1 : 0);
+    }
+}
+
+static void writeMembership(std::vector<uint8_t>& buffer, const MembershipData& membership) {
+    writeUint64(buffer, membership.version);
+    buffer.push_back(membership.snapshot ? 1 : 0);
+    writeUint32(buffer, static_cast<uint32_t>(membership.nodes.size()));
+    for (const auto& node : membership.nodes) {
+        writeNodeInfo(buffer, node);
+    }
+    writeUint32(buffer, static_cast<uint32_t>(membership.changes.size()));
+    for (const auto& change : membership.changes) {
+        writeUint64(buffer, change.version);
+        buffer.push_back(change.kind);
+        writeNodeInfo(buffer, change.node);
+    }
+}
+
+static void writeGossip(std::vector<uint8_t>& buffer, const GossipData& gossip) {
+    buffer.push_back(gossip.kind);
+    writeUint64(buffer, gossip.seq);
+    writeString(buffer, gossip.from);
+    writeString(buffer, gossip.target);
+    writeUint32(buffer, static_cast<uint32_t>(gossip.updates.size()));
+    for (const auto& update : gossip.updates) {
+        writeString(buffer, update.id);
+        writeString(buffer, update.address);
+        writeUint64(buffer, update.incarnation);
+        buffer.push_back(update.status);
+    }
+}
+
+static void writeRaft(std::vector<uint8_t>& buffer, const RaftData& raft) {
+    writeUint64(buffer, raft.term);
+    writeString(buffer, raft.from);
+    writeUint64(buffer, raft.seq);
+    writeUint64(buffer, raft.prevIndex);
+    writeUint64(buffer, raft.prevTerm);
+    writeUint64(buffer, raft.commit);
+    writeUint64(buffer, raft.index);
+    buffer.push_back(raft.success ? 1 : 0);
+    writeUint32(buffer, static_cast<uint32_t>(raft.entries.size()));
+    for (const auto& entry : raft.entries) {
+        writeUint64(buffer, entry.term);
+        writeUint32(buffer, static_cast<uint32_t>(entry.commands.size()));
+        for (const auto& command : entry.commands) {
+            writeUint64(buffer, command.version);
+            buffer.push_back(command.kind);
+            writeNodeInfo(buffer, command.node);
+        }
+    }
+}
+
+static void writeTxnKeys(std::vector<uint8_t>& buffer, const std::vector<TxnKeyData>& keys) {
+    writeUint32(buffer, static_cast<uint32_t>(keys.size()));
+    for (const auto& key : keys) {
+        writeString(buffer, key.key);
+        writeString(buffer, key.value);
+        writeUint64(buffer, key.version);
+        buffer.push_back(key.remove ? 1 : 0);
+    }
+}
+
+static void writeTxn(std::vector<uint8_t>& buffer, const TxnData& txn) {
+    buffer.push_back(txn.op);
+    buffer.push_back(txn.status);
+    writeUint64(buffer, txn.id);
+    writeUint64(buffer, txn.epoch);
+    writeTxnKeys(buffer, txn.reads);
+    writeTxnKeys(buffer, txn.writes);
+    writeNodeInfo(buffer, txn.record);
+    writeUint32(buffer, static_cast<uint32_t>(txn.participants.size()));
+    for (const auto& node : txn.participants) {
+        writeNodeInfo(buffer, node);
+    }
+}
+
+static void writeStatValues(std::vector<uint8_t>& buffer, const std::vector<StatValueData>& values) {
+    writeUint32(buffer, static_cast<uint32_t>(values.size()));
+    for (const auto& value : values) {
+        writeString(buffer, value.name);
+        writeUint64(buffer, static_cast<uint64_t>(value.value));
+    }
+}
+
+static void writeNodeStats(std::vector<uint8_t>& buffer, const StatsData& stats) {
+    writeUint64(buffer, stats.uptime_ms);
+    writeUint64(buffer, stats.window_ms);
+    writeUint32(buffer, static_cast<uint32_t>(stats.latencies.size()));
+    for (const auto& latency : stats.latencies) {
+        writeString(buffer, latency.name);
+        writeUint64(buffer, latency.count);
+        writeUint64(buffer, latency.per_second);
+        writeUint64(buffer, latency.p50);
+        writeUint64(buffer, latency.p99);
+        writeUint64(buffer, latency.p999);
+        writeUint64(buffer, latency.max);
+        writeUint64(buffer, latency.mean);
+    }
+    writeStatValues(buffer, stats.counters);
+    writeStatValues(buffer, stats.gauges);
 }
 
 std::vector<uint8_t> MessageSerializer::serialize(const Message& message) {
     std::vector<uint8_t> buffer;
-    buffer.push_back(static_cast<uint8_t>(message.type));
+    // A message carries its own trace, else that of the span sending it
+    const TraceContext& trace = message.trace.trace_id ? message.trace : Tracing::current();
+    if (trace.trace_id) {
+        buffer.push_back(static_cast<uint8_t>(message.type) | kTracedMessage);
+        writeUint64(buffer, trace.trace_id);
+        writeUint64(buffer, trace.span_id);
+        buffer.push_back(trace.sampled ? 1 : 0);
+    } else {
+        buffer.push_back(static_cast<uint8_t>(message.type));
+    }
     switch (message.type) {
         case MessageType::NODE_REGISTRATION:
+        case MessageType::NODE_LEAVE:
             writeNodeInfo(buffer, message.node_info);
             break;
+        case MessageType::WATCH:
+        case MessageType::MEMBERSHIP_UPDATE:
+            writeMembership(buffer, message.membership);
+            break;
+        case MessageType::GOSSIP:
+            writeGossip(buffer, message.gossip);
+            break;
+        case MessageType::RAFT_APPEND:
+        case MessageType::RAFT_APPEND_RESPONSE:
+        case MessageType::RAFT_VOTE:
+        case MessageType::RAFT_VOTE_RESPONSE:
+        case MessageType::RAFT_PROPOSE:
+        case MessageType::RAFT_PROPOSE_RESPONSE:
+            writeRaft(buffer, message.raft);
+            break;
+        case MessageType::TXN_REQUEST:
+        case MessageType::TXN_RESPONSE:
+            writeTxn(buffer, message.txn);
+            break;
+        case MessageType::STATS_RESPONSE:
+            writeNodeStats(buffer, message.node_stats);
+            break;
+        case MessageType::HANDOFF_REQUEST:
+        case MessageType::HANDOFF_RESPONSE:
+            writeUint64(buffer, message.handoff.epoch);
+            writeUint32(buffer, static_cast<uint32_t>(message.handoff.partitions.size()));
+            for (uint32_t partition : message.handoff.partitions) {
+                writeUint32(buffer, partition);
+            }
+            buffer.push_back(message.handoff.release ? 1 : 0);
+            buffer.push_back(message.handoff.ready ? 1 : 0);
+            writeTxnKeys(buffer, message.handoff.pairs);
+            break;
+        case MessageType::FAULT_INJECTION:
+            writeUint32(buffer, message.faults.delay_ms);
+            writeUint32(buffer, message.faults.loss_ppm);
+            writeUint32(buffer, static_cast<uint32_t>(message.faults.blocked.size()));
+            for (const auto& peer : message.faults.blocked) {
+                writeString(buffer, peer);
+            }
+            break;
         case MessageType::NODE_LIST_REQUEST:
             // No payload needed
             break;
@@ -37,11 +251,91 @@ std::vector<uint8_t> MessageSerializer::serialize(const Message& message) {
             for (const auto& node : message.node_list.nodes) {
                 writeNodeInfo(buffer, node);
             }
+            writeUint64(buffer, message.node_list.epoch);
             break;
         case MessageType::DATA_REQUEST:
         case MessageType::DATA_RESPONSE:
             writeString(buffer, message.key_value.key);
             writeString(buffer, message.key_value.value);
+            buffer.push_back(message.key_value.op);
+            buffer.push_back(message.key_value.status);
+            writeUint64(buffer, message.key_value.epoch);
+            writeUint64(buffer, message.key_value.version);
+            break;
+        case MessageType::QUERY_REQUEST:
+        case MessageType::PREPARE_REQUEST:
+        case MessageType::EXPLAIN_REQUEST:
+            writeString(buffer, message.query.text);
+            break;
+        case MessageType::TABLE_STATS_REQUEST:
+        case MessageType::STATS_REQUEST:
+            // No payload needed
+            break;
+        case MessageType::OPEN_CURSOR:
+            writeString(buffer, message.query.text);
+            writeUint32(buffer, message.cursor.credits);
+            writeUint32(buffer, message.cursor.batch_rows);
+            break;
+        case MessageType::FETCH_CURSOR:
+            writeUint64(buffer, message.cursor.id);
+            writeUint32(buffer, message.cursor.credits);
+            break;
+        case MessageType::CLOSE_CURSOR:
+            writeUint64(buffer, message.cursor.id);
+            break;
+        case MessageType::BULK_LOAD:
+            writeString(buffer, message.bulk.table);
+            buffer.push_back(message.bulk.delimiter);
+            writeUint32(buffer, static_cast<uint32_t>(message.bulk.columns.size()));
+            for (size_t i = 0; i < message.bulk.columns.size(); ++i) {
+                writeString(buffer, message.bulk.columns[i]);
+                buffer.push_back(i < message.bulk.types.size() ? message.bulk.types[i] : 0);
+            }
+            writeString(buffer, message.bulk.lines);
+            buffer.push_back(message.bulk.done ? 1 : 0);
+            break;
+        case MessageType::CURSOR_BATCH:
+            writeUint64(buffer, message.cursor.id);
+            writeString(buffer, message.query.error);
+            writeResult(buffer, message.result);
+            break;
+        case MessageType::TABLE_STATS_RESPONSE:
+            writeUint32(buffer, static_cast<uint32_t>(message.stats.size()));
+            for (const auto& table : message.stats) {
+                writeTableStats(buffer, table);
+            }
+            break;
+        case MessageType::QUERY_RESPONSE:
+            writeString(buffer, message.query.text);
+            writeString(buffer, message.query.error);
+            writeResult(buffer, message.result);
+            break;
+        case MessageType::PREPARE_RESPONSE:
+            writeUint32(buffer, message.query.statement_id);
+            writeUint32(buffer, message.query.param_count);
+            writeString(buffer, message.query.error);
+            break;
+        case MessageType::QUERY_FRAGMENT:
+            writeString(buffer, message.query.text);
+            writeUint32(buffer, static_cast<uint32_t>(message.query.params.size()));
+            for (const auto& param : message.query.params) {
+                writeLiteral(buffer, param);
+            }
+            writeJoin(buffer, message.join);
+            break;
+        case MessageType::SHUFFLE_DATA:
+            writeJoin(buffer, message.join);
+            break;
+        case MessageType::FRAGMENT_RESULT:
+            writeString(buffer, message.query.error);
+            writeResult(buffer, message.result);
+            break;
+        case MessageType::EXECUTE_REQUEST:
+            writeUint32(buffer, message.query.statement_id);
+            writeUint32(buffer, static_cast<uint32_t>(message.query.params.size()));
+            for (const auto& param : message.query.params) {
+                writeLiteral(buffer, param);
+            }
             break;
         default:
             // Unknown type: do nothing or throw